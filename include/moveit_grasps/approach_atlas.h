@@ -0,0 +1,186 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Precomputed approach orientations that reach each cell of the bins of a fixed shelf
+*/
+
+#ifndef MOVEIT_GRASPS__APPROACH_ATLAS_
+#define MOVEIT_GRASPS__APPROACH_ATLAS_
+
+// ROS
+#include <ros/ros.h>
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+// C++
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace moveit_grasps
+{
+/**
+ * \brief Which approach directions of a grasp can succeed IK without colliding with a static shelf, per cell of a
+ *        grid over the interior of each bin. The atlas is built offline for a fixed shelf and robot mounting, e.g. by
+ *        the approach_atlas_builder, and lets the GraspGenerator skip grasps that can never succeed at their cell.
+ *        The approach direction of a grasp is the z-axis of its grasp pose, snapped to the nearest of up to 64
+ *        directions spread evenly over the sphere
+ */
+class ApproachAtlas
+{
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  static const std::size_t MAX_DIRECTIONS = 64;
+
+  /**
+   * \brief Constructor
+   * \param num_directions - number of approach directions, at most MAX_DIRECTIONS
+   */
+  ApproachAtlas(std::size_t num_directions = MAX_DIRECTIONS);
+
+  /**
+   * \brief Add a bin with no feasible approach directions in any of its cells
+   * \param world_to_bin - pose of a corner of the bin in world frame
+   * \param bin_size - length of the bin interior along the local x, y and z axes of the corner
+   * \param resolution - edge length of the cells
+   * \return id of the bin
+   */
+  std::size_t addBin(const Eigen::Affine3d& world_to_bin, const Eigen::Vector3d& bin_size, double resolution);
+
+  /**
+   * \brief Remove all bins
+   */
+  void clear();
+
+  /**
+   * \brief Mark an approach direction as feasible at a cell
+   */
+  void setFeasible(std::size_t bin_id, std::size_t cell_id, std::size_t direction_id);
+
+  /**
+   * \brief Make the approach directions of each cell also feasible at its neighbor cells, so grasps near the border
+   *        of a cell are not skipped because of the sampling at its center
+   */
+  void dilate();
+
+  /**
+   * \brief Check if a grasp can succeed at its position. Grasps outside of all bins are always feasible
+   * \param grasp_pose - grasp pose in world frame, approaching along its z-axis
+   * \return false if the approach direction never succeeded in the cell of the grasp
+   */
+  bool isFeasible(const Eigen::Affine3d& grasp_pose) const;
+
+  /**
+   * \brief Get the id of the approach direction closest to a unit vector
+   */
+  std::size_t getDirectionId(const Eigen::Vector3d& approach_direction) const;
+
+  /**
+   * \brief Get the center of a cell in world frame
+   */
+  Eigen::Vector3d getCellCenter(std::size_t bin_id, std::size_t cell_id) const;
+
+  /**
+   * \brief Get the number of cells of a bin
+   */
+  std::size_t getNumCells(std::size_t bin_id) const
+  {
+    return bins_[bin_id].feasible_directions_.size();
+  }
+
+  /**
+   * \brief Get the number of bins
+   */
+  std::size_t getNumBins() const
+  {
+    return bins_.size();
+  }
+
+  /**
+   * \brief Get the unit approach directions, in world frame
+   */
+  const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& getDirections() const
+  {
+    return directions_;
+  }
+
+  /**
+   * \brief Write the atlas to a binary file
+   * \return true on success
+   */
+  bool save(const std::string& file_name) const;
+
+  /**
+   * \brief Replace the atlas by one written with save()
+   * \return true on success
+   */
+  bool load(const std::string& file_name);
+
+private:
+  struct Bin
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    Eigen::Affine3d world_to_bin_;
+    Eigen::Affine3d bin_to_world_;
+    Eigen::Vector3d size_;
+    double resolution_;
+    std::size_t num_cells_[3];
+
+    // One bit per approach direction
+    std::vector<uint64_t> feasible_directions_;
+  };
+
+  /**
+   * \brief Spread the approach directions over the sphere on a Fibonacci lattice
+   */
+  void setDirections(std::size_t num_directions);
+
+  // Unit approach directions
+  std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > directions_;
+
+  std::vector<Bin, Eigen::aligned_allocator<Bin> > bins_;
+};  // end class
+
+typedef boost::shared_ptr<ApproachAtlas> ApproachAtlasPtr;
+typedef boost::shared_ptr<const ApproachAtlas> ApproachAtlasConstPtr;
+
+}  // end namespace
+
+#endif
@@ -0,0 +1,137 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Solve inverse kinematics for many poses of one arm at once
+*/
+
+#ifndef MOVEIT_GRASPS__BATCH_IK_SOLVER_
+#define MOVEIT_GRASPS__BATCH_IK_SOLVER_
+
+// ROS
+#include <ros/ros.h>
+
+// MoveIt
+#include <moveit/kinematics_base/kinematics_base.h>
+#include <moveit/robot_model/robot_model.h>
+#include <moveit_msgs/MoveItErrorCodes.h>
+
+// Eigen
+#include <Eigen/Geometry>
+#include <eigen_stl_containers/eigen_stl_vector_container.h>
+
+// C++
+#include <boost/function.hpp>
+
+namespace moveit_grasps
+{
+// Check of a solution for the pose with index pose_id of a batch, in the variable order of the arm group
+typedef boost::function<bool(std::size_t pose_id, const std::vector<double>& solution)> BatchIKCallbackFn;
+
+/**
+ * \brief Inverse kinematics for a batch of target poses of the tip link of an arm. Solvers keep scratch memory
+ *        between batches, so every thread needs its own instance
+ */
+class BatchIKSolver
+{
+public:
+  virtual ~BatchIKSolver()
+  {
+  }
+
+  /**
+   * \brief Solve IK for every pose of a batch
+   * \param ik_poses - poses of the tip frame, expressed in the base frame of the solver
+   * \param ik_seeds - one seed per pose, in the variable order of the arm group
+   * \param timeout - time allowed per pose in seconds
+   * \param solution_callback - accepts or rejects a solution, may be empty
+   * \param ik_solutions - one solution per pose in the variable order of the arm group, empty if none was found
+   * \param error_codes - one result per pose: SUCCESS, NO_IK_SOLUTION or TIMED_OUT
+   * \return number of poses solved
+   */
+  virtual std::size_t solve(const EigenSTL::vector_Affine3d& ik_poses,
+                            const std::vector<std::vector<double> >& ik_seeds, double timeout,
+                            const BatchIKCallbackFn& solution_callback,
+                            std::vector<std::vector<double> >& ik_solutions,
+                            std::vector<moveit_msgs::MoveItErrorCodes>& error_codes) = 0;
+
+  /**
+   * \brief Name of the solver, for logging
+   */
+  virtual std::string getName() const = 0;
+};
+typedef boost::shared_ptr<BatchIKSolver> BatchIKSolverPtr;
+typedef boost::shared_ptr<const BatchIKSolver> BatchIKSolverConstPtr;
+
+/**
+ * \brief Solve a batch pose by pose with any kinematics plugin
+ */
+class KinematicsPluginBatchIKSolver : public BatchIKSolver
+{
+public:
+  /**
+   * \brief Constructor
+   * \param kin_solver - the plugin instance, used only by this solver
+   * \param arm_jmg - the arm the plugin solves for
+   */
+  KinematicsPluginBatchIKSolver(const kinematics::KinematicsBaseConstPtr& kin_solver,
+                                const robot_model::JointModelGroup* arm_jmg);
+
+  std::size_t solve(const EigenSTL::vector_Affine3d& ik_poses, const std::vector<std::vector<double> >& ik_seeds,
+                    double timeout, const BatchIKCallbackFn& solution_callback,
+                    std::vector<std::vector<double> >& ik_solutions,
+                    std::vector<moveit_msgs::MoveItErrorCodes>& error_codes);
+
+  std::string getName() const;
+
+private:
+  /**
+   * \brief Forward a solution of the plugin, in its variable order, to the callback of the batch
+   */
+  void pluginCallback(const BatchIKCallbackFn& solution_callback, std::size_t pose_id, const geometry_msgs::Pose&,
+                      const std::vector<double>& ik_sol, moveit_msgs::MoveItErrorCodes& error_code);
+
+  kinematics::KinematicsBaseConstPtr kin_solver_;
+
+  // group[bijection_[i]] = solver[i]
+  std::vector<unsigned int> bijection_;
+
+  // Scratch memory in the orders of the solver and the group
+  std::vector<double> solver_values_;
+  std::vector<double> group_values_;
+};
+
+}  // end namespace
+
+#endif
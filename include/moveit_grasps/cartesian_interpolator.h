@@ -0,0 +1,116 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Straight line end effector paths with a step size adapted to the joint motion and the clearance, solved
+           with Jacobian steps or IK
+*/
+
+#ifndef MOVEIT_GRASPS__CARTESIAN_INTERPOLATOR_
+#define MOVEIT_GRASPS__CARTESIAN_INTERPOLATOR_
+
+// ROS
+#include <ros/ros.h>
+
+// MoveIt
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/planning_scene/planning_scene.h>
+
+namespace moveit_grasps
+{
+/**
+ * \brief RobotState::computeCartesianPath() solves IK and checks collisions every max_step, no matter how long the
+ *        segment is or how far the arm is from obstacles. This class grows the step while the joints move little per
+ *        step and the arm is far from obstacles, and shrinks it near obstacles and singularities, where the joints
+ *        move a lot per step. The jump threshold test is the same as in MoveIt, normalized by the step length.
+ *        Optionally every step is solved with damped least squares Jacobian steps from the previous state, which is
+ *        much cheaper than an IK plugin call for the short straight lines of grasp approaches. IK is the fallback
+ *        for steps that do not converge or leave the joint limits
+ */
+class CartesianInterpolator
+{
+public:
+  /**
+   * \brief Constructor
+   * \param min_step - smallest cartesian step in meters, or radians for rotations
+   * \param max_step - largest cartesian step
+   * \param max_joint_step - joint space distance per step above which the step shrinks
+   * \param clearance_factor - fraction of the clearance of the group a step may cover
+   * \param jacobian_steps - solve steps with the Jacobian before falling back to IK
+   */
+  CartesianInterpolator(double min_step = 0.005, double max_step = 0.05, double max_joint_step = 0.1,
+                        double clearance_factor = 0.5, bool jacobian_steps = false);
+
+  /**
+   * \brief Move a link along a straight line to a target pose in the planning frame
+   * \param robot_state - start state, set to the last state of the path
+   * \param group - group to solve IK for
+   * \param trajectory - states of the path, starting with the start state
+   * \param link - link to move, the tip of the IK solver
+   * \param target - goal pose of the link in the planning frame
+   * \param jump_threshold - factor of the mean joint motion per cartesian distance above which the path is cut, or
+   *        0 to disable
+   * \param validity_callback - check of every state of the path
+   * \param planning_scene - scene to measure the clearance of the group, or NULL to adapt to the joint motion only
+   * \return fraction of the path that is valid
+   */
+  double computeCartesianPath(robot_state::RobotState* robot_state, const robot_model::JointModelGroup* group,
+                              std::vector<robot_state::RobotStatePtr>& trajectory, const robot_model::LinkModel* link,
+                              const Eigen::Affine3d& target, double jump_threshold,
+                              const moveit::core::GroupStateValidityCallbackFn& validity_callback,
+                              const planning_scene::PlanningScene* planning_scene) const;
+
+  /**
+   * \brief Move a link to a nearby pose with damped least squares Jacobian steps
+   * \param robot_state - state to start from, set to the solution
+   * \param pose - goal pose of the link in the planning frame
+   * \return true if the pose was reached within the joint limits
+   */
+  bool computeJacobianStep(robot_state::RobotState& robot_state, const robot_model::JointModelGroup* group,
+                           const robot_model::LinkModel* link, const Eigen::Affine3d& pose) const;
+
+private:
+  double min_step_;
+  double max_step_;
+  double max_joint_step_;
+  double clearance_factor_;
+  bool jacobian_steps_;
+};  // end class
+
+typedef boost::shared_ptr<CartesianInterpolator> CartesianInterpolatorPtr;
+typedef boost::shared_ptr<const CartesianInterpolator> CartesianInterpolatorConstPtr;
+
+}  // namespace
+
+#endif
@@ -0,0 +1,128 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Cheap bounding sphere collision test that resolves most grasp states before an exact mesh check
+*/
+
+#ifndef MOVEIT_GRASPS__COARSE_COLLISION_CHECKER_
+#define MOVEIT_GRASPS__COARSE_COLLISION_CHECKER_
+
+// ROS
+#include <ros/ros.h>
+
+// MoveIt
+#include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/planning_scene/planning_scene.h>
+
+namespace moveit_grasps
+{
+enum CoarseCollisionResult
+{
+  COARSE_CLEAR,      // no link comes close to the world, only self collisions need an exact check
+  COARSE_COLLIDING,  // a link is completely inside a solid collision object
+  COARSE_UNKNOWN     // near contact, needs an exact check
+};
+
+/**
+ * \brief Level of detail collision checking. Every link is bounded by a sphere, generated once per robot model, and
+ *        every collision object shape by a sphere, generated once per planning scene. Most grasp states are either
+ *        far away from all obstacles or deep inside one, which these spheres decide without touching the meshes
+ */
+class CoarseCollisionChecker
+{
+public:
+  /**
+   * \brief Constructor
+   * \param robot_model - the robot whose links are bounded
+   * \param clearance - extra distance in meters a link must keep from an object to be considered clear
+   */
+  CoarseCollisionChecker(const robot_model::RobotModelConstPtr& robot_model, double clearance = 0.01);
+
+  /**
+   * \brief Bound the collision objects of a planning scene, and copy its allowed collision matrix
+   */
+  void setPlanningScene(const planning_scene::PlanningScene& planning_scene);
+
+  /**
+   * \brief Check the links moved by a group against the world of the last planning scene
+   * \param robot_state - state with updated link transforms
+   * \param group - only links updated by this group are checked, like PlanningScene::isStateColliding()
+   */
+  CoarseCollisionResult checkWorldCollision(const robot_state::RobotState& robot_state,
+                                            const robot_model::JointModelGroup* group) const;
+
+private:
+  struct LinkSphere
+  {
+    Eigen::Vector3d center_;  // in the link frame
+    double radius_;
+    bool has_geometry_;
+  };
+
+  struct ObjectShape
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    std::string object_id_;
+    shapes::ShapeConstPtr shape_;
+    Eigen::Affine3d inverse_pose_;  // world to shape frame
+    Eigen::Vector3d center_;        // bounding sphere in the world frame
+    double radius_;
+    bool bounded_;
+  };
+
+  // Check one link sphere against one shape
+  CoarseCollisionResult checkShape(const std::string& link_name, const Eigen::Vector3d& center, double radius,
+                                   const ObjectShape& object_shape) const;
+
+  // Check if a sphere is completely inside a solid shape, given in the shape frame
+  static bool isSphereInside(const shapes::Shape* shape, const Eigen::Vector3d& center, double radius);
+
+  // Bounding spheres indexed by link index
+  std::vector<LinkSphere> link_spheres_;
+  double clearance_;
+
+  // Shapes of the last planning scene
+  std::vector<ObjectShape, Eigen::aligned_allocator<ObjectShape> > object_shapes_;
+  collision_detection::AllowedCollisionMatrix acm_;
+};  // end class
+
+typedef boost::shared_ptr<CoarseCollisionChecker> CoarseCollisionCheckerPtr;
+typedef boost::shared_ptr<const CoarseCollisionChecker> CoarseCollisionCheckerConstPtr;
+
+}  // namespace
+
+#endif
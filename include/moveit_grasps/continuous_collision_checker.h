@@ -0,0 +1,114 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Continuous collision checking of joint space motions by conservative advancement
+*/
+
+#ifndef MOVEIT_GRASPS__CONTINUOUS_COLLISION_CHECKER_
+#define MOVEIT_GRASPS__CONTINUOUS_COLLISION_CHECKER_
+
+// ROS
+#include <ros/ros.h>
+
+// MoveIt
+#include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/planning_scene/planning_scene.h>
+
+namespace moveit_grasps
+{
+/**
+ * \brief Checking discrete states along a motion is expensive when the states are close, and misses thin obstacles
+ *        when they are not. This class checks the linear joint space motion between two states with conservative
+ *        advancement: the distance of a state to collision, divided by a bound on how far any point of the moving
+ *        links travels during the motion, gives a step that is guaranteed to be free of collisions.
+ *        The bound supports revolute and prismatic joints, attached bodies are taken into account
+ */
+class ContinuousCollisionChecker
+{
+public:
+  /**
+   * \brief Constructor
+   * \param robot_model - the robot whose links are bounded by spheres
+   * \param min_clearance - distance in meters below which a state counts as colliding, limits the number of steps. The
+   *        default of 0 only rejects touching states, like the discrete checks
+   * \param max_steps - motions that need more steps are reported as colliding
+   */
+  ContinuousCollisionChecker(const robot_model::RobotModelConstPtr& robot_model, double min_clearance = 0.0,
+                             std::size_t max_steps = 200);
+
+  /**
+   * \brief Check the motion between two states, interpolated in joint space like RobotState::interpolate()
+   * \param planning_scene - objects and allowed collision matrix to check against
+   * \param from - start of the motion
+   * \param to - end of the motion, only differs from start in the joints of the group
+   * \param group - group that moves
+   * \return true if the whole motion is collision free
+   */
+  bool isMotionValid(const planning_scene::PlanningScene& planning_scene, const robot_state::RobotState& from,
+                     const robot_state::RobotState& to, const robot_model::JointModelGroup* group) const;
+
+  /**
+   * \brief Check the motions between consecutive states of a trajectory
+   * \return number of states that can be reached from the first one without collision
+   */
+  std::size_t checkTrajectory(const planning_scene::PlanningScene& planning_scene,
+                              const std::vector<robot_state::RobotStatePtr>& trajectory,
+                              const robot_model::JointModelGroup* group) const;
+
+  /**
+   * \brief Bound the distance any point of the links moved by a group travels between two states
+   */
+  double getMotionBound(const robot_state::RobotState& from, const robot_state::RobotState& to,
+                        const robot_model::JointModelGroup* group) const;
+
+private:
+  // Largest distance of any point of a link or its descendants from the link origin, over all joint positions
+  double getReach(const robot_model::LinkModel* link, const std::vector<double>& link_radii,
+                  std::vector<double>& link_reach) const;
+
+  // Radius of a sphere around the origin of every link containing its geometry, indexed by link index
+  std::vector<double> link_radii_;
+
+  double min_clearance_;
+  std::size_t max_steps_;
+};  // end class
+
+typedef boost::shared_ptr<ContinuousCollisionChecker> ContinuousCollisionCheckerPtr;
+typedef boost::shared_ptr<const ContinuousCollisionChecker> ContinuousCollisionCheckerConstPtr;
+
+}  // namespace
+
+#endif
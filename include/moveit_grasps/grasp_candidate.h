@@ -45,6 +45,7 @@
 
 // Grasping
 #include <moveit_grasps/grasp_data.h>
+#include <moveit_grasps/grasp_feature_matrix.h>
 
 // MoveIt
 #include <moveit/robot_state/robot_state.h>
@@ -81,6 +82,28 @@ public:
 
   bool isValid();
 
+  /**
+   * \brief Forget the results of a previous filter pass so that the candidate can be filtered again
+   */
+  void resetFilterResults();
+
+  /**
+   * \brief Create a copy of this grasp expressed for another end effector, e.g. the other arm of a dual arm robot.
+   *        The generic grasp pose is kept while the eef pose, approach/retreat and postures are taken from grasp_data.
+   *        Filter results and IK solutions are not copied
+   * \param grasp_data - data describing the end effector the copy is meant for
+   * \return the new grasp candidate
+   */
+  boost::shared_ptr<GraspCandidate> cloneForGraspData(const GraspDataPtr& grasp_data) const;
+
+  /**
+   * \brief Create a copy of this grasp for an object that moved, e.g. when tracking it between perception cycles.
+   *        Filter results are not copied, the IK solutions become the IK seeds of the copy
+   * \param transform - motion of the object in the frame of the grasp pose
+   * \return the new grasp candidate
+   */
+  boost::shared_ptr<GraspCandidate> cloneWithTransform(const Eigen::Affine3d& transform) const;
+
   moveit_msgs::Grasp grasp_;
 
   /*# Contents of moveit_msgs::Grasp for reference
@@ -154,10 +177,28 @@ public:
   bool grasp_filtered_by_orientation_;    // grasp pose is not desireable
   bool grasp_filtered_by_ik_closed_;      // ik solution was fine with fingers opened, but failed with fingers closed
   bool pregrasp_filtered_by_ik_;
+  bool grasp_skipped_by_predictor_;  // IK was not attempted because the success predictor expected it to fail
+  bool ik_timed_out_;  // the IK solver ran out of time, rather than finding that no solution exists
+  bool ik_retried_;    // timed out in the first pass of two phase IK and was filtered again with the longer timeout
 
   std::vector<double> grasp_ik_solution_;
   std::vector<double> pregrasp_ik_solution_;
 
+  // Unweighted features grasp_quality was computed from, a row of the matrix of the generateGrasps() call, or NULL
+  GraspFeatureMatrixConstPtr feature_matrix_;
+  std::size_t feature_row_;
+
+  // Joint space distance from the state the arm starts its motion in to the first IK solution of this grasp, the
+  // pregrasp if it was filtered. A rough measure of the cost of moving to the grasp, set by the filter
+  double joint_distance_;
+
+  // Optional IK seeds, e.g. the solutions of a previous cycle, used by the filter instead of its seed state
+  std::vector<double> grasp_ik_seed_;
+  std::vector<double> pregrasp_ik_seed_;
+
+  // Arms that have a valid grasp (and pregrasp) IK solution for this candidate, filled by multi-arm filtering
+  std::vector<const robot_model::JointModelGroup*> reachable_arms_;
+
   // Store pregrasp, grasp, lifted, and retreat trajectories
   GraspTrajectories segmented_cartesian_traj_;
 };  // class
@@ -0,0 +1,110 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Details of why a grasp failed, recorded while filtering and shown on demand
+*/
+
+#ifndef MOVEIT_GRASPS__GRASP_DIAGNOSTICS_
+#define MOVEIT_GRASPS__GRASP_DIAGNOSTICS_
+
+// moveit_grasps
+#include <moveit_grasps/grasp_candidate.h>
+
+// MoveIt
+#include <moveit_msgs/MoveItErrorCodes.h>
+#include <eigen_stl_containers/eigen_stl_vector_container.h>
+
+// C++
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace moveit_grasps
+{
+/**
+ * \brief The first state an IK search rejected because of a collision, with the colliding pairs and contact points
+ */
+struct CollisionDiagnostics
+{
+  CollisionDiagnostics() : num_rejected_states_(0)
+  {
+  }
+
+  void clear()
+  {
+    rejected_positions_.clear();
+    contact_pairs_.clear();
+    contact_points_.clear();
+    num_rejected_states_ = 0;
+  }
+
+  // Joint positions of the group in the first rejected state
+  std::vector<double> rejected_positions_;
+
+  // Colliding link and object names, and the contact points in the planning frame
+  std::vector<std::pair<std::string, std::string> > contact_pairs_;
+  EigenSTL::vector_Vector3d contact_points_;
+
+  // All states rejected by collision
+  std::size_t num_rejected_states_;
+};
+
+enum GraspFailureStage
+{
+  GRASP_IK_FAILURE,
+  GRASP_CLOSED_IK_FAILURE,
+  PREGRASP_IK_FAILURE
+};
+
+/**
+ * \brief Why the IK of a grasp failed
+ */
+struct GraspFailureDiagnostics
+{
+  GraspCandidatePtr grasp_candidate_;
+  GraspFailureStage stage_;
+  moveit_msgs::MoveItErrorCodes error_code_;
+  CollisionDiagnostics collision_;
+
+  // If no state collided, the remaining error in meters and radians after 4 Jacobian steps from the IK seed towards
+  // the pose, or -1. This only hints at how far out of reach the pose is; it is not the best partial solution of the
+  // IK solver, which is not available
+  double position_residual_;
+  double rotation_residual_;
+};
+
+}  // namespace
+
+#endif
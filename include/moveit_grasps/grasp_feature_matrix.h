@@ -0,0 +1,126 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Unweighted feature scores of generated grasps, to score them again for other weights
+*/
+
+#ifndef MOVEIT_GRASPS__GRASP_FEATURE_MATRIX_
+#define MOVEIT_GRASPS__GRASP_FEATURE_MATRIX_
+
+// Eigen
+#include <Eigen/Core>
+
+// C++
+#include <boost/shared_ptr.hpp>
+#include <vector>
+
+namespace moveit_grasps
+{
+/**
+ * \brief Features a grasp is scored by, in the order of the weights in GraspScoreWeights
+ */
+enum GraspFeature
+{
+  ORIENTATION_X_FEATURE = 0,
+  ORIENTATION_Y_FEATURE,
+  ORIENTATION_Z_FEATURE,
+  TRANSLATION_X_FEATURE,
+  TRANSLATION_Y_FEATURE,
+  TRANSLATION_Z_FEATURE,
+  DEPTH_FEATURE,
+  WIDTH_FEATURE,
+  OVERHANG_FEATURE,
+  NUM_GRASP_FEATURES
+};
+
+typedef Eigen::Matrix<double, NUM_GRASP_FEATURES, 1> GraspFeatureVector;
+
+/**
+ * \brief The features of the grasps of one generateGrasps() call, one row per grasp in one dense matrix. The quality
+ *        of a grasp is the weighted mean of its features, (features . weights) / (feature_counts . weights), where
+ *        the feature counts say how many scores of the end effector were summed into each feature. New weights then
+ *        score all grasps with a single matrix-vector product
+ */
+class GraspFeatureMatrix
+{
+public:
+  /**
+   * \brief Constructor
+   * \param feature_counts - number of scores summed into each feature, 0 for features the end effector does not use
+   */
+  explicit GraspFeatureMatrix(const GraspFeatureVector& feature_counts);
+
+  /**
+   * \brief Add the features of a grasp as a new row
+   * \return the row of the grasp
+   */
+  std::size_t addGrasp(const GraspFeatureVector& features);
+
+  /**
+   * \brief Features of the grasp in a row
+   */
+  GraspFeatureVector getFeatures(std::size_t row) const;
+
+  std::size_t getNumGrasps() const
+  {
+    return features_.size() / NUM_GRASP_FEATURES;
+  }
+
+  const GraspFeatureVector& getFeatureCounts() const
+  {
+    return feature_counts_;
+  }
+
+  /**
+   * \brief Quality of every grasp for a set of weights
+   * \param weights - weight of each feature
+   * \param qualities - quality of the grasp in each row, unchanged on failure
+   * \return false if the weights of the scored features do not sum to a positive value
+   */
+  bool computeQualities(const GraspFeatureVector& weights, Eigen::VectorXd& qualities) const;
+
+private:
+  GraspFeatureVector feature_counts_;
+
+  // Row major, the rows are appended while the grasps are generated
+  std::vector<double> features_;
+};  // end class
+
+typedef boost::shared_ptr<GraspFeatureMatrix> GraspFeatureMatrixPtr;
+typedef boost::shared_ptr<const GraspFeatureMatrix> GraspFeatureMatrixConstPtr;
+
+}  // namespace
+
+#endif
@@ -48,6 +48,18 @@
 // Grasping
 #include <moveit_grasps/grasp_generator.h>
 #include <moveit_grasps/grasp_candidate.h>
+#include <moveit_grasps/grasp_predicates.h>
+#include <moveit_grasps/batch_ik_solver.h>
+#include <moveit_grasps/coarse_collision_checker.h>
+#include <moveit_grasps/static_distance_field.h>
+#include <moveit_grasps/scene_region_cropper.h>
+#include <moveit_grasps/grasp_diagnostics.h>
+#include <moveit_grasps/grasp_filter_cache.h>
+#include <moveit_grasps/grasp_success_predictor.h>
+#include <moveit_grasps/ik_seed_index.h>
+#include <moveit_grasps/worker_thread_config.h>
+#include <moveit_grasps/shared_grasp_queue.h>
+#include <moveit_grasps/worker_scene_sync.h>
 
 // Rviz
 #include <moveit_visual_tools/moveit_visual_tools.h>
@@ -65,44 +77,6 @@
 
 namespace moveit_grasps
 {
-enum grasp_parallel_plane
-{
-  XY,
-  XZ,
-  YZ
-};
-
-/**
- * \brief Contains information to filter grasps by a cutting plane
- */
-struct CuttingPlane
-{
-  Eigen::Affine3d pose_;
-  grasp_parallel_plane plane_;
-  int direction_;
-
-  CuttingPlane(Eigen::Affine3d pose, grasp_parallel_plane plane, int direction)
-    : pose_(pose), plane_(plane), direction_(direction)
-  {
-  }
-};
-typedef boost::shared_ptr<CuttingPlane> CuttingPlanePtr;
-
-/**
- * \brief Contains information to filter grasps by orientation
- */
-struct DesiredGraspOrientation
-{
-  Eigen::Affine3d pose_;
-  double max_angle_offset_;
-
-  DesiredGraspOrientation(Eigen::Affine3d pose, double max_angle_offset)
-    : pose_(pose), max_angle_offset_(max_angle_offset)
-  {
-  }
-};
-typedef boost::shared_ptr<DesiredGraspOrientation> DesiredGraspOrientationPtr;
-
 /**
  * \brief Struct for passing parameters to threads, for cleaner code
  */
@@ -131,6 +105,8 @@ struct IkThreadStruct
   kinematics::KinematicsBaseConstPtr kin_solver_;
   robot_state::RobotStatePtr robot_state_;
   const robot_model::JointModelGroup* arm_jmg_;
+  BatchIKSolverPtr batch_ik_solver_;  // optional, used instead of kin_solver_
+  std::vector<double> motion_start_joints_;  // IK solutions closest to this are preferred
   double timeout_;
   bool filter_pregrasp_;
   bool verbose_;
@@ -140,9 +116,30 @@ struct IkThreadStruct
   geometry_msgs::PoseStamped ik_pose_;
   moveit_msgs::MoveItErrorCodes error_code_;
   std::vector<double> ik_seed_state_;
+
+  // Failure details of this thread until the filter pass ends, if recording
+  CollisionDiagnostics collision_diagnostics_;
+  std::vector<GraspFailureDiagnostics> failure_diagnostics_;
 };
 typedef boost::shared_ptr<IkThreadStruct> IkThreadStructPtr;
 
+// Per arm copies of a set of grasp candidates, as filled by multi-arm filtering
+typedef std::map<const robot_model::JointModelGroup*, std::vector<GraspCandidatePtr> > ArmGraspCandidates;
+
+/**
+ * \brief Outcome of filtering the grasps of one object with GraspFilter::filterGraspsForObjects()
+ */
+struct ObjectFilterResult
+{
+  std::size_t remaining_grasps_;
+
+  // Grasps whose IK started from the solution of a nearby grasp, possibly of another object
+  std::size_t seeded_grasps_;
+
+  // Thread time spent on the grasps of the object, in seconds
+  double filter_time_;
+};
+
 // Class
 class GraspFilter
 {
@@ -162,6 +159,70 @@ public:
                     const robot_model::JointModelGroup* arm_jmg, const moveit::core::RobotStatePtr seed_state,
                     bool filter_pregrasp = false);
 
+  /**
+   * \brief Return grasps that are kinematically feasible for any of several arms, e.g. both arms of a dual arm robot.
+   *        All arms are checked against the same planning scene snapshot in one thread pool, using a pool of
+   *        kinematic solvers per arm. Every grasp is solved in this process with the default IK timeout of its arm:
+   *        two_phase_ik, use_success_predictor, use_worker_processes and incremental_refilter only apply to the
+   *        single arm filterGrasps(), and refilterGrasps() can not reuse the results of this call
+   * \param grasp_candidates - all possible grasps that this will test. each one is tagged with the arms that reach it
+   * \param grasp_datas - the arms to solve the IK problem on, and their end effectors
+   * \param arm_grasp_candidates - per arm copies of grasp_candidates, expressed for that arm's end effector and
+   *        populated with its IK solutions
+   * \param filter_pregrasp -whether to also check ik feasibility for the pregrasp position
+   * \return true if at least one arm can reach at least one grasp
+   */
+  bool filterGrasps(std::vector<GraspCandidatePtr>& grasp_candidates,
+                    planning_scene_monitor::PlanningSceneMonitorPtr planning_scene_monitor,
+                    const GraspDatas& grasp_datas, const moveit::core::RobotStatePtr seed_state,
+                    ArmGraspCandidates& arm_grasp_candidates, bool filter_pregrasp = false);
+
+  /**
+   * \brief Return the kinematically feasible grasps of several objects, e.g. to choose the easiest pick of a bin.
+   *        All candidate sets are checked in one parallel sweep against one planning scene snapshot. Solutions of
+   *        every object seed the IK of nearby grasps of all objects through a shared IK seed index
+   * \param object_grasp_candidates - the candidates of every object, their filter results and IK solutions are set
+   * \param arm_jmg - the arm to solve the IK problem on
+   * \param object_results - remaining grasps and timing of every object
+   * \param filter_pregrasp -whether to also check ik feasibility for the pregrasp position
+   * \return true if any object has grasps remaining
+   */
+  bool filterGraspsForObjects(std::vector<std::vector<GraspCandidatePtr> >& object_grasp_candidates,
+                              planning_scene_monitor::PlanningSceneMonitorPtr planning_scene_monitor,
+                              const robot_model::JointModelGroup* arm_jmg, const moveit::core::RobotStatePtr seed_state,
+                              std::vector<ObjectFilterResult>& object_results, bool filter_pregrasp = false);
+
+  /**
+   * \brief Filter the grasps of the previous filterGrasps() call again after the planning scene changed. Only grasps
+   *        whose stored arm and gripper volumes overlap an added, removed or moved collision object are re-checked,
+   *        all others keep their status and IK solutions. Requires incremental_refilter to be enabled, otherwise, if
+   *        the previous results belong to other candidates, or if the allowed collision matrix, attached bodies,
+   *        joints outside the arm or seed state changed, all grasps are filtered again
+   * \param grasp_candidates - the same vector as given to the previous filterGrasps() call
+   * \param arm_jmg - the arm to solve the IK problem on
+   * \param filter_pregrasp -whether to also check ik feasibility for the pregrasp position
+   * \param octomap_changed_regions - regions where the octomap was updated. Octomap changes can not be bounded by
+   *        the filter itself, so if empty an octomap change causes all grasps to be re-checked
+   * \return true if grasps remain
+   */
+  bool refilterGrasps(std::vector<GraspCandidatePtr>& grasp_candidates,
+                      planning_scene_monitor::PlanningSceneMonitorPtr planning_scene_monitor,
+                      const robot_model::JointModelGroup* arm_jmg, const moveit::core::RobotStatePtr seed_state,
+                      bool filter_pregrasp = false, const AlignedBoxes& octomap_changed_regions = AlignedBoxes());
+
+  /**
+   * \brief Check grasps carried over from a previous cycle, e.g. by GraspGenerator::trackGrasps(), with a short IK
+   *        timeout. The IK solver starts from the previous solutions stored as IK seeds of the grasps
+   * \param grasp_candidates - the tracked grasps
+   * \param arm_jmg - the arm to solve the IK problem on
+   * \param filter_pregrasp -whether to also check ik feasibility for the pregrasp position
+   * \return true if grasps remain, otherwise the caller should generate and filter all grasps again
+   */
+  bool revalidateGrasps(std::vector<GraspCandidatePtr>& grasp_candidates,
+                        planning_scene_monitor::PlanningSceneMonitorPtr planning_scene_monitor,
+                        const robot_model::JointModelGroup* arm_jmg, const moveit::core::RobotStatePtr seed_state,
+                        bool filter_pregrasp = false);
+
   /**
    * \brief Filter grasps by cutting plane
    * \param grasp_candidates - all possible grasps that this will test. this vector is returned modified
@@ -198,11 +259,183 @@ public:
                                  const robot_model::JointModelGroup* arm_jmg,
                                  const moveit::core::RobotStatePtr seed_state, bool filter_pregrasp, bool verbose);
 
+  /**
+   * \brief Helper for filterGrasps, checking against an already copied planning scene
+   * \return number of grasps remaining
+   */
+  std::size_t filterGraspsHelper(std::vector<GraspCandidatePtr>& grasp_candidates,
+                                 planning_scene::PlanningScenePtr cloned_scene,
+                                 const robot_model::JointModelGroup* arm_jmg,
+                                 const moveit::core::RobotStatePtr seed_state, bool filter_pregrasp, bool verbose);
+
+  /**
+   * \brief Second pass of the two phase IK timeout mode: filter the best scored grasps whose IK timed out in the
+   *        first pass again, with the full timeout. Grasps without an IK solution are not retried
+   * \return number of grasps that became valid
+   */
+  std::size_t retryTimedOutGrasps(std::vector<GraspCandidatePtr>& grasp_candidates,
+                                  planning_scene::PlanningScenePtr cloned_scene,
+                                  const robot_model::JointModelGroup* arm_jmg,
+                                  const moveit::core::RobotStatePtr seed_state, bool filter_pregrasp);
+
+  /**
+   * \brief Filter grasps in the worker processes of the shared grasp queue. Grasps filtered by a cutting plane or
+   *        orientation are not sent. Grasps the workers do not finish within worker_timeout, or before the last
+   *        worker is dropped, are filtered in this process
+   * \return number of grasps remaining
+   */
+  std::size_t filterGraspsInWorkers(std::vector<GraspCandidatePtr>& grasp_candidates,
+                                    planning_scene::PlanningScenePtr cloned_scene,
+                                    const robot_model::JointModelGroup* arm_jmg,
+                                    const moveit::core::RobotStatePtr seed_state, bool filter_pregrasp);
+
+  /**
+   * \brief Create the shared grasp queue if worker processes are enabled
+   * \return true if worker processes are enabled and at least one is running
+   */
+  bool loadWorkerQueue();
+
+  /**
+   * \brief Set the IK timeout for filterGraspsHelper(), which filterGrasps() otherwise takes from the arm
+   */
+  void setSolverTimeout(double solver_timeout)
+  {
+    solver_timeout_ = solver_timeout;
+  }
+
+  /**
+   * \brief Move the static collision objects of a planning scene into the distance field, if enabled
+   * \return the scene to use for exact collision checks, without the objects in the distance field
+   */
+  planning_scene::PlanningScenePtr loadStaticDistanceField(const planning_scene::PlanningScenePtr& cloned_scene);
+
+  /**
+   * \brief Distance field of the static collision objects, e.g. to share with the GraspPlanner. NULL if disabled
+   */
+  StaticDistanceFieldPtr getStaticDistanceField()
+  {
+    return static_distance_field_;
+  }
+
+  /**
+   * \brief Crop a scene to the region the arms sweep through while reaching the grasps and pregrasps, if enabled
+   * \param check_scene - scene for the exact collision checks
+   * \param arms - arms that will reach for the grasps
+   * \return the cropped scene, or check_scene if cropping is disabled
+   */
+  planning_scene::PlanningScenePtr cropPlanningScene(const planning_scene::PlanningScenePtr& check_scene,
+                                                     const std::vector<GraspCandidatePtr>& grasp_candidates,
+                                                     const std::vector<const robot_model::JointModelGroup*>& arms);
+
+  /**
+   * \brief Scene cropper with the configured margin, e.g. to share with the GraspPlanner. NULL if disabled
+   */
+  SceneRegionCropperPtr getSceneRegionCropper()
+  {
+    return scene_region_cropper_;
+  }
+
+  /**
+   * \brief Prepare the coarse collision checker for a planning scene, if enabled
+   */
+  void loadCoarseCollisionChecker(const planning_scene::PlanningScenePtr& cloned_scene);
+
+  /**
+   * \brief Apply the cutting planes and orientations, then order the remaining grasps by predicted IK success times
+   *        score and mark those predicted to fail as skipped by the predictor. A fraction of the skipped grasps is
+   *        kept to verify the prediction
+   * \param predictor - model of previous IK results for the arm
+   * \param link_transform - transform from the robot model frame to the frame of the IK solver
+   * \param grasp_order - indices of the grasps to process, in order, without those the cheap filters removed
+   * \param ik_poses - pose of every grasp in the frame of the IK solver
+   * \return number of skipped grasps
+   */
+  std::size_t orderBySuccessPrediction(std::vector<GraspCandidatePtr>& grasp_candidates,
+                                       const GraspSuccessPredictorPtr& predictor, const Eigen::Affine3d& link_transform,
+                                       std::vector<std::size_t>& grasp_order, EigenSTL::vector_Affine3d& ik_poses);
+
+  /**
+   * \brief Store the filter request, the volumes of all grasps and the scene for incremental re-filtering
+   */
+  void setFilterCache(const std::vector<GraspCandidatePtr>& grasp_candidates,
+                      const planning_scene::PlanningScenePtr& cloned_scene, const robot_model::JointModelGroup* arm_jmg,
+                      const moveit::core::RobotStatePtr& seed_state, bool filter_pregrasp);
+
+  /**
+   * \brief Store the arm and gripper volumes of filtered grasps for incremental re-filtering
+   * \param grasp_ids - indices of the grasps in grasp_candidates whose volumes changed
+   */
+  void updateFilterCache(const std::vector<GraspCandidatePtr>& grasp_candidates,
+                         const std::vector<std::size_t>& grasp_ids, const robot_model::JointModelGroup* arm_jmg);
+
+  /**
+   * \brief Check that exactly one end effector is attached to an arm
+   * \return true on success
+   */
+  bool checkEndEffector(const robot_model::JointModelGroup* arm_jmg);
+
+  /**
+   * \brief Create an ik solver for every thread, if not already loaded for this arm
+   * \return true on success
+   */
+  bool loadKinematicSolvers(const robot_model::JointModelGroup* arm_jmg, std::size_t num_threads);
+
+  /**
+   * \brief Create a batch ik solver for every thread as chosen by the batch_ik_solver setting, if not already loaded
+   *        for this arm. Requires the kinematic solvers to be loaded
+   * \return true if batch solvers are in use for this arm
+   */
+  bool loadBatchIKSolvers(const robot_model::JointModelGroup* arm_jmg, std::size_t num_threads);
+
+  /**
+   * \brief Joint positions of an arm at the start of its motion, from the motion start state if set
+   */
+  std::vector<double> getMotionStartJoints(const robot_model::JointModelGroup* arm_jmg,
+                                           const moveit::core::RobotStatePtr& seed_state) const;
+
+  /**
+   * \brief Set the joint distance from the motion start of every valid grasp
+   */
+  void setJointDistances(std::vector<GraspCandidatePtr>& grasp_candidates,
+                         const std::vector<double>& motion_start_joints) const;
+
+  /**
+   * \brief Create a robot state for every thread, copied from the internal robot state. If the worker threads are
+   *        configured, each OpenMP worker applies the configuration and copies its own state, so the state is first
+   *        touched on the CPU of the worker
+   */
+  void loadRobotStates(std::size_t num_threads);
+
+  /**
+   * \brief Get the transform that brings a pose from the robot model frame to the frame of the arm's IK solver
+   * \return true on success
+   */
+  bool getIKFrameTransform(const robot_model::JointModelGroup* arm_jmg, Eigen::Affine3d& link_transform);
+
+  /**
+   * \brief Check a grasp against all cutting planes and desired orientations, and mark it if filtered
+   * \return true if grasp is filtered
+   */
+  bool filterGraspByCuttingPlanesAndOrientations(GraspCandidatePtr& grasp_candidate);
+
   /**
    * \brief Thread for checking part of the possible grasps list
    */
   bool processCandidateGrasp(IkThreadStructPtr& ik_thread_struct);
 
+  /**
+   * \brief Thread function that checks several grasps with one call of the batch ik solver per stage
+   * \param grasp_ids - indices of the grasps in the candidates of the thread struct
+   * \return number of grasps that remain valid
+   */
+  std::size_t processCandidateGraspBatch(IkThreadStructPtr& ik_thread_struct,
+                                         const std::vector<std::size_t>& grasp_ids);
+
+  /**
+   * \brief Collision check of IK solutions in the scene of the thread, recording into it if failures are recorded
+   */
+  moveit::core::GroupStateValidityCallbackFn createConstraintFn(IkThreadStructPtr& ik_thread_struct) const;
+
   /**
    * \brief Helper for the thread function to find IK solutions
    * \return true on success
@@ -219,6 +452,45 @@ public:
                             GraspCandidatePtr& grasp_candidate,
                             const moveit::core::GroupStateValidityCallbackFn& constraint_fn);
 
+  /**
+   * \brief Check only the links moved by an end effector, for a state whose other links are known to be valid.
+   *        Only the dirty part of the robot state is updated
+   * \return true if not in collision
+   */
+  bool isEndEffectorStateValid(const IkThreadStructPtr& ik_thread_struct,
+                               const robot_model::JointModelGroup* ee_jmg) const;
+
+  /**
+   * \brief Keep the details of a failed IK search in the thread struct
+   * \param ik_pose - pose of the search in the frame of the IK solver
+   * \param ik_seed - seed of the search, the start of the Jacobian steps that measure the residual
+   * \param collision - first collision of the search, moved into the diagnostics
+   */
+  void recordFailure(IkThreadStructPtr& ik_thread_struct, const GraspCandidatePtr& grasp_candidate,
+                     GraspFailureStage stage, const moveit_msgs::MoveItErrorCodes& error_code,
+                     const Eigen::Affine3d& ik_pose, const std::vector<double>& ik_seed,
+                     CollisionDiagnostics& collision);
+
+  /**
+   * \brief Move the failures recorded by the threads into failure_diagnostics_
+   */
+  void collectFailureDiagnostics(const std::vector<IkThreadStructPtr>& ik_thread_structs);
+
+  /**
+   * \brief Failures recorded by the last filter call, if record_failure_diagnostics is enabled
+   */
+  const std::vector<GraspFailureDiagnostics>& getFailureDiagnostics() const
+  {
+    return failure_diagnostics_;
+  }
+
+  /**
+   * \brief Show recorded failures: the first rejected arm state with its contact points, or the residual of the IK
+   * \param max_failures - number of failures to show, best scored grasps first
+   * \return true on success
+   */
+  bool visualizeFailureDiagnostics(std::size_t max_failures = 10);
+
   /**
    * \brief add a cutting plane
    * \param pose - pose describing the cutting plane
@@ -250,6 +522,27 @@ public:
    */
   void clearDesiredGraspOrientations();
 
+  /**
+   * \brief Set the state the arm moves to the grasps from, e.g. the current state. The joint distance of every grasp
+   *        is measured from it, and with ik_solutions_per_grasp > 1 the closest of several IK solutions is kept.
+   *        Without a start state the seed state of the filter is used
+   * \param motion_start_state - the start state, or NULL to use the seed state
+   */
+  void setMotionStartState(const moveit::core::RobotStatePtr& motion_start_state);
+
+  /**
+   * \brief Get the cutting planes and desired orientations, e.g. to let the GraspGenerator skip excluded grasps
+   */
+  const GraspPredicatesPtr& getGraspPredicates() const
+  {
+    return grasp_predicates_;
+  }
+
+  /**
+   * \brief Use a predicate set shared with other components instead of the own one
+   */
+  void setGraspPredicates(const GraspPredicatesPtr& grasp_predicates);
+
   /**
    * \brief Of an array of grasps, sort the valid ones from best score to worse score
    * \return true on success, false if no grasps remain
@@ -323,12 +616,83 @@ private:
   double show_filtered_arm_solutions_pregrasp_speed_;
   bool show_grasp_filter_collision_if_failed_;
 
+  // Failure details recorded during the parallel pass, always on if failures are shown
+  bool record_failure_diagnostics_;
+  std::vector<GraspFailureDiagnostics> failure_diagnostics_;
+
+  // CPUs and scheduling of the OpenMP workers
+  WorkerThreadConfig worker_thread_config_;
+
   // Shared node handle
   ros::NodeHandle nh_;
 
   // Cutting planes and orientation filter
-  std::vector<CuttingPlanePtr> cutting_planes_;
-  std::vector<DesiredGraspOrientationPtr> desired_grasp_orientations_;
+  GraspPredicatesPtr grasp_predicates_;
+
+  // Distance field of objects that rarely move
+  std::vector<std::string> static_collision_objects_;
+  double static_distance_field_resolution_;
+  double static_distance_field_padding_;
+  StaticDistanceFieldPtr static_distance_field_;
+
+  // Only check the part of the scene the arm can reach
+  bool crop_planning_scene_;
+  double crop_planning_scene_margin_;
+  SceneRegionCropperPtr scene_region_cropper_;
+
+  // Coarse to fine collision checking
+  bool coarse_collision_checking_;
+  double coarse_collision_clearance_;
+  CoarseCollisionCheckerPtr coarse_collision_checker_;
+
+  // Two phase IK timeout, a short first pass over all grasps and a full one over the best that timed out
+  bool two_phase_ik_;
+  double first_pass_ik_timeout_;
+  double second_pass_ik_timeout_;
+  int second_pass_max_grasps_;
+
+  // Results of the previous filter pass, for incremental re-filtering
+  bool incremental_refilter_;
+  GraspFilterCache filter_cache_;
+  std::size_t filter_cache_predicates_version_;
+
+  // Online model of IK results per arm, used to order and skip IK work
+  bool use_success_predictor_;
+  int success_predictor_k_;
+  int success_predictor_min_samples_;
+  int success_predictor_max_samples_;
+  double success_predictor_threshold_;
+  double success_predictor_verify_fraction_;
+  std::map<std::string, GraspSuccessPredictorPtr> success_predictors_;
+  // Scene each predictor learned in, its samples are forgotten when collision objects or settings change
+  std::map<std::string, GraspFilterCache> success_predictor_scenes_;
+
+  // Filtering in worker processes that share a queue in shared memory
+  bool use_worker_processes_;
+  std::string worker_queue_name_;
+  int worker_queue_capacity_;
+  double worker_timeout_;
+  double worker_lease_timeout_;
+  SharedGraspQueuePtr worker_queue_;
+  WorkerScenePublisherPtr worker_scene_publisher_;
+
+  // IK timeout for grasps tracked from a previous cycle
+  double tracking_ik_timeout_;
+
+  // Batch IK instead of one kinematics plugin call per pose
+  std::string batch_ik_solver_type_;
+  int batch_ik_size_;
+  double panda_ik_redundancy_step_;
+  std::map<std::string, std::vector<BatchIKSolverPtr> > batch_ik_solvers_;
+
+  // Several IK solutions per grasp, the one closest to the motion start is kept and can be preferred by the ranking
+  int ik_solutions_per_grasp_;
+  double joint_distance_weight_;
+  moveit::core::RobotStatePtr motion_start_state_;
+
+  // IK seeds shared between the objects of filterGraspsForObjects()
+  double ik_seed_index_cell_size_;
+  double ik_seed_index_max_rotation_;
 
 };  // end of class
 
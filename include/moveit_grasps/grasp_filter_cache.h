@@ -0,0 +1,223 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Remembers the arm volumes of filtered grasps so that only grasps near a planning scene change are re-checked
+*/
+
+#ifndef MOVEIT_GRASPS__GRASP_FILTER_CACHE_
+#define MOVEIT_GRASPS__GRASP_FILTER_CACHE_
+
+// ROS
+#include <ros/ros.h>
+
+// Grasping
+#include <moveit_grasps/grasp_candidate.h>
+
+// MoveIt
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/collision_detection/world.h>
+#include <moveit/collision_detection/collision_matrix.h>
+#include <moveit/planning_scene/planning_scene.h>
+
+// Eigen
+#include <Eigen/Geometry>
+
+// C++
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+
+namespace moveit_grasps
+{
+typedef std::vector<Eigen::AlignedBox3d> AlignedBoxes;
+
+/**
+ * \brief Results of a previous filterGrasps() call, together with the axis aligned boxes swept by the arm and
+ *        gripper links of every candidate and a snapshot of the scene they were checked against.
+ *        The boxes are kept in a uniform grid so that the grasps touching a changed region are found quickly
+ */
+class GraspFilterCache
+{
+public:
+  /**
+   * \brief Constructor
+   * \param cell_size - edge length of the cells of the spatial index, in meters
+   */
+  GraspFilterCache(double cell_size = 0.1);
+
+  /**
+   * \brief Forget all stored results
+   */
+  void clear();
+
+  /**
+   * \brief Check if stored results exist
+   */
+  bool empty() const
+  {
+    return grasp_candidates_.empty();
+  }
+
+  /**
+   * \brief Remember which filterGrasps() call the stored volumes belong to. Clears previously stored volumes
+   */
+  void setFilterRequest(const std::vector<GraspCandidatePtr>& grasp_candidates,
+                        const robot_model::JointModelGroup* arm_jmg, bool filter_pregrasp);
+
+  /**
+   * \brief Check if the stored volumes belong to the same candidates, arm and pregrasp setting
+   */
+  bool matchesFilterRequest(const std::vector<GraspCandidatePtr>& grasp_candidates,
+                            const robot_model::JointModelGroup* arm_jmg, bool filter_pregrasp) const;
+
+  /**
+   * \brief Replace the volumes of a grasp. A grasp without volumes is never returned by findOverlappingGrasps()
+   * \param grasp_id - index of the grasp in the candidate vector given to setFilterRequest()
+   */
+  void setGraspVolumes(std::size_t grasp_id, const AlignedBoxes& volumes);
+
+  /**
+   * \brief Mark a grasp as depending on the whole scene, e.g. an IK failure whose arm configurations are unknown. It
+   *        is returned by findOverlappingGrasps() for every region, until setGraspVolumes() is called for it
+   * \param grasp_id - index of the grasp in the candidate vector given to setFilterRequest()
+   */
+  void setGraspUnbounded(std::size_t grasp_id);
+
+  /**
+   * \brief Find the grasps with at least one volume intersecting a region
+   * \param region - axis aligned box in the planning frame
+   * \param grasp_ids - indices of the overlapping grasps are added to this set
+   */
+  void findOverlappingGrasps(const Eigen::AlignedBox3d& region, std::set<std::size_t>& grasp_ids) const;
+
+  /**
+   * \brief Take a snapshot of the scene the grasps were checked against: the collision objects, the allowed collision
+   *        matrix, the attached bodies, the current robot state and the IK seed state
+   */
+  void setWorld(const planning_scene::PlanningScene& planning_scene, const moveit::core::RobotState& seed_state);
+
+  /**
+   * \brief Compare the parts of a scene that can not be bounded in space against the stored snapshot: the allowed
+   *        collision matrix, the attached bodies, the joints of the current state outside the arm and the seed state.
+   *        Conditional collision matrix entries are compared by type only
+   * \return false if any of them changed, so that all grasps need to be re-checked
+   */
+  bool matchesRobot(const planning_scene::PlanningScene& planning_scene,
+                    const moveit::core::RobotState& seed_state) const;
+
+  /**
+   * \brief Compare only the allowed collision matrix and the attached bodies against the stored snapshot
+   * \return false if any of them changed
+   */
+  bool matchesCollisionSettings(const planning_scene::PlanningScene& planning_scene) const;
+
+  /**
+   * \brief Compare the collision objects against the stored snapshot
+   * \param world - the current collision objects
+   * \param changed_regions - old and new bounding boxes of every added, removed, moved or reshaped object
+   * \param ignore_octomaps - skip objects containing an octomap, e.g. when the caller knows the updated region
+   * \return false if a changed object can not be bounded, e.g. an octomap, so that all grasps need to be re-checked
+   */
+  bool getChangedRegions(const collision_detection::World& world, AlignedBoxes& changed_regions,
+                         bool ignore_octomaps = false) const;
+
+  /**
+   * \brief Bounding box of every link with collision geometry in a robot state
+   * \param robot_state - a state with updated link transforms
+   * \param links - the links to bound
+   * \param volumes - boxes are appended to this vector
+   */
+  static void getLinkVolumes(const moveit::core::RobotState& robot_state,
+                             const std::vector<const robot_model::LinkModel*>& links, AlignedBoxes& volumes);
+
+  /**
+   * \brief Bounding box of all shapes of a collision object
+   * \return false if the object contains a shape that can not be bounded
+   */
+  static bool getObjectVolume(const collision_detection::World::Object& object, Eigen::AlignedBox3d& volume);
+
+private:
+  // Key of the index cell containing a point
+  std::int64_t getCellKey(int x, int y, int z) const;
+  void getCellRange(const Eigen::AlignedBox3d& box, Eigen::Vector3i& min_cell, Eigen::Vector3i& max_cell) const;
+
+  // Add or remove a grasp from all cells its volumes touch
+  void indexGrasp(std::size_t grasp_id, bool insert);
+
+  // The filter request the volumes belong to
+  std::vector<GraspCandidatePtr> grasp_candidates_;
+  const robot_model::JointModelGroup* arm_jmg_;
+  bool filter_pregrasp_;
+
+  // Volumes of every grasp, indexed by grasp id
+  std::vector<AlignedBoxes> grasp_volumes_;
+
+  // Grasps that overlap every region
+  std::vector<std::size_t> unbounded_grasps_;
+
+  // Uniform grid of grasp ids
+  double cell_size_;
+  std::unordered_map<std::int64_t, std::vector<std::size_t> > cells_;
+
+  // Collision objects at the time of filtering
+  struct ObjectSnapshot
+  {
+    std::vector<shapes::ShapeConstPtr> shapes_;
+    EigenSTL::vector_Affine3d shape_poses_;
+    Eigen::AlignedBox3d volume_;
+    bool bounded_;
+  };
+  std::map<std::string, ObjectSnapshot> objects_;
+
+  // Robot and collision settings at the time of filtering
+  struct AttachedBodySnapshot
+  {
+    std::string link_name_;
+    std::vector<shapes::ShapeConstPtr> shapes_;
+    EigenSTL::vector_Affine3d fixed_transforms_;
+    std::set<std::string> touch_links_;
+  };
+  std::map<std::string, AttachedBodySnapshot> attached_bodies_;
+  collision_detection::AllowedCollisionMatrix allowed_collision_matrix_;
+  std::vector<double> current_positions_;
+  std::vector<double> seed_positions_;
+};  // end class
+
+typedef boost::shared_ptr<GraspFilterCache> GraspFilterCachePtr;
+typedef boost::shared_ptr<const GraspFilterCache> GraspFilterCacheConstPtr;
+
+}  // namespace
+
+#endif
@@ -0,0 +1,114 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Filters the grasps of a shared grasp queue, as one of several worker processes
+*/
+
+#ifndef MOVEIT_GRASPS__GRASP_FILTER_WORKER_
+#define MOVEIT_GRASPS__GRASP_FILTER_WORKER_
+
+// ROS
+#include <ros/ros.h>
+
+// moveit_grasps
+#include <moveit_grasps/grasp_filter.h>
+#include <moveit_grasps/shared_grasp_queue.h>
+#include <moveit_grasps/worker_scene_sync.h>
+
+namespace moveit_grasps
+{
+/**
+ * \brief Claims chunks of the grasps a GraspFilter coordinator writes to a SharedGraspQueue, filters them with its
+ *        own GraspFilter and kinematic solvers, and writes the results back. The planning scene is kept in sync
+ *        through the scene diffs of the coordinator
+ */
+class GraspFilterWorker
+{
+public:
+  /**
+   * \brief Constructor
+   * \param grasp_filter - filter to use, configured like the one of the coordinator
+   * \param grasp_data - end effector of the arm the coordinator filters grasps for
+   * \param queue_name - name of the queue, the worker_queue_name of the coordinator
+   * \param chunk_size - number of grasps to claim at once
+   * \param num_threads - threads filtering a chunk, several worker processes already share the CPUs
+   */
+  GraspFilterWorker(const GraspFilterPtr& grasp_filter, const GraspDataPtr& grasp_data, const std::string& queue_name,
+                    std::size_t chunk_size = 32, std::size_t num_threads = 1);
+
+  /**
+   * \brief Open the queue and subscribe to the scene of the coordinator
+   * \return true on success
+   */
+  bool connect();
+
+  /**
+   * \brief Wait for a batch and filter its grasps until none are left to claim
+   * \param timeout - maximum time to wait for a batch in seconds
+   * \return true if a batch was processed
+   */
+  bool processBatch(double timeout);
+
+  /**
+   * \brief Process batches until ROS shuts down, reconnecting when the coordinator restarts. Callbacks must be spun
+   *        by another thread
+   */
+  void run();
+
+private:
+  ros::NodeHandle nh_;
+
+  GraspFilterPtr grasp_filter_;
+  GraspDataPtr grasp_data_;
+
+  std::string queue_name_;
+  std::size_t chunk_size_;
+  std::size_t num_threads_;
+  SharedGraspQueue queue_;
+
+  // Local copy of the scene of the coordinator
+  planning_scene::PlanningScenePtr planning_scene_;
+  WorkerSceneSubscriberPtr scene_subscriber_;
+
+  // Batch of another arm, left for other workers
+  uint64_t skipped_batch_id_;
+};  // end class
+
+typedef boost::shared_ptr<GraspFilterWorker> GraspFilterWorkerPtr;
+typedef boost::shared_ptr<const GraspFilterWorker> GraspFilterWorkerConstPtr;
+
+}  // namespace
+
+#endif
@@ -66,11 +66,13 @@
 #include <moveit_visual_tools/moveit_visual_tools.h>
 
 // moveit_grasps
+#include <moveit_grasps/approach_atlas.h>
 #include <moveit_grasps/grasp_candidate.h>
+#include <moveit_grasps/grasp_feature_matrix.h>
+#include <moveit_grasps/grasp_pose_batch.h>
+#include <moveit_grasps/grasp_predicates.h>
 #include <moveit_grasps/grasp_scorer.h>
-
-// bounding_box
-//#include <bounding_box/bounding_box.h>
+#include <moveit_grasps/mesh_bounding_box.h>
 
 // C++
 #include <cstdlib>
@@ -155,6 +157,27 @@ struct GraspCandidateConfig
   bool generate_z_axis_grasps_;
 };
 
+/**
+ * \brief Grasps of one generate and filter cycle, kept to reuse when the same object is detected again at a slightly
+ *        different pose, e.g. on a conveyor or after a slip
+ */
+struct TrackedGrasps
+{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  TrackedGrasps(const Eigen::Affine3d& cuboid_pose, double depth, double width, double height,
+                const std::vector<GraspCandidatePtr>& grasp_candidates)
+    : cuboid_pose_(cuboid_pose), cuboid_size_(depth, width, height), grasp_candidates_(grasp_candidates)
+  {
+  }
+
+  Eigen::Affine3d cuboid_pose_;  // pose the grasps were generated for
+  Eigen::Vector3d cuboid_size_;  // depth, width and height of the cuboid
+  std::vector<GraspCandidatePtr> grasp_candidates_;
+};
+typedef boost::shared_ptr<TrackedGrasps> TrackedGraspsPtr;
+typedef boost::shared_ptr<const TrackedGrasps> TrackedGraspsConstPtr;
+
 struct GraspScoreWeights
 {
   GraspScoreWeights()
@@ -170,6 +193,18 @@ struct GraspScoreWeights
   {
   }
 
+  /**
+   * \brief The weights in the order of GraspFeature
+   */
+  GraspFeatureVector getFeatureWeights() const
+  {
+    GraspFeatureVector weights;
+    weights << orientation_x_score_weight_, orientation_y_score_weight_, orientation_z_score_weight_,
+        translation_x_score_weight_, translation_y_score_weight_, translation_z_score_weight_, depth_score_weight_,
+        width_score_weight_, overhang_score_weight_;
+    return weights;
+  }
+
   double orientation_x_score_weight_;
   double orientation_y_score_weight_;
   double orientation_z_score_weight_;
@@ -198,18 +233,18 @@ public:
    */
   GraspGenerator(moveit_visual_tools::MoveItVisualToolsPtr visual_tools, bool verbose = false);
 
-  // TODO(davetcoleman): reinstate ability to generate bounding boxes
   /**
-   * \brief Create possible grasp positions around a cuboid
+   * \brief Create possible grasp positions around the oriented bounding box of a mesh
    * \param mesh_msg - model of object to grasp from perception
-   * \param cuboid_pose - centroid of object to grasp in world frame
+   * \param object_pose - pose of the mesh frame in world frame
    * \param grasp_data data describing end effector
    * \param grasp_candidates possible grasps generated
+   * \param grasp_candidate_config parameter for selectively enabling and disabling different grasp types
    * \return true if successful
    */
-  // bool generateGrasps(const shape_msgs::Mesh& mesh_msg, const Eigen::Affine3d& cuboid_pose,
-  //                          const moveit_grasps::GraspDataPtr grasp_data, std::vector<GraspCandidatePtr>&
-  //                          grasp_candidates);
+  bool generateGrasps(const shape_msgs::Mesh& mesh_msg, const Eigen::Affine3d& object_pose,
+                      const GraspDataPtr grasp_data, std::vector<GraspCandidatePtr>& grasp_candidates,
+                      const GraspCandidateConfig grasp_candidate_config = GraspCandidateConfig());
 
   /**
    * \brief Create possible grasp positions around a cuboid
@@ -226,6 +261,22 @@ public:
                       const GraspDataPtr grasp_data, std::vector<GraspCandidatePtr>& grasp_candidates,
                       const GraspCandidateConfig grasp_candidate_config = GraspCandidateConfig());
 
+  /**
+   * \brief Move the valid grasps of a previous cycle along with the cuboid, instead of generating all grasps again.
+   *        The moved grasps keep their previous IK solutions as IK seeds, to be checked with
+   *        GraspFilter::revalidateGrasps()
+   * \param tracked_grasps - the cuboid and filtered grasps of the previous cycle
+   * \param cuboid_pose - centroid of object to grasp in world frame
+   * \param depth length of cuboid along local x-axis
+   * \param width length of cuboid along local y-axis
+   * \param height length of cuboid along local z-axis
+   * \param grasp_candidates the moved grasps
+   * \return false if the cuboid moved or changed too much, or had no valid grasps, in which case the caller should
+   *         generate all grasps again
+   */
+  bool trackGrasps(const TrackedGrasps& tracked_grasps, const Eigen::Affine3d& cuboid_pose, double depth,
+                   double width, double height, std::vector<GraspCandidatePtr>& grasp_candidates);
+
   /**
    * \brief Create grasp positions around one axis of a cuboid
    * \param cuboid_pose:      centroid of object to grasp in world frame
@@ -250,12 +301,12 @@ public:
    * \param translation - translation to go from cuboid centroid to grasping location
    * \param corner_rotation - extra rotatation needed to align grasp pose as you move around the cuboid
    * \param num_radial_grasps - the number of grasps to generate around the corner
-   * \param grasp_poses - list of grasp poses generated
+   * \param grasp_poses - list of grasp poses generated, a GraspPoseBatch or std::vector<Eigen::Affine3d>
    * \return the number of poses generated
    */
+  template <typename PoseBatch>
   std::size_t addCornerGraspsHelper(Eigen::Affine3d pose, double rotation_angles[3], Eigen::Vector3d translation,
-                                    double corner_rotation, std::size_t num_radial_grasps,
-                                    std::vector<Eigen::Affine3d>& grasp_poses);
+                                    double corner_rotation, std::size_t num_radial_grasps, PoseBatch& grasp_poses);
 
   /**
    * \brief helper function for adding grasps along the face of a cuboid
@@ -265,12 +316,13 @@ public:
    * \param translation - translation to go from cuboid centroid to grasping location
    * \param alignment_rotation - extra rotatation needed to align grasp pose as you move around the cuboid
    * \param num_grasps - the number of grasps to generate around the corner
-   * \param grasp_poses - list of grasp poses generated
+   * \param grasp_poses - list of grasp poses generated, a GraspPoseBatch or std::vector<Eigen::Affine3d>
    * \return the number of poses generated
    */
+  template <typename PoseBatch>
   std::size_t addFaceGraspsHelper(Eigen::Affine3d pose, double rotation_angles[3], Eigen::Vector3d translation,
                                   Eigen::Vector3d delta, double alignment_rotation, std::size_t num_grasps,
-                                  std::vector<Eigen::Affine3d>& grasp_poses);
+                                  PoseBatch& grasp_poses);
 
   /**
    * \brief helper function for adding grasps along the edges of the cuboid
@@ -280,12 +332,13 @@ public:
    * \param translation - translation to go from cuboid centroid to grasping location
    * \param alignment_rotation - extra rotatation needed to align grasp pose as you move around the cuboid
    * \param num_grasps - the number of grasps to generate around the corner
-   * \param grasp_poses - list of grasp poses generated
+   * \param grasp_poses - list of grasp poses generated, a GraspPoseBatch or std::vector<Eigen::Affine3d>
    * \return the number of poses generated
    */
+  template <typename PoseBatch>
   std::size_t addEdgeGraspsHelper(Eigen::Affine3d cuboid_pose, double rotation_angles[3], Eigen::Vector3d translation,
                                   Eigen::Vector3d delta, double alignment_rotation, std::size_t num_grasps,
-                                  std::vector<Eigen::Affine3d>& grasp_poses, double corner_rotation);
+                                  PoseBatch& grasp_poses, double corner_rotation);
 
   /**
    * \brief helper function for determining if the grasp will intersect the cuboid
@@ -325,16 +378,25 @@ public:
                 std::vector<GraspCandidatePtr>& grasp_candidates, const Eigen::Affine3d& object_pose,
                 const Eigen::Vector3d& object_size, double object_width);
 
+  /**
+   * \brief Create a grasp candidate, with its features in the feature matrix of the current generateGrasps() call
+   * \param features - features grasp_quality was computed from, kept in the feature matrix of the call
+   */
+  GraspCandidatePtr createGraspCandidate(const moveit_msgs::Grasp& grasp, const GraspDataPtr& grasp_data,
+                                         const Eigen::Affine3d& object_pose, const GraspFeatureVector& features) const;
+
   /**
    * \brief Score the generated suction grasp poses
    * \param grasp_pose - the pose of the grasp
    * \param grasp_data - data describing the end effector
    * \param cuboid_pose - the pose of the object being grasped
    * \param object size - the extents of the object being grasped
+   * \param features - optionally set to the unweighted features of the grasp
    * \return a score with positive being better
    */
   double scoreSuctionGrasp(const Eigen::Affine3d& grasp_pose, const GraspDataPtr& grasp_data,
-                           const Eigen::Affine3d& cuboid_pose, const Eigen::Vector3d& object_size);
+                           const Eigen::Affine3d& cuboid_pose, const Eigen::Vector3d& object_size,
+                           GraspFeatureVector* features = NULL);
 
   /**
    * \brief Score the generated finger grasp poses
@@ -342,10 +404,24 @@ public:
    * \param grasp_data - data describing the end effector
    * \param object_pose - the pose of the object being grasped
    * \param percent_open - percentage that the grippers are open. 0.0 -> grippers are at object width + padding
+   * \param features - optionally set to the unweighted features of the grasp
    * \return a score with positive being better
    */
   double scoreFingerGrasp(const Eigen::Affine3d& grasp_pose, const GraspDataPtr& grasp_data,
-                          const Eigen::Affine3d& object_pose, double percent_open);
+                          const Eigen::Affine3d& object_pose, double percent_open,
+                          GraspFeatureVector* features = NULL);
+
+  /**
+   * \brief Score grasps again for other weights from the features they were generated with, without generating or
+   *        filtering them again, and sort them best first. GraspFilter::removeInvalidAndFilter() ranks by the joint
+   *        distance as well
+   * \param grasp_candidates - grasps of any number of generateGrasps() calls
+   * \param grasp_score_weights - the new weights
+   * \return false if a grasp has no features, it keeps its quality, or if the weights of the scored features do not
+   *         sum to a positive value, then no grasp is changed
+   */
+  static bool rescoreGrasps(std::vector<GraspCandidatePtr>& grasp_candidates,
+                            const GraspScoreWeights& grasp_score_weights);
 
   /**
    * \brief Get the grasp direction vector relative to the world frame
@@ -431,6 +507,27 @@ public:
     verbose_ = verbose;
   }
 
+  /**
+   * \brief Skip grasps whose approach direction never succeeds at their cell of a bin, e.g. an atlas loaded from
+   *        approach_atlas_file
+   * \param approach_atlas - the atlas to use, or NULL to add all grasps
+   */
+  void setApproachAtlas(const ApproachAtlasConstPtr& approach_atlas)
+  {
+    approach_atlas_ = approach_atlas;
+  }
+
+  /**
+   * \brief Skip grasp poses excluded by cutting planes, desired orientations or pose checks, e.g. those of the
+   *        GraspFilter, before they become grasp candidates. Axes and suction grasps whose approach directions are
+   *        all outside of a desired orientation are not generated at all
+   * \param grasp_predicates - the predicates to use, or NULL to add all grasps
+   */
+  void setGraspPredicates(const GraspPredicatesConstPtr& grasp_predicates)
+  {
+    grasp_predicates_ = grasp_predicates;
+  }
+
   /**
    * \brief Visualize animated grasps
    * \return true on success
@@ -442,6 +539,31 @@ public:
   Eigen::Affine3d ideal_grasp_pose_;
 
 private:
+  /**
+   * \brief Implementation of generateCuboidAxisGrasps(), creating the grasp poses in a batch of the configured
+   *        precision
+   */
+  template <typename PoseBatch>
+  bool generateCuboidAxisGrasps(const Eigen::Affine3d& cuboid_pose, double depth, double width, double height,
+                                grasp_axis_t axis, const GraspDataPtr grasp_data,
+                                const GraspCandidateConfig& grasp_candidate_config,
+                                std::vector<GraspCandidatePtr>& grasp_candidates, PoseBatch& grasp_poses);
+
+  /**
+   * \brief Create the suction grasp poses around the center grasp pose and add them as grasp candidates
+   * \param grasp_poses - batch of the configured precision, with the center grasp pose
+   */
+  template <typename PoseBatch>
+  void addSuctionGrasps(const Eigen::Affine3d& cuboid_top_pose, double depth, double width,
+                        const Eigen::Vector3d& object_size, const GraspDataPtr grasp_data,
+                        std::vector<GraspCandidatePtr>& grasp_candidates, PoseBatch& grasp_poses);
+
+  /**
+   * \brief Check a grasp pose against the approach atlas and the grasp predicates
+   * \return true if the grasp can not succeed and should not be added
+   */
+  bool isGraspPoseExcluded(const Eigen::Affine3d& grasp_pose, const GraspDataPtr& grasp_data) const;
+
   bool generateFingerGrasps(const Eigen::Affine3d& cuboid_pose, double depth, double width, double height,
                             const GraspDataPtr grasp_data, std::vector<GraspCandidatePtr>& grasp_candidates,
                             const GraspCandidateConfig grasp_candidate_config = GraspCandidateConfig());
@@ -462,6 +584,26 @@ private:
   double show_prefiltered_grasps_speed_;
   bool show_grasp_overhang_;
 
+  // Store generated grasp poses in single instead of double precision until they become grasp candidates
+  bool single_precision_grasp_poses_;
+
+  // Features of the grasps of each generateGrasps() call, set only during the call, kept by the candidates
+  GraspFeatureMatrixPtr feature_matrix_;
+
+  // Fits cuboids to meshes, keeping its buffers between calls
+  MeshBoundingBox mesh_bounding_box_;
+
+  // Optional approach directions that can succeed per cell of the bins of a fixed shelf
+  ApproachAtlasConstPtr approach_atlas_;
+
+  // Optional predicates shared with the filter
+  GraspPredicatesConstPtr grasp_predicates_;
+
+  // Largest change of a cuboid between cycles for which its grasps are tracked
+  double tracking_max_translation_;
+  double tracking_max_rotation_;
+  double tracking_max_size_change_;
+
   // Shared node handle
   ros::NodeHandle nh_;
 
@@ -44,6 +44,8 @@
 
 // moveit_grasps
 #include <moveit_grasps/grasp_filter.h>
+#include <moveit_grasps/continuous_collision_checker.h>
+#include <moveit_grasps/cartesian_interpolator.h>
 
 namespace moveit_grasps
 {
@@ -103,6 +105,20 @@ public:
                                     const EigenSTL::vector_Affine3d& waypoints,
                                     const std::string& grasp_object_id = "");
 
+  /**
+   * \brief Check static collision objects in a distance field instead of the planning scene, e.g. the one built by
+   *        the GraspFilter. The field is updated for every planning scene, which is not thread safe
+   * \param static_distance_field - the field to use, or NULL to check all objects exactly
+   */
+  void setStaticDistanceField(const StaticDistanceFieldPtr& static_distance_field);
+
+  /**
+   * \brief Only check the collision objects and octomap voxels near the arm base and the waypoints, e.g. with the
+   *        cropper of the GraspFilter
+   * \param scene_region_cropper - the cropper to use, or NULL to check the whole scene
+   */
+  void setSceneRegionCropper(const SceneRegionCropperPtr& scene_region_cropper);
+
   /**
    * \brief Wait for user input to proceeed
    * \param message - text to display to user when waiting
@@ -132,6 +148,32 @@ public:
   bool isEnabled(const std::string& setting_name);
 
 private:
+  /**
+   * \brief Compute one cartesian segment, with IK at fixed steps or with a CartesianInterpolator
+   * \param robot_state - start state, set to the end of the segment
+   * \param trajectory - states of the segment, starting with the start state
+   * \param planning_scene - scene to adapt the step size to
+   * \param cartesian_interpolator - interpolator to use, or NULL for RobotState::computeCartesianPath()
+   * \return fraction of the segment that is valid
+   */
+  double computeCartesianSegment(moveit::core::RobotStatePtr& robot_state, const robot_model::JointModelGroup* arm_jmg,
+                                 std::vector<moveit::core::RobotStatePtr>& trajectory,
+                                 const moveit::core::LinkModel* ik_tip_link, const Eigen::Affine3d& target,
+                                 double max_step, double jump_threshold,
+                                 const moveit::core::GroupStateValidityCallbackFn& constraint_fn,
+                                 const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                 const CartesianInterpolator* cartesian_interpolator);
+
+  /**
+   * \brief Cut a cartesian segment at the first motion that is not collision free
+   * \param trajectory - states of the segment, starting with the start state
+   * \param valid_percentage - fraction of the segment computeCartesianPath() found
+   * \return fraction of the segment that is valid
+   */
+  double checkContinuousCollision(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                  std::vector<moveit::core::RobotStatePtr>& trajectory,
+                                  const robot_model::JointModelGroup* arm_jmg, double valid_percentage);
+
   // A shared node handle
   ros::NodeHandle nh_;
 
@@ -140,6 +182,15 @@ private:
 
   WaitForNextStepCallback wait_for_next_step_callback_;
 
+  // Optional distance field of static collision objects
+  StaticDistanceFieldPtr static_distance_field_;
+
+  // Checks the motion between cartesian waypoints, created when enabled
+  ContinuousCollisionCheckerPtr continuous_collision_checker_;
+
+  // Optional cropping of the scene to the reach of the arm
+  SceneRegionCropperPtr scene_region_cropper_;
+
   // Visualization settings
   bool enabled_setttings_loaded_ = false;
   std::map<std::string, bool> enabled_setting_;
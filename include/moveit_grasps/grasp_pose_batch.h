@@ -0,0 +1,137 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Compact storage for the grasp poses of a grasp lattice
+*/
+
+#ifndef MOVEIT_GRASPS__GRASP_POSE_BATCH_
+#define MOVEIT_GRASPS__GRASP_POSE_BATCH_
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// C++
+#include <vector>
+
+namespace moveit_grasps
+{
+/**
+ * \brief Grasp poses stored as a quaternion and a translation in Scalar precision, instead of the 16 doubles of an
+ *        Eigen::Affine3d. With float that is 28 instead of 128 bytes per pose, which is plenty for millimeter level
+ *        grasp lattices. Poses are converted from and to Eigen::Affine3d, so the class can be used like a
+ *        std::vector<Eigen::Affine3d> that only supports appending
+ */
+template <typename Scalar>
+class GraspPoseBatch
+{
+public:
+  std::size_t size() const
+  {
+    return poses_.size();
+  }
+
+  bool empty() const
+  {
+    return poses_.empty();
+  }
+
+  void clear()
+  {
+    poses_.clear();
+  }
+
+  void reserve(std::size_t size)
+  {
+    poses_.reserve(size);
+  }
+
+  void push_back(const Eigen::Affine3d& pose)
+  {
+    CompactPose compact_pose;
+    compact_pose.rotation_ = Eigen::Quaterniond(pose.rotation()).coeffs().cast<Scalar>();
+    compact_pose.translation_ = pose.translation().cast<Scalar>();
+    poses_.push_back(compact_pose);
+  }
+
+  /**
+   * \brief Get a pose in double precision
+   */
+  Eigen::Affine3d operator[](std::size_t pose_id) const
+  {
+    const CompactPose& compact_pose = poses_[pose_id];
+    Eigen::Quaterniond rotation(compact_pose.rotation_.template cast<double>());
+    return Eigen::Translation3d(compact_pose.translation_.template cast<double>()) * rotation.normalized();
+  }
+
+  /**
+   * \brief Get the translation of a pose, without converting its rotation
+   */
+  Eigen::Vector3d getTranslation(std::size_t pose_id) const
+  {
+    return poses_[pose_id].translation_.template cast<double>();
+  }
+
+private:
+  struct CompactPose
+  {
+    Eigen::Matrix<Scalar, 4, 1, Eigen::DontAlign> rotation_;  // quaternion coefficients x, y, z, w
+    Eigen::Matrix<Scalar, 3, 1, Eigen::DontAlign> translation_;
+  };
+
+  std::vector<CompactPose> poses_;
+};  // end class
+
+typedef GraspPoseBatch<float> GraspPoseBatchf;
+typedef GraspPoseBatch<double> GraspPoseBatchd;
+
+/**
+ * \brief Get the translation of a grasp pose, for code that works on both GraspPoseBatch and
+ *        std::vector<Eigen::Affine3d>
+ */
+template <typename Scalar>
+inline Eigen::Vector3d getTranslation(const GraspPoseBatch<Scalar>& grasp_poses, std::size_t pose_id)
+{
+  return grasp_poses.getTranslation(pose_id);
+}
+
+inline Eigen::Vector3d getTranslation(const std::vector<Eigen::Affine3d>& grasp_poses, std::size_t pose_id)
+{
+  return grasp_poses[pose_id].translation();
+}
+
+}  // namespace
+
+#endif
@@ -0,0 +1,205 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Cutting planes, approach orientation cones and pose checks shared by the grasp generator and filter
+*/
+
+#ifndef MOVEIT_GRASPS__GRASP_PREDICATES_
+#define MOVEIT_GRASPS__GRASP_PREDICATES_
+
+// ROS
+#include <ros/ros.h>
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// C++
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <vector>
+
+namespace moveit_grasps
+{
+enum grasp_parallel_plane
+{
+  XY,
+  XZ,
+  YZ
+};
+
+/**
+ * \brief Contains information to filter grasps by a cutting plane
+ */
+struct CuttingPlane
+{
+  Eigen::Affine3d pose_;
+  grasp_parallel_plane plane_;
+  int direction_;
+
+  CuttingPlane(Eigen::Affine3d pose, grasp_parallel_plane plane, int direction)
+    : pose_(pose), plane_(plane), direction_(direction)
+  {
+  }
+};
+typedef boost::shared_ptr<CuttingPlane> CuttingPlanePtr;
+
+/**
+ * \brief Contains information to filter grasps by orientation
+ */
+struct DesiredGraspOrientation
+{
+  Eigen::Affine3d pose_;
+  double max_angle_offset_;
+
+  DesiredGraspOrientation(Eigen::Affine3d pose, double max_angle_offset)
+    : pose_(pose), max_angle_offset_(max_angle_offset)
+  {
+  }
+};
+typedef boost::shared_ptr<DesiredGraspOrientation> DesiredGraspOrientationPtr;
+
+// Check of a grasp pose in standard grasping orientation, returns false if the grasp can never succeed
+typedef boost::function<bool(const Eigen::Affine3d& grasp_pose)> GraspPoseCheckFn;
+
+/**
+ * \brief The set of predicates that exclude grasps, e.g. the walls of a shelf bin and the approach directions that
+ *        fit through its opening. The GraspFilter checks every candidate against them, and the GraspGenerator skips
+ *        excluded grasp poses, and whole families of approach directions, before they become candidates
+ */
+class GraspPredicates
+{
+public:
+  /**
+   * \brief Constructor
+   */
+  GraspPredicates();
+
+  /**
+   * \brief add a cutting plane
+   * \param pose - pose describing the cutting plane
+   * \param plane - which plane to use as the cutting plane
+   * \param direction - on which side of the plane the grasps will be removed
+   */
+  void addCuttingPlane(const Eigen::Affine3d& pose, grasp_parallel_plane plane, int direction);
+
+  /**
+   * \brief add a desired grasp orientation
+   * \param pose - the desired grasping pose
+   * \param max_angle_offset - maximum amount a generated grasp can deviate from the desired pose
+   */
+  void addDesiredGraspOrientation(const Eigen::Affine3d& pose, double max_angle_offset);
+
+  /**
+   * \brief add a check of grasp poses, e.g. the reachability of an ApproachAtlas. Only the generator runs them, the
+   *        filter solves IK itself
+   */
+  void addGraspPoseCheck(const GraspPoseCheckFn& grasp_pose_check);
+
+  void clearCuttingPlanes();
+  void clearDesiredGraspOrientations();
+  void clearGraspPoseChecks();
+
+  const std::vector<CuttingPlanePtr>& getCuttingPlanes() const
+  {
+    return cutting_planes_;
+  }
+
+  const std::vector<DesiredGraspOrientationPtr>& getDesiredGraspOrientations() const
+  {
+    return desired_grasp_orientations_;
+  }
+
+  /**
+   * \brief Get a number that changes whenever a predicate is added or removed
+   */
+  std::size_t getVersion() const
+  {
+    return version_;
+  }
+
+  /**
+   * \brief Check if an end effector position is on the removed side of a cutting plane
+   */
+  static bool isCutByPlane(const CuttingPlane& cutting_plane, const Eigen::Vector3d& eef_position);
+
+  /**
+   * \brief Check if an approach direction deviates too much from a desired grasp orientation
+   * \param approach_direction - unit z-axis of a grasp pose in standard grasping orientation
+   */
+  static bool isOutsideOrientation(const DesiredGraspOrientation& desired_orientation,
+                                   const Eigen::Vector3d& approach_direction);
+
+  /**
+   * \brief Check if an end effector position is cut by any cutting plane
+   */
+  bool isCut(const Eigen::Vector3d& eef_position) const;
+
+  /**
+   * \brief Check if an approach direction is outside of any desired grasp orientation
+   */
+  bool isOutsideOrientations(const Eigen::Vector3d& approach_direction) const;
+
+  /**
+   * \brief Check a grasp pose against all predicates
+   * \param grasp_pose - grasp pose in standard grasping orientation
+   * \param grasp_pose_to_eef_pose - transform from the grasp pose to the end effector pose
+   * \return true if the grasp is excluded
+   */
+  bool excludes(const Eigen::Affine3d& grasp_pose, const Eigen::Affine3d& grasp_pose_to_eef_pose) const;
+
+  /**
+   * \brief Check if the desired grasp orientations exclude all approach directions at a fixed angle to an axis,
+   *        e.g. all grasps rotated about the closing direction of the fingers
+   * \param axis - unit axis
+   * \param offset - cosine of the angle between the axis and the approach directions
+   * \return true if no approach direction on the cone around the axis is allowed
+   */
+  bool excludesApproachCone(const Eigen::Vector3d& axis, double offset) const;
+
+private:
+  std::vector<CuttingPlanePtr> cutting_planes_;
+  std::vector<DesiredGraspOrientationPtr> desired_grasp_orientations_;
+  std::vector<GraspPoseCheckFn> grasp_pose_checks_;
+
+  std::size_t version_;
+};  // end class
+
+typedef boost::shared_ptr<GraspPredicates> GraspPredicatesPtr;
+typedef boost::shared_ptr<const GraspPredicates> GraspPredicatesConstPtr;
+
+}  // end namespace
+
+#endif
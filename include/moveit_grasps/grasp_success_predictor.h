@@ -0,0 +1,146 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Online nearest neighbor model predicting whether a grasp pose will have an IK solution
+*/
+
+#ifndef MOVEIT_GRASPS__GRASP_SUCCESS_PREDICTOR_
+#define MOVEIT_GRASPS__GRASP_SUCCESS_PREDICTOR_
+
+// ROS
+#include <ros/ros.h>
+
+// Eigen
+#include <Eigen/Geometry>
+
+// C++
+#include <boost/shared_ptr.hpp>
+#include <vector>
+
+namespace moveit_grasps
+{
+/**
+ * \brief Filter outcomes are strongly correlated in pose space: neighbors of a pose without an IK solution usually
+ *        fail as well. This model remembers the outcome of recent IK queries and predicts the success of a new pose
+ *        from its k nearest neighbors, using the position and wrist orientation in the frame of the IK solver.
+ *        The neighbors are found in a kd-tree over the samples, rebuilt by updateIndex()
+ */
+class GraspSuccessPredictor
+{
+public:
+  /**
+   * \brief Constructor
+   * \param k - number of neighbors to vote
+   * \param max_samples - oldest samples are forgotten beyond this number
+   * \param orientation_weight - distance in meters that equals a unit change of the wrist axes
+   */
+  GraspSuccessPredictor(std::size_t k = 10, std::size_t max_samples = 5000, double orientation_weight = 0.1);
+
+  /**
+   * \brief Remember the outcome of an IK query
+   * \param ik_pose - pose of the end effector parent link in the frame of the IK solver
+   * \param success - whether a valid IK solution was found
+   */
+  void addSample(const Eigen::Affine3d& ik_pose, bool success);
+
+  /**
+   * \brief Rebuild the kd-tree if samples were added since the last call. Call before predicting a batch of poses,
+   *        predictions without an up to date tree compare against every sample
+   */
+  void updateIndex();
+
+  /**
+   * \brief Probability that a pose has a valid IK solution. Smoothed towards 0.5 when few neighbors are known.
+   *        Safe to call from several threads once updateIndex() was called
+   * \param ik_pose - pose of the end effector parent link in the frame of the IK solver
+   */
+  double predictSuccess(const Eigen::Affine3d& ik_pose) const;
+
+  /**
+   * \brief Number of remembered samples
+   */
+  std::size_t getNumSamples() const
+  {
+    return samples_.size();
+  }
+
+  /**
+   * \brief Forget all samples
+   */
+  void clear();
+
+private:
+  typedef Eigen::Matrix<double, 9, 1> Feature;
+
+  Feature getFeature(const Eigen::Affine3d& ik_pose) const;
+
+  // Squared distance and index of the neighbors found so far, a max heap of at most k elements
+  typedef std::vector<std::pair<double, std::size_t> > Neighbors;
+  void addNeighbor(const Feature& feature, std::size_t sample_id, std::size_t k, Neighbors& neighbors) const;
+
+  // Build the subtree of index_[begin, end) and return its node id
+  int buildNode(std::size_t begin, std::size_t end);
+  void searchNode(int node_id, const Feature& feature, std::size_t k, Neighbors& neighbors) const;
+
+  std::size_t k_;
+  std::size_t max_samples_;
+  double orientation_weight_;
+
+  // Ring buffer of samples, next_sample_ is the one to overwrite once full
+  std::vector<Feature, Eigen::aligned_allocator<Feature> > samples_;
+  std::vector<bool> outcomes_;
+  std::size_t next_sample_;
+
+  // Kd-tree over the samples, leaves hold a range of index_
+  struct Node
+  {
+    int axis_;  // -1 for leaves
+    double split_;
+    int left_;
+    int right_;
+    std::size_t begin_;
+    std::size_t end_;
+  };
+  std::vector<Node> nodes_;
+  std::vector<std::size_t> index_;
+  bool index_valid_;
+};  // end class
+
+typedef boost::shared_ptr<GraspSuccessPredictor> GraspSuccessPredictorPtr;
+typedef boost::shared_ptr<const GraspSuccessPredictor> GraspSuccessPredictorConstPtr;
+
+}  // namespace
+
+#endif
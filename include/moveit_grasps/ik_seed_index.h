@@ -0,0 +1,118 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   IK solutions of solved grasp poses, looked up by nearby poses to seed their IK
+*/
+
+#ifndef MOVEIT_GRASPS__IK_SEED_INDEX_
+#define MOVEIT_GRASPS__IK_SEED_INDEX_
+
+// Eigen
+#include <Eigen/Geometry>
+
+// C++
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace moveit_grasps
+{
+/**
+ * \brief Grasps of neighboring objects, or of one object seen twice, often share nearly the same IK poses. This
+ *        index keeps the solutions found so far in a uniform grid of IK pose positions, so that a grasp can start its
+ *        IK from the solution of a close pose. A pose solved before is then confirmed in a single solver iteration.
+ *        Safe to use from several threads
+ */
+class IKSeedIndex
+{
+public:
+  /**
+   * \brief Constructor
+   * \param cell_size - edge length in meters of the grid cells, poses in one cell can seed each other
+   * \param max_rotation - largest rotation in radians between a pose and the pose of its seed
+   * \param max_seeds_per_cell - further solutions in a full cell are dropped
+   */
+  IKSeedIndex(double cell_size = 0.02, double max_rotation = 0.3, std::size_t max_seeds_per_cell = 8);
+
+  /**
+   * \brief Remember a valid IK solution
+   * \param ik_pose - pose of the end effector parent link in the frame of the IK solver
+   */
+  void addSolution(const Eigen::Affine3d& ik_pose, const std::vector<double>& solution);
+
+  /**
+   * \brief Find the solution of the closest remembered pose in the cell of a pose
+   * \param ik_pose - pose of the end effector parent link in the frame of the IK solver
+   * \param seed - the solution, unchanged if none was found
+   * \return true if a seed was found
+   */
+  bool findSeed(const Eigen::Affine3d& ik_pose, std::vector<double>& seed) const;
+
+  /**
+   * \brief Number of remembered solutions
+   */
+  std::size_t getNumSolutions() const;
+
+  /**
+   * \brief Forget all solutions
+   */
+  void clear();
+
+private:
+  std::int64_t getCellKey(const Eigen::Vector3d& position) const;
+
+  struct Seed
+  {
+    Eigen::Matrix3d rotation_;
+    std::vector<double> solution_;
+  };
+
+  double cell_size_;
+  double max_rotation_;
+  std::size_t max_seeds_per_cell_;
+  std::size_t num_solutions_;
+
+  std::unordered_map<std::int64_t, std::vector<Seed> > cells_;
+  mutable boost::mutex cells_mutex_;
+};  // end class
+
+typedef boost::shared_ptr<IKSeedIndex> IKSeedIndexPtr;
+typedef boost::shared_ptr<const IKSeedIndex> IKSeedIndexConstPtr;
+
+}  // namespace
+
+#endif
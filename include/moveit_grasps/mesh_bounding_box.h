@@ -0,0 +1,143 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Fit an oriented bounding box to a mesh, so meshes from perception can be grasped like cuboids
+*/
+
+#ifndef MOVEIT_GRASPS__MESH_BOUNDING_BOX_
+#define MOVEIT_GRASPS__MESH_BOUNDING_BOX_
+
+// ROS
+#include <ros/ros.h>
+
+// Msgs
+#include <shape_msgs/Mesh.h>
+
+// Eigen
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+// C++
+#include <vector>
+
+namespace moveit_grasps
+{
+/**
+ * \brief Oriented bounding box of the vertices of a mesh. The principal axes of the vertex covariance give a first
+ *        box, which is refined by a minimum area rectangle of the convex hull of the vertices projected along each
+ *        principal axis. The box with the smallest surface area wins, which also handles flat meshes. Buffers are
+ *        kept between fits, so reuse one instance
+ */
+class MeshBoundingBox
+{
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  /**
+   * \brief Constructor
+   */
+  MeshBoundingBox();
+
+  /**
+   * \brief Fit an oriented bounding box to the vertices of a mesh
+   * \param mesh_msg - mesh to bound, only its vertices are used
+   * \param box_pose - center and orientation of the box in the mesh frame
+   * \param box_size - length of the box along its local x, y and z axes
+   * \return true on success
+   */
+  bool fit(const shape_msgs::Mesh& mesh_msg, Eigen::Affine3d& box_pose, Eigen::Vector3d& box_size);
+
+private:
+  /**
+   * \brief Find the minimum area rectangle of the hull_candidates_ with rotating calipers on their convex hull
+   * \param extent - size of the point set, to scale tolerances
+   * \param direction - unit direction of the first side of the rectangle
+   * \param center - center of the rectangle
+   * \param size - length of the rectangle along direction and its left normal
+   * \return the area of the rectangle, or a negative value if the points span no area
+   */
+  double fitMinAreaRectangle(double extent, Eigen::Vector2d& direction, Eigen::Vector2d& center,
+                             Eigen::Vector2d& size);
+
+  /**
+   * \brief Compute the convex hull of the hull_candidates_ into hull_, in counter clockwise order
+   */
+  void computeConvexHull(double extent);
+
+  /**
+   * \brief Set the hull_candidates_ to the projected vertices that are not inside the polygon of their extreme points
+   *        along x, y and the diagonals, as none of those can be on the convex hull
+   * \param u, v - rows of projected_vertices_ to use as x and y
+   */
+  void selectHullCandidates(std::size_t u, std::size_t v, double extent);
+
+  /**
+   * \brief Remove the hull_candidates_ inside the polygon of their extreme points along evenly spaced directions
+   * \param num_directions - number of directions, at most 32
+   */
+  void discardInteriorPoints(std::size_t num_directions, double extent);
+
+  /**
+   * \brief Remove repeated points from polygon_ and compute its edges
+   * \return false if the polygon has no area
+   */
+  bool setPolygonEdges(double extent);
+
+  /**
+   * \brief Check if a point is inside polygon_, or on its edges up to a tolerance
+   */
+  bool isInsidePolygon(const Eigen::Vector2d& point) const;
+
+  // Vertices relative to the first one, in the mesh frame and in the principal axes frame
+  Eigen::Matrix3Xd vertices_;
+  Eigen::Matrix3Xd projected_vertices_;
+
+  // Vertices projected along one principal axis that may be on their convex hull, and the hull itself
+  std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > hull_candidates_;
+  std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > hull_;
+
+  // Polygon of extreme points used to discard interior points
+  std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > polygon_;
+  std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > edge_normals_;
+  std::vector<double> edge_offsets_;
+};  // end class
+
+typedef boost::shared_ptr<MeshBoundingBox> MeshBoundingBoxPtr;
+typedef boost::shared_ptr<const MeshBoundingBox> MeshBoundingBoxConstPtr;
+
+}  // namespace
+
+#endif
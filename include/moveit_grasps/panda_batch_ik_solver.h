@@ -0,0 +1,136 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Closed form inverse kinematics of the Franka Emika Panda arm for batches of poses
+*/
+
+#ifndef MOVEIT_GRASPS__PANDA_BATCH_IK_SOLVER_
+#define MOVEIT_GRASPS__PANDA_BATCH_IK_SOLVER_
+
+// moveit_grasps
+#include <moveit_grasps/batch_ik_solver.h>
+
+// MoveIt
+#include <moveit/robot_state/robot_state.h>
+
+namespace moveit_grasps
+{
+/**
+ * \brief Analytic IK of the 7-DOF Panda. The redundancy is resolved by sampling the last joint, starting at its seed
+ *        value and stepping outwards. For a fixed last joint the remaining six joints have up to eight closed form
+ *        solutions, which are passed to the callback ordered by their distance to the seed. A batch is solved one
+ *        redundancy step at a time for all of its poses, so the pose data stays in cache and the easy poses finish
+ *        after the first step
+ */
+class PandaBatchIKSolver : public BatchIKSolver
+{
+public:
+  static const std::size_t NUM_JOINTS = 7;
+
+  // Most solutions of a pose for one value of the last joint
+  static const std::size_t MAX_SOLUTIONS = 8;
+
+  /**
+   * \brief Constructor
+   * \param redundancy_step - step in radians between samples of the last joint
+   */
+  PandaBatchIKSolver(double redundancy_step = 0.05);
+
+  /**
+   * \brief Check that an arm group is a Panda by comparing the analytic FK with the robot model, and read its joint
+   *        limits and the offset of the tip frame from the flange
+   * \param robot_state - state of the robot model, not modified
+   * \param arm_jmg - the arm, with its seven joints in order from the base
+   * \param base_frame - frame the target poses are expressed in
+   * \param tip_frame - frame the target poses are given for, rigidly attached to the flange
+   * \return true if the analytic model matches the arm
+   */
+  bool initialize(const moveit::core::RobotState& robot_state, const robot_model::JointModelGroup* arm_jmg,
+                  const std::string& base_frame, const std::string& tip_frame);
+
+  std::size_t solve(const EigenSTL::vector_Affine3d& ik_poses, const std::vector<std::vector<double> >& ik_seeds,
+                    double timeout, const BatchIKCallbackFn& solution_callback,
+                    std::vector<std::vector<double> >& ik_solutions,
+                    std::vector<moveit_msgs::MoveItErrorCodes>& error_codes);
+
+  std::string getName() const;
+
+  /**
+   * \brief Pose of the flange (panda_link8) in the base frame (panda_link0)
+   * \param joints - the seven joint values
+   */
+  static Eigen::Affine3d computeFlangePose(const double* joints);
+
+  /**
+   * \brief All solutions within the joint limits for one value of the last joint
+   * \param flange_pose - target pose of the flange in the base frame
+   * \param q7 - value of the last joint
+   * \param seed - used for the first joint at the shoulder singularity
+   * \param solutions - room for MAX_SOLUTIONS * NUM_JOINTS values, filled one solution after the other
+   * \return number of solutions
+   */
+  std::size_t solveFixedRedundancy(const Eigen::Affine3d& flange_pose, double q7, const double* seed,
+                                   double* solutions) const;
+
+private:
+  /**
+   * \brief Add a solution if all joints can be brought into their limits
+   * \return number of solutions afterwards
+   */
+  std::size_t addSolution(double* joints, double* solutions, std::size_t num_solutions) const;
+
+  double redundancy_step_;
+
+  // Joint limits
+  double lower_[NUM_JOINTS];
+  double upper_[NUM_JOINTS];
+
+  // Transform from the tip frame to the flange
+  Eigen::Affine3d tip_to_flange_;
+
+  // Scratch memory, kept between batches
+  EigenSTL::vector_Affine3d flange_poses_;
+  std::vector<std::size_t> pending_;
+  std::vector<double> solutions_;
+  std::vector<std::size_t> solution_order_;
+  std::vector<double> solution_distances_;
+  std::vector<double> solution_;
+};
+typedef boost::shared_ptr<PandaBatchIKSolver> PandaBatchIKSolverPtr;
+typedef boost::shared_ptr<const PandaBatchIKSolver> PandaBatchIKSolverConstPtr;
+
+}  // end namespace
+
+#endif
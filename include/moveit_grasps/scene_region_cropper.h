@@ -0,0 +1,114 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Crop a planning scene to the region an arm can sweep through while reaching its grasps
+*/
+
+#ifndef MOVEIT_GRASPS__SCENE_REGION_CROPPER_
+#define MOVEIT_GRASPS__SCENE_REGION_CROPPER_
+
+// ROS
+#include <ros/ros.h>
+
+// MoveIt
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/planning_scene/planning_scene.h>
+
+// geometric_shapes
+#include <geometric_shapes/shapes.h>
+
+namespace moveit_grasps
+{
+/**
+ * \brief A scene holds the whole cell, including large octomaps, while the arm reaching for one object only touches a
+ *        small part of it. This class bounds that part by a box around the arm base and the grasp targets, padded by a
+ *        margin for links that bulge out of it such as the elbow, and creates a scene without the collision objects
+ *        and octomap voxels outside of it. The margin has to cover the arm, otherwise collisions are missed
+ */
+class SceneRegionCropper
+{
+public:
+  /**
+   * \brief Constructor
+   * \param margin - distance in meters the arm may reach outside of the box around its base and targets
+   */
+  SceneRegionCropper(double margin = 0.3);
+
+  /**
+   * \brief Bound the region an arm sweeps through while moving to target positions
+   * \param robot_state - state used to locate the arm base
+   * \param arm_jmg - the arm, its base is the parent link of its first joint
+   * \param targets - positions of the end effector in the planning frame, e.g. grasp and pregrasp poses
+   * \return the box around the arm base and the targets, padded by the margin
+   */
+  Eigen::AlignedBox3d computeReachRegion(const robot_state::RobotState& robot_state,
+                                         const robot_model::JointModelGroup* arm_jmg,
+                                         const EigenSTL::vector_Vector3d& targets) const;
+
+  /**
+   * \brief Create a diff of a scene that keeps only the collision objects and octomap voxels intersecting a region.
+   *        Planes are unbounded and always kept, attached objects move with the robot and are not touched
+   * \param planning_scene - the full scene
+   * \param region - box in the planning frame, e.g. from computeReachRegion()
+   * \return the cropped scene
+   */
+  planning_scene::PlanningScenePtr cropScene(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                             const Eigen::AlignedBox3d& region) const;
+
+  /**
+   * \brief Copy the occupied voxels of an octomap that intersect a region
+   * \param octree_shape - octomap to crop
+   * \param pose - pose of the octomap in the planning frame
+   * \param region - box in the planning frame
+   * \return the cropped octomap, or NULL if no occupied voxel intersects the region
+   */
+  static shapes::ShapeConstPtr cropOcTree(const shapes::OcTree& octree_shape, const Eigen::Affine3d& pose,
+                                          const Eigen::AlignedBox3d& region);
+
+  double getMargin() const
+  {
+    return margin_;
+  }
+
+private:
+  double margin_;
+};  // end class
+
+typedef boost::shared_ptr<SceneRegionCropper> SceneRegionCropperPtr;
+typedef boost::shared_ptr<const SceneRegionCropper> SceneRegionCropperConstPtr;
+
+}  // namespace
+
+#endif
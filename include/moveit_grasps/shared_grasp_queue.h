@@ -0,0 +1,284 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Queue of grasps in shared memory, for filtering grasps in worker processes
+*/
+
+#ifndef MOVEIT_GRASPS__SHARED_GRASP_QUEUE_
+#define MOVEIT_GRASPS__SHARED_GRASP_QUEUE_
+
+// ROS
+#include <ros/ros.h>
+
+// moveit_grasps
+#include <moveit_grasps/grasp_candidate.h>
+
+// Boost
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+// C++
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace moveit_grasps
+{
+// Shared memory can not hold dynamic containers
+static const std::size_t SHARED_MAX_JOINTS = 16;
+static const std::size_t SHARED_MAX_NAME_LENGTH = 64;
+static const std::size_t SHARED_MAX_WORKERS = 64;
+
+/**
+ * \brief One grasp to filter, written by the coordinator and filled in by a worker
+ */
+struct SharedGraspTask
+{
+  // Request
+  double grasp_pose_[7];          // position and quaternion x, y, z, w in the base link frame of the grasp data
+  double approach_direction_[3];  // in the same frame as the grasp pose
+  double approach_distance_;
+  double pre_grasp_posture_[SHARED_MAX_JOINTS];  // open end effector positions
+  double grasp_posture_[SHARED_MAX_JOINTS];      // closed end effector positions
+  uint32_t num_posture_joints_;
+
+  // Worker that claimed the task, 0 if none. Only the claiming worker can finish it
+  uint64_t claim_worker_;
+
+  // Result
+  uint8_t done_;
+  uint8_t grasp_filtered_by_ik_;
+  uint8_t grasp_filtered_by_ik_closed_;
+  uint8_t pregrasp_filtered_by_ik_;
+  uint8_t grasp_skipped_by_predictor_;
+  uint8_t ik_timed_out_;
+  uint32_t num_grasp_ik_joints_;
+  uint32_t num_pregrasp_ik_joints_;
+  double grasp_ik_solution_[SHARED_MAX_JOINTS];
+  double pregrasp_ik_solution_[SHARED_MAX_JOINTS];
+};
+
+/**
+ * \brief Write the request of a task for a grasp candidate
+ * \return false if the end effector has too many joints
+ */
+bool writeGraspTask(const GraspCandidatePtr& grasp_candidate, SharedGraspTask& task);
+
+/**
+ * \brief Create a grasp candidate from the request of a task
+ * \param grasp_data - the end effector the task was written for
+ */
+GraspCandidatePtr readGraspTask(const SharedGraspTask& task, const GraspDataPtr& grasp_data);
+
+/**
+ * \brief Write the filter results and IK solutions of a grasp candidate to its task
+ */
+void writeGraspTaskResult(const GraspCandidatePtr& grasp_candidate, SharedGraspTask& task);
+
+/**
+ * \brief Copy the filter results and IK solutions of a task to its grasp candidate
+ */
+void readGraspTaskResult(const SharedGraspTask& task, GraspCandidatePtr& grasp_candidate);
+
+/**
+ * \brief Settings shared by all tasks of a batch
+ */
+struct SharedGraspBatch
+{
+  uint64_t batch_id_;
+  uint64_t scene_version_;
+  char arm_name_[SHARED_MAX_NAME_LENGTH];
+  uint8_t filter_pregrasp_;
+  double ik_timeout_;
+  double seed_state_[SHARED_MAX_JOINTS];
+  uint32_t num_seed_joints_;
+  uint32_t num_tasks_;
+};
+
+/**
+ * \brief A fixed number of task slots in shared memory, reused by every batch. The coordinator writes a batch of
+ *        tasks and waits, worker processes claim chunks of it, fill in the results and report them done. Workers
+ *        only need a scene copy of the batch's scene version, see WorkerScenePublisher.
+ *        Every worker holds a lease that a thread of its process renews. The lock is robust and the lease of a
+ *        worker that crashes expires, which hands its unfinished tasks to the other workers and drops it from the
+ *        worker count. A restarted coordinator replaces the shared memory with one of a new generation, which
+ *        workers detect with isCurrent() to reattach
+ */
+class SharedGraspQueue
+{
+public:
+  SharedGraspQueue();
+
+  /**
+   * \brief Destructor, removes the shared memory if it was created by this queue
+   */
+  ~SharedGraspQueue();
+
+  /**
+   * \brief Create the shared memory as coordinator, replacing a leftover one of the same name
+   * \param name - name of the shared memory object
+   * \param capacity - maximum number of tasks per batch
+   * \param lease_timeout - time in seconds after which a worker that stopped renewing its lease is dropped
+   * \return true on success
+   */
+  bool create(const std::string& name, std::size_t capacity, double lease_timeout = 1.0);
+
+  /**
+   * \brief Open shared memory created by a coordinator, as worker, and start renewing the lease of the worker
+   * \return true on success, false if the queue does not exist or has no free worker slot
+   */
+  bool open(const std::string& name);
+
+  /**
+   * \brief Unmap the shared memory, and remove it if it was created by this queue. A worker hands its unfinished
+   *        tasks back
+   */
+  void close();
+
+  /**
+   * \brief Check whether the shared memory of this name is still the one that was opened, workers reopen the queue
+   *        otherwise
+   * \return false if the queue is closed, its coordinator removed or replaced the shared memory, or the lease of
+   *         this worker expired
+   */
+  bool isCurrent() const;
+
+  std::size_t getCapacity() const;
+
+  /**
+   * \brief Number of workers that opened the queue and have not closed it yet, without those whose lease expired
+   */
+  std::size_t getNumWorkers();
+
+  SharedGraspTask& getTask(std::size_t task_id)
+  {
+    return tasks_[task_id];
+  }
+
+  /**
+   * \brief Hand out the first batch.num_tasks_ tasks to the workers
+   * \param batch - settings of the batch, its id is assigned here
+   */
+  void submitBatch(SharedGraspBatch& batch);
+
+  /**
+   * \brief Wait until the workers finished all tasks of the current batch. Tasks of workers whose lease expires
+   *        meanwhile are handed to the others
+   * \param timeout - maximum time to wait in seconds
+   * \return true if all tasks are done, false on timeout
+   */
+  bool waitForBatch(double timeout);
+
+  /**
+   * \brief Stop handing out and accepting tasks of the current batch, after which its results can be read. Tasks
+   *        that are not done, e.g. after a timeout, have done_ unset
+   */
+  void closeBatch();
+
+  /**
+   * \brief Check and reset whether a worker asked for the complete scene
+   */
+  bool takeSceneRequest();
+
+  /**
+   * \brief Wait until the current batch has tasks that were not claimed yet
+   * \param batch - settings of that batch
+   * \param timeout - maximum time to wait in seconds
+   * \return true if there are tasks
+   */
+  bool waitForTasks(SharedGraspBatch& batch, double timeout);
+
+  /**
+   * \brief Claim a chunk of the tasks of a batch, first the unclaimed ones, then those of expired workers
+   * \param begin - id of the first claimed task
+   * \param tasks - copy of the claimed tasks
+   * \return false if the batch was replaced, closed or has no tasks left, or the lease of this worker expired
+   */
+  bool claimTasks(uint64_t batch_id, std::size_t max_tasks, std::size_t& begin, std::vector<SharedGraspTask>& tasks);
+
+  /**
+   * \brief Write the results of claimed tasks, unless their batch was closed or the tasks were handed to another
+   *        worker in the meantime
+   * \param begin - id of the first claimed task
+   * \param tasks - the claimed tasks with their results
+   */
+  void finishTasks(uint64_t batch_id, std::size_t begin, const std::vector<SharedGraspTask>& tasks);
+
+  /**
+   * \brief Ask the coordinator to publish the complete scene, e.g. after missing a scene diff
+   */
+  void requestScene();
+
+private:
+  struct Header;
+
+  static std::size_t getTasksOffset();
+
+  /**
+   * \brief Renew the lease of this worker until interrupted
+   */
+  void renewLease();
+
+  /**
+   * \brief Drop the workers whose lease expired, the lock must be held
+   */
+  void expireWorkers();
+
+  /**
+   * \brief Hand the unfinished tasks of a worker back and free its slot, the lock must be held
+   */
+  void releaseWorker(std::size_t slot);
+
+  boost::scoped_ptr<boost::interprocess::mapped_region> region_;
+  Header* header_;
+  SharedGraspTask* tasks_;
+  uint64_t generation_;
+
+  // Lease of a worker
+  std::size_t slot_;
+  uint64_t worker_id_;
+  boost::scoped_ptr<boost::thread> lease_thread_;
+
+  std::string name_;
+  bool owner_;
+};  // end class
+
+typedef boost::shared_ptr<SharedGraspQueue> SharedGraspQueuePtr;
+typedef boost::shared_ptr<const SharedGraspQueue> SharedGraspQueueConstPtr;
+
+}  // namespace
+
+#endif
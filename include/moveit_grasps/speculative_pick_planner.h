@@ -0,0 +1,190 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Plan the free space motion to several of the best grasps at once and keep the first or best pick plan
+*/
+
+#ifndef MOVEIT_GRASPS__SPECULATIVE_PICK_PLANNER_
+#define MOVEIT_GRASPS__SPECULATIVE_PICK_PLANNER_
+
+// ROS
+#include <ros/ros.h>
+
+// moveit_grasps
+#include <moveit_grasps/grasp_planner.h>
+#include <moveit_grasps/worker_thread_config.h>
+
+// MoveIt
+#include <moveit/planning_pipeline/planning_pipeline.h>
+#include <moveit/planning_interface/planning_interface.h>
+#include <moveit/planning_request_adapter/planning_request_adapter.h>
+
+// ROS
+#include <pluginlib/class_loader.h>
+
+// C++
+#include <boost/thread.hpp>
+
+namespace moveit_grasps
+{
+/**
+ * \brief A complete pick: the free space motion to the pregrasp, then the cartesian approach, lift and retreat stored
+ *        in the grasp candidate
+ */
+struct PickPlan
+{
+  GraspCandidatePtr grasp_candidate_;
+  planning_interface::MotionPlanResponse pre_approach_plan_;
+
+  // Position of the grasp in the ranked candidates
+  std::size_t rank_;
+};
+
+/**
+ * \brief Plans the cartesian paths of ranked grasps one after the other in the calling thread, and starts a free space
+ *        plan to the pregrasp of every cartesian feasible grasp in its own thread, up to max_speculative_plans at a
+ *        time. A failing grasp then only delays the result if no other plan succeeds. Once a pick plan is chosen the
+ *        remaining planners are terminated. All planners share one read only planning scene. The free space requests
+ *        pass through the request adapters of the planning pipeline, e.g. to fix the start state or add time stamps,
+ *        and each planning context is created from the adapted request in its thread
+ */
+class SpeculativePickPlanner
+{
+public:
+  /**
+   * \brief Constructor
+   * \param grasp_planner - plans the cartesian paths, only used from the calling thread
+   * \param planning_pipeline - provides the planner for the free space motions
+   */
+  SpeculativePickPlanner(const GraspPlannerPtr& grasp_planner,
+                         const planning_pipeline::PlanningPipelinePtr& planning_pipeline);
+
+  virtual ~SpeculativePickPlanner()
+  {
+  }
+
+  /**
+   * \brief Find a pick plan for one of the grasps
+   * \param grasp_candidates - valid grasps with IK solutions, ranked best first
+   * \param start_state - state of the robot the free space motion starts from
+   * \param planning_scene - snapshot of the scene, not modified while planning
+   * \param pick_plan - the chosen plan
+   * \return true if a plan was found
+   */
+  bool planPick(const std::vector<GraspCandidatePtr>& grasp_candidates, const moveit::core::RobotState& start_state,
+                const planning_scene::PlanningSceneConstPtr& planning_scene, PickPlan& pick_plan);
+
+protected:
+  // A free space plan running in its own thread
+  struct Speculation
+  {
+    GraspCandidatePtr grasp_candidate_;
+    std::size_t rank_;
+    planning_scene::PlanningSceneConstPtr planning_scene_;
+    planning_interface::MotionPlanRequest request_;
+    planning_interface::PlanningContextPtr planning_context_;  // created by the planner thread unless given
+    planning_interface::MotionPlanResponse response_;
+    boost::shared_ptr<boost::thread> thread_;
+    std::size_t worker_id_;
+    bool done_;
+    bool success_;
+    bool terminated_;
+  };
+  typedef boost::shared_ptr<Speculation> SpeculationPtr;
+
+  /**
+   * \brief Plan the cartesian path of a grasp and set up the request of its free space planner. Overridden in the
+   *        tests to run stub planners, by setting the planning context
+   * \return the speculation, not started yet, or NULL if the grasp is not feasible
+   */
+  virtual SpeculationPtr createSpeculation(const GraspCandidatePtr& grasp_candidate, std::size_t rank,
+                                           const moveit::core::RobotState& start_state,
+                                           const planning_scene::PlanningSceneConstPtr& planning_scene);
+
+  /**
+   * \brief Choose a finished plan if one can be chosen now
+   * \param speculations - all speculations ordered by rank
+   * \param deadline_passed - whether to settle for the best finished plan
+   * \return the chosen speculation, or NULL to keep waiting
+   */
+  SpeculationPtr chooseSpeculation(const std::vector<SpeculationPtr>& speculations, bool deadline_passed) const;
+
+private:
+  /**
+   * \brief Thread function running the free space planner of a speculation
+   */
+  void solveSpeculation(const SpeculationPtr& speculation);
+
+  /**
+   * \brief Apply the request adapters from adapter_id on and solve the adapted request
+   */
+  bool adaptAndSolve(const SpeculationPtr& speculation, std::size_t adapter_id,
+                     const planning_scene::PlanningSceneConstPtr& planning_scene,
+                     const planning_interface::MotionPlanRequest& req, planning_interface::MotionPlanResponse& res);
+
+  // A shared node handle
+  ros::NodeHandle nh_;
+
+  GraspPlannerPtr grasp_planner_;
+  planning_pipeline::PlanningPipelinePtr planning_pipeline_;
+
+  // The request adapters of the pipeline, loaded again since the pipeline only applies them around its own contexts
+  boost::shared_ptr<pluginlib::ClassLoader<planning_request_adapter::PlanningRequestAdapter> > adapter_plugin_loader_;
+  std::vector<planning_request_adapter::PlanningRequestAdapterConstPtr> planning_adapters_;
+
+  // Settings
+  int max_speculative_plans_;
+  bool wait_for_better_ranked_;
+  double deadline_;
+  double planning_time_;
+  int planning_attempts_;
+  std::string planner_id_;
+  double goal_tolerance_;
+
+  // CPUs and scheduling of the planner threads, which the threads of the planners inherit
+  WorkerThreadConfig worker_thread_config_;
+
+  // Signals finished speculations to the calling thread
+  boost::mutex speculation_mutex_;
+  boost::condition_variable speculation_done_;
+};
+
+// Create boost pointers for this class
+typedef boost::shared_ptr<SpeculativePickPlanner> SpeculativePickPlannerPtr;
+typedef boost::shared_ptr<const SpeculativePickPlanner> SpeculativePickPlannerConstPtr;
+
+}  // end namespace
+
+#endif
@@ -39,11 +39,52 @@
 #ifndef MOVEIT_GRASPS__STATE_VALIDITY_CALLBACK
 #define MOVEIT_GRASPS__STATE_VALIDITY_CALLBACK
 
+#include <moveit_grasps/coarse_collision_checker.h>
+#include <moveit_grasps/grasp_diagnostics.h>
+#include <moveit_grasps/static_distance_field.h>
+
 namespace
 {
-bool isGraspStateValid(const planning_scene::PlanningScene* planning_scene, bool verbose, double verbose_speed,
-                       moveit_visual_tools::MoveItVisualToolsPtr visual_tools, robot_state::RobotState* robot_state,
-                       const robot_state::JointModelGroup* group, const double* ik_solution)
+// Remember the contacts of the first colliding state, the check with contacts costs about as much as the one before
+void recordCollision(const planning_scene::PlanningScene* planning_scene, const robot_state::RobotState& robot_state,
+                     const robot_state::JointModelGroup* group, bool static_collision,
+                     moveit_grasps::CollisionDiagnostics* collision_diagnostics)
+{
+  if (!collision_diagnostics || collision_diagnostics->num_rejected_states_++ > 0)
+    return;
+  robot_state.copyJointGroupPositions(group, collision_diagnostics->rejected_positions_);
+
+  // The distance field only knows that some static object is too close
+  if (static_collision)
+  {
+    collision_diagnostics->contact_pairs_.push_back(std::make_pair(group->getName(), std::string("static objects")));
+    return;
+  }
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  req.group_name = group->getName();
+  req.contacts = true;
+  req.max_contacts = 10;
+  req.max_contacts_per_pair = 1;
+  planning_scene->checkCollision(req, res, robot_state);
+  for (collision_detection::CollisionResult::ContactMap::const_iterator contact_it = res.contacts.begin();
+       contact_it != res.contacts.end(); ++contact_it)
+  {
+    collision_diagnostics->contact_pairs_.push_back(contact_it->first);
+    for (std::size_t i = 0; i < contact_it->second.size(); ++i)
+      collision_diagnostics->contact_points_.push_back(contact_it->second[i].pos);
+  }
+}
+
+// Same as isGraspStateValid, also recording the first collision if collision_diagnostics is given
+bool isGraspStateValidRecorded(const planning_scene::PlanningScene* planning_scene,
+                               const moveit_grasps::CoarseCollisionChecker* coarse_collision_checker,
+                               const moveit_grasps::StaticDistanceField* static_distance_field, bool verbose,
+                               double verbose_speed, moveit_visual_tools::MoveItVisualToolsPtr visual_tools,
+                               moveit_grasps::CollisionDiagnostics* collision_diagnostics,
+                               robot_state::RobotState* robot_state, const robot_state::JointModelGroup* group,
+                               const double* ik_solution)
 {
   robot_state->setJointGroupPositions(group, ik_solution);
   robot_state->update();
@@ -53,8 +94,47 @@ bool isGraspStateValid(const planning_scene::PlanningScene* planning_scene, bool
     ROS_ERROR_STREAM_NAMED("manipulation", "No planning scene provided");
     return false;
   }
+
+  // Static objects are only in the distance field, the planning scene holds everything else
+  if (static_distance_field && static_distance_field->isStateColliding(*robot_state, group))
+  {
+    recordCollision(planning_scene, *robot_state, group, true, collision_diagnostics);
+    if (verbose)
+    {
+      ROS_INFO_STREAM_NAMED("manipulation", "State is in collision with static objects");
+      visual_tools->publishRobotState(*robot_state, rviz_visual_tools::RED);
+      visual_tools->trigger();
+      ros::Duration(verbose_speed).sleep();
+    }
+    return false;
+  }
+
+  // Resolve states far from or deep inside obstacles without the meshes, verbose mode always shows the exact check
+  if (coarse_collision_checker && !verbose)
+  {
+    switch (coarse_collision_checker->checkWorldCollision(*robot_state, group))
+    {
+      case moveit_grasps::COARSE_COLLIDING:
+        recordCollision(planning_scene, *robot_state, group, false, collision_diagnostics);
+        return false;
+      case moveit_grasps::COARSE_CLEAR:
+      {
+        collision_detection::CollisionRequest req;
+        collision_detection::CollisionResult res;
+        req.group_name = group->getName();
+        planning_scene->checkSelfCollision(req, res, *robot_state);
+        if (res.collision)
+          recordCollision(planning_scene, *robot_state, group, false, collision_diagnostics);
+        return !res.collision;
+      }
+      case moveit_grasps::COARSE_UNKNOWN:
+        break;
+    }
+  }
+
   if (!planning_scene->isStateColliding(*robot_state, group->getName()))
     return true;  // not in collision
+  recordCollision(planning_scene, *robot_state, group, false, collision_diagnostics);
 
   // Display more info about the collision
   if (verbose)
@@ -68,6 +148,17 @@ bool isGraspStateValid(const planning_scene::PlanningScene* planning_scene, bool
   return false;
 }
 
+bool isGraspStateValid(const planning_scene::PlanningScene* planning_scene,
+                       const moveit_grasps::CoarseCollisionChecker* coarse_collision_checker,
+                       const moveit_grasps::StaticDistanceField* static_distance_field, bool verbose,
+                       double verbose_speed, moveit_visual_tools::MoveItVisualToolsPtr visual_tools,
+                       robot_state::RobotState* robot_state, const robot_state::JointModelGroup* group,
+                       const double* ik_solution)
+{
+  return isGraspStateValidRecorded(planning_scene, coarse_collision_checker, static_distance_field, verbose,
+                                   verbose_speed, visual_tools, NULL, robot_state, group, ik_solution);
+}
+
 }  // namespace
 
 #endif
@@ -0,0 +1,138 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Precomputed distance field of static collision objects, checked against sphere sets of the arm links
+*/
+
+#ifndef MOVEIT_GRASPS__STATIC_DISTANCE_FIELD_
+#define MOVEIT_GRASPS__STATIC_DISTANCE_FIELD_
+
+// ROS
+#include <ros/ros.h>
+
+// MoveIt
+#include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit/distance_field/propagation_distance_field.h>
+
+namespace moveit_grasps
+{
+/**
+ * \brief Shelves and totes stay put for hours, yet every exact collision check traverses their meshes again. This
+ *        class voxelizes the static collision objects into a distance field once per scene version, and represents
+ *        every link by a set of spheres, so that checking the static world costs one lookup per sphere. All other
+ *        objects remain in a dynamic scene for the exact checks.
+ *        The spheres and voxels are conservative, so the field is only a pre-filter: states it reports within one
+ *        voxel of a static object are confirmed by an exact check against a scene holding only the static objects
+ */
+class StaticDistanceField
+{
+public:
+  /**
+   * \brief Constructor
+   * \param robot_model - the robot whose links are decomposed into spheres
+   * \param static_object_ids - ids of the collision objects that rarely move
+   * \param resolution - voxel size of the distance field in meters
+   * \param padding - extra distance in meters every sphere must keep from static objects
+   */
+  StaticDistanceField(const robot_model::RobotModelConstPtr& robot_model,
+                      const std::vector<std::string>& static_object_ids, double resolution = 0.02,
+                      double padding = 0.0);
+
+  /**
+   * \brief Rebuild the distance field if the static objects of a planning scene changed
+   * \return true if the field was rebuilt
+   */
+  bool update(const planning_scene::PlanningScene& planning_scene);
+
+  /**
+   * \brief Create a scene without the objects in the distance field, for exact checks of everything else
+   * \param planning_scene - the full scene, that has been passed to update()
+   */
+  planning_scene::PlanningScenePtr getDynamicScene(const planning_scene::PlanningSceneConstPtr& planning_scene) const;
+
+  /**
+   * \brief Check the links moved by a group against the static objects. Spheres that come close to a static object
+   *        are only a hint, the state is then checked exactly against the static objects
+   * \param robot_state - state with updated link transforms
+   * \param group - only links updated by this group are checked, like PlanningScene::isStateColliding()
+   * \return true if in collision
+   */
+  bool isStateColliding(const robot_state::RobotState& robot_state, const robot_model::JointModelGroup* group) const;
+
+  /**
+   * \brief Ids of the objects in the distance field, without those the allowed collision matrix lets the robot touch
+   */
+  const std::vector<std::string>& getFieldObjectIds() const
+  {
+    return field_object_ids_;
+  }
+
+private:
+  // Spheres covering the bounding box of every link, indexed by link index, in the link frame
+  struct LinkSpheres
+  {
+    EigenSTL::vector_Vector3d centers_;
+    std::vector<double> radii_;
+  };
+  void computeLinkSpheres(const robot_model::RobotModelConstPtr& robot_model);
+
+  // Exact check of the links moved by a group against the static scene
+  bool isStateCollidingExact(const robot_state::RobotState& robot_state,
+                             const robot_model::JointModelGroup* group) const;
+
+  std::vector<LinkSpheres> link_spheres_;
+  double max_sphere_radius_;
+
+  std::vector<std::string> static_object_ids_;
+  double resolution_;
+  double padding_;
+
+  // Field of the static objects at the last update
+  boost::shared_ptr<distance_field::PropagationDistanceField> distance_field_;
+  std::vector<std::string> field_object_ids_;
+  std::map<std::string, collision_detection::World::ObjectConstPtr> field_objects_;
+
+  // Scene with only the objects in the field, to confirm hits of the spheres exactly
+  planning_scene::PlanningScenePtr static_scene_;
+};  // end class
+
+typedef boost::shared_ptr<StaticDistanceField> StaticDistanceFieldPtr;
+typedef boost::shared_ptr<const StaticDistanceField> StaticDistanceFieldConstPtr;
+
+}  // namespace
+
+#endif
@@ -0,0 +1,148 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Keep copies of a planning scene in worker processes in sync through versioned scene diffs
+*/
+
+#ifndef MOVEIT_GRASPS__WORKER_SCENE_SYNC_
+#define MOVEIT_GRASPS__WORKER_SCENE_SYNC_
+
+// ROS
+#include <ros/ros.h>
+#include <moveit_msgs/PlanningScene.h>
+
+// MoveIt
+#include <moveit/planning_scene/planning_scene.h>
+
+// Boost
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+// C++
+#include <map>
+#include <stdint.h>
+#include <string>
+
+namespace moveit_grasps
+{
+/**
+ * \brief Publishes a planning scene to the workers of a SharedGraspQueue. Every scene that differs from the previous
+ *        one gets a new version, and only the collision objects that changed are sent. Versions are the names of the
+ *        scene messages
+ */
+class WorkerScenePublisher
+{
+public:
+  /**
+   * \brief Constructor
+   * \param nh - node handle to advertise the topics on
+   * \param queue_name - name of the queue, used as namespace of the topics
+   */
+  WorkerScenePublisher(ros::NodeHandle& nh, const std::string& queue_name);
+
+  /**
+   * \brief Publish the changes since the previous scene, or the complete scene the first time
+   * \return version of the scene
+   */
+  uint64_t publishScene(const planning_scene::PlanningSceneConstPtr& planning_scene);
+
+  /**
+   * \brief Publish the complete scene of the current version, e.g. for a worker that missed a diff
+   */
+  void publishFullScene(const planning_scene::PlanningSceneConstPtr& planning_scene);
+
+  uint64_t getVersion() const
+  {
+    return version_;
+  }
+
+private:
+  ros::Publisher diff_pub_;
+  ros::Publisher full_pub_;
+
+  uint64_t version_;
+
+  // World objects as last published. Objects are copied when modified, so a changed pointer is a changed object
+  std::map<std::string, collision_detection::World::ObjectConstPtr> objects_;
+};  // end class
+
+typedef boost::shared_ptr<WorkerScenePublisher> WorkerScenePublisherPtr;
+typedef boost::shared_ptr<const WorkerScenePublisher> WorkerScenePublisherConstPtr;
+
+/**
+ * \brief Applies the scenes of a WorkerScenePublisher to a local planning scene
+ */
+class WorkerSceneSubscriber
+{
+public:
+  /**
+   * \brief Constructor
+   * \param nh - node handle to subscribe with, its callbacks must be spun by another thread
+   * \param queue_name - name of the queue, used as namespace of the topics
+   * \param planning_scene - the local copy of the scene
+   */
+  WorkerSceneSubscriber(ros::NodeHandle& nh, const std::string& queue_name,
+                        const planning_scene::PlanningScenePtr& planning_scene);
+
+  /**
+   * \brief Wait until the local scene has a version and copy it
+   * \param version - the version needed
+   * \param timeout - maximum time to wait in seconds
+   * \param planning_scene - copy of the local scene
+   * \return false on timeout, or right away if a diff was missed and the complete scene is needed
+   */
+  bool getScene(uint64_t version, double timeout, planning_scene::PlanningScenePtr& planning_scene);
+
+private:
+  void sceneDiffCallback(const moveit_msgs::PlanningScene::ConstPtr& msg);
+
+  void sceneCallback(const moveit_msgs::PlanningScene::ConstPtr& msg);
+
+  ros::Subscriber diff_sub_;
+  ros::Subscriber full_sub_;
+
+  boost::mutex mutex_;
+  boost::condition_variable scene_updated_;
+  planning_scene::PlanningScenePtr planning_scene_;
+  uint64_t version_;
+  bool out_of_sync_;
+};  // end class
+
+typedef boost::shared_ptr<WorkerSceneSubscriber> WorkerSceneSubscriberPtr;
+typedef boost::shared_ptr<const WorkerSceneSubscriber> WorkerSceneSubscriberConstPtr;
+
+}  // namespace
+
+#endif
@@ -0,0 +1,124 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   CPU affinity and scheduling of the filter and planner worker threads
+*/
+
+#ifndef MOVEIT_GRASPS__WORKER_THREAD_CONFIG_
+#define MOVEIT_GRASPS__WORKER_THREAD_CONFIG_
+
+// ROS
+#include <ros/ros.h>
+
+// C++
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <vector>
+
+namespace moveit_grasps
+{
+/**
+ * \brief Where and how the worker threads of a pool run. The workers can be restricted to a set of CPUs, for example
+ *        to keep them off cores isolated for a real-time control loop, each pinned to one CPU of the set, and run with
+ *        SCHED_FIFO or SCHED_OTHER. Nothing changes with the default configuration. Real-time priorities need
+ *        CAP_SYS_NICE or an rtprio limit, otherwise the scheduling is left as it is with a warning
+ */
+class WorkerThreadConfig
+{
+public:
+  /**
+   * \brief Constructor, leaves the threads as they are
+   */
+  WorkerThreadConfig();
+
+  /**
+   * \brief Load the configuration from the parameters thread_cpus, pin_threads, thread_scheduler and thread_priority
+   * \param nh - namespace of the parameters
+   * \return false if the parameters are invalid, the threads are then left as they are
+   */
+  bool load(const ros::NodeHandle& nh);
+
+  /**
+   * \brief Whether applying the configuration changes anything
+   */
+  bool isEnabled() const
+  {
+    return !allowed_cpus_.empty() || scheduler_policy_ != NO_POLICY;
+  }
+
+  /**
+   * \brief Largest useful number of workers, the number of allowed CPUs when they are restricted
+   * \param num_threads - number of workers wanted
+   */
+  std::size_t limitNumWorkers(std::size_t num_threads) const;
+
+  /**
+   * \brief Restrict the calling thread to the allowed CPUs, or pin it to one of them, and set its scheduling
+   * \param worker_id - index of the worker in its pool, chooses the CPU when pinning
+   * \return false if the system refused a setting
+   */
+  bool applyToCurrentThread(std::size_t worker_id) const;
+
+private:
+  static const int NO_POLICY = -1;
+
+  std::vector<int> allowed_cpus_;
+  bool pin_workers_;
+  int scheduler_policy_;
+  int priority_;
+};  // end class
+
+/**
+ * \brief Saves the CPU affinity and scheduling of the calling thread and restores them when destroyed. The thread
+ *        that starts an OpenMP pool becomes one of its workers, this keeps it from staying pinned afterwards
+ */
+class ScopedThreadSettings
+{
+public:
+  ScopedThreadSettings();
+  ~ScopedThreadSettings();
+
+private:
+  pthread_t thread_;
+  cpu_set_t cpu_set_;
+  int policy_;
+  sched_param param_;
+  bool saved_;
+};  // end class
+
+}  // namespace
+
+#endif
@@ -0,0 +1,290 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Precomputed approach orientations that reach each cell of the bins of a fixed shelf
+*/
+
+#include <moveit_grasps/approach_atlas.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+namespace
+{
+const char ATLAS_FILE_MAGIC[4] = { 'M', 'G', 'A', 'A' };
+const uint32_t ATLAS_FILE_VERSION = 1;
+
+template <typename T>
+void writeValue(std::ofstream& file, const T& value)
+{
+  file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readValue(std::ifstream& file, T& value)
+{
+  return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+}  // namespace
+
+namespace moveit_grasps
+{
+const std::size_t ApproachAtlas::MAX_DIRECTIONS;
+
+ApproachAtlas::ApproachAtlas(std::size_t num_directions)
+{
+  setDirections(num_directions);
+}
+
+std::size_t ApproachAtlas::addBin(const Eigen::Affine3d& world_to_bin, const Eigen::Vector3d& bin_size,
+                                  double resolution)
+{
+  Bin bin;
+  bin.world_to_bin_ = world_to_bin;
+  bin.bin_to_world_ = world_to_bin.inverse();
+  bin.size_ = bin_size.cwiseMax(0.0);
+  bin.resolution_ = resolution > 0 ? resolution : std::max(bin.size_.maxCoeff(), 1.0);
+
+  std::size_t num_cells = 1;
+  for (std::size_t i = 0; i < 3; ++i)
+  {
+    bin.num_cells_[i] = std::max(static_cast<std::size_t>(std::ceil(bin.size_[i] / bin.resolution_)), std::size_t(1));
+    num_cells *= bin.num_cells_[i];
+  }
+  bin.feasible_directions_.assign(num_cells, 0);
+
+  bins_.push_back(bin);
+  return bins_.size() - 1;
+}
+
+void ApproachAtlas::clear()
+{
+  bins_.clear();
+}
+
+void ApproachAtlas::setFeasible(std::size_t bin_id, std::size_t cell_id, std::size_t direction_id)
+{
+  bins_[bin_id].feasible_directions_[cell_id] |= uint64_t(1) << direction_id;
+}
+
+void ApproachAtlas::dilate()
+{
+  for (std::size_t bin_id = 0; bin_id < bins_.size(); ++bin_id)
+  {
+    Bin& bin = bins_[bin_id];
+    const std::vector<uint64_t> sampled = bin.feasible_directions_;
+    const long nx = bin.num_cells_[0], ny = bin.num_cells_[1], nz = bin.num_cells_[2];
+
+    for (long x = 0; x < nx; ++x)
+      for (long y = 0; y < ny; ++y)
+        for (long z = 0; z < nz; ++z)
+        {
+          uint64_t& feasible = bin.feasible_directions_[(x * ny + y) * nz + z];
+          for (long nbr_x = std::max(x - 1, 0L); nbr_x <= std::min(x + 1, nx - 1); ++nbr_x)
+            for (long nbr_y = std::max(y - 1, 0L); nbr_y <= std::min(y + 1, ny - 1); ++nbr_y)
+              for (long nbr_z = std::max(z - 1, 0L); nbr_z <= std::min(z + 1, nz - 1); ++nbr_z)
+                feasible |= sampled[(nbr_x * ny + nbr_y) * nz + nbr_z];
+        }
+  }
+}
+
+bool ApproachAtlas::isFeasible(const Eigen::Affine3d& grasp_pose) const
+{
+  for (std::size_t bin_id = 0; bin_id < bins_.size(); ++bin_id)
+  {
+    const Bin& bin = bins_[bin_id];
+    const Eigen::Vector3d position = bin.bin_to_world_ * grasp_pose.translation();
+    if ((position.array() < 0.0).any() || (position.array() > bin.size_.array()).any())
+      continue;
+
+    std::size_t cell_id = 0;
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+      const std::size_t index =
+          std::min(static_cast<std::size_t>(position[i] / bin.resolution_), bin.num_cells_[i] - 1);
+      cell_id = cell_id * bin.num_cells_[i] + index;
+    }
+
+    const std::size_t direction_id = getDirectionId(grasp_pose.rotation().col(2));
+    return bin.feasible_directions_[cell_id] & (uint64_t(1) << direction_id);
+  }
+
+  // The atlas knows nothing outside of its bins
+  return true;
+}
+
+std::size_t ApproachAtlas::getDirectionId(const Eigen::Vector3d& approach_direction) const
+{
+  std::size_t best_id = 0;
+  double best_alignment = -std::numeric_limits<double>::infinity();
+  for (std::size_t i = 0; i < directions_.size(); ++i)
+  {
+    const double alignment = directions_[i].dot(approach_direction);
+    if (alignment > best_alignment)
+    {
+      best_alignment = alignment;
+      best_id = i;
+    }
+  }
+  return best_id;
+}
+
+Eigen::Vector3d ApproachAtlas::getCellCenter(std::size_t bin_id, std::size_t cell_id) const
+{
+  const Bin& bin = bins_[bin_id];
+  Eigen::Vector3d center;
+  for (std::size_t i = 3; i-- > 0;)
+  {
+    const std::size_t index = cell_id % bin.num_cells_[i];
+    cell_id /= bin.num_cells_[i];
+    // The last cell may be cut off by the bin wall
+    center[i] = (index * bin.resolution_ + std::min((index + 1) * bin.resolution_, bin.size_[i])) / 2.0;
+  }
+  return bin.world_to_bin_ * center;
+}
+
+bool ApproachAtlas::save(const std::string& file_name) const
+{
+  std::ofstream file(file_name.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+  {
+    ROS_ERROR_STREAM_NAMED("approach_atlas", "Unable to open " << file_name << " for writing");
+    return false;
+  }
+
+  file.write(ATLAS_FILE_MAGIC, sizeof(ATLAS_FILE_MAGIC));
+  writeValue(file, ATLAS_FILE_VERSION);
+  writeValue(file, static_cast<uint32_t>(directions_.size()));
+  writeValue(file, static_cast<uint32_t>(bins_.size()));
+  for (std::size_t bin_id = 0; bin_id < bins_.size(); ++bin_id)
+  {
+    const Bin& bin = bins_[bin_id];
+    const Eigen::Vector3d translation = bin.world_to_bin_.translation();
+    const Eigen::Quaterniond rotation(bin.world_to_bin_.rotation());
+    for (std::size_t i = 0; i < 3; ++i)
+      writeValue(file, translation[i]);
+    for (std::size_t i = 0; i < 4; ++i)
+      writeValue(file, rotation.coeffs()[i]);
+    for (std::size_t i = 0; i < 3; ++i)
+      writeValue(file, bin.size_[i]);
+    writeValue(file, bin.resolution_);
+    file.write(reinterpret_cast<const char*>(bin.feasible_directions_.data()),
+               bin.feasible_directions_.size() * sizeof(uint64_t));
+  }
+
+  if (!file.good())
+  {
+    ROS_ERROR_STREAM_NAMED("approach_atlas", "Unable to write " << file_name);
+    return false;
+  }
+  return true;
+}
+
+bool ApproachAtlas::load(const std::string& file_name)
+{
+  std::ifstream file(file_name.c_str(), std::ios::in | std::ios::binary);
+  if (!file.is_open())
+  {
+    ROS_ERROR_STREAM_NAMED("approach_atlas", "Unable to open " << file_name << " for reading");
+    return false;
+  }
+
+  char magic[sizeof(ATLAS_FILE_MAGIC)];
+  uint32_t version, num_directions, num_bins;
+  if (!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), ATLAS_FILE_MAGIC) ||
+      !readValue(file, version) || version != ATLAS_FILE_VERSION || !readValue(file, num_directions) ||
+      num_directions == 0 || num_directions > MAX_DIRECTIONS || !readValue(file, num_bins))
+  {
+    ROS_ERROR_STREAM_NAMED("approach_atlas", file_name << " is not an approach atlas of version "
+                                                       << ATLAS_FILE_VERSION);
+    return false;
+  }
+
+  setDirections(num_directions);
+  clear();
+  for (std::size_t bin_id = 0; bin_id < num_bins; ++bin_id)
+  {
+    Eigen::Vector3d translation, bin_size;
+    Eigen::Quaterniond rotation;
+    double resolution;
+    bool success = true;
+    for (std::size_t i = 0; i < 3; ++i)
+      success &= readValue(file, translation[i]);
+    for (std::size_t i = 0; i < 4; ++i)
+      success &= readValue(file, rotation.coeffs()[i]);
+    for (std::size_t i = 0; i < 3; ++i)
+      success &= readValue(file, bin_size[i]);
+    success &= readValue(file, resolution);
+
+    if (success)
+    {
+      Eigen::Affine3d world_to_bin = Eigen::Translation3d(translation) * rotation.normalized();
+      const std::size_t new_bin_id = addBin(world_to_bin, bin_size, resolution);
+      std::vector<uint64_t>& feasible_directions = bins_[new_bin_id].feasible_directions_;
+      success = static_cast<bool>(file.read(reinterpret_cast<char*>(feasible_directions.data()),
+                                            feasible_directions.size() * sizeof(uint64_t)));
+    }
+    if (!success)
+    {
+      ROS_ERROR_STREAM_NAMED("approach_atlas", file_name << " ends in bin " << bin_id << " of " << num_bins);
+      clear();
+      return false;
+    }
+  }
+
+  ROS_DEBUG_STREAM_NAMED("approach_atlas", "Loaded " << num_bins << " bins with " << num_directions
+                                                     << " approach directions from " << file_name);
+  return true;
+}
+
+void ApproachAtlas::setDirections(std::size_t num_directions)
+{
+  num_directions = std::min(std::max(num_directions, std::size_t(1)), MAX_DIRECTIONS);
+
+  // Golden angle steps around the z-axis at evenly spaced heights
+  const double golden_angle = M_PI * (3.0 - std::sqrt(5.0));
+  directions_.resize(num_directions);
+  for (std::size_t i = 0; i < num_directions; ++i)
+  {
+    const double z = 1.0 - (2.0 * i + 1.0) / num_directions;
+    const double radius = std::sqrt(std::max(1.0 - z * z, 0.0));
+    directions_[i] = Eigen::Vector3d(radius * std::cos(golden_angle * i), radius * std::sin(golden_angle * i), z);
+  }
+}
+
+}  // end namespace
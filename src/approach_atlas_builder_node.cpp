@@ -0,0 +1,209 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Offline tool that records which approach directions succeed IK with the static shelf in each bin cell
+*/
+
+// ROS
+#include <ros/ros.h>
+
+// MoveIt
+#include <moveit/planning_scene_monitor/planning_scene_monitor.h>
+
+// Grasp
+#include <moveit_grasps/approach_atlas.h>
+#include <moveit_grasps/grasp_data.h>
+#include <moveit_grasps/grasp_filter.h>
+#include <moveit_grasps/grasp_generator.h>
+#include <moveit_visual_tools/moveit_visual_tools.h>
+
+// Parameter loading
+#include <rosparam_shortcuts/rosparam_shortcuts.h>
+
+// C++
+#include <map>
+
+int main(int argc, char* argv[])
+{
+  ros::init(argc, argv, "approach_atlas_builder");
+
+  ros::AsyncSpinner spinner(2);
+  spinner.start();
+
+  ros::NodeHandle nh("~");
+  const std::string parent_name = "approach_atlas_builder";  // for namespacing logging messages
+  std::string ee_group_name;
+  std::string planning_group_name;
+  std::string approach_atlas_file;
+  // Corner of each bin as x, y, z, roll, pitch, yaw and the size of its interior as x, y, z
+  std::vector<double> bin_poses;
+  std::vector<double> bin_sizes;
+  std::size_t error = 0;
+  error += !rosparam_shortcuts::get(parent_name, nh, "ee_group_name", ee_group_name);
+  error += !rosparam_shortcuts::get(parent_name, nh, "planning_group_name", planning_group_name);
+  error += !rosparam_shortcuts::get(parent_name, nh, "approach_atlas_file", approach_atlas_file);
+  error += !rosparam_shortcuts::get(parent_name, nh, "bin_poses", bin_poses);
+  error += !rosparam_shortcuts::get(parent_name, nh, "bin_sizes", bin_sizes);
+  rosparam_shortcuts::shutdownIfError(parent_name, error);
+
+  // Optional settings
+  double resolution;
+  int num_directions, num_rolls, cells_per_batch;
+  bool filter_pregrasp, dilate;
+  nh.param("resolution", resolution, 0.05);
+  nh.param("num_directions", num_directions, static_cast<int>(moveit_grasps::ApproachAtlas::MAX_DIRECTIONS));
+  nh.param("num_rolls", num_rolls, 4);
+  nh.param("cells_per_batch", cells_per_batch, 16);
+  nh.param("filter_pregrasp", filter_pregrasp, true);
+  nh.param("dilate", dilate, true);
+
+  if (bin_poses.size() % 6 != 0 || bin_sizes.size() % 3 != 0 || bin_poses.size() / 6 != bin_sizes.size() / 3)
+  {
+    ROS_ERROR_STREAM_NAMED(parent_name, "bin_poses needs 6 values and bin_sizes 3 values per bin");
+    return 1;
+  }
+
+  // Load the robot and the static shelf from move_group
+  planning_scene_monitor::PlanningSceneMonitorPtr planning_scene_monitor(
+      new planning_scene_monitor::PlanningSceneMonitor("robot_description"));
+  const robot_model::RobotModelConstPtr robot_model = planning_scene_monitor->getRobotModel();
+  if (!robot_model)
+  {
+    ROS_ERROR_STREAM_NAMED(parent_name, "Unable to load robot model");
+    return 1;
+  }
+  if (!planning_scene_monitor->requestPlanningSceneState())
+    ROS_WARN_STREAM_NAMED(parent_name, "Unable to get the planning scene from move_group, building without shelf");
+
+  const robot_model::JointModelGroup* arm_jmg = robot_model->getJointModelGroup(planning_group_name);
+  if (!arm_jmg)
+  {
+    ROS_ERROR_STREAM_NAMED(parent_name, "Unknown planning group " << planning_group_name);
+    return 1;
+  }
+
+  moveit_visual_tools::MoveItVisualToolsPtr visual_tools(
+      new moveit_visual_tools::MoveItVisualTools(robot_model->getModelFrame(), "/rviz_visual_tools",
+                                                 planning_scene_monitor));
+  visual_tools->loadSharedRobotState();
+
+  moveit_grasps::GraspDataPtr grasp_data(new moveit_grasps::GraspData(nh, ee_group_name, robot_model));
+  moveit_grasps::GraspGeneratorPtr grasp_generator(new moveit_grasps::GraspGenerator(visual_tools));
+  moveit_grasps::GraspFilterPtr grasp_filter(
+      new moveit_grasps::GraspFilter(visual_tools->getSharedRobotState(), visual_tools));
+
+  // Sample every grasp, even with an atlas configured for the generator
+  grasp_generator->setApproachAtlas(moveit_grasps::ApproachAtlasConstPtr());
+
+  moveit::core::RobotStatePtr seed_state;
+  {
+    planning_scene_monitor::LockedPlanningSceneRO scene(planning_scene_monitor);
+    seed_state.reset(new moveit::core::RobotState(scene->getCurrentState()));
+  }
+
+  moveit_grasps::ApproachAtlas atlas(std::max(num_directions, 1));
+  for (std::size_t i = 0; i < bin_poses.size() / 6; ++i)
+  {
+    const Eigen::Affine3d world_to_bin = Eigen::Translation3d(bin_poses[6 * i], bin_poses[6 * i + 1],
+                                                              bin_poses[6 * i + 2]) *
+                                         Eigen::AngleAxisd(bin_poses[6 * i + 5], Eigen::Vector3d::UnitZ()) *
+                                         Eigen::AngleAxisd(bin_poses[6 * i + 4], Eigen::Vector3d::UnitY()) *
+                                         Eigen::AngleAxisd(bin_poses[6 * i + 3], Eigen::Vector3d::UnitX());
+    atlas.addBin(world_to_bin, Eigen::Vector3d(bin_sizes[3 * i], bin_sizes[3 * i + 1], bin_sizes[3 * i + 2]),
+                 resolution);
+  }
+
+  const std::size_t batch_size = std::max(cells_per_batch, 1);
+  const std::size_t rolls = std::max(num_rolls, 1);
+  for (std::size_t bin_id = 0; bin_id < atlas.getNumBins() && ros::ok(); ++bin_id)
+  {
+    std::size_t num_feasible = 0;
+    for (std::size_t first_cell = 0; first_cell < atlas.getNumCells(bin_id) && ros::ok(); first_cell += batch_size)
+    {
+      const std::size_t end_cell = std::min(first_cell + batch_size, atlas.getNumCells(bin_id));
+
+      // Grasps at each cell center for every approach direction and roll about it
+      std::vector<moveit_grasps::GraspCandidatePtr> grasp_candidates;
+      std::vector<std::pair<std::size_t, std::size_t> > cell_directions;
+      for (std::size_t cell_id = first_cell; cell_id < end_cell; ++cell_id)
+        for (std::size_t direction_id = 0; direction_id < atlas.getDirections().size(); ++direction_id)
+          for (std::size_t roll = 0; roll < rolls; ++roll)
+          {
+            Eigen::Affine3d grasp_pose =
+                Eigen::Translation3d(atlas.getCellCenter(bin_id, cell_id)) *
+                Eigen::Quaterniond::FromTwoVectors(Eigen::Vector3d::UnitZ(), atlas.getDirections()[direction_id]) *
+                Eigen::AngleAxisd(2.0 * M_PI * roll / rolls, Eigen::Vector3d::UnitZ());
+            grasp_generator->addGrasp(grasp_pose, grasp_data, grasp_candidates, grasp_pose, Eigen::Vector3d::Zero(),
+                                      0.0);
+            cell_directions.resize(grasp_candidates.size(), std::make_pair(cell_id, direction_id));
+          }
+
+      if (grasp_candidates.empty())
+        continue;
+
+      // The filter may reorder the candidates
+      std::map<const moveit_grasps::GraspCandidate*, std::size_t> candidate_ids;
+      for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+        candidate_ids[grasp_candidates[i].get()] = i;
+
+      grasp_filter->filterGrasps(grasp_candidates, planning_scene_monitor, arm_jmg, seed_state, filter_pregrasp);
+
+      for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+      {
+        if (!grasp_candidates[i]->isValid())
+          continue;
+        const std::pair<std::size_t, std::size_t>& cell_direction =
+            cell_directions[candidate_ids[grasp_candidates[i].get()]];
+        atlas.setFeasible(bin_id, cell_direction.first, cell_direction.second);
+        ++num_feasible;
+      }
+    }
+
+    ROS_INFO_STREAM_NAMED(parent_name, "Bin " << bin_id << ": " << num_feasible << " feasible grasps in "
+                                              << atlas.getNumCells(bin_id) << " cells");
+  }
+
+  if (!ros::ok())
+    return 1;
+
+  if (dilate)
+    atlas.dilate();
+
+  if (!atlas.save(approach_atlas_file))
+    return 1;
+
+  ROS_INFO_STREAM_NAMED(parent_name, "Saved approach atlas to " << approach_atlas_file);
+  return 0;
+}
@@ -0,0 +1,117 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Solve inverse kinematics for many poses of one arm at once
+*/
+
+// moveit_grasps
+#include <moveit_grasps/batch_ik_solver.h>
+
+// Conversions
+#include <eigen_conversions/eigen_msg.h>
+
+namespace moveit_grasps
+{
+KinematicsPluginBatchIKSolver::KinematicsPluginBatchIKSolver(const kinematics::KinematicsBaseConstPtr& kin_solver,
+                                                             const robot_model::JointModelGroup* arm_jmg)
+  : kin_solver_(kin_solver), bijection_(arm_jmg->getKinematicsSolverJointBijection())
+{
+  solver_values_.resize(bijection_.size());
+  group_values_.resize(bijection_.size());
+}
+
+std::size_t KinematicsPluginBatchIKSolver::solve(const EigenSTL::vector_Affine3d& ik_poses,
+                                                 const std::vector<std::vector<double> >& ik_seeds, double timeout,
+                                                 const BatchIKCallbackFn& solution_callback,
+                                                 std::vector<std::vector<double> >& ik_solutions,
+                                                 std::vector<moveit_msgs::MoveItErrorCodes>& error_codes)
+{
+  ik_solutions.resize(ik_poses.size());
+  error_codes.resize(ik_poses.size());
+
+  std::size_t num_solved = 0;
+  geometry_msgs::Pose ik_pose;
+  for (std::size_t pose_id = 0; pose_id < ik_poses.size(); ++pose_id)
+  {
+    ik_solutions[pose_id].clear();
+    if (ik_seeds[pose_id].size() != bijection_.size())
+    {
+      ROS_ERROR_STREAM_NAMED("batch_ik_solver", "Seed of pose " << pose_id << " has " << ik_seeds[pose_id].size()
+                                                                << " values, expected " << bijection_.size());
+      error_codes[pose_id].val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+      continue;
+    }
+
+    // The plugin works in its own variable order
+    for (std::size_t i = 0; i < bijection_.size(); ++i)
+      solver_values_[i] = ik_seeds[pose_id][bijection_[i]];
+
+    kinematics::KinematicsBase::IKCallbackFn ik_callback_fn;
+    if (solution_callback)
+      ik_callback_fn = boost::bind(&KinematicsPluginBatchIKSolver::pluginCallback, this, boost::cref(solution_callback),
+                                   pose_id, _1, _2, _3);
+
+    tf::poseEigenToMsg(ik_poses[pose_id], ik_pose);
+    std::vector<double> solution;
+    kin_solver_->searchPositionIK(ik_pose, solver_values_, timeout, solution, ik_callback_fn, error_codes[pose_id]);
+    if (error_codes[pose_id].val != moveit_msgs::MoveItErrorCodes::SUCCESS)
+      continue;
+
+    ik_solutions[pose_id].resize(bijection_.size());
+    for (std::size_t i = 0; i < bijection_.size(); ++i)
+      ik_solutions[pose_id][bijection_[i]] = solution[i];
+    num_solved++;
+  }
+  return num_solved;
+}
+
+std::string KinematicsPluginBatchIKSolver::getName() const
+{
+  return "kinematics_plugin";
+}
+
+void KinematicsPluginBatchIKSolver::pluginCallback(const BatchIKCallbackFn& solution_callback, std::size_t pose_id,
+                                                   const geometry_msgs::Pose&, const std::vector<double>& ik_sol,
+                                                   moveit_msgs::MoveItErrorCodes& error_code)
+{
+  for (std::size_t i = 0; i < bijection_.size(); ++i)
+    group_values_[bijection_[i]] = ik_sol[i];
+  if (solution_callback(pose_id, group_values_))
+    error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+  else
+    error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+}
+
+}  // end namespace
@@ -0,0 +1,223 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Straight line end effector paths with a step size adapted to the joint motion and the clearance, solved
+           with Jacobian steps or IK
+*/
+
+// moveit_grasps
+#include <moveit_grasps/cartesian_interpolator.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace moveit_grasps
+{
+CartesianInterpolator::CartesianInterpolator(double min_step, double max_step, double max_joint_step,
+                                             double clearance_factor, bool jacobian_steps)
+  : min_step_(min_step)
+  , max_step_(max_step)
+  , max_joint_step_(max_joint_step)
+  , clearance_factor_(clearance_factor)
+  , jacobian_steps_(jacobian_steps)
+{
+}
+
+double CartesianInterpolator::computeCartesianPath(robot_state::RobotState* robot_state,
+                                                   const robot_model::JointModelGroup* group,
+                                                   std::vector<robot_state::RobotStatePtr>& trajectory,
+                                                   const robot_model::LinkModel* link, const Eigen::Affine3d& target,
+                                                   double jump_threshold,
+                                                   const moveit::core::GroupStateValidityCallbackFn& validity_callback,
+                                                   const planning_scene::PlanningScene* planning_scene) const
+{
+  robot_state->update();
+  trajectory.clear();
+  trajectory.push_back(robot_state::RobotStatePtr(new robot_state::RobotState(*robot_state)));
+
+  // Rotations in radians count like translations in meters, as in RobotState::computeCartesianPath()
+  const Eigen::Affine3d start_pose = robot_state->getGlobalLinkTransform(link);
+  const Eigen::Quaterniond start_rotation(start_pose.rotation());
+  const Eigen::Quaterniond target_rotation(target.rotation());
+  const double path_length = std::max((target.translation() - start_pose.translation()).norm(),
+                                      start_rotation.angularDistance(target_rotation));
+  if (path_length < std::numeric_limits<double>::epsilon())
+    return 1.0;
+
+  collision_detection::DistanceRequest distance_req;
+  if (planning_scene)
+  {
+    distance_req.group = group;
+    distance_req.enableGroup(planning_scene->getRobotModel());
+    distance_req.acm = &planning_scene->getAllowedCollisionMatrix();
+  }
+
+  std::vector<double> cartesian_steps;
+  std::vector<double> joint_steps;
+  double fraction = 0.0;
+  double step = std::min(min_step_ * 2.0, max_step_);
+  while (fraction < 1.0)
+  {
+    // Avoid a tiny last step from rounding errors
+    double next_fraction = fraction + step / path_length;
+    if (next_fraction > 1.0 - 1e-9)
+      next_fraction = 1.0;
+
+    Eigen::Affine3d pose(start_rotation.slerp(next_fraction, target_rotation));
+    pose.translation() = start_pose.translation() + next_fraction * (target.translation() - start_pose.translation());
+
+    robot_state::RobotStatePtr next_state(new robot_state::RobotState(*trajectory.back()));
+    bool found_ik = false;
+    if (jacobian_steps_ && computeJacobianStep(*next_state, group, link, pose))
+    {
+      std::vector<double> positions;
+      next_state->copyJointGroupPositions(group, positions);
+      found_ik = !validity_callback || validity_callback(next_state.get(), group, &positions[0]);
+    }
+    if (!found_ik)
+    {
+      *next_state = *trajectory.back();
+      found_ik = next_state->setFromIK(group, pose, link->getName(), 1, 0.0, validity_callback);
+    }
+    const double joint_step = found_ik ? trajectory.back()->distance(*next_state, group) : 0.0;
+
+    // Retry closer, unless the step cannot shrink further
+    if ((!found_ik || joint_step > max_joint_step_) && step > min_step_)
+    {
+      step = std::max(min_step_, step / 2.0);
+      continue;
+    }
+    if (!found_ik)
+      break;
+
+    cartesian_steps.push_back((next_fraction - fraction) * path_length);
+    fraction = next_fraction;
+    trajectory.push_back(next_state);
+    joint_steps.push_back(joint_step);
+
+    // Grow while the joints move little, but stay within reach of the closest obstacle
+    if (joint_step < max_joint_step_ / 2.0)
+      step *= 2.0;
+    if (planning_scene && min_step_ < max_step_)
+    {
+      next_state->update();
+      collision_detection::DistanceResult distance_res;
+      planning_scene->getCollisionWorld()->distanceRobot(distance_req, distance_res,
+                                                         *planning_scene->getCollisionRobot(), *next_state);
+      step = std::min(step, clearance_factor_ * distance_res.minimum_distance.distance);
+    }
+    step = std::max(min_step_, std::min(max_step_, step));
+  }
+
+  // Cut the path at the first step whose joint motion per cartesian distance is far above the mean
+  if (jump_threshold > 0.0 && !joint_steps.empty())
+  {
+    double mean_joint_motion = 0.0;
+    for (std::size_t i = 0; i < joint_steps.size(); ++i)
+      mean_joint_motion += joint_steps[i] / cartesian_steps[i];
+    mean_joint_motion /= joint_steps.size();
+
+    for (std::size_t i = 0; i < joint_steps.size(); ++i)
+    {
+      if (joint_steps[i] / cartesian_steps[i] > jump_threshold * mean_joint_motion)
+      {
+        ROS_DEBUG_STREAM_NAMED("cartesian_interpolator", "Joint space jump at step " << i);
+        trajectory.resize(i + 1);
+        fraction = 0.0;
+        for (std::size_t j = 0; j < i; ++j)
+          fraction += cartesian_steps[j] / path_length;
+        break;
+      }
+    }
+  }
+
+  *robot_state = *trajectory.back();
+  return fraction;
+}
+
+bool CartesianInterpolator::computeJacobianStep(robot_state::RobotState& robot_state,
+                                                const robot_model::JointModelGroup* group,
+                                                const robot_model::LinkModel* link, const Eigen::Affine3d& pose) const
+{
+  static const std::size_t MAX_ITERATIONS = 5;
+  static const double DAMPING = 0.01;
+  static const double TRANSLATION_TOLERANCE = 1e-4;
+  static const double ROTATION_TOLERANCE = 1e-3;
+
+  // The Jacobian is expressed in the frame of the parent link of the group
+  const robot_model::LinkModel* reference_link = group->getJointModels().front()->getParentLinkModel();
+
+  std::vector<double> positions;
+  robot_state.copyJointGroupPositions(group, positions);
+  Eigen::Map<Eigen::VectorXd> joint_positions(&positions[0], positions.size());
+
+  Eigen::MatrixXd jacobian;
+  for (std::size_t iteration = 0; iteration < MAX_ITERATIONS; ++iteration)
+  {
+    robot_state.update();
+    const Eigen::Affine3d& link_pose = robot_state.getGlobalLinkTransform(link);
+    const Eigen::AngleAxisd rotation_error(pose.rotation() * link_pose.rotation().transpose());
+    const Eigen::Vector3d translation_error = pose.translation() - link_pose.translation();
+    if (translation_error.norm() < TRANSLATION_TOLERANCE && std::abs(rotation_error.angle()) < ROTATION_TOLERANCE)
+      return true;
+
+    Eigen::Matrix3d to_reference = Eigen::Matrix3d::Identity();
+    if (reference_link)
+      to_reference = robot_state.getGlobalLinkTransform(reference_link).rotation().transpose();
+    Eigen::Matrix<double, 6, 1> twist;
+    twist << to_reference * translation_error, to_reference * rotation_error.axis() * rotation_error.angle();
+
+    if (!robot_state.getJacobian(group, link, Eigen::Vector3d::Zero(), jacobian))
+      return false;
+
+    // Damped least squares stays bounded near singularities
+    Eigen::MatrixXd damped = jacobian * jacobian.transpose();
+    damped.diagonal().array() += DAMPING * DAMPING;
+    joint_positions += jacobian.transpose() * damped.ldlt().solve(twist);
+
+    robot_state.setJointGroupPositions(group, positions);
+    if (!robot_state.satisfiesBounds(group))
+      return false;
+  }
+
+  robot_state.update();
+  const Eigen::Affine3d& link_pose = robot_state.getGlobalLinkTransform(link);
+  return (pose.translation() - link_pose.translation()).norm() < TRANSLATION_TOLERANCE &&
+         std::abs(Eigen::AngleAxisd(pose.rotation() * link_pose.rotation().transpose()).angle()) < ROTATION_TOLERANCE;
+}
+
+}  // namespace
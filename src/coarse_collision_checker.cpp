@@ -0,0 +1,207 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Cheap bounding sphere collision test that resolves most grasp states before an exact mesh check
+*/
+
+// moveit_grasps
+#include <moveit_grasps/coarse_collision_checker.h>
+
+// geometric_shapes
+#include <geometric_shapes/shapes.h>
+#include <geometric_shapes/shape_operations.h>
+
+// octomap
+#include <octomap/octomap.h>
+
+// C++
+#include <cmath>
+
+namespace moveit_grasps
+{
+CoarseCollisionChecker::CoarseCollisionChecker(const robot_model::RobotModelConstPtr& robot_model, double clearance)
+  : clearance_(clearance)
+{
+  const std::vector<const robot_model::LinkModel*>& links = robot_model->getLinkModels();
+  link_spheres_.resize(links.size());
+  for (std::size_t i = 0; i < links.size(); ++i)
+  {
+    LinkSphere& sphere = link_spheres_[links[i]->getLinkIndex()];
+    sphere.has_geometry_ = !links[i]->getShapes().empty();
+    sphere.center_ = links[i]->getCenteredBoundingBoxOffset();
+    sphere.radius_ = links[i]->getShapeExtentsAtOrigin().norm() / 2.0;
+  }
+}
+
+void CoarseCollisionChecker::setPlanningScene(const planning_scene::PlanningScene& planning_scene)
+{
+  object_shapes_.clear();
+  acm_ = planning_scene.getAllowedCollisionMatrix();
+
+  const collision_detection::World& world = *planning_scene.getWorld();
+  for (collision_detection::World::const_iterator it = world.begin(); it != world.end(); ++it)
+  {
+    const collision_detection::World::Object& object = *it->second;
+    for (std::size_t i = 0; i < object.shapes_.size(); ++i)
+    {
+      ObjectShape object_shape;
+      object_shape.object_id_ = it->first;
+      object_shape.shape_ = object.shapes_[i];
+      object_shape.inverse_pose_ = object.shape_poses_[i].inverse();
+
+      // Planes and octomaps are tested in their own frame
+      object_shape.bounded_ =
+          object.shapes_[i]->type != shapes::PLANE && object.shapes_[i]->type != shapes::OCTREE;
+      if (object_shape.bounded_)
+      {
+        shapes::computeShapeBoundingSphere(object.shapes_[i].get(), object_shape.center_, object_shape.radius_);
+        object_shape.center_ = object.shape_poses_[i] * object_shape.center_;
+      }
+      object_shapes_.push_back(object_shape);
+    }
+  }
+}
+
+CoarseCollisionResult CoarseCollisionChecker::checkWorldCollision(const robot_state::RobotState& robot_state,
+                                                                  const robot_model::JointModelGroup* group) const
+{
+  // Attached bodies have no precomputed bounds
+  std::vector<const robot_state::AttachedBody*> attached_bodies;
+  robot_state.getAttachedBodies(attached_bodies);
+  if (!attached_bodies.empty())
+    return COARSE_UNKNOWN;
+
+  CoarseCollisionResult result = COARSE_CLEAR;
+  const std::vector<const robot_model::LinkModel*>& links = group->getUpdatedLinkModelsWithGeometry();
+  for (std::size_t i = 0; i < links.size(); ++i)
+  {
+    const LinkSphere& sphere = link_spheres_[links[i]->getLinkIndex()];
+    if (!sphere.has_geometry_)
+      continue;
+    const Eigen::Vector3d center = robot_state.getGlobalLinkTransform(links[i]) * sphere.center_;
+
+    for (std::size_t j = 0; j < object_shapes_.size(); ++j)
+    {
+      switch (checkShape(links[i]->getName(), center, sphere.radius_, object_shapes_[j]))
+      {
+        case COARSE_COLLIDING:
+          return COARSE_COLLIDING;
+        case COARSE_UNKNOWN:
+          result = COARSE_UNKNOWN;
+          break;
+        case COARSE_CLEAR:
+          break;
+      }
+    }
+  }
+  return result;
+}
+
+CoarseCollisionResult CoarseCollisionChecker::checkShape(const std::string& link_name, const Eigen::Vector3d& center,
+                                                         double radius, const ObjectShape& object_shape) const
+{
+  const double padded_radius = radius + clearance_;
+
+  if (object_shape.bounded_)
+  {
+    if ((center - object_shape.center_).norm() > padded_radius + object_shape.radius_)
+      return COARSE_CLEAR;
+
+    // Deep inside a solid, unless the scene allows this link to touch the object
+    collision_detection::AllowedCollision::Type type;
+    if (!acm_.getAllowedCollision(link_name, object_shape.object_id_, type) &&
+        isSphereInside(object_shape.shape_.get(), object_shape.inverse_pose_ * center, radius))
+      return COARSE_COLLIDING;
+
+    return COARSE_UNKNOWN;
+  }
+
+  const Eigen::Vector3d local_center = object_shape.inverse_pose_ * center;
+  if (object_shape.shape_->type == shapes::PLANE)
+  {
+    const shapes::Plane* plane = static_cast<const shapes::Plane*>(object_shape.shape_.get());
+    const Eigen::Vector3d normal(plane->a, plane->b, plane->c);
+    const double distance = std::abs(normal.dot(local_center) + plane->d) / normal.norm();
+    return distance > padded_radius ? COARSE_CLEAR : COARSE_UNKNOWN;
+  }
+
+  if (object_shape.shape_->type == shapes::OCTREE)
+  {
+    // Look for an occupied voxel in the box around the sphere
+    const shapes::OcTree* octree_shape = static_cast<const shapes::OcTree*>(object_shape.shape_.get());
+    const octomap::point3d min(local_center.x() - padded_radius, local_center.y() - padded_radius,
+                               local_center.z() - padded_radius);
+    const octomap::point3d max(local_center.x() + padded_radius, local_center.y() + padded_radius,
+                               local_center.z() + padded_radius);
+    for (octomap::OcTree::leaf_bbx_iterator it = octree_shape->octree->begin_leafs_bbx(min, max),
+                                            end = octree_shape->octree->end_leafs_bbx();
+         it != end; ++it)
+    {
+      if (octree_shape->octree->isNodeOccupied(*it))
+        return COARSE_UNKNOWN;
+    }
+    return COARSE_CLEAR;
+  }
+
+  return COARSE_UNKNOWN;
+}
+
+bool CoarseCollisionChecker::isSphereInside(const shapes::Shape* shape, const Eigen::Vector3d& center, double radius)
+{
+  switch (shape->type)
+  {
+    case shapes::BOX:
+    {
+      const shapes::Box* box = static_cast<const shapes::Box*>(shape);
+      for (std::size_t i = 0; i < 3; ++i)
+        if (std::abs(center[i]) + radius > box->size[i] / 2.0)
+          return false;
+      return true;
+    }
+    case shapes::SPHERE:
+      return center.norm() + radius <= static_cast<const shapes::Sphere*>(shape)->radius;
+    case shapes::CYLINDER:
+    {
+      const shapes::Cylinder* cylinder = static_cast<const shapes::Cylinder*>(shape);
+      return center.head<2>().norm() + radius <= cylinder->radius &&
+             std::abs(center.z()) + radius <= cylinder->length / 2.0;
+    }
+    default:
+      // Meshes may be hollow or open
+      return false;
+  }
+}
+
+}  // namespace
@@ -0,0 +1,190 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Continuous collision checking of joint space motions by conservative advancement
+*/
+
+// moveit_grasps
+#include <moveit_grasps/continuous_collision_checker.h>
+
+// geometric_shapes
+#include <geometric_shapes/shape_operations.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+
+namespace moveit_grasps
+{
+ContinuousCollisionChecker::ContinuousCollisionChecker(const robot_model::RobotModelConstPtr& robot_model,
+                                                       double min_clearance, std::size_t max_steps)
+  : min_clearance_(min_clearance), max_steps_(max_steps)
+{
+  const std::vector<const robot_model::LinkModel*>& links = robot_model->getLinkModels();
+  link_radii_.resize(links.size(), 0.0);
+  for (std::size_t i = 0; i < links.size(); ++i)
+  {
+    if (links[i]->getShapes().empty())
+      continue;
+    link_radii_[links[i]->getLinkIndex()] =
+        links[i]->getCenteredBoundingBoxOffset().norm() + links[i]->getShapeExtentsAtOrigin().norm() / 2.0;
+  }
+}
+
+bool ContinuousCollisionChecker::isMotionValid(const planning_scene::PlanningScene& planning_scene,
+                                               const robot_state::RobotState& from, const robot_state::RobotState& to,
+                                               const robot_model::JointModelGroup* group) const
+{
+  const double motion_bound = getMotionBound(from, to, group);
+
+  collision_detection::DistanceRequest req;
+  req.group = group;
+  req.enableGroup(planning_scene.getRobotModel());
+  req.acm = &planning_scene.getAllowedCollisionMatrix();
+
+  robot_state::RobotState state(from);
+  double t = 0.0;
+  for (std::size_t step = 0; step < max_steps_; ++step)
+  {
+    from.interpolate(to, t, state, group);
+    state.update();
+
+    collision_detection::DistanceResult world_res;
+    planning_scene.getCollisionWorld()->distanceRobot(req, world_res, *planning_scene.getCollisionRobot(), state);
+    collision_detection::DistanceResult self_res;
+    planning_scene.getCollisionRobotUnpadded()->distanceSelf(req, self_res, state);
+    if (world_res.collision || self_res.collision)
+      return false;
+
+    // Two moving links approach each other at up to twice the speed
+    const double clearance = std::min(world_res.minimum_distance.distance, self_res.minimum_distance.distance / 2.0);
+    if (clearance < min_clearance_)
+      return false;
+
+    if (t >= 1.0)
+      return true;
+    t = motion_bound > 0.0 ? std::min(1.0, t + clearance / motion_bound) : 1.0;
+  }
+
+  ROS_DEBUG_STREAM_NAMED("continuous_collision_checker", "Motion needs more than " << max_steps_ << " steps");
+  return false;
+}
+
+std::size_t ContinuousCollisionChecker::checkTrajectory(const planning_scene::PlanningScene& planning_scene,
+                                                        const std::vector<robot_state::RobotStatePtr>& trajectory,
+                                                        const robot_model::JointModelGroup* group) const
+{
+  if (trajectory.empty())
+    return 0;
+
+  for (std::size_t i = 1; i < trajectory.size(); ++i)
+  {
+    if (!isMotionValid(planning_scene, *trajectory[i - 1], *trajectory[i], group))
+      return i;
+  }
+  return trajectory.size();
+}
+
+double ContinuousCollisionChecker::getMotionBound(const robot_state::RobotState& from,
+                                                  const robot_state::RobotState& to,
+                                                  const robot_model::JointModelGroup* group) const
+{
+  // Attached bodies enlarge the links they are attached to
+  std::vector<double> link_radii = link_radii_;
+  std::vector<const robot_state::AttachedBody*> attached_bodies;
+  from.getAttachedBodies(attached_bodies);
+  for (std::size_t i = 0; i < attached_bodies.size(); ++i)
+  {
+    const std::vector<shapes::ShapeConstPtr>& body_shapes = attached_bodies[i]->getShapes();
+    const EigenSTL::vector_Affine3d& body_transforms = attached_bodies[i]->getFixedTransforms();
+    double& radius = link_radii[attached_bodies[i]->getAttachedLink()->getLinkIndex()];
+    for (std::size_t j = 0; j < body_shapes.size(); ++j)
+    {
+      Eigen::Vector3d center;
+      double shape_radius;
+      shapes::computeShapeBoundingSphere(body_shapes[j].get(), center, shape_radius);
+      radius = std::max(radius, (body_transforms[j] * center).norm() + shape_radius);
+    }
+  }
+
+  std::vector<double> link_reach(link_radii.size(), -1.0);
+  double motion_bound = 0.0;
+  const std::vector<const robot_model::JointModel*>& joints = group->getActiveJointModels();
+  for (std::size_t i = 0; i < joints.size(); ++i)
+  {
+    const robot_model::JointModel* joint = joints[i];
+    const double distance = joint->distance(from.getJointPositions(joint), to.getJointPositions(joint));
+    switch (joint->getType())
+    {
+      case robot_model::JointModel::PRISMATIC:
+        motion_bound += distance;
+        break;
+      case robot_model::JointModel::REVOLUTE:
+        // The axis passes through the origin of the child link
+        motion_bound += distance * getReach(joint->getChildLinkModel(), link_radii, link_reach);
+        break;
+      default:
+        // Translations and rotations of multi dof joints are combined in their distance
+        motion_bound += distance * (1.0 + getReach(joint->getChildLinkModel(), link_radii, link_reach));
+        break;
+    }
+  }
+  return motion_bound;
+}
+
+double ContinuousCollisionChecker::getReach(const robot_model::LinkModel* link, const std::vector<double>& link_radii,
+                                            std::vector<double>& link_reach) const
+{
+  double& reach = link_reach[link->getLinkIndex()];
+  if (reach >= 0.0)
+    return reach;
+
+  reach = link_radii[link->getLinkIndex()];
+  const std::vector<const robot_model::JointModel*>& child_joints = link->getChildJointModels();
+  for (std::size_t i = 0; i < child_joints.size(); ++i)
+  {
+    const robot_model::LinkModel* child_link = child_joints[i]->getChildLinkModel();
+    double offset = child_link->getJointOriginTransform().translation().norm();
+    if (child_joints[i]->getType() == robot_model::JointModel::PRISMATIC)
+    {
+      const robot_model::VariableBounds& bounds = child_joints[i]->getVariableBounds()[0];
+      offset += std::max(std::abs(bounds.min_position_), std::abs(bounds.max_position_));
+    }
+    reach = std::max(reach, offset + getReach(child_link, link_radii, link_reach));
+  }
+  return reach;
+}
+
+}  // namespace
@@ -42,7 +42,6 @@
 // MoveIt
 #include <moveit/robot_state/robot_state.h>
 #include <moveit/planning_scene_monitor/planning_scene_monitor.h>
-#include <moveit/kinematic_constraints/utils.h>
 #include <moveit/planning_interface/planning_interface.h>
 #include <moveit/planning_pipeline/planning_pipeline.h>
 #include <moveit/robot_state/conversions.h>
@@ -55,6 +54,7 @@
 #include <moveit_grasps/grasp_filter.h>
 #include <moveit_grasps/grasp_data.h>
 #include <moveit_grasps/grasp_planner.h>
+#include <moveit_grasps/speculative_pick_planner.h>
 
 // Parameter loading
 #include <rosparam_shortcuts/rosparam_shortcuts.h>
@@ -171,6 +171,9 @@ public:
     // Load grasp filter
     grasp_filter_.reset(new moveit_grasps::GraspFilter(visual_tools_->getSharedRobotState(), visual_tools_));
 
+    // Skip the grasps excluded by the cutting planes and orientations of the filter while generating them
+    grasp_generator_->setGraspPredicates(grasp_filter_->getGraspPredicates());
+
     // ---------------------------------------------------------------------------------------------
     // Load grasp planner for approach, lift and retreat planning
     grasp_planner_.reset(new moveit_grasps::GraspPlanner(visual_tools_));
@@ -181,6 +184,9 @@ public:
     // load the motion planning pipeline
     planning_pipeline_.reset(new planning_pipeline::PlanningPipeline(robot_model_, nh_, "planning_plugin", "request_"
                                                                                                            "adapter"));
+
+    // Plan the free space motion to several grasps at once
+    speculative_pick_planner_.reset(new moveit_grasps::SpeculativePickPlanner(grasp_planner_, planning_pipeline_));
   }
 
   bool demoRandomGrasp()
@@ -229,6 +235,11 @@ public:
       ROS_WARN_STREAM_NAMED(LOGNAME, "The ideal seed state is not reachable. Using start state as seed.");
     }
 
+    // Prefer IK solutions close to the state the pre-approach plan starts from
+    robot_state::RobotStatePtr motion_start_state(new robot_state::RobotState(*visual_tools_->getSharedRobotState()));
+    setPreApproachStartState(*motion_start_state);
+    grasp_filter_->setMotionStartState(motion_start_state);
+
     // --------------------------------------------
     // Filtering grasps
     // Note: This step also solves for the grasp and pre-grasp states and stores them in grasp candidates)
@@ -245,6 +256,10 @@ public:
     }
     ROS_INFO_STREAM_NAMED(LOGNAME, "" << grasp_candidates.size() << " remain after filtering");
 
+    // Reuse the filter's distance field of static objects, if enabled
+    grasp_planner_->setStaticDistanceField(grasp_filter_->getStaticDistanceField());
+    grasp_planner_->setSceneRegionCropper(grasp_filter_->getSceneRegionCropper());
+
     // Plan free-space approach, cartesian approach, lift and retreat trajectories
     moveit_grasps::GraspCandidatePtr selected_grasp_candidate;
     moveit_msgs::MotionPlanResponse pre_approach_plan;
@@ -307,40 +322,26 @@ public:
     ros::Duration(0.25).sleep();
   }
 
-  bool planFullGrasp(std::vector<moveit_grasps::GraspCandidatePtr> grasp_candidates,
+  bool planFullGrasp(const std::vector<moveit_grasps::GraspCandidatePtr>& grasp_candidates,
                      moveit_grasps::GraspCandidatePtr& valid_grasp_candidate,
                      moveit_msgs::MotionPlanResponse& pre_approach_plan)
   {
-    moveit::core::RobotStatePtr current_state;
+    // NOTE: We have to change the start state since Panda start configuration is in self collision.
+    planning_scene::PlanningScenePtr cloned_scene;
     {
-      boost::scoped_ptr<planning_scene_monitor::LockedPlanningSceneRW> ls(
-          new planning_scene_monitor::LockedPlanningSceneRW(planning_scene_monitor_));
-      current_state.reset(new moveit::core::RobotState((*ls)->getCurrentState()));
+      planning_scene_monitor::LockedPlanningSceneRO ls(planning_scene_monitor_);
+      cloned_scene = planning_scene::PlanningScene::clone(ls);
     }
+    robot_state::RobotState start_state = cloned_scene->getCurrentState();
+    setPreApproachStartState(start_state);
 
-    bool success = false;
-    for (; !grasp_candidates.empty(); grasp_candidates.erase(grasp_candidates.begin()))
-    {
-      valid_grasp_candidate = grasp_candidates.front();
-      valid_grasp_candidate->getPreGraspState(current_state);
-      if (!grasp_planner_->planApproachLiftRetreat(valid_grasp_candidate, current_state, planning_scene_monitor_,
-                                                   false))
-      {
-        ROS_INFO_NAMED(LOGNAME, "failed to plan approach lift retreat");
-        continue;
-      }
-
-      robot_state::RobotStatePtr pre_grasp_state = valid_grasp_candidate->segmented_cartesian_traj_[APPROACH].front();
-      if (!planPreApproach(*pre_grasp_state, pre_approach_plan))
-      {
-        ROS_WARN_NAMED(LOGNAME, "failed to plan to pregrasp_state");
-        continue;
-      }
-
-      success = true;
-      break;
-    }
-    return success;
+    moveit_grasps::PickPlan pick_plan;
+    if (!speculative_pick_planner_->planPick(grasp_candidates, start_state, cloned_scene, pick_plan))
+      return false;
+
+    valid_grasp_candidate = pick_plan.grasp_candidate_;
+    pick_plan.pre_approach_plan_.getMessage(pre_approach_plan);
+    return true;
   }
 
   void setACMFingerEntry(const std::string& object_name, bool allowed)
@@ -357,28 +358,8 @@ public:
     }
   }
 
-  bool planPreApproach(const robot_state::RobotState& goal_state, moveit_msgs::MotionPlanResponse& pre_approach_plan)
+  void setPreApproachStartState(robot_state::RobotState& rs)
   {
-    planning_interface::MotionPlanRequest req;
-    planning_interface::MotionPlanResponse res;
-
-    double tolerance_above = 0.01;
-    double tolerance_below = 0.01;
-    // req.planner_id = "RRTConnectkConfigDefault";
-    req.group_name = arm_jmg_->getName();
-    req.num_planning_attempts = 5;
-    req.allowed_planning_time = 1.5;
-    moveit_msgs::Constraints goal =
-        kinematic_constraints::constructGoalConstraints(goal_state, arm_jmg_, tolerance_below, tolerance_above);
-
-    req.goal_constraints.push_back(goal);
-    boost::scoped_ptr<planning_scene_monitor::LockedPlanningSceneRW> ls(
-        new planning_scene_monitor::LockedPlanningSceneRW(planning_scene_monitor_));
-
-    // ---------------------------------
-    // Change the robot current state
-    // NOTE: We have to do this since Panda start configuration is in self collision.
-    robot_state::RobotState rs = (*ls)->getCurrentState();
     std::vector<double> starting_joint_values = { 0.0, -0.785, 0.0, -2.356, 0.0, 1.571, 0.785 };
     std::vector<std::string> joint_names = { "panda_joint1", "panda_joint2", "panda_joint3", "panda_joint4",
                                              "panda_joint5", "panda_joint6", "panda_joint7" };
@@ -388,18 +369,6 @@ public:
       rs.setJointPositions(joint_names[i], &starting_joint_values[i]);
     }
     rs.update();
-    robot_state::robotStateToRobotStateMsg(rs, req.start_state);
-    // ---------------------------
-
-    planning_pipeline_->generatePlan(*ls, req, res);
-    if (res.error_code_.val != res.error_code_.SUCCESS)
-    {
-      ROS_INFO_NAMED(LOGNAME, "Failed to plan approach successfully");
-      return false;
-    }
-
-    res.getMessage(pre_approach_plan);
-    return true;
   }
 
   bool getIKSolution(const moveit::core::JointModelGroup* arm_jmg, const Eigen::Affine3d& target_pose,
@@ -484,6 +453,7 @@ private:
 
   // Motion planning
   planning_pipeline::PlanningPipelinePtr planning_pipeline_;
+  moveit_grasps::SpeculativePickPlannerPtr speculative_pick_planner_;
 
   // which baxter arm are we using
   std::string ee_group_name_;
@@ -38,6 +38,9 @@
 
 #include <moveit_grasps/grasp_candidate.h>
 
+// Conversions
+#include <eigen_conversions/eigen_msg.h>
+
 namespace moveit_grasps
 {
 GraspCandidate::GraspCandidate(moveit_msgs::Grasp grasp, const GraspDataPtr grasp_data, Eigen::Affine3d cuboid_pose)
@@ -49,6 +52,11 @@ GraspCandidate::GraspCandidate(moveit_msgs::Grasp grasp, const GraspDataPtr gras
   , grasp_filtered_by_orientation_(false)
   , grasp_filtered_by_ik_closed_(false)
   , pregrasp_filtered_by_ik_(false)
+  , grasp_skipped_by_predictor_(false)
+  , ik_timed_out_(false)
+  , ik_retried_(false)
+  , feature_row_(0)
+  , joint_distance_(0.0)
 {
 }
 
@@ -105,13 +113,89 @@ bool GraspCandidate::getGraspStateClosedEEOnly(moveit::core::RobotStatePtr& robo
   return grasp_data_->setRobotState(robot_state, grasp_.grasp_posture);
 }
 
+boost::shared_ptr<GraspCandidate> GraspCandidate::cloneForGraspData(const GraspDataPtr& grasp_data) const
+{
+  moveit_msgs::Grasp grasp = grasp_;
+  if (grasp_data == grasp_data_)
+  {
+    boost::shared_ptr<GraspCandidate> grasp_candidate(new GraspCandidate(grasp, grasp_data, cuboid_pose_));
+    grasp_candidate->feature_matrix_ = feature_matrix_;
+    grasp_candidate->feature_row_ = feature_row_;
+    return grasp_candidate;
+  }
+
+  // Recover the generic grasp pose and convert it to the other end effector's frame of reference
+  Eigen::Affine3d eef_pose;
+  tf::poseMsgToEigen(grasp_.grasp_pose.pose, eef_pose);
+  Eigen::Affine3d grasp_pose = eef_pose * grasp_data_->grasp_pose_to_eef_pose_.inverse();
+  tf::poseEigenToMsg(grasp_pose * grasp_data->grasp_pose_to_eef_pose_, grasp.grasp_pose.pose);
+  grasp.grasp_pose.header.frame_id = grasp_data->base_link_;
+
+  // Approach and retreat - aligned with eef to grasp transform
+  Eigen::Vector3d grasp_approach_vector = -1 * grasp_data->grasp_pose_to_eef_pose_.translation();
+  grasp_approach_vector = grasp_approach_vector / grasp_approach_vector.norm();
+
+  grasp.pre_grasp_approach.desired_distance = grasp_data->grasp_max_depth_ + grasp_data->approach_distance_desired_;
+  grasp.pre_grasp_approach.direction.header.frame_id = grasp_data->parent_link_->getName();
+  grasp.pre_grasp_approach.direction.vector.x = grasp_approach_vector.x();
+  grasp.pre_grasp_approach.direction.vector.y = grasp_approach_vector.y();
+  grasp.pre_grasp_approach.direction.vector.z = grasp_approach_vector.z();
+
+  grasp.post_grasp_retreat.desired_distance = grasp_data->grasp_max_depth_ + grasp_data->retreat_distance_desired_;
+  grasp.post_grasp_retreat.direction.header.frame_id = grasp_data->parent_link_->getName();
+  grasp.post_grasp_retreat.direction.vector.x = -1 * grasp_approach_vector.x();
+  grasp.post_grasp_retreat.direction.vector.y = -1 * grasp_approach_vector.y();
+  grasp.post_grasp_retreat.direction.vector.z = -1 * grasp_approach_vector.z();
+
+  // The object width is not known here, so use the configured open and closed postures of the other end effector
+  grasp.pre_grasp_posture = grasp_data->pre_grasp_posture_;
+  grasp.grasp_posture = grasp_data->grasp_posture_;
+
+  // The copy keeps the quality, and the features it was computed from
+  boost::shared_ptr<GraspCandidate> grasp_candidate(new GraspCandidate(grasp, grasp_data, cuboid_pose_));
+  grasp_candidate->feature_matrix_ = feature_matrix_;
+  grasp_candidate->feature_row_ = feature_row_;
+  return grasp_candidate;
+}
+
+boost::shared_ptr<GraspCandidate> GraspCandidate::cloneWithTransform(const Eigen::Affine3d& transform) const
+{
+  // Approach and retreat directions are in the end effector frame and move with the grasp pose
+  moveit_msgs::Grasp grasp = grasp_;
+  Eigen::Affine3d grasp_pose;
+  tf::poseMsgToEigen(grasp_.grasp_pose.pose, grasp_pose);
+  tf::poseEigenToMsg(transform * grasp_pose, grasp.grasp_pose.pose);
+
+  boost::shared_ptr<GraspCandidate> grasp_candidate(new GraspCandidate(grasp, grasp_data_, transform * cuboid_pose_));
+  grasp_candidate->feature_matrix_ = feature_matrix_;
+  grasp_candidate->feature_row_ = feature_row_;
+  grasp_candidate->grasp_ik_seed_ = grasp_ik_solution_;
+  grasp_candidate->pregrasp_ik_seed_ = pregrasp_ik_solution_;
+  return grasp_candidate;
+}
+
 bool GraspCandidate::isValid()
 {
   if (grasp_filtered_by_ik_ || grasp_filtered_by_cutting_plane_ || grasp_filtered_by_orientation_ ||
-      pregrasp_filtered_by_ik_)
+      pregrasp_filtered_by_ik_ || grasp_skipped_by_predictor_)
     return false;
   else
     return true;
 }
 
+void GraspCandidate::resetFilterResults()
+{
+  grasp_filtered_by_ik_ = false;
+  grasp_filtered_by_cutting_plane_ = false;
+  grasp_filtered_by_orientation_ = false;
+  grasp_filtered_by_ik_closed_ = false;
+  pregrasp_filtered_by_ik_ = false;
+  grasp_skipped_by_predictor_ = false;
+  ik_timed_out_ = false;
+  ik_retried_ = false;
+  joint_distance_ = 0.0;
+  grasp_ik_solution_.clear();
+  pregrasp_ik_solution_.clear();
+}
+
 }  // namespace
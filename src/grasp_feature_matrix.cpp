@@ -0,0 +1,73 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Unweighted feature scores of generated grasps, to score them again for other weights
+*/
+
+#include <moveit_grasps/grasp_feature_matrix.h>
+
+namespace moveit_grasps
+{
+GraspFeatureMatrix::GraspFeatureMatrix(const GraspFeatureVector& feature_counts) : feature_counts_(feature_counts)
+{
+}
+
+std::size_t GraspFeatureMatrix::addGrasp(const GraspFeatureVector& features)
+{
+  const std::size_t row = getNumGrasps();
+  features_.insert(features_.end(), features.data(), features.data() + NUM_GRASP_FEATURES);
+  return row;
+}
+
+GraspFeatureVector GraspFeatureMatrix::getFeatures(std::size_t row) const
+{
+  return Eigen::Map<const GraspFeatureVector>(&features_[row * NUM_GRASP_FEATURES]);
+}
+
+bool GraspFeatureMatrix::computeQualities(const GraspFeatureVector& weights, Eigen::VectorXd& qualities) const
+{
+  // The qualities are normalized by the total weight of the features that were scored
+  const double total_weight = feature_counts_.dot(weights);
+  if (total_weight <= 0)
+    return false;
+
+  typedef Eigen::Matrix<double, Eigen::Dynamic, NUM_GRASP_FEATURES, Eigen::RowMajor> FeatureMatrix;
+  const Eigen::Map<const FeatureMatrix> features(features_.data(), getNumGrasps(), NUM_GRASP_FEATURES);
+  qualities.noalias() = features * weights;
+  qualities /= total_weight;
+  return true;
+}
+
+}  // namespace
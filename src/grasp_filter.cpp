@@ -39,6 +39,8 @@
 // moveit_grasps
 #include <moveit_grasps/grasp_filter.h>
 #include <moveit_grasps/state_validity_callback.h>
+#include <moveit_grasps/panda_batch_ik_solver.h>
+#include <moveit_grasps/cartesian_interpolator.h>
 
 // moveit
 #include <moveit/transforms/transforms.h>
@@ -66,6 +68,57 @@ bool ikCallbackFnAdapter(moveit::core::RobotState* state, const moveit::core::Jo
     error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
   return true;
 }
+
+double jointDistance(const std::vector<double>& from, const double* to)
+{
+  double distance = 0.0;
+  for (std::size_t i = 0; i < from.size(); ++i)
+    distance += (to[i] - from[i]) * (to[i] - from[i]);
+  return std::sqrt(distance);
+}
+
+// The valid IK solution closest to the motion start among those found so far
+struct ClosestIKSolution
+{
+  ClosestIKSolution() : distance_(0.0), count_(0)
+  {
+  }
+  std::vector<double> solution_;
+  double distance_;
+  std::size_t count_;
+};
+
+// Remember a valid solution if it is the closest so far, and reject it until enough were found so that the solver
+// keeps searching
+bool gatherIKSolution(ClosestIKSolution* closest, std::size_t num_wanted,
+                      const std::vector<double>& motion_start_joints,
+                      const moveit::core::GroupStateValidityCallbackFn& constraint, moveit::core::RobotState* state,
+                      const moveit::core::JointModelGroup* group, const double* ik_solution)
+{
+  if (!constraint(state, group, ik_solution))
+    return false;
+  const double distance = jointDistance(motion_start_joints, ik_solution);
+  if (closest->count_ == 0 || distance < closest->distance_)
+  {
+    closest->distance_ = distance;
+    closest->solution_.assign(ik_solution, ik_solution + motion_start_joints.size());
+  }
+  return ++closest->count_ >= num_wanted;
+}
+
+// Solutions that were only rejected to look for closer ones are valid results
+void useClosestIKSolutions(const std::vector<ClosestIKSolution>& closest,
+                           std::vector<std::vector<double> >& ik_solutions,
+                           std::vector<moveit_msgs::MoveItErrorCodes>& error_codes)
+{
+  for (std::size_t i = 0; i < closest.size(); ++i)
+  {
+    if (closest[i].count_ == 0)
+      continue;
+    ik_solutions[i] = closest[i].solution_;
+    error_codes[i].val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+  }
+}
 }
 
 namespace moveit_grasps
@@ -73,7 +126,10 @@ namespace moveit_grasps
 // Constructor
 GraspFilter::GraspFilter(robot_state::RobotStatePtr robot_state,
                          moveit_visual_tools::MoveItVisualToolsPtr& visual_tools)
-  : visual_tools_(visual_tools), nh_("~/moveit_grasps/filter")
+  : visual_tools_(visual_tools)
+  , nh_("~/moveit_grasps/filter")
+  , grasp_predicates_(new GraspPredicates())
+  , filter_cache_predicates_version_(0)
 {
   // Make a copy of the robot state so that we are sure outside influence does not break our grasp filter
   robot_state_.reset(new moveit::core::RobotState(*robot_state));
@@ -96,6 +152,49 @@ GraspFilter::GraspFilter(robot_state::RobotStatePtr robot_state,
                                     show_grasp_filter_collision_if_failed_);
 
   rosparam_shortcuts::shutdownIfError(parent_name, error);
+
+  // Optional settings
+  nh_.param("static_collision_objects", static_collision_objects_, std::vector<std::string>());
+  nh_.param("static_distance_field_resolution", static_distance_field_resolution_, 0.02);
+  nh_.param("static_distance_field_padding", static_distance_field_padding_, 0.0);
+  nh_.param("crop_planning_scene", crop_planning_scene_, false);
+  nh_.param("crop_planning_scene_margin", crop_planning_scene_margin_, 0.3);
+  nh_.param("coarse_collision_checking", coarse_collision_checking_, false);
+  nh_.param("coarse_collision_clearance", coarse_collision_clearance_, 0.01);
+  nh_.param("two_phase_ik", two_phase_ik_, false);
+  nh_.param("first_pass_ik_timeout", first_pass_ik_timeout_, 0.005);
+  nh_.param("second_pass_ik_timeout", second_pass_ik_timeout_, 0.0);
+  nh_.param("second_pass_max_grasps", second_pass_max_grasps_, 50);
+  nh_.param("incremental_refilter", incremental_refilter_, false);
+  nh_.param("use_success_predictor", use_success_predictor_, false);
+  nh_.param("success_predictor_k", success_predictor_k_, 10);
+  nh_.param("success_predictor_min_samples", success_predictor_min_samples_, 200);
+  nh_.param("success_predictor_max_samples", success_predictor_max_samples_, 5000);
+  nh_.param("success_predictor_threshold", success_predictor_threshold_, 0.1);
+  nh_.param("success_predictor_verify_fraction", success_predictor_verify_fraction_, 0.1);
+  nh_.param("use_worker_processes", use_worker_processes_, false);
+  nh_.param("worker_queue_name", worker_queue_name_, std::string("moveit_grasps_filter"));
+  nh_.param("worker_queue_capacity", worker_queue_capacity_, 2048);
+  nh_.param("worker_timeout", worker_timeout_, 1.0);
+  nh_.param("worker_lease_timeout", worker_lease_timeout_, 1.0);
+  nh_.param("tracking_ik_timeout", tracking_ik_timeout_, 0.005);
+  nh_.param("batch_ik_solver", batch_ik_solver_type_, std::string(""));
+  nh_.param("batch_ik_size", batch_ik_size_, 16);
+  nh_.param("panda_ik_redundancy_step", panda_ik_redundancy_step_, 0.05);
+  nh_.param("ik_solutions_per_grasp", ik_solutions_per_grasp_, 1);
+  nh_.param("joint_distance_weight", joint_distance_weight_, 0.0);
+  nh_.param("ik_seed_index_cell_size", ik_seed_index_cell_size_, 0.02);
+  nh_.param("ik_seed_index_max_rotation", ik_seed_index_max_rotation_, 0.3);
+  nh_.param("record_failure_diagnostics", record_failure_diagnostics_, false);
+  // Failed filter passes are shown from the recorded diagnostics
+  if (show_grasp_filter_collision_if_failed_)
+    record_failure_diagnostics_ = true;
+  if (!worker_thread_config_.load(nh_))
+    ROS_WARN_STREAM_NAMED("grasp_filter", "Invalid thread settings, the filter threads keep the CPU affinity and "
+                                          "scheduling of the process");
+
+  if (crop_planning_scene_)
+    scene_region_cropper_.reset(new SceneRegionCropper(crop_planning_scene_margin_));
 }
 
 bool GraspFilter::filterGrasps(std::vector<GraspCandidatePtr>& grasp_candidates,
@@ -113,12 +212,13 @@ bool GraspFilter::filterGrasps(std::vector<GraspCandidatePtr>& grasp_candidates,
   }
   if (!filter_pregrasp)
     ROS_WARN_STREAM_NAMED("grasp_filter", "Not filtering pre-grasp - GraspCandidate may have bad data");
+  failure_diagnostics_.clear();
 
   // Visualize the cutting planes if desired
   visualizeCuttingPlanes();
 
-  // Get the solver timeout from kinematics.yaml
-  solver_timeout_ = arm_jmg->getDefaultIKTimeout();
+  // Get the solver timeout from kinematics.yaml, or start with a short one and retry the best grasps that timed out
+  solver_timeout_ = two_phase_ik_ ? first_pass_ik_timeout_ : arm_jmg->getDefaultIKTimeout();
   ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Grasp filter IK timeout " << solver_timeout_);
 
   // Choose how many degrees of freedom
@@ -126,35 +226,45 @@ bool GraspFilter::filterGrasps(std::vector<GraspCandidatePtr>& grasp_candidates,
   ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Solver for " << num_variables_ << " degrees of freedom");
 
   // Get the end effector joint model group
-  if (arm_jmg->getAttachedEndEffectorNames().size() == 0)
-  {
-    ROS_ERROR_STREAM_NAMED("grasp_filter", "No end effectors attached to this arm");
+  if (!checkEndEffector(arm_jmg))
     return false;
-  }
-  else if (arm_jmg->getAttachedEndEffectorNames().size() > 1)
+
+  // Copy planning scene that is locked
+  planning_scene::PlanningScenePtr cloned_scene;
   {
-    ROS_ERROR_STREAM_NAMED("grasp_filter", "More than one end effectors attached to this arm");
-    return false;
+    planning_scene_monitor::LockedPlanningSceneRO scene(planning_scene_monitor);
+    cloned_scene = planning_scene::PlanningScene::clone(scene);
   }
 
-  // Try to filter grasps not in verbose mode
-  std::size_t remaining_grasps =
-      filterGraspsHelper(grasp_candidates, planning_scene_monitor, arm_jmg, seed_state, filter_pregrasp, verbose);
+  // Try to filter grasps not in verbose mode, in worker processes if there are any
+  std::size_t remaining_grasps;
+  if (loadWorkerQueue())
+    remaining_grasps = filterGraspsInWorkers(grasp_candidates, cloned_scene, arm_jmg, seed_state, filter_pregrasp);
+  else
+    remaining_grasps =
+        filterGraspsHelper(grasp_candidates, cloned_scene, arm_jmg, seed_state, filter_pregrasp, verbose);
+
+  if (two_phase_ik_)
+  {
+    remaining_grasps += retryTimedOutGrasps(grasp_candidates, cloned_scene, arm_jmg, seed_state, filter_pregrasp);
+    solver_timeout_ = arm_jmg->getDefaultIKTimeout();
+  }
 
   if (remaining_grasps == 0)
   {
     ROS_WARN_STREAM_NAMED("grasp_filter", "Grasp filters removed all grasps!");
     if (show_grasp_filter_collision_if_failed_)
     {
-      ROS_INFO_STREAM_NAMED("grasp_filter", "Re-running in verbose mode since it failed");
-      verbose = true;
-      remaining_grasps =
-          filterGraspsHelper(grasp_candidates, planning_scene_monitor, arm_jmg, seed_state, filter_pregrasp, verbose);
+      ROS_INFO_STREAM_NAMED("grasp_filter", "Showing the " << failure_diagnostics_.size()
+                                                           << " failures recorded while filtering");
+      visualizeFailureDiagnostics();
     }
-    else
-      ROS_INFO_STREAM_NAMED("grasp_filter", "NOT re-running in verbose mode");
   }
 
+  // Remember where the arm went for every grasp, so that a scene change only re-checks the grasps it touches
+  if (incremental_refilter_)
+    setFilterCache(grasp_candidates, cloned_scene, arm_jmg, seed_state, filter_pregrasp);
+
   // Visualize valid grasps as arrows with cartesian path as well
   if (show_filtered_grasps_)
   {
@@ -178,59 +288,67 @@ bool GraspFilter::filterGrasps(std::vector<GraspCandidatePtr>& grasp_candidates,
   return true;
 }
 
-bool GraspFilter::filterGraspByPlane(GraspCandidatePtr grasp_candidate, Eigen::Affine3d filter_pose,
-                                     grasp_parallel_plane plane, int direction)
+bool GraspFilter::revalidateGrasps(std::vector<GraspCandidatePtr>& grasp_candidates,
+                                   planning_scene_monitor::PlanningSceneMonitorPtr planning_scene_monitor,
+                                   const robot_model::JointModelGroup* arm_jmg,
+                                   const moveit::core::RobotStatePtr seed_state, bool filter_pregrasp)
 {
-  Eigen::Affine3d grasp_pose;
-  Eigen::Vector3d grasp_position;
+  if (grasp_candidates.empty())
+  {
+    ROS_ERROR_NAMED("grasp_filter", "Unable to revalidate grasps because vector is empty");
+    return false;
+  }
+
+  failure_diagnostics_.clear();
 
-  // get grasp translation in filter pose CS
-  grasp_pose = visual_tools_->convertPose(grasp_candidate->grasp_.grasp_pose.pose);
-  grasp_position = filter_pose.inverse() * grasp_pose.translation();
+  // Seeded from their previous solutions, the grasps only need a short IK timeout
+  solver_timeout_ = tracking_ik_timeout_ > 0 ? tracking_ik_timeout_ : arm_jmg->getDefaultIKTimeout();
+  num_variables_ = arm_jmg->getVariableCount();
+  if (!checkEndEffector(arm_jmg))
+    return false;
 
-  // filter grasps by cutting plane
-  double epsilon = 0.00000001;
-  switch (plane)
+  // Copy planning scene that is locked
+  planning_scene::PlanningScenePtr cloned_scene;
   {
-    case XY:
-      if ((direction == -1 && grasp_position(2) < 0 + epsilon) || (direction == 1 && grasp_position(2) > 0 - epsilon))
-        grasp_candidate->grasp_filtered_by_cutting_plane_ = true;
-      break;
-    case XZ:
-      if ((direction == -1 && grasp_position(1) < 0 + epsilon) || (direction == 1 && grasp_position(1) > 0 - epsilon))
-        grasp_candidate->grasp_filtered_by_cutting_plane_ = true;
-      break;
-    case YZ:
-      if ((direction == -1 && grasp_position(0) < 0 + epsilon) || (direction == 1 && grasp_position(0) > 0 - epsilon))
-        grasp_candidate->grasp_filtered_by_cutting_plane_ = true;
-      break;
-    default:
-      ROS_WARN_STREAM_NAMED("filter_by_plane", "plane not specified correctly");
-      break;
+    planning_scene_monitor::LockedPlanningSceneRO scene(planning_scene_monitor);
+    cloned_scene = planning_scene::PlanningScene::clone(scene);
   }
 
+  // These grasps were valid before, do not let the predictor skip them
+  const bool use_success_predictor = use_success_predictor_;
+  use_success_predictor_ = false;
+  std::size_t remaining_grasps =
+      filterGraspsHelper(grasp_candidates, cloned_scene, arm_jmg, seed_state, filter_pregrasp, false);
+  use_success_predictor_ = use_success_predictor;
+  solver_timeout_ = arm_jmg->getDefaultIKTimeout();
+
+  if (incremental_refilter_)
+    setFilterCache(grasp_candidates, cloned_scene, arm_jmg, seed_state, filter_pregrasp);
+
+  ROS_INFO_STREAM_NAMED("grasp_filter", remaining_grasps << " of " << grasp_candidates.size()
+                                                         << " tracked grasps are still valid");
+  return remaining_grasps > 0;
+}
+
+bool GraspFilter::filterGraspByPlane(GraspCandidatePtr grasp_candidate, Eigen::Affine3d filter_pose,
+                                     grasp_parallel_plane plane, int direction)
+{
+  const Eigen::Affine3d grasp_pose = visual_tools_->convertPose(grasp_candidate->grasp_.grasp_pose.pose);
+  if (GraspPredicates::isCutByPlane(CuttingPlane(filter_pose, plane, direction), grasp_pose.translation()))
+    grasp_candidate->grasp_filtered_by_cutting_plane_ = true;
+
   return grasp_candidate->grasp_filtered_by_cutting_plane_;
 }
 
 bool GraspFilter::filterGraspByOrientation(GraspCandidatePtr grasp_candidate, Eigen::Affine3d desired_pose,
                                            double max_angular_offset)
 {
-  Eigen::Affine3d std_grasp_pose;
-  Eigen::Affine3d grasp_pose;
-  Eigen::Vector3d desired_z_axis;
-  Eigen::Vector3d grasp_z_axis;
-  double angle;
-
   // convert grasp pose back to standard grasping orientation
-  grasp_pose = visual_tools_->convertPose(grasp_candidate->grasp_.grasp_pose.pose);
-  std_grasp_pose = grasp_pose * grasp_candidate->grasp_data_->grasp_pose_to_eef_pose_.inverse();
-
-  // compute the angle between the z-axes of the desired and grasp poses
-  grasp_z_axis = std_grasp_pose.rotation() * Eigen::Vector3d(0, 0, 1);
-  desired_z_axis = desired_pose.rotation() * Eigen::Vector3d(0, 0, 1);
-  angle = acos(grasp_z_axis.normalized().dot(desired_z_axis.normalized()));
+  const Eigen::Affine3d grasp_pose = visual_tools_->convertPose(grasp_candidate->grasp_.grasp_pose.pose);
+  const Eigen::Affine3d std_grasp_pose = grasp_pose * grasp_candidate->grasp_data_->grasp_pose_to_eef_pose_.inverse();
 
-  if (angle > max_angular_offset)
+  if (GraspPredicates::isOutsideOrientation(DesiredGraspOrientation(desired_pose, max_angular_offset),
+                                            std_grasp_pose.rotation().col(2)))
   {
     grasp_candidate->grasp_filtered_by_orientation_ = true;
     return true;
@@ -253,6 +371,16 @@ std::size_t GraspFilter::filterGraspsHelper(std::vector<GraspCandidatePtr>& gras
     planning_scene_monitor::LockedPlanningSceneRO scene(planning_scene_monitor);
     cloned_scene = planning_scene::PlanningScene::clone(scene);
   }
+
+  return filterGraspsHelper(grasp_candidates, cloned_scene, arm_jmg, seed_state, filter_pregrasp, verbose);
+}
+
+std::size_t GraspFilter::filterGraspsHelper(std::vector<GraspCandidatePtr>& grasp_candidates,
+                                            planning_scene::PlanningScenePtr cloned_scene,
+                                            const robot_model::JointModelGroup* arm_jmg,
+                                            const moveit::core::RobotStatePtr seed_state, bool filter_pregrasp,
+                                            bool verbose)
+{
   *robot_state_ = cloned_scene->getCurrentState();
 
   // Choose Number of cores
@@ -262,6 +390,9 @@ std::size_t GraspFilter::filterGraspsHelper(std::vector<GraspCandidatePtr>& gras
     num_threads = grasp_candidates.size();
   }
 
+  // More threads than allowed CPUs would only take turns on them
+  num_threads = worker_thread_config_.limitNumWorkers(num_threads);
+
   // Debug
   if (verbose || collision_verbose_)
   {
@@ -272,69 +403,31 @@ std::size_t GraspFilter::filterGraspsHelper(std::vector<GraspCandidatePtr>& gras
                                                      << num_threads << " threads");
 
   // Load kinematic solvers if not already loaded
-  if (kin_solvers_[arm_jmg->getName()].size() != num_threads)
-  {
-    kin_solvers_[arm_jmg->getName()].clear();
-
-    // Create an ik solver for every thread
-    for (std::size_t i = 0; i < num_threads; ++i)
-    {
-      // ROS_DEBUG_STREAM_NAMED("grasp_filter","Creating ik solver " << i);
-      kin_solvers_[arm_jmg->getName()].push_back(arm_jmg->getSolverInstance());
-
-      // Test to make sure we have a valid kinematics solver
-      if (!kin_solvers_[arm_jmg->getName()][i])
-      {
-        ROS_ERROR_STREAM_NAMED("grasp_filter", "No kinematic solver found");
-        return 0;
-      }
-    }
-  }
+  if (!loadKinematicSolvers(arm_jmg, num_threads))
+    return 0;
+  const bool use_batch_ik = loadBatchIKSolvers(arm_jmg, num_threads);
 
   // Robot states
-  // Create a robot state for every thread
-  if (robot_states_.size() != num_threads)
-  {
-    robot_states_.clear();
-    for (std::size_t i = 0; i < num_threads; ++i)
-    {
-      // Copy the previous robot state
-      robot_states_.push_back(moveit::core::RobotStatePtr(new moveit::core::RobotState(*robot_state_)));
-    }
-  }
-  else  // update the states
-  {
-    for (std::size_t i = 0; i < num_threads; ++i)
-    {
-      // Copy the previous robot state
-      *(robot_states_[i]) = *robot_state_;
-    }
-  }
+  // Create a robot state for every thread, this thread is a worker too until the filter returns
+  ScopedThreadSettings caller_thread_settings;
+  loadRobotStates(num_threads);
+
+  // Split off the static collision objects, crop the rest to the arm's reach and bound it for coarse checks
+  planning_scene::PlanningScenePtr check_scene = loadStaticDistanceField(cloned_scene);
+  check_scene =
+      cropPlanningScene(check_scene, grasp_candidates, std::vector<const robot_model::JointModelGroup*>(1, arm_jmg));
+  loadCoarseCollisionChecker(check_scene);
 
   // Transform poses
   // bring the pose to the frame of the IK solver
-  const std::string& ik_frame = kin_solvers_[arm_jmg->getName()][0]->getBaseFrame();
   Eigen::Affine3d link_transform;
-  ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug",
-                         "Frame transform from ik_frame: " << ik_frame << " and robot model frame: "
-                                                           << robot_state_->getRobotModel()->getModelFrame());
-  if (!moveit::core::Transforms::sameFrame(ik_frame, robot_state_->getRobotModel()->getModelFrame()))
-  {
-    const robot_model::LinkModel* lm =
-        robot_state_->getLinkModel((!ik_frame.empty() && ik_frame[0] == '/') ? ik_frame.substr(1) : ik_frame);
-
-    if (!lm)
-    {
-      ROS_ERROR_STREAM_NAMED("grasp_filter", "Unable to find frame for link transform");
-      return 0;
-    }
-
-    link_transform = robot_state_->getGlobalLinkTransform(lm).inverse();
-  }
+  if (!getIKFrameTransform(arm_jmg, link_transform))
+    return 0;
 
   // Create the seed state vector
   std::vector<double> ik_seed_state;
   seed_state->copyJointGroupPositions(arm_jmg, ik_seed_state);
+  const std::vector<double> motion_start_joints = getMotionStartJoints(arm_jmg, seed_state);
 
   // Thread data
   // Allocate only once to increase performance
@@ -342,36 +435,110 @@ std::size_t GraspFilter::filterGraspsHelper(std::vector<GraspCandidatePtr>& gras
   ik_thread_structs.resize(num_threads);
   for (std::size_t thread_id = 0; thread_id < num_threads; ++thread_id)
   {
-    ik_thread_structs[thread_id].reset(new moveit_grasps::IkThreadStruct(grasp_candidates, cloned_scene, link_transform,
+    ik_thread_structs[thread_id].reset(new moveit_grasps::IkThreadStruct(grasp_candidates, check_scene, link_transform,
                                                                          0,  // this is filled in by OpenMP
                                                                          kin_solvers_[arm_jmg->getName()][thread_id],
                                                                          robot_states_[thread_id], solver_timeout_,
                                                                          filter_pregrasp, verbose, thread_id));
     ik_thread_structs[thread_id]->ik_seed_state_ = ik_seed_state;
+    ik_thread_structs[thread_id]->motion_start_joints_ = motion_start_joints;
+    if (use_batch_ik)
+      ik_thread_structs[thread_id]->batch_ik_solver_ = batch_ik_solvers_[arm_jmg->getName()][thread_id];
   }
 
   // Benchmark time
   ros::Time start_time;
   start_time = ros::Time::now();
 
+  // Process the most promising grasps first, skipping those that previous IK results say will fail
+  std::vector<std::size_t> grasp_order(grasp_candidates.size());
+  for (std::size_t i = 0; i < grasp_order.size(); ++i)
+    grasp_order[i] = i;
+  EigenSTL::vector_Affine3d ik_poses;
+  GraspSuccessPredictorPtr predictor;
+  if (use_success_predictor_ && !verbose)
+  {
+    GraspSuccessPredictorPtr& arm_predictor = success_predictors_[arm_jmg->getName()];
+    if (!arm_predictor)
+      arm_predictor.reset(new GraspSuccessPredictor(success_predictor_k_, success_predictor_max_samples_));
+
+    // The samples include collision rejections, which only hold in the scene they were learned in
+    GraspFilterCache& predictor_scene = success_predictor_scenes_[arm_jmg->getName()];
+    AlignedBoxes changed_regions;
+    if (!predictor_scene.getChangedRegions(*cloned_scene->getWorld(), changed_regions) || !changed_regions.empty() ||
+        !predictor_scene.matchesCollisionSettings(*cloned_scene))
+    {
+      if (arm_predictor->getNumSamples() > 0)
+        ROS_DEBUG_STREAM_NAMED("grasp_filter", "Planning scene changed, forgetting "
+                                                   << arm_predictor->getNumSamples() << " success predictor samples");
+      arm_predictor->clear();
+      predictor_scene.setWorld(*cloned_scene, *seed_state);
+    }
+    predictor = arm_predictor;
+    orderBySuccessPrediction(grasp_candidates, predictor, link_transform, grasp_order, ik_poses);
+  }
+
   // Loop through poses and find those that are kinematically feasible
 
   omp_set_num_threads(num_threads);
+  if (use_batch_ik)
+  {
+    // Consecutive grasps of the order form a batch, so the most promising grasps are still processed first
+    const std::size_t batch_size = std::max(batch_ik_size_, 1);
+    const std::size_t num_batches = (grasp_order.size() + batch_size - 1) / batch_size;
 #pragma omp parallel for schedule(dynamic)
-  for (std::size_t grasp_id = 0; grasp_id < grasp_candidates.size(); ++grasp_id)
+    for (std::size_t batch_id = 0; batch_id < num_batches; ++batch_id)
+    {
+      std::size_t thread_id = omp_get_thread_num();
+      ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Thread " << thread_id << " processing batch " << batch_id);
+
+      // If in verbose mode allow for quick exit
+      if (ik_thread_structs[thread_id]->verbose_ && !ros::ok())
+        continue;  // breaking a for loop is not allows with OpenMP
+
+      const std::size_t begin = batch_id * batch_size;
+      const std::size_t end = std::min(begin + batch_size, grasp_order.size());
+      std::vector<std::size_t> grasp_ids(grasp_order.begin() + begin, grasp_order.begin() + end);
+      processCandidateGraspBatch(ik_thread_structs[thread_id], grasp_ids);
+    }
+  }
+  else
   {
-    std::size_t thread_id = omp_get_thread_num();
-    ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Thread " << thread_id << " processing grasp " << grasp_id);
+#pragma omp parallel for schedule(dynamic)
+    for (std::size_t order_id = 0; order_id < grasp_order.size(); ++order_id)
+    {
+      std::size_t grasp_id = grasp_order[order_id];
+      std::size_t thread_id = omp_get_thread_num();
+      ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Thread " << thread_id << " processing grasp " << grasp_id);
 
-    // If in verbose mode allow for quick exit
-    if (ik_thread_structs[thread_id]->verbose_ && !ros::ok())
-      continue;  // breaking a for loop is not allows with OpenMP
+      // If in verbose mode allow for quick exit
+      if (ik_thread_structs[thread_id]->verbose_ && !ros::ok())
+        continue;  // breaking a for loop is not allows with OpenMP
 
-    // Assign grasp to process
-    ik_thread_structs[thread_id]->grasp_id = grasp_id;
+      // Assign grasp to process
+      ik_thread_structs[thread_id]->grasp_id = grasp_id;
 
-    // Process the grasp
-    processCandidateGrasp(ik_thread_structs[thread_id]);
+      // Process the grasp
+      processCandidateGrasp(ik_thread_structs[thread_id]);
+    }
+  }
+
+  setJointDistances(grasp_candidates, motion_start_joints);
+  collectFailureDiagnostics(ik_thread_structs);
+
+  // Learn from the grasps that were actually checked
+  if (predictor)
+  {
+    for (std::size_t i = 0; i < grasp_order.size(); ++i)
+    {
+      const GraspCandidatePtr& grasp_candidate = grasp_candidates[grasp_order[i]];
+      if (grasp_candidate->grasp_filtered_by_cutting_plane_ || grasp_candidate->grasp_filtered_by_orientation_)
+        continue;
+      // A short first pass timeout says little about the grasp
+      if (two_phase_ik_ && grasp_candidate->ik_timed_out_)
+        continue;
+      predictor->addSample(ik_poses[grasp_order[i]], !grasp_candidate->grasp_filtered_by_ik_);
+    }
   }
 
   // Count number of grasps remaining
@@ -380,6 +547,7 @@ std::size_t GraspFilter::filterGraspsHelper(std::vector<GraspCandidatePtr>& gras
   std::size_t grasp_filtered_by_cutting_plane = 0;
   std::size_t grasp_filtered_by_orientation = 0;
   std::size_t pregrasp_filtered_by_ik = 0;
+  std::size_t grasp_skipped_by_predictor = 0;
 
   for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
   {
@@ -389,6 +557,8 @@ std::size_t GraspFilter::filterGraspsHelper(std::vector<GraspCandidatePtr>& gras
       grasp_filtered_by_cutting_plane++;
     else if (grasp_candidates[i]->grasp_filtered_by_orientation_)
       grasp_filtered_by_orientation++;
+    else if (grasp_candidates[i]->grasp_skipped_by_predictor_)
+      grasp_skipped_by_predictor++;
     else if (grasp_candidates[i]->pregrasp_filtered_by_ik_)
       pregrasp_filtered_by_ik++;
     else
@@ -396,7 +566,7 @@ std::size_t GraspFilter::filterGraspsHelper(std::vector<GraspCandidatePtr>& gras
   }
 
   if (remaining_grasps + grasp_filtered_by_ik + grasp_filtered_by_cutting_plane + grasp_filtered_by_orientation +
-          pregrasp_filtered_by_ik !=
+          grasp_skipped_by_predictor + pregrasp_filtered_by_ik !=
       grasp_candidates.size())
     ROS_ERROR_STREAM_NAMED("grasp_filter", "Logged filter reasons do not add up to total number of grasps. Internal "
                                            "error.");
@@ -419,6 +589,8 @@ std::size_t GraspFilter::filterGraspsHelper(std::vector<GraspCandidatePtr>& gras
     std::cout << "grasp_filtered_by_cutting_plane " << grasp_filtered_by_cutting_plane << std::endl;
     std::cout << "grasp_filtered_by_orientation   " << grasp_filtered_by_orientation << std::endl;
     std::cout << "grasp_filtered_by_ik            " << grasp_filtered_by_ik << std::endl;
+    if (predictor)
+      std::cout << "grasp_skipped_by_predictor      " << grasp_skipped_by_predictor << std::endl;
     std::cout << "pregrasp_filtered_by_ik         " << pregrasp_filtered_by_ik << std::endl;
     std::cout << "remaining grasps                " << remaining_grasps << std::endl;
     std::cout << "time duration:                  " << duration << std::endl;
@@ -429,103 +601,1318 @@ std::size_t GraspFilter::filterGraspsHelper(std::vector<GraspCandidatePtr>& gras
   return remaining_grasps;
 }
 
-bool GraspFilter::processCandidateGrasp(IkThreadStructPtr& ik_thread_struct)
+bool GraspFilter::filterGrasps(std::vector<GraspCandidatePtr>& grasp_candidates,
+                               planning_scene_monitor::PlanningSceneMonitorPtr planning_scene_monitor,
+                               const GraspDatas& grasp_datas, const moveit::core::RobotStatePtr seed_state,
+                               ArmGraspCandidates& arm_grasp_candidates, bool filter_pregrasp)
 {
-  ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Checking grasp #" << ik_thread_struct->grasp_id);
+  // Error check
+  if (grasp_candidates.empty())
+  {
+    ROS_ERROR_NAMED("grasp_filter", "Unable to filter grasps because vector is empty");
+    return false;
+  }
+  if (grasp_datas.empty())
+  {
+    ROS_ERROR_NAMED("grasp_filter", "Unable to filter grasps because no arms were given");
+    return false;
+  }
+  if (!filter_pregrasp)
+    ROS_WARN_STREAM_NAMED("grasp_filter", "Not filtering pre-grasp - GraspCandidate may have bad data");
+  if (two_phase_ik_ || use_success_predictor_ || use_worker_processes_ || incremental_refilter_)
+    ROS_WARN_STREAM_ONCE_NAMED("grasp_filter", "two_phase_ik, use_success_predictor, use_worker_processes and "
+                                               "incremental_refilter do not apply when filtering for several arms");
+  failure_diagnostics_.clear();
 
-  // Helper pointer
-  GraspCandidatePtr& grasp_candidate = ik_thread_struct->grasp_candidates_[ik_thread_struct->grasp_id];
+  // Visualize the cutting planes if desired
+  visualizeCuttingPlanes();
 
-  // Get pose
-  ik_thread_struct->ik_pose_ = grasp_candidate->grasp_.grasp_pose;
+  // Express every candidate for the end effector of every arm
+  std::vector<const robot_model::JointModelGroup*> arms;
+  arm_grasp_candidates.clear();
+  for (GraspDatas::const_iterator data_it = grasp_datas.begin(); data_it != grasp_datas.end(); ++data_it)
+  {
+    const robot_model::JointModelGroup* arm_jmg = data_it->first;
+    if (!checkEndEffector(arm_jmg))
+      return false;
+    arms.push_back(arm_jmg);
 
-  // Debug
-  if (ik_thread_struct->verbose_ && false)
+    std::vector<GraspCandidatePtr>& arm_candidates = arm_grasp_candidates[arm_jmg];
+    arm_candidates.reserve(grasp_candidates.size());
+    for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+      arm_candidates.push_back(grasp_candidates[i]->cloneForGraspData(data_it->second));
+  }
+
+  // Copy planning scene that is locked, shared by all arms
+  planning_scene::PlanningScenePtr cloned_scene;
   {
-    ik_thread_struct->ik_pose_.header.frame_id = ik_thread_struct->kin_solver_->getBaseFrame();
-    visual_tools_->publishZArrow(ik_thread_struct->ik_pose_.pose, rviz_visual_tools::RED, rviz_visual_tools::MEDIUM,
-                                 0.1);
+    planning_scene_monitor::LockedPlanningSceneRO scene(planning_scene_monitor);
+    cloned_scene = planning_scene::PlanningScene::clone(scene);
   }
+  *robot_state_ = cloned_scene->getCurrentState();
 
-  // Filter by cutting planes
-  for (std::size_t i = 0; i < cutting_planes_.size(); i++)
+  // Choose Number of cores
+  const std::size_t num_tasks = grasp_candidates.size() * arms.size();
+  std::size_t num_threads = omp_get_max_threads();
+  if (num_threads > num_tasks)
+    num_threads = num_tasks;
+  num_threads = worker_thread_config_.limitNumWorkers(num_threads);
+  if (collision_verbose_)
   {
-    if (filterGraspByPlane(grasp_candidate, cutting_planes_[i]->pose_, cutting_planes_[i]->plane_,
-                           cutting_planes_[i]->direction_) == true)
-    {
-      grasp_candidate->grasp_filtered_by_cutting_plane_ = true;
-      return false;
-    }
+    num_threads = 1;
+    ROS_WARN_STREAM_NAMED("grasp_filter", "Using only " << num_threads << " threads because verbose is true");
+  }
+  ROS_INFO_STREAM_NAMED("grasp_filter", "Filtering " << grasp_candidates.size() << " candidate grasps for "
+                                                     << arms.size() << " arms with " << num_threads << " threads");
+
+  // Every arm has its own robot state per thread, a thread alternates between arms and the arm joints and gripper
+  // posture of one arm must not stay in the state while the next arm is collision checked
+  ScopedThreadSettings caller_thread_settings;
+  loadRobotStates(num_threads);
+  std::vector<std::vector<moveit::core::RobotStatePtr> > arm_robot_states(arms.size(), robot_states_);
+  omp_set_num_threads(num_threads);
+#pragma omp parallel
+  {
+    const std::size_t thread_id = omp_get_thread_num();
+    for (std::size_t arm_id = 1; arm_id < arms.size(); ++arm_id)
+      arm_robot_states[arm_id][thread_id].reset(new moveit::core::RobotState(*robot_state_));
   }
+  planning_scene::PlanningScenePtr check_scene = loadStaticDistanceField(cloned_scene);
+  check_scene = cropPlanningScene(check_scene, grasp_candidates, arms);
+  loadCoarseCollisionChecker(check_scene);
 
-  // Filter by desired orientation
-  for (std::size_t i = 0; i < desired_grasp_orientations_.size(); i++)
+  // Thread data for every arm, with its own kinematic solver pool, IK frame and seed
+  std::vector<std::vector<IkThreadStructPtr> > arm_thread_structs(arms.size());
+  for (std::size_t arm_id = 0; arm_id < arms.size(); ++arm_id)
   {
-    if (filterGraspByOrientation(grasp_candidate, desired_grasp_orientations_[i]->pose_,
-                                 desired_grasp_orientations_[i]->max_angle_offset_) == true)
-    {
-      grasp_candidate->grasp_filtered_by_orientation_ = true;
+    const robot_model::JointModelGroup* arm_jmg = arms[arm_id];
+    if (!loadKinematicSolvers(arm_jmg, num_threads))
       return false;
-    }
-  }
+    const bool use_batch_ik = loadBatchIKSolvers(arm_jmg, num_threads);
 
-  moveit::core::GroupStateValidityCallbackFn constraint_fn = boost::bind(
-      &isGraspStateValid, ik_thread_struct->planning_scene_.get(), collision_verbose_ || ik_thread_struct->verbose_,
-      collision_verbose_speed_, visual_tools_, _1, _2, _3);
+    Eigen::Affine3d link_transform;
+    if (!getIKFrameTransform(arm_jmg, link_transform))
+      return false;
 
-  // Set gripper position (how open the fingers are) to the custom open position
-  if (grasp_candidate->grasp_data_->end_effector_type_ == FINGER)
-    grasp_candidate->getGraspStateOpenEEOnly(ik_thread_struct->robot_state_);
+    std::vector<double> ik_seed_state;
+    seed_state->copyJointGroupPositions(arm_jmg, ik_seed_state);
 
-  // Solve IK Problem for grasp posture
-  if (!findIKSolution(grasp_candidate->grasp_ik_solution_, ik_thread_struct, grasp_candidate, constraint_fn))
-  {
-    ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Unable to find the-grasp IK solution");
-    grasp_candidate->grasp_filtered_by_ik_ = true;
-    return false;
+    arm_thread_structs[arm_id].resize(num_threads);
+    for (std::size_t thread_id = 0; thread_id < num_threads; ++thread_id)
+    {
+      arm_thread_structs[arm_id][thread_id].reset(new moveit_grasps::IkThreadStruct(
+          arm_grasp_candidates[arm_jmg], check_scene, link_transform,
+          0,  // this is filled in by OpenMP
+          kin_solvers_[arm_jmg->getName()][thread_id], arm_robot_states[arm_id][thread_id],
+          arm_jmg->getDefaultIKTimeout(), filter_pregrasp, false, thread_id));
+      arm_thread_structs[arm_id][thread_id]->ik_seed_state_ = ik_seed_state;
+      arm_thread_structs[arm_id][thread_id]->motion_start_joints_ = getMotionStartJoints(arm_jmg, seed_state);
+      if (use_batch_ik)
+        arm_thread_structs[arm_id][thread_id]->batch_ik_solver_ = batch_ik_solvers_[arm_jmg->getName()][thread_id];
+    }
   }
 
-  // Copy solution to seed state so that next solution is faster
-  ik_thread_struct->ik_seed_state_ = grasp_candidate->grasp_ik_solution_;
+  // Benchmark time
+  ros::Time start_time;
+  start_time = ros::Time::now();
 
-  // Check if IK solution for grasp pose is valid for fingers closed as well
-  if (grasp_candidate->grasp_data_->end_effector_type_ == FINGER)
+  // Loop through every (grasp, arm) pair, interleaving arms so that the work stays balanced
+  omp_set_num_threads(num_threads);
+#pragma omp parallel for schedule(dynamic)
+  for (std::size_t task_id = 0; task_id < num_tasks; ++task_id)
   {
-    if (!checkFingersClosedIK(grasp_candidate->grasp_ik_solution_, ik_thread_struct, grasp_candidate, constraint_fn))
-    {
-      ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Unable to find the-grasp IK solution with CLOSED fingers");
-      grasp_candidate->grasp_filtered_by_ik_closed_ = true;
-      return false;
-    }
+    std::size_t thread_id = omp_get_thread_num();
+    IkThreadStructPtr& ik_thread_struct = arm_thread_structs[task_id % arms.size()][thread_id];
+
+    // Assign grasp to process
+    ik_thread_struct->grasp_id = task_id / arms.size();
+
+    // Process the grasp
+    processCandidateGrasp(ik_thread_struct);
   }
 
-  // Start pre-grasp section
-  if (ik_thread_struct->filter_pregrasp_)  // optionally check the pregrasp
+  for (std::size_t arm_id = 0; arm_id < arms.size(); ++arm_id)
   {
-    // Convert to a pre-grasp
-    const std::string& ee_parent_link_name = grasp_candidate->grasp_data_->ee_jmg_->getEndEffectorParentGroup().second;
-    ik_thread_struct->ik_pose_ = GraspGenerator::getPreGraspPose(grasp_candidate, ee_parent_link_name);
+    setJointDistances(arm_grasp_candidates[arms[arm_id]], arm_thread_structs[arm_id][0]->motion_start_joints_);
+    collectFailureDiagnostics(arm_thread_structs[arm_id]);
+  }
 
-    // Solve IK Problem for pregrasp
-    if (!findIKSolution(grasp_candidate->pregrasp_ik_solution_, ik_thread_struct, grasp_candidate, constraint_fn))
-    {
-      ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Unable to find PRE-grasp IK solution");
-      grasp_candidate->pregrasp_filtered_by_ik_ = true;
-      return false;
-    }
-    else if (grasp_candidate->pregrasp_ik_solution_.empty())
+  // Tag every candidate with the arms that can reach it, with the fingers open and closed
+  std::size_t reachable_grasps = 0;
+  std::vector<std::size_t> remaining_grasps(arms.size(), 0);
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+  {
+    grasp_candidates[i]->reachable_arms_.clear();
+    for (std::size_t arm_id = 0; arm_id < arms.size(); ++arm_id)
     {
-      ROS_ERROR_STREAM_NAMED("grasp_filter", "IK solution found but vector is empty??");
+      const GraspCandidatePtr& arm_candidate = arm_grasp_candidates[arms[arm_id]][i];
+      if (arm_candidate->isValid() && !arm_candidate->grasp_filtered_by_ik_closed_)
+      {
+        grasp_candidates[i]->reachable_arms_.push_back(arms[arm_id]);
+        remaining_grasps[arm_id]++;
+      }
     }
+    if (!grasp_candidates[i]->reachable_arms_.empty())
+      reachable_grasps++;
   }
-  else
+
+  // End Benchmark time
+  double duration = (ros::Time::now() - start_time).toSec();
+
+  if (statistics_verbose_)
   {
-    ROS_WARN_STREAM_NAMED("grasp_filter", "Not filtering pregrasp!!");
+    std::cout << "-------------------------------------------------------" << std::endl;
+    std::cout << "MULTI-ARM GRASP FILTER RESULTS " << std::endl;
+    std::cout << "total candidate grasps          " << grasp_candidates.size() << std::endl;
+    for (std::size_t arm_id = 0; arm_id < arms.size(); ++arm_id)
+      std::cout << "remaining for " << arms[arm_id]->getName() << ": " << remaining_grasps[arm_id] << std::endl;
+    std::cout << "reachable by any arm            " << reachable_grasps << std::endl;
+    std::cout << "time duration:                  " << duration << std::endl;
+    std::cout << "-------------------------------------------------------" << std::endl;
+  }
+
+  if (reachable_grasps == 0)
+  {
+    ROS_WARN_STREAM_NAMED("grasp_filter", "No grasps reachable by any arm after filtering");
+    return false;
+  }
+
+  return true;
+}
+
+bool GraspFilter::filterGraspsForObjects(std::vector<std::vector<GraspCandidatePtr> >& object_grasp_candidates,
+                                         planning_scene_monitor::PlanningSceneMonitorPtr planning_scene_monitor,
+                                         const robot_model::JointModelGroup* arm_jmg,
+                                         const moveit::core::RobotStatePtr seed_state,
+                                         std::vector<ObjectFilterResult>& object_results, bool filter_pregrasp)
+{
+  // All candidates in one vector, with the first grasp id of every object
+  const std::size_t num_objects = object_grasp_candidates.size();
+  std::vector<GraspCandidatePtr> grasp_candidates;
+  std::vector<std::size_t> object_begin(num_objects + 1);
+  for (std::size_t object_id = 0; object_id < num_objects; ++object_id)
+  {
+    object_begin[object_id] = grasp_candidates.size();
+    grasp_candidates.insert(grasp_candidates.end(), object_grasp_candidates[object_id].begin(),
+                            object_grasp_candidates[object_id].end());
+  }
+  object_begin[num_objects] = grasp_candidates.size();
+  object_results.assign(num_objects, ObjectFilterResult());
+  failure_diagnostics_.clear();
+
+  // Error check
+  if (grasp_candidates.empty())
+  {
+    ROS_ERROR_NAMED("grasp_filter", "Unable to filter grasps because no object has candidates");
+    return false;
+  }
+  if (!filter_pregrasp)
+    ROS_WARN_STREAM_NAMED("grasp_filter", "Not filtering pre-grasp - GraspCandidate may have bad data");
+
+  // Visualize the cutting planes if desired
+  visualizeCuttingPlanes();
+
+  solver_timeout_ = arm_jmg->getDefaultIKTimeout();
+  num_variables_ = arm_jmg->getVariableCount();
+  if (!checkEndEffector(arm_jmg))
+    return false;
+
+  // Copy planning scene that is locked, shared by all objects
+  planning_scene::PlanningScenePtr cloned_scene;
+  {
+    planning_scene_monitor::LockedPlanningSceneRO scene(planning_scene_monitor);
+    cloned_scene = planning_scene::PlanningScene::clone(scene);
+  }
+  *robot_state_ = cloned_scene->getCurrentState();
+
+  // Choose Number of cores
+  std::size_t num_threads = omp_get_max_threads();
+  if (num_threads > grasp_candidates.size())
+    num_threads = grasp_candidates.size();
+  num_threads = worker_thread_config_.limitNumWorkers(num_threads);
+  if (collision_verbose_)
+  {
+    num_threads = 1;
+    ROS_WARN_STREAM_NAMED("grasp_filter", "Using only " << num_threads << " threads because verbose is true");
+  }
+  ROS_INFO_STREAM_NAMED("grasp_filter", "Filtering " << grasp_candidates.size() << " candidate grasps of "
+                                                     << num_objects << " objects with " << num_threads << " threads");
+
+  if (!loadKinematicSolvers(arm_jmg, num_threads))
+    return false;
+  const bool use_batch_ik = loadBatchIKSolvers(arm_jmg, num_threads);
+  ScopedThreadSettings caller_thread_settings;
+  loadRobotStates(num_threads);
+  planning_scene::PlanningScenePtr check_scene = loadStaticDistanceField(cloned_scene);
+  check_scene =
+      cropPlanningScene(check_scene, grasp_candidates, std::vector<const robot_model::JointModelGroup*>(1, arm_jmg));
+  loadCoarseCollisionChecker(check_scene);
+
+  Eigen::Affine3d link_transform;
+  if (!getIKFrameTransform(arm_jmg, link_transform))
+    return false;
+
+  std::vector<double> ik_seed_state;
+  seed_state->copyJointGroupPositions(arm_jmg, ik_seed_state);
+  const std::vector<double> motion_start_joints = getMotionStartJoints(arm_jmg, seed_state);
+
+  // Thread data, a thread keeps its last solution as seed when it moves on to the next object
+  std::vector<IkThreadStructPtr> ik_thread_structs(num_threads);
+  for (std::size_t thread_id = 0; thread_id < num_threads; ++thread_id)
+  {
+    ik_thread_structs[thread_id].reset(new moveit_grasps::IkThreadStruct(grasp_candidates, check_scene, link_transform,
+                                                                         0,  // this is filled in by OpenMP
+                                                                         kin_solvers_[arm_jmg->getName()][thread_id],
+                                                                         robot_states_[thread_id], solver_timeout_,
+                                                                         filter_pregrasp, false, thread_id));
+    ik_thread_structs[thread_id]->ik_seed_state_ = ik_seed_state;
+    ik_thread_structs[thread_id]->motion_start_joints_ = motion_start_joints;
+    if (use_batch_ik)
+      ik_thread_structs[thread_id]->batch_ik_solver_ = batch_ik_solvers_[arm_jmg->getName()][thread_id];
+  }
+
+  // Tasks of consecutive grasps of one object, a batch or a single grasp, as first grasp id and object id
+  const std::size_t task_size = use_batch_ik ? std::max(batch_ik_size_, 1) : 1;
+  std::vector<std::pair<std::size_t, std::size_t> > tasks;
+  for (std::size_t object_id = 0; object_id < num_objects; ++object_id)
+    for (std::size_t grasp_id = object_begin[object_id]; grasp_id < object_begin[object_id + 1]; grasp_id += task_size)
+      tasks.push_back(std::make_pair(grasp_id, object_id));
+
+  EigenSTL::vector_Affine3d ik_poses(grasp_candidates.size());
+  Eigen::Affine3d pose;
+  for (std::size_t grasp_id = 0; grasp_id < grasp_candidates.size(); ++grasp_id)
+  {
+    tf::poseMsgToEigen(grasp_candidates[grasp_id]->grasp_.grasp_pose.pose, pose);
+    ik_poses[grasp_id] = link_transform * pose;
+  }
+
+  IKSeedIndex ik_seed_index(ik_seed_index_cell_size_, ik_seed_index_max_rotation_);
+  std::vector<char> seeded(grasp_candidates.size(), 0);  // not std::vector<bool>, threads write different elements
+  std::vector<std::vector<double> > thread_object_times(num_threads, std::vector<double>(num_objects, 0.0));
+
+  // Benchmark time
+  ros::Time start_time;
+  start_time = ros::Time::now();
+
+  omp_set_num_threads(num_threads);
+#pragma omp parallel for schedule(dynamic)
+  for (std::size_t task_id = 0; task_id < tasks.size(); ++task_id)
+  {
+    const ros::WallTime task_start_time = ros::WallTime::now();
+    std::size_t thread_id = omp_get_thread_num();
+    const std::size_t object_id = tasks[task_id].second;
+    const std::size_t end = std::min(tasks[task_id].first + task_size, object_begin[object_id + 1]);
+    ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Thread " << thread_id << " processing grasps "
+                                                                << tasks[task_id].first << " to " << end
+                                                                << " of object " << object_id);
+
+    // Start from a solution of a nearby grasp, unless the grasp has a seed of its own
+    std::vector<std::size_t> grasp_ids;
+    for (std::size_t grasp_id = tasks[task_id].first; grasp_id < end; ++grasp_id)
+    {
+      grasp_ids.push_back(grasp_id);
+      GraspCandidatePtr& grasp_candidate = grasp_candidates[grasp_id];
+      seeded[grasp_id] = grasp_candidate->grasp_ik_seed_.empty() &&
+                         ik_seed_index.findSeed(ik_poses[grasp_id], grasp_candidate->grasp_ik_seed_);
+    }
+
+    if (use_batch_ik)
+      processCandidateGraspBatch(ik_thread_structs[thread_id], grasp_ids);
+    else
+      for (std::size_t i = 0; i < grasp_ids.size(); ++i)
+      {
+        ik_thread_structs[thread_id]->grasp_id = grasp_ids[i];
+        processCandidateGrasp(ik_thread_structs[thread_id]);
+      }
+
+    for (std::size_t i = 0; i < grasp_ids.size(); ++i)
+    {
+      GraspCandidatePtr& grasp_candidate = grasp_candidates[grasp_ids[i]];
+      if (seeded[grasp_ids[i]])
+        grasp_candidate->grasp_ik_seed_.clear();
+      if (grasp_candidate->isValid())
+        ik_seed_index.addSolution(ik_poses[grasp_ids[i]], grasp_candidate->grasp_ik_solution_);
+    }
+    thread_object_times[thread_id][object_id] += (ros::WallTime::now() - task_start_time).toSec();
+  }
+
+  setJointDistances(grasp_candidates, motion_start_joints);
+  collectFailureDiagnostics(ik_thread_structs);
+
+  // Results of every object
+  std::size_t remaining_grasps = 0;
+  for (std::size_t object_id = 0; object_id < num_objects; ++object_id)
+  {
+    ObjectFilterResult& object_result = object_results[object_id];
+    for (std::size_t grasp_id = object_begin[object_id]; grasp_id < object_begin[object_id + 1]; ++grasp_id)
+    {
+      object_result.remaining_grasps_ += grasp_candidates[grasp_id]->isValid();
+      object_result.seeded_grasps_ += seeded[grasp_id];
+    }
+    for (std::size_t thread_id = 0; thread_id < num_threads; ++thread_id)
+      object_result.filter_time_ += thread_object_times[thread_id][object_id];
+    remaining_grasps += object_result.remaining_grasps_;
+  }
+
+  // End Benchmark time
+  double duration = (ros::Time::now() - start_time).toSec();
+
+  if (statistics_verbose_)
+  {
+    std::cout << "-------------------------------------------------------" << std::endl;
+    std::cout << "MULTI-OBJECT GRASP FILTER RESULTS " << std::endl;
+    std::cout << "total candidate grasps          " << grasp_candidates.size() << std::endl;
+    for (std::size_t object_id = 0; object_id < num_objects; ++object_id)
+      std::cout << "object " << object_id << ": " << object_results[object_id].remaining_grasps_ << " of "
+                << object_grasp_candidates[object_id].size() << " remaining, "
+                << object_results[object_id].seeded_grasps_ << " seeded, "
+                << object_results[object_id].filter_time_ << " s" << std::endl;
+    std::cout << "remaining grasps                " << remaining_grasps << std::endl;
+    std::cout << "shared IK seeds                 " << ik_seed_index.getNumSolutions() << std::endl;
+    std::cout << "time duration:                  " << duration << std::endl;
+    std::cout << "-------------------------------------------------------" << std::endl;
+  }
+
+  if (remaining_grasps == 0)
+  {
+    ROS_WARN_STREAM_NAMED("grasp_filter", "No grasps remaining for any object after filtering");
+    return false;
+  }
+
+  return true;
+}
+
+bool GraspFilter::refilterGrasps(std::vector<GraspCandidatePtr>& grasp_candidates,
+                                 planning_scene_monitor::PlanningSceneMonitorPtr planning_scene_monitor,
+                                 const robot_model::JointModelGroup* arm_jmg,
+                                 const moveit::core::RobotStatePtr seed_state, bool filter_pregrasp,
+                                 const AlignedBoxes& octomap_changed_regions)
+{
+  // The predicates may be changed through a shared predicate set without the filter knowing
+  if (!incremental_refilter_ || !filter_cache_.matchesFilterRequest(grasp_candidates, arm_jmg, filter_pregrasp) ||
+      filter_cache_predicates_version_ != grasp_predicates_->getVersion())
+  {
+    ROS_INFO_STREAM_NAMED("grasp_filter", "No previous filter results to reuse, filtering all grasps");
+    for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+      grasp_candidates[i]->resetFilterResults();
+    return filterGrasps(grasp_candidates, planning_scene_monitor, arm_jmg, seed_state, filter_pregrasp);
+  }
+  failure_diagnostics_.clear();
+
+  // Copy planning scene that is locked
+  planning_scene::PlanningScenePtr cloned_scene;
+  {
+    planning_scene_monitor::LockedPlanningSceneRO scene(planning_scene_monitor);
+    cloned_scene = planning_scene::PlanningScene::clone(scene);
+  }
+
+  // Changes that are not bound to a region of the scene
+  if (!filter_cache_.matchesRobot(*cloned_scene, *seed_state))
+  {
+    ROS_INFO_STREAM_NAMED("grasp_filter", "Allowed collisions, attached bodies or robot state changed, filtering all "
+                                          "grasps");
+    for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+      grasp_candidates[i]->resetFilterResults();
+    return filterGrasps(grasp_candidates, planning_scene_monitor, arm_jmg, seed_state, filter_pregrasp);
+  }
+
+  // Find what moved since the previous pass
+  AlignedBoxes changed_regions = octomap_changed_regions;
+  if (!filter_cache_.getChangedRegions(*cloned_scene->getWorld(), changed_regions, !octomap_changed_regions.empty()))
+  {
+    ROS_INFO_STREAM_NAMED("grasp_filter", "Planning scene change can not be bounded, filtering all grasps");
+    for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+      grasp_candidates[i]->resetFilterResults();
+    return filterGrasps(grasp_candidates, planning_scene_monitor, arm_jmg, seed_state, filter_pregrasp);
+  }
+
+  // Collect the grasps touching a changed region
+  std::set<std::size_t> overlapping_grasps;
+  for (std::size_t i = 0; i < changed_regions.size(); ++i)
+    filter_cache_.findOverlappingGrasps(changed_regions[i], overlapping_grasps);
+  std::vector<std::size_t> grasp_ids(overlapping_grasps.begin(), overlapping_grasps.end());
+
+  ROS_INFO_STREAM_NAMED("grasp_filter", changed_regions.size() << " changed regions touch " << grasp_ids.size()
+                                                               << " of " << grasp_candidates.size() << " grasps");
+
+  if (!grasp_ids.empty())
+  {
+    std::vector<GraspCandidatePtr> changed_candidates;
+    changed_candidates.reserve(grasp_ids.size());
+    for (std::size_t i = 0; i < grasp_ids.size(); ++i)
+    {
+      grasp_candidates[grasp_ids[i]]->resetFilterResults();
+      changed_candidates.push_back(grasp_candidates[grasp_ids[i]]);
+    }
+
+    solver_timeout_ = arm_jmg->getDefaultIKTimeout();
+    num_variables_ = arm_jmg->getVariableCount();
+    if (!checkEndEffector(arm_jmg))
+      return false;
+
+    filterGraspsHelper(changed_candidates, cloned_scene, arm_jmg, seed_state, filter_pregrasp, false);
+    updateFilterCache(grasp_candidates, grasp_ids, arm_jmg);
+  }
+  filter_cache_.setWorld(*cloned_scene, *seed_state);
+
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+    if (grasp_candidates[i]->isValid())
+      return true;
+
+  ROS_WARN_STREAM_NAMED("grasp_filter", "No grasps remaining after re-filtering");
+  return false;
+}
+
+std::size_t GraspFilter::retryTimedOutGrasps(std::vector<GraspCandidatePtr>& grasp_candidates,
+                                             planning_scene::PlanningScenePtr cloned_scene,
+                                             const robot_model::JointModelGroup* arm_jmg,
+                                             const moveit::core::RobotStatePtr seed_state, bool filter_pregrasp)
+{
+  std::vector<GraspCandidatePtr> timed_out_grasps;
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+    if (grasp_candidates[i]->ik_timed_out_ && !grasp_candidates[i]->isValid())
+      timed_out_grasps.push_back(grasp_candidates[i]);
+
+  if (timed_out_grasps.empty())
+    return 0;
+
+  // Only the best scored grasps get the full timeout
+  std::sort(timed_out_grasps.begin(), timed_out_grasps.end(), compareGraspScores);
+  if (timed_out_grasps.size() > static_cast<std::size_t>(second_pass_max_grasps_))
+    timed_out_grasps.resize(std::max(second_pass_max_grasps_, 0));
+  if (timed_out_grasps.empty())
+    return 0;
+
+  for (std::size_t i = 0; i < timed_out_grasps.size(); ++i)
+  {
+    timed_out_grasps[i]->resetFilterResults();
+    timed_out_grasps[i]->ik_retried_ = true;
+  }
+
+  solver_timeout_ = second_pass_ik_timeout_ > 0 ? second_pass_ik_timeout_ : arm_jmg->getDefaultIKTimeout();
+  ROS_INFO_STREAM_NAMED("grasp_filter", "Retrying " << timed_out_grasps.size() << " timed out grasps with IK timeout "
+                                                    << solver_timeout_);
+
+  // These grasps were chosen by score, do not let the predictor skip them again
+  const bool use_success_predictor = use_success_predictor_;
+  use_success_predictor_ = false;
+  std::size_t remaining_grasps =
+      filterGraspsHelper(timed_out_grasps, cloned_scene, arm_jmg, seed_state, filter_pregrasp, false);
+  use_success_predictor_ = use_success_predictor;
+
+  return remaining_grasps;
+}
+
+std::size_t GraspFilter::filterGraspsInWorkers(std::vector<GraspCandidatePtr>& grasp_candidates,
+                                               planning_scene::PlanningScenePtr cloned_scene,
+                                               const robot_model::JointModelGroup* arm_jmg,
+                                               const moveit::core::RobotStatePtr seed_state, bool filter_pregrasp)
+{
+  std::vector<double> ik_seed_state;
+  seed_state->copyJointGroupPositions(arm_jmg, ik_seed_state);
+  if (ik_seed_state.size() > SHARED_MAX_JOINTS || arm_jmg->getName().size() >= SHARED_MAX_NAME_LENGTH)
+  {
+    ROS_WARN_STREAM_NAMED("grasp_filter", "Arm " << arm_jmg->getName() << " does not fit the shared grasp queue");
+    return filterGraspsHelper(grasp_candidates, cloned_scene, arm_jmg, seed_state, filter_pregrasp, false);
+  }
+
+  SharedGraspBatch batch = SharedGraspBatch();
+  batch.scene_version_ = worker_scene_publisher_->publishScene(cloned_scene);
+  arm_jmg->getName().copy(batch.arm_name_, SHARED_MAX_NAME_LENGTH - 1);
+  batch.filter_pregrasp_ = filter_pregrasp;
+  batch.ik_timeout_ = solver_timeout_;
+  std::copy(ik_seed_state.begin(), ik_seed_state.end(), batch.seed_state_);
+  batch.num_seed_joints_ = ik_seed_state.size();
+
+  // Cutting planes and orientations are cheap, only the grasps that need IK are sent
+  std::vector<GraspCandidatePtr> worker_grasps;
+  std::vector<GraspCandidatePtr> local_grasps;
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+    if (!filterGraspByCuttingPlanesAndOrientations(grasp_candidates[i]))
+      worker_grasps.push_back(grasp_candidates[i]);
+
+  ros::Time start_time = ros::Time::now();
+
+  // Batches larger than the queue are sent in parts that reuse its slots
+  std::vector<GraspCandidatePtr> unfinished_grasps;
+  const std::size_t capacity = worker_queue_->getCapacity();
+  for (std::size_t part_begin = 0; part_begin < worker_grasps.size(); part_begin += capacity)
+  {
+    std::vector<GraspCandidatePtr> part_grasps;
+    for (std::size_t i = part_begin; i < std::min(part_begin + capacity, worker_grasps.size()); ++i)
+    {
+      if (writeGraspTask(worker_grasps[i], worker_queue_->getTask(part_grasps.size())))
+        part_grasps.push_back(worker_grasps[i]);
+      else
+        local_grasps.push_back(worker_grasps[i]);
+    }
+
+    batch.num_tasks_ = part_grasps.size();
+    worker_queue_->submitBatch(batch);
+
+    // Answer workers that missed a scene diff while waiting. The tasks of crashed workers are handed to the others
+    ros::Time deadline = ros::Time::now() + ros::Duration(worker_timeout_);
+    while (!worker_queue_->waitForBatch(0.01))
+    {
+      if (worker_queue_->takeSceneRequest())
+        worker_scene_publisher_->publishFullScene(cloned_scene);
+      if (ros::Time::now() > deadline || !ros::ok() || worker_queue_->getNumWorkers() == 0)
+        break;
+    }
+    worker_queue_->closeBatch();
+
+    for (std::size_t i = 0; i < part_grasps.size(); ++i)
+    {
+      const SharedGraspTask& task = worker_queue_->getTask(i);
+      if (task.done_)
+      {
+        readGraspTaskResult(task, part_grasps[i]);
+        continue;
+      }
+      unfinished_grasps.push_back(part_grasps[i]);
+    }
+  }
+
+  ROS_INFO_STREAM_NAMED("grasp_filter", "Worker processes filtered "
+                                            << worker_grasps.size() - local_grasps.size() - unfinished_grasps.size()
+                                            << " of " << worker_grasps.size() << " grasps in "
+                                            << (ros::Time::now() - start_time).toSec() << " seconds");
+  if (!unfinished_grasps.empty())
+  {
+    ROS_WARN_STREAM_NAMED("grasp_filter", unfinished_grasps.size() << " grasps were not finished by the worker "
+                                                                      "processes, filtering them here");
+    local_grasps.insert(local_grasps.end(), unfinished_grasps.begin(), unfinished_grasps.end());
+  }
+
+  // Grasps that do not fit the queue or were not finished
+  if (!local_grasps.empty())
+    filterGraspsHelper(local_grasps, cloned_scene, arm_jmg, seed_state, filter_pregrasp, false);
+
+  // Workers do not know the motion start state, they prefer solutions close to the seed
+  setJointDistances(grasp_candidates, getMotionStartJoints(arm_jmg, seed_state));
+
+  std::size_t remaining_grasps = 0;
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+    if (grasp_candidates[i]->isValid())
+      remaining_grasps++;
+  return remaining_grasps;
+}
+
+bool GraspFilter::loadWorkerQueue()
+{
+  if (!use_worker_processes_)
+    return false;
+
+  if (!worker_queue_)
+  {
+    worker_queue_.reset(new SharedGraspQueue());
+    if (!worker_queue_->create(worker_queue_name_, std::max(worker_queue_capacity_, 1), worker_lease_timeout_))
+    {
+      ROS_ERROR_STREAM_NAMED("grasp_filter", "Unable to create shared grasp queue, not using worker processes");
+      use_worker_processes_ = false;
+      worker_queue_.reset();
+      return false;
+    }
+    ros::NodeHandle root_nh;
+    worker_scene_publisher_.reset(new WorkerScenePublisher(root_nh, worker_queue_name_));
+  }
+
+  if (worker_queue_->getNumWorkers() == 0)
+  {
+    ROS_DEBUG_STREAM_NAMED("grasp_filter", "No worker processes connected to queue " << worker_queue_name_);
+    return false;
+  }
+  return true;
+}
+
+planning_scene::PlanningScenePtr
+GraspFilter::loadStaticDistanceField(const planning_scene::PlanningScenePtr& cloned_scene)
+{
+  if (static_collision_objects_.empty())
+    return cloned_scene;
+
+  if (!static_distance_field_)
+    static_distance_field_.reset(new StaticDistanceField(robot_state_->getRobotModel(), static_collision_objects_,
+                                                         static_distance_field_resolution_,
+                                                         static_distance_field_padding_));
+
+  // Only rebuilt when the static objects changed
+  static_distance_field_->update(*cloned_scene);
+  return static_distance_field_->getDynamicScene(cloned_scene);
+}
+
+planning_scene::PlanningScenePtr
+GraspFilter::cropPlanningScene(const planning_scene::PlanningScenePtr& check_scene,
+                               const std::vector<GraspCandidatePtr>& grasp_candidates,
+                               const std::vector<const robot_model::JointModelGroup*>& arms)
+{
+  if (!scene_region_cropper_ || grasp_candidates.empty())
+    return check_scene;
+
+  // The arm moves the end effector between the pregrasp and the grasp
+  EigenSTL::vector_Vector3d targets;
+  targets.reserve(2 * grasp_candidates.size());
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+  {
+    const GraspCandidatePtr& grasp_candidate = grasp_candidates[i];
+    const geometry_msgs::Point& grasp_position = grasp_candidate->grasp_.grasp_pose.pose.position;
+    targets.push_back(Eigen::Vector3d(grasp_position.x, grasp_position.y, grasp_position.z));
+    const geometry_msgs::Point pregrasp_position =
+        GraspGenerator::getPreGraspPose(grasp_candidate, grasp_candidate->grasp_data_->parent_link_->getName())
+            .pose.position;
+    targets.push_back(Eigen::Vector3d(pregrasp_position.x, pregrasp_position.y, pregrasp_position.z));
+  }
+
+  robot_state_->update();
+  Eigen::AlignedBox3d region;
+  for (std::size_t i = 0; i < arms.size(); ++i)
+    region.extend(scene_region_cropper_->computeReachRegion(*robot_state_, arms[i], targets));
+
+  return scene_region_cropper_->cropScene(check_scene, region);
+}
+
+void GraspFilter::loadCoarseCollisionChecker(const planning_scene::PlanningScenePtr& cloned_scene)
+{
+  if (!coarse_collision_checking_)
+    return;
+
+  // Link bounds only depend on the robot model
+  if (!coarse_collision_checker_)
+    coarse_collision_checker_.reset(
+        new CoarseCollisionChecker(robot_state_->getRobotModel(), coarse_collision_clearance_));
+  coarse_collision_checker_->setPlanningScene(*cloned_scene);
+}
+
+std::size_t GraspFilter::orderBySuccessPrediction(std::vector<GraspCandidatePtr>& grasp_candidates,
+                                                  const GraspSuccessPredictorPtr& predictor,
+                                                  const Eigen::Affine3d& link_transform,
+                                                  std::vector<std::size_t>& grasp_order,
+                                                  EigenSTL::vector_Affine3d& ik_poses)
+{
+  ik_poses.resize(grasp_candidates.size());
+  std::vector<double> predictions(grasp_candidates.size());
+  std::vector<double> priorities(grasp_candidates.size());
+  std::vector<char> filtered(grasp_candidates.size(), false);
+  predictor->updateIndex();
+
+#pragma omp parallel for schedule(static)
+  for (std::size_t grasp_id = 0; grasp_id < grasp_candidates.size(); ++grasp_id)
+  {
+    // Grasps the cheap filters remove need no IK, and must not count as skipped
+    if (filterGraspByCuttingPlanesAndOrientations(grasp_candidates[grasp_id]))
+    {
+      filtered[grasp_id] = true;
+      continue;
+    }
+
+    Eigen::Affine3d grasp_pose;
+    tf::poseMsgToEigen(grasp_candidates[grasp_id]->grasp_.grasp_pose.pose, grasp_pose);
+    ik_poses[grasp_id] = link_transform * grasp_pose;
+    predictions[grasp_id] = predictor->predictSuccess(ik_poses[grasp_id]);
+    priorities[grasp_id] = predictions[grasp_id] * grasp_candidates[grasp_id]->grasp_.grasp_quality;
+  }
+
+  grasp_order.erase(std::remove_if(grasp_order.begin(), grasp_order.end(),
+                                   [&filtered](std::size_t grasp_id) { return filtered[grasp_id]; }),
+                    grasp_order.end());
+  std::stable_sort(grasp_order.begin(), grasp_order.end(),
+                   [&priorities](std::size_t a, std::size_t b) { return priorities[a] > priorities[b]; });
+
+  // Only skip once the model has seen enough results
+  if (predictor->getNumSamples() < static_cast<std::size_t>(success_predictor_min_samples_))
+    return 0;
+
+  // Keep a fraction of the skipped grasps so that wrong predictions get corrected
+  std::vector<std::size_t> kept_grasps;
+  kept_grasps.reserve(grasp_order.size());
+  std::size_t skipped_grasps = 0;
+  double verify_credit = 0;
+  for (std::size_t i = 0; i < grasp_order.size(); ++i)
+  {
+    const std::size_t grasp_id = grasp_order[i];
+    if (predictions[grasp_id] < success_predictor_threshold_)
+    {
+      verify_credit += success_predictor_verify_fraction_;
+      if (verify_credit < 1.0)
+      {
+        grasp_candidates[grasp_id]->grasp_skipped_by_predictor_ = true;
+        skipped_grasps++;
+        continue;
+      }
+      verify_credit -= 1.0;
+    }
+    kept_grasps.push_back(grasp_id);
+  }
+  grasp_order.swap(kept_grasps);
+
+  ROS_DEBUG_STREAM_NAMED("grasp_filter", "Predictor skipped " << skipped_grasps << " of "
+                                                              << grasp_candidates.size() << " grasps");
+  return skipped_grasps;
+}
+
+void GraspFilter::setFilterCache(const std::vector<GraspCandidatePtr>& grasp_candidates,
+                                 const planning_scene::PlanningScenePtr& cloned_scene,
+                                 const robot_model::JointModelGroup* arm_jmg,
+                                 const moveit::core::RobotStatePtr& seed_state, bool filter_pregrasp)
+{
+  std::vector<std::size_t> grasp_ids(grasp_candidates.size());
+  for (std::size_t i = 0; i < grasp_ids.size(); ++i)
+    grasp_ids[i] = i;
+  filter_cache_.setFilterRequest(grasp_candidates, arm_jmg, filter_pregrasp);
+  filter_cache_predicates_version_ = grasp_predicates_->getVersion();
+  updateFilterCache(grasp_candidates, grasp_ids, arm_jmg);
+  filter_cache_.setWorld(*cloned_scene, *seed_state);
+}
+
+void GraspFilter::updateFilterCache(const std::vector<GraspCandidatePtr>& grasp_candidates,
+                                    const std::vector<std::size_t>& grasp_ids,
+                                    const robot_model::JointModelGroup* arm_jmg)
+{
+  if (grasp_ids.empty() || robot_states_.empty())
+    return;
+
+  // Links that were collision checked
+  std::vector<const robot_model::LinkModel*> links = arm_jmg->getLinkModels();
+  const std::vector<const robot_model::LinkModel*>& ee_links =
+      grasp_candidates[grasp_ids.front()]->grasp_data_->ee_jmg_->getLinkModels();
+  links.insert(links.end(), ee_links.begin(), ee_links.end());
+
+  std::vector<AlignedBoxes> grasp_volumes(grasp_ids.size());
+  std::vector<char> unbounded(grasp_ids.size(), false);
+
+  omp_set_num_threads(robot_states_.size());
+#pragma omp parallel for schedule(dynamic)
+  for (std::size_t i = 0; i < grasp_ids.size(); ++i)
+  {
+    moveit::core::RobotStatePtr& robot_state = robot_states_[omp_get_thread_num()];
+    GraspCandidatePtr grasp_candidate = grasp_candidates[grasp_ids[i]];
+
+    // Cutting planes and orientations do not depend on the planning scene
+    if (grasp_candidate->grasp_filtered_by_cutting_plane_ || grasp_candidate->grasp_filtered_by_orientation_)
+      continue;
+
+    // Without an IK solution the arm configurations the solver rejected are unknown, any part of the arm may have
+    // been blocked by an object anywhere in the scene. These grasps are re-checked after every scene change
+    if (grasp_candidate->grasp_filtered_by_ik_ || grasp_candidate->pregrasp_filtered_by_ik_ ||
+        grasp_candidate->grasp_skipped_by_predictor_)
+    {
+      unbounded[i] = true;
+      continue;
+    }
+
+    grasp_candidate->getGraspStateOpen(robot_state);
+    robot_state->update();
+    GraspFilterCache::getLinkVolumes(*robot_state, links, grasp_volumes[i]);
+
+    if (!grasp_candidate->pregrasp_ik_solution_.empty())
+    {
+      grasp_candidate->getPreGraspState(robot_state);
+      robot_state->update();
+      GraspFilterCache::getLinkVolumes(*robot_state, links, grasp_volumes[i]);
+    }
+  }
+
+  for (std::size_t i = 0; i < grasp_ids.size(); ++i)
+  {
+    if (unbounded[i])
+      filter_cache_.setGraspUnbounded(grasp_ids[i]);
+    else
+      filter_cache_.setGraspVolumes(grasp_ids[i], grasp_volumes[i]);
+  }
+}
+
+bool GraspFilter::checkEndEffector(const robot_model::JointModelGroup* arm_jmg)
+{
+  if (arm_jmg->getAttachedEndEffectorNames().size() == 0)
+  {
+    ROS_ERROR_STREAM_NAMED("grasp_filter", "No end effectors attached to arm " << arm_jmg->getName());
+    return false;
+  }
+  else if (arm_jmg->getAttachedEndEffectorNames().size() > 1)
+  {
+    ROS_ERROR_STREAM_NAMED("grasp_filter", "More than one end effectors attached to arm " << arm_jmg->getName());
+    return false;
+  }
+  return true;
+}
+
+bool GraspFilter::loadKinematicSolvers(const robot_model::JointModelGroup* arm_jmg, std::size_t num_threads)
+{
+  std::vector<kinematics::KinematicsBaseConstPtr>& kin_solvers = kin_solvers_[arm_jmg->getName()];
+  if (kin_solvers.size() == num_threads)
+    return true;
+
+  kin_solvers.clear();
+
+  // Create an ik solver for every thread
+  for (std::size_t i = 0; i < num_threads; ++i)
+  {
+    // ROS_DEBUG_STREAM_NAMED("grasp_filter","Creating ik solver " << i);
+    kin_solvers.push_back(arm_jmg->getSolverInstance());
+
+    // Test to make sure we have a valid kinematics solver
+    if (!kin_solvers[i])
+    {
+      ROS_ERROR_STREAM_NAMED("grasp_filter", "No kinematic solver found for arm " << arm_jmg->getName());
+      kin_solvers.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+bool GraspFilter::loadBatchIKSolvers(const robot_model::JointModelGroup* arm_jmg, std::size_t num_threads)
+{
+  if (batch_ik_solver_type_.empty())
+    return false;
+
+  std::vector<BatchIKSolverPtr>& batch_ik_solvers = batch_ik_solvers_[arm_jmg->getName()];
+  if (batch_ik_solvers.size() == num_threads)
+    return true;
+
+  batch_ik_solvers.clear();
+  const std::vector<kinematics::KinematicsBaseConstPtr>& kin_solvers = kin_solvers_[arm_jmg->getName()];
+  if (batch_ik_solver_type_ == "panda_analytic")
+  {
+    // The analytic solver has no state besides scratch memory, so one validated solver is copied to every thread
+    PandaBatchIKSolver panda_solver(panda_ik_redundancy_step_);
+    if (panda_solver.initialize(*robot_state_, arm_jmg, kin_solvers[0]->getBaseFrame(), kin_solvers[0]->getTipFrame()))
+    {
+      for (std::size_t i = 0; i < num_threads; ++i)
+        batch_ik_solvers.push_back(BatchIKSolverPtr(new PandaBatchIKSolver(panda_solver)));
+    }
+    else
+      ROS_WARN_STREAM_NAMED("grasp_filter", "Arm " << arm_jmg->getName() << " is not a Panda, using its kinematics "
+                                                                            "plugin for batch IK");
+  }
+  else if (batch_ik_solver_type_ != "kinematics_plugin")
+  {
+    ROS_ERROR_STREAM_NAMED("grasp_filter", "Unknown batch_ik_solver '" << batch_ik_solver_type_
+                                                                       << "', using the kinematics plugin");
+  }
+
+  // Any other solver is called pose by pose through the plugin
+  if (batch_ik_solvers.empty())
+  {
+    for (std::size_t i = 0; i < num_threads; ++i)
+      batch_ik_solvers.push_back(BatchIKSolverPtr(new KinematicsPluginBatchIKSolver(kin_solvers[i], arm_jmg)));
+  }
+
+  ROS_DEBUG_STREAM_NAMED("grasp_filter", "Using " << batch_ik_solvers[0]->getName() << " batch IK for arm "
+                                                  << arm_jmg->getName());
+  return true;
+}
+
+std::vector<double> GraspFilter::getMotionStartJoints(const robot_model::JointModelGroup* arm_jmg,
+                                                      const moveit::core::RobotStatePtr& seed_state) const
+{
+  std::vector<double> motion_start_joints;
+  if (motion_start_state_)
+    motion_start_state_->copyJointGroupPositions(arm_jmg, motion_start_joints);
+  else
+    seed_state->copyJointGroupPositions(arm_jmg, motion_start_joints);
+  return motion_start_joints;
+}
+
+void GraspFilter::setJointDistances(std::vector<GraspCandidatePtr>& grasp_candidates,
+                                    const std::vector<double>& motion_start_joints) const
+{
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+  {
+    GraspCandidatePtr& grasp_candidate = grasp_candidates[i];
+    if (!grasp_candidate->isValid())
+      continue;
+
+    // The arm moves freely to the pregrasp, then along a cartesian path to the grasp
+    const std::vector<double>& first_solution = grasp_candidate->pregrasp_ik_solution_.empty() ?
+                                                    grasp_candidate->grasp_ik_solution_ :
+                                                    grasp_candidate->pregrasp_ik_solution_;
+    if (first_solution.size() == motion_start_joints.size())
+      grasp_candidate->joint_distance_ = jointDistance(motion_start_joints, &first_solution[0]);
+  }
+}
+
+void GraspFilter::loadRobotStates(std::size_t num_threads)
+{
+  // The workers keep their CPUs and scheduling for later filter calls
+  if (worker_thread_config_.isEnabled())
+  {
+    robot_states_.resize(num_threads);
+    omp_set_num_threads(num_threads);
+#pragma omp parallel
+    {
+      const std::size_t thread_id = omp_get_thread_num();
+      worker_thread_config_.applyToCurrentThread(thread_id);
+      robot_states_[thread_id].reset(new moveit::core::RobotState(*robot_state_));
+    }
+    return;
+  }
+
+  if (robot_states_.size() != num_threads)
+  {
+    robot_states_.clear();
+    for (std::size_t i = 0; i < num_threads; ++i)
+    {
+      // Copy the previous robot state
+      robot_states_.push_back(moveit::core::RobotStatePtr(new moveit::core::RobotState(*robot_state_)));
+    }
+  }
+  else  // update the states
+  {
+    for (std::size_t i = 0; i < num_threads; ++i)
+    {
+      // Copy the previous robot state
+      *(robot_states_[i]) = *robot_state_;
+    }
+  }
+}
+
+bool GraspFilter::getIKFrameTransform(const robot_model::JointModelGroup* arm_jmg, Eigen::Affine3d& link_transform)
+{
+  link_transform = Eigen::Affine3d::Identity();
+
+  const std::string& ik_frame = kin_solvers_[arm_jmg->getName()][0]->getBaseFrame();
+  ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug",
+                         "Frame transform from ik_frame: " << ik_frame << " and robot model frame: "
+                                                           << robot_state_->getRobotModel()->getModelFrame());
+  if (!moveit::core::Transforms::sameFrame(ik_frame, robot_state_->getRobotModel()->getModelFrame()))
+  {
+    const robot_model::LinkModel* lm =
+        robot_state_->getLinkModel((!ik_frame.empty() && ik_frame[0] == '/') ? ik_frame.substr(1) : ik_frame);
+
+    if (!lm)
+    {
+      ROS_ERROR_STREAM_NAMED("grasp_filter", "Unable to find frame for link transform");
+      return false;
+    }
+
+    link_transform = robot_state_->getGlobalLinkTransform(lm).inverse();
+  }
+  return true;
+}
+
+bool GraspFilter::filterGraspByCuttingPlanesAndOrientations(GraspCandidatePtr& grasp_candidate)
+{
+  const std::vector<CuttingPlanePtr>& cutting_planes = grasp_predicates_->getCuttingPlanes();
+  const std::vector<DesiredGraspOrientationPtr>& desired_grasp_orientations =
+      grasp_predicates_->getDesiredGraspOrientations();
+
+  // Filter by cutting planes
+  for (std::size_t i = 0; i < cutting_planes.size(); i++)
+  {
+    if (filterGraspByPlane(grasp_candidate, cutting_planes[i]->pose_, cutting_planes[i]->plane_,
+                           cutting_planes[i]->direction_) == true)
+    {
+      grasp_candidate->grasp_filtered_by_cutting_plane_ = true;
+      return true;
+    }
+  }
+
+  // Filter by desired orientation
+  for (std::size_t i = 0; i < desired_grasp_orientations.size(); i++)
+  {
+    if (filterGraspByOrientation(grasp_candidate, desired_grasp_orientations[i]->pose_,
+                                 desired_grasp_orientations[i]->max_angle_offset_) == true)
+    {
+      grasp_candidate->grasp_filtered_by_orientation_ = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool GraspFilter::processCandidateGrasp(IkThreadStructPtr& ik_thread_struct)
+{
+  ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Checking grasp #" << ik_thread_struct->grasp_id);
+
+  // Helper pointer
+  GraspCandidatePtr& grasp_candidate = ik_thread_struct->grasp_candidates_[ik_thread_struct->grasp_id];
+
+  // Get pose
+  ik_thread_struct->ik_pose_ = grasp_candidate->grasp_.grasp_pose;
+
+  // Debug
+  if (ik_thread_struct->verbose_ && false)
+  {
+    ik_thread_struct->ik_pose_.header.frame_id = ik_thread_struct->kin_solver_->getBaseFrame();
+    visual_tools_->publishZArrow(ik_thread_struct->ik_pose_.pose, rviz_visual_tools::RED, rviz_visual_tools::MEDIUM,
+                                 0.1);
+  }
+
+  if (filterGraspByCuttingPlanesAndOrientations(grasp_candidate))
+    return false;
+
+  moveit::core::GroupStateValidityCallbackFn constraint_fn = createConstraintFn(ik_thread_struct);
+
+  // Set gripper position (how open the fingers are) to the custom open position
+  if (grasp_candidate->grasp_data_->end_effector_type_ == FINGER)
+    grasp_candidate->getGraspStateOpenEEOnly(ik_thread_struct->robot_state_);
+
+  // Start from a previous solution of this grasp if there is one
+  if (grasp_candidate->grasp_ik_seed_.size() == ik_thread_struct->ik_seed_state_.size())
+    ik_thread_struct->ik_seed_state_ = grasp_candidate->grasp_ik_seed_;
+
+  // Solve IK Problem for grasp posture
+  Eigen::Affine3d ik_pose;
+  ik_thread_struct->collision_diagnostics_.clear();
+  if (!findIKSolution(grasp_candidate->grasp_ik_solution_, ik_thread_struct, grasp_candidate, constraint_fn))
+  {
+    ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Unable to find the-grasp IK solution");
+    grasp_candidate->grasp_filtered_by_ik_ = true;
+    if (record_failure_diagnostics_)
+    {
+      tf::poseMsgToEigen(ik_thread_struct->ik_pose_.pose, ik_pose);
+      recordFailure(ik_thread_struct, grasp_candidate, GRASP_IK_FAILURE, ik_thread_struct->error_code_, ik_pose,
+                    ik_thread_struct->ik_seed_state_, ik_thread_struct->collision_diagnostics_);
+    }
+    return false;
+  }
+
+  // Copy solution to seed state so that next solution is faster
+  ik_thread_struct->ik_seed_state_ = grasp_candidate->grasp_ik_solution_;
+
+  // Check if IK solution for grasp pose is valid for fingers closed as well
+  if (grasp_candidate->grasp_data_->end_effector_type_ == FINGER)
+  {
+    ik_thread_struct->collision_diagnostics_.clear();
+    if (!checkFingersClosedIK(grasp_candidate->grasp_ik_solution_, ik_thread_struct, grasp_candidate, constraint_fn))
+    {
+      ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Unable to find the-grasp IK solution with CLOSED fingers");
+      grasp_candidate->grasp_filtered_by_ik_closed_ = true;
+      if (record_failure_diagnostics_)
+      {
+        tf::poseMsgToEigen(ik_thread_struct->ik_pose_.pose, ik_pose);
+        recordFailure(ik_thread_struct, grasp_candidate, GRASP_CLOSED_IK_FAILURE, ik_thread_struct->error_code_,
+                      ik_pose, ik_thread_struct->ik_seed_state_, ik_thread_struct->collision_diagnostics_);
+      }
+      return false;
+    }
+  }
+
+  // Start pre-grasp section
+  if (ik_thread_struct->filter_pregrasp_)  // optionally check the pregrasp
+  {
+    // Convert to a pre-grasp
+    const std::string& ee_parent_link_name = grasp_candidate->grasp_data_->ee_jmg_->getEndEffectorParentGroup().second;
+    ik_thread_struct->ik_pose_ = GraspGenerator::getPreGraspPose(grasp_candidate, ee_parent_link_name);
+    if (grasp_candidate->pregrasp_ik_seed_.size() == ik_thread_struct->ik_seed_state_.size())
+      ik_thread_struct->ik_seed_state_ = grasp_candidate->pregrasp_ik_seed_;
+
+    // Solve IK Problem for pregrasp
+    ik_thread_struct->collision_diagnostics_.clear();
+    if (!findIKSolution(grasp_candidate->pregrasp_ik_solution_, ik_thread_struct, grasp_candidate, constraint_fn))
+    {
+      ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Unable to find PRE-grasp IK solution");
+      grasp_candidate->pregrasp_filtered_by_ik_ = true;
+      if (record_failure_diagnostics_)
+      {
+        tf::poseMsgToEigen(ik_thread_struct->ik_pose_.pose, ik_pose);
+        recordFailure(ik_thread_struct, grasp_candidate, PREGRASP_IK_FAILURE, ik_thread_struct->error_code_, ik_pose,
+                      ik_thread_struct->ik_seed_state_, ik_thread_struct->collision_diagnostics_);
+      }
+      return false;
+    }
+    else if (grasp_candidate->pregrasp_ik_solution_.empty())
+    {
+      ROS_ERROR_STREAM_NAMED("grasp_filter", "IK solution found but vector is empty??");
+    }
+  }
+  else
+  {
+    ROS_WARN_STREAM_NAMED("grasp_filter", "Not filtering pregrasp!!");
   }
 
   return true;
 }
 
+std::size_t GraspFilter::processCandidateGraspBatch(IkThreadStructPtr& ik_thread_struct,
+                                                    const std::vector<std::size_t>& grasp_ids)
+{
+  std::vector<GraspCandidatePtr>& grasp_candidates = ik_thread_struct->grasp_candidates_;
+  robot_state::RobotStatePtr& robot_state = ik_thread_struct->robot_state_;
+
+  // Grasps of the current stage with their IK problems, in the frame of the solver
+  std::vector<std::size_t> stage_ids;
+  EigenSTL::vector_Affine3d ik_poses;
+  std::vector<std::vector<double> > ik_seeds;
+  std::vector<std::vector<double> > ik_solutions;
+  std::vector<moveit_msgs::MoveItErrorCodes> error_codes;
+
+  Eigen::Affine3d pose;
+  for (std::size_t i = 0; i < grasp_ids.size(); ++i)
+  {
+    GraspCandidatePtr& grasp_candidate = grasp_candidates[grasp_ids[i]];
+    ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Checking grasp #" << grasp_ids[i]);
+    if (filterGraspByCuttingPlanesAndOrientations(grasp_candidate))
+      continue;
+
+    tf::poseMsgToEigen(grasp_candidate->grasp_.grasp_pose.pose, pose);
+    stage_ids.push_back(grasp_ids[i]);
+    ik_poses.push_back(ik_thread_struct->link_transform_ * pose);
+
+    // Start from a previous solution of this grasp if there is one
+    if (grasp_candidate->grasp_ik_seed_.size() == ik_thread_struct->ik_seed_state_.size())
+      ik_seeds.push_back(grasp_candidate->grasp_ik_seed_);
+    else
+      ik_seeds.push_back(ik_thread_struct->ik_seed_state_);
+  }
+  if (stage_ids.empty())
+    return 0;
+
+  moveit::core::GroupStateValidityCallbackFn constraint_fn = createConstraintFn(ik_thread_struct);
+
+  // Solutions are checked with the gripper at the custom open position of their grasp, and optionally gathered
+  const robot_model::JointModelGroup* arm_jmg = grasp_candidates[stage_ids[0]]->grasp_data_->arm_jmg_;
+  const bool gather = ik_solutions_per_grasp_ > 1 && !ik_thread_struct->motion_start_joints_.empty();
+  std::vector<ClosestIKSolution> closest(stage_ids.size());
+  std::vector<CollisionDiagnostics> collisions(record_failure_diagnostics_ ? stage_ids.size() : 0);
+  BatchIKCallbackFn ik_callback_fn = [&](std::size_t pose_id, const std::vector<double>& solution) {
+    GraspCandidatePtr& grasp_candidate = grasp_candidates[stage_ids[pose_id]];
+    if (grasp_candidate->grasp_data_->end_effector_type_ == FINGER)
+      grasp_candidate->getGraspStateOpenEEOnly(robot_state);
+
+    // The validity callback records into the thread struct, which only looks at the contacts of the first collision
+    CollisionDiagnostics& thread_collision = ik_thread_struct->collision_diagnostics_;
+    if (record_failure_diagnostics_)
+      thread_collision.num_rejected_states_ = collisions[pose_id].num_rejected_states_;
+
+    bool valid;
+    if (gather)
+      valid = gatherIKSolution(&closest[pose_id], ik_solutions_per_grasp_, ik_thread_struct->motion_start_joints_,
+                               constraint_fn, robot_state.get(), arm_jmg, &solution[0]);
+    else
+      valid = constraint_fn(robot_state.get(), arm_jmg, &solution[0]);
+
+    if (record_failure_diagnostics_)
+    {
+      if (collisions[pose_id].num_rejected_states_ == 0)
+        std::swap(collisions[pose_id], thread_collision);
+      else
+        collisions[pose_id].num_rejected_states_ = thread_collision.num_rejected_states_;
+      thread_collision.clear();
+    }
+    return valid;
+  };
+
+  // Solve IK for all grasp postures
+  ik_thread_struct->batch_ik_solver_->solve(ik_poses, ik_seeds, ik_thread_struct->timeout_, ik_callback_fn,
+                                            ik_solutions, error_codes);
+  useClosestIKSolutions(closest, ik_solutions, error_codes);
+
+  // Check the solved grasps with closed fingers and set up their pregrasps
+  std::size_t num_valid = 0;
+  std::size_t num_pregrasps = 0;
+  for (std::size_t i = 0; i < stage_ids.size(); ++i)
+  {
+    GraspCandidatePtr& grasp_candidate = grasp_candidates[stage_ids[i]];
+    if (error_codes[i].val != moveit_msgs::MoveItErrorCodes::SUCCESS)
+    {
+      ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Unable to find the-grasp IK solution");
+      if (error_codes[i].val == moveit_msgs::MoveItErrorCodes::TIMED_OUT)
+        grasp_candidate->ik_timed_out_ = true;
+      grasp_candidate->grasp_filtered_by_ik_ = true;
+      if (record_failure_diagnostics_)
+        recordFailure(ik_thread_struct, grasp_candidate, GRASP_IK_FAILURE, error_codes[i], ik_poses[i], ik_seeds[i],
+                      collisions[i]);
+      continue;
+    }
+    grasp_candidate->grasp_ik_solution_ = ik_solutions[i];
+
+    // Copy solution to seed state so that next solution is faster
+    ik_thread_struct->ik_seed_state_ = ik_solutions[i];
+
+    // Check if IK solution for grasp pose is valid for fingers closed as well
+    if (grasp_candidate->grasp_data_->end_effector_type_ == FINGER &&
+        !checkFingersClosedIK(grasp_candidate->grasp_ik_solution_, ik_thread_struct, grasp_candidate, constraint_fn))
+    {
+      ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Unable to find the-grasp IK solution with CLOSED fingers");
+      grasp_candidate->grasp_filtered_by_ik_closed_ = true;
+      if (record_failure_diagnostics_)
+      {
+        CollisionDiagnostics collision;
+        recordFailure(ik_thread_struct, grasp_candidate, GRASP_CLOSED_IK_FAILURE, error_codes[i], ik_poses[i],
+                      ik_seeds[i], collision);
+      }
+      continue;
+    }
+
+    if (!ik_thread_struct->filter_pregrasp_)
+    {
+      num_valid++;
+      continue;
+    }
+
+    // Convert to a pre-grasp, earlier entries of the stage are reused
+    const std::string& ee_parent_link_name = grasp_candidate->grasp_data_->ee_jmg_->getEndEffectorParentGroup().second;
+    tf::poseMsgToEigen(GraspGenerator::getPreGraspPose(grasp_candidate, ee_parent_link_name).pose, pose);
+    stage_ids[num_pregrasps] = stage_ids[i];
+    ik_poses[num_pregrasps] = ik_thread_struct->link_transform_ * pose;
+    if (grasp_candidate->pregrasp_ik_seed_.size() == grasp_candidate->grasp_ik_solution_.size())
+      ik_seeds[num_pregrasps] = grasp_candidate->pregrasp_ik_seed_;
+    else
+      ik_seeds[num_pregrasps] = grasp_candidate->grasp_ik_solution_;
+    num_pregrasps++;
+  }
+
+  if (!ik_thread_struct->filter_pregrasp_)
+  {
+    ROS_WARN_STREAM_NAMED("grasp_filter", "Not filtering pregrasp!!");
+    return num_valid;
+  }
+  if (num_pregrasps == 0)
+    return 0;
+  stage_ids.resize(num_pregrasps);
+  ik_poses.resize(num_pregrasps);
+  ik_seeds.resize(num_pregrasps);
+
+  // Solve IK for all pregrasps
+  closest.assign(num_pregrasps, ClosestIKSolution());
+  collisions.assign(record_failure_diagnostics_ ? num_pregrasps : 0, CollisionDiagnostics());
+  ik_thread_struct->batch_ik_solver_->solve(ik_poses, ik_seeds, ik_thread_struct->timeout_, ik_callback_fn,
+                                            ik_solutions, error_codes);
+  useClosestIKSolutions(closest, ik_solutions, error_codes);
+
+  for (std::size_t i = 0; i < stage_ids.size(); ++i)
+  {
+    GraspCandidatePtr& grasp_candidate = grasp_candidates[stage_ids[i]];
+    if (error_codes[i].val != moveit_msgs::MoveItErrorCodes::SUCCESS)
+    {
+      ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Unable to find PRE-grasp IK solution");
+      if (error_codes[i].val == moveit_msgs::MoveItErrorCodes::TIMED_OUT)
+        grasp_candidate->ik_timed_out_ = true;
+      grasp_candidate->pregrasp_filtered_by_ik_ = true;
+      if (record_failure_diagnostics_)
+        recordFailure(ik_thread_struct, grasp_candidate, PREGRASP_IK_FAILURE, error_codes[i], ik_poses[i],
+                      ik_seeds[i], collisions[i]);
+      continue;
+    }
+    grasp_candidate->pregrasp_ik_solution_ = ik_solutions[i];
+    num_valid++;
+  }
+
+  return num_valid;
+}
+
+moveit::core::GroupStateValidityCallbackFn GraspFilter::createConstraintFn(IkThreadStructPtr& ik_thread_struct) const
+{
+  const planning_scene::PlanningScene* planning_scene = ik_thread_struct->planning_scene_.get();
+  const CoarseCollisionChecker* coarse_collision_checker = coarse_collision_checker_.get();
+  const StaticDistanceField* static_distance_field = static_distance_field_.get();
+  const bool verbose = collision_verbose_ || ik_thread_struct->verbose_;
+  const double verbose_speed = collision_verbose_speed_;
+  const moveit_visual_tools::MoveItVisualToolsPtr visual_tools = visual_tools_;
+  CollisionDiagnostics* collision_diagnostics =
+      record_failure_diagnostics_ ? &ik_thread_struct->collision_diagnostics_ : NULL;
+
+  // More arguments than boost::bind takes
+  return [=](robot_state::RobotState* robot_state, const robot_model::JointModelGroup* group,
+             const double* ik_solution) {
+    return isGraspStateValidRecorded(planning_scene, coarse_collision_checker, static_distance_field, verbose,
+                                     verbose_speed, visual_tools, collision_diagnostics, robot_state, group,
+                                     ik_solution);
+  };
+}
+
 bool GraspFilter::findIKSolution(std::vector<double>& ik_solution, IkThreadStructPtr& ik_thread_struct,
                                  GraspCandidatePtr& grasp_candidate,
                                  const moveit::core::GroupStateValidityCallbackFn& constraint_fn)
@@ -536,16 +1923,50 @@ bool GraspFilter::findIKSolution(std::vector<double>& ik_solution, IkThreadStruc
   eigen_pose = ik_thread_struct->link_transform_ * eigen_pose;
   tf::poseEigenToMsg(eigen_pose, ik_thread_struct->ik_pose_.pose);
 
-  // Set callback function
-  kinematics::KinematicsBase::IKCallbackFn ik_callback_fn;
-  if (constraint_fn)
-    ik_callback_fn = boost::bind(&ikCallbackFnAdapter, ik_thread_struct->robot_state_.get(),
-                                 grasp_candidate->grasp_data_->arm_jmg_, constraint_fn, _1, _2, _3);
+  // Optionally gather several solutions and keep the one closest to the motion start
+  std::vector<ClosestIKSolution> closest(1);
+  moveit::core::GroupStateValidityCallbackFn ik_constraint_fn = constraint_fn;
+  if (constraint_fn && ik_solutions_per_grasp_ > 1 && !ik_thread_struct->motion_start_joints_.empty())
+    ik_constraint_fn = boost::bind(&gatherIKSolution, &closest[0], ik_solutions_per_grasp_,
+                                   boost::cref(ik_thread_struct->motion_start_joints_), constraint_fn, _1, _2, _3);
 
-  // Test it with IK
-  ik_thread_struct->kin_solver_->searchPositionIK(ik_thread_struct->ik_pose_.pose, ik_thread_struct->ik_seed_state_,
-                                                  ik_thread_struct->timeout_, ik_solution, ik_callback_fn,
-                                                  ik_thread_struct->error_code_);
+  if (ik_thread_struct->batch_ik_solver_)
+  {
+    // A batch of one pose
+    const robot_model::JointModelGroup* arm_jmg = grasp_candidate->grasp_data_->arm_jmg_;
+    BatchIKCallbackFn batch_callback_fn;
+    if (ik_constraint_fn)
+      batch_callback_fn = [&](std::size_t, const std::vector<double>& solution) {
+        return ik_constraint_fn(ik_thread_struct->robot_state_.get(), arm_jmg, &solution[0]);
+      };
+    std::vector<std::vector<double> > ik_solutions;
+    std::vector<moveit_msgs::MoveItErrorCodes> error_codes;
+    ik_thread_struct->batch_ik_solver_->solve(EigenSTL::vector_Affine3d(1, eigen_pose),
+                                              std::vector<std::vector<double> >(1, ik_thread_struct->ik_seed_state_),
+                                              ik_thread_struct->timeout_, batch_callback_fn, ik_solutions,
+                                              error_codes);
+    useClosestIKSolutions(closest, ik_solutions, error_codes);
+    ik_solution = ik_solutions[0];
+    ik_thread_struct->error_code_ = error_codes[0];
+  }
+  else
+  {
+    // Set callback function
+    kinematics::KinematicsBase::IKCallbackFn ik_callback_fn;
+    if (ik_constraint_fn)
+      ik_callback_fn = boost::bind(&ikCallbackFnAdapter, ik_thread_struct->robot_state_.get(),
+                                   grasp_candidate->grasp_data_->arm_jmg_, ik_constraint_fn, _1, _2, _3);
+
+    // Test it with IK
+    ik_thread_struct->kin_solver_->searchPositionIK(ik_thread_struct->ik_pose_.pose, ik_thread_struct->ik_seed_state_,
+                                                    ik_thread_struct->timeout_, ik_solution, ik_callback_fn,
+                                                    ik_thread_struct->error_code_);
+    if (closest[0].count_ > 0)
+    {
+      ik_solution = closest[0].solution_;
+      ik_thread_struct->error_code_.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+    }
+  }
 
   // Results
   if (ik_thread_struct->error_code_.val == moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION)
@@ -557,6 +1978,7 @@ bool GraspFilter::findIKSolution(std::vector<double>& ik_solution, IkThreadStruc
   else if (ik_thread_struct->error_code_.val == moveit_msgs::MoveItErrorCodes::TIMED_OUT)
   {
     ROS_DEBUG_STREAM_NAMED("grasp_filter.superdebug", "Timed Out.");
+    grasp_candidate->ik_timed_out_ = true;
     return false;
   }
   else if (ik_thread_struct->error_code_.val != moveit_msgs::MoveItErrorCodes::SUCCESS)
@@ -573,11 +1995,41 @@ bool GraspFilter::checkFingersClosedIK(std::vector<double>& ik_solution, IkThrea
                                        GraspCandidatePtr& grasp_candidate,
                                        const moveit::core::GroupStateValidityCallbackFn& constraint_fn)
 {
+  robot_state::RobotState* robot_state = ik_thread_struct->robot_state_.get();
+  const robot_model::JointModelGroup* ee_jmg = grasp_candidate->grasp_data_->ee_jmg_;
+
+  // Verbose mode shows the collisions of the whole arm
+  if (ik_thread_struct->verbose_ || collision_verbose_ || !ee_jmg)
+  {
+    // Set gripper position (how open the fingers are) to CLOSED
+    grasp_candidate->getGraspStateClosedEEOnly(ik_thread_struct->robot_state_);
+
+    // Set callback function
+    if (!constraint_fn(robot_state, grasp_candidate->grasp_data_->arm_jmg_, &ik_solution[0]))
+    {
+      ROS_WARN_STREAM_NAMED("grasp_filter", "Grasp filtered because in collision with fingers CLOSED");
+      return false;
+    }
+    return true;
+  }
+
+  // The state usually still holds the solution from the IK callback, then only the end effector subtree is dirty
+  const std::vector<int>& arm_variables = grasp_candidate->grasp_data_->arm_jmg_->getVariableIndexList();
+  const double* positions = robot_state->getVariablePositions();
+  for (std::size_t i = 0; i < arm_variables.size(); ++i)
+  {
+    if (positions[arm_variables[i]] != ik_solution[i])
+    {
+      robot_state->setJointGroupPositions(grasp_candidate->grasp_data_->arm_jmg_, ik_solution);
+      break;
+    }
+  }
+
   // Set gripper position (how open the fingers are) to CLOSED
   grasp_candidate->getGraspStateClosedEEOnly(ik_thread_struct->robot_state_);
 
-  // Set callback function
-  if (!constraint_fn(ik_thread_struct->robot_state_.get(), grasp_candidate->grasp_data_->arm_jmg_, &ik_solution[0]))
+  // The arm was checked with open fingers, only the links moved by the end effector need checking again
+  if (!isEndEffectorStateValid(ik_thread_struct, ee_jmg))
   {
     ROS_WARN_STREAM_NAMED("grasp_filter", "Grasp filtered because in collision with fingers CLOSED");
     return false;
@@ -586,15 +2038,173 @@ bool GraspFilter::checkFingersClosedIK(std::vector<double>& ik_solution, IkThrea
   return true;
 }
 
+bool GraspFilter::isEndEffectorStateValid(const IkThreadStructPtr& ik_thread_struct,
+                                          const robot_model::JointModelGroup* ee_jmg) const
+{
+  robot_state::RobotState& robot_state = *ik_thread_struct->robot_state_;
+  robot_state.update();
+
+  if (static_distance_field_ && static_distance_field_->isStateColliding(robot_state, ee_jmg))
+    return false;
+
+  if (coarse_collision_checker_)
+  {
+    switch (coarse_collision_checker_->checkWorldCollision(robot_state, ee_jmg))
+    {
+      case COARSE_COLLIDING:
+        return false;
+      case COARSE_CLEAR:
+      {
+        collision_detection::CollisionRequest req;
+        collision_detection::CollisionResult res;
+        req.group_name = ee_jmg->getName();
+        ik_thread_struct->planning_scene_->checkSelfCollision(req, res, robot_state);
+        return !res.collision;
+      }
+      case COARSE_UNKNOWN:
+        break;
+    }
+  }
+
+  // Pairs without an end effector link have not changed
+  return !ik_thread_struct->planning_scene_->isStateColliding(robot_state, ee_jmg->getName());
+}
+
+void GraspFilter::recordFailure(IkThreadStructPtr& ik_thread_struct, const GraspCandidatePtr& grasp_candidate,
+                                GraspFailureStage stage, const moveit_msgs::MoveItErrorCodes& error_code,
+                                const Eigen::Affine3d& ik_pose, const std::vector<double>& ik_seed,
+                                CollisionDiagnostics& collision)
+{
+  static const std::size_t RESIDUAL_STEPS = 4;
+
+  ik_thread_struct->failure_diagnostics_.push_back(GraspFailureDiagnostics());
+  GraspFailureDiagnostics& failure = ik_thread_struct->failure_diagnostics_.back();
+  failure.grasp_candidate_ = grasp_candidate;
+  failure.stage_ = stage;
+  failure.error_code_ = error_code;
+  failure.position_residual_ = -1.0;
+  failure.rotation_residual_ = -1.0;
+  std::swap(failure.collision_, collision);
+
+  // The state of the thread still has the fingers closed around the solution of the arm
+  robot_state::RobotState& robot_state = *ik_thread_struct->robot_state_;
+  if (stage == GRASP_CLOSED_IK_FAILURE)
+  {
+    if (failure.collision_.num_rejected_states_ == 0)
+      recordCollision(ik_thread_struct->planning_scene_.get(), robot_state, grasp_candidate->grasp_data_->ee_jmg_,
+                      false, &failure.collision_);
+    return;
+  }
+  if (failure.collision_.num_rejected_states_ > 0 || ik_seed.empty())
+    return;
+
+  // Nothing collided, so measure how far a few Jacobian steps from the seed get towards the pose
+  const robot_model::JointModelGroup* arm_jmg = grasp_candidate->grasp_data_->arm_jmg_;
+  const robot_model::LinkModel* link = robot_state.getRobotModel()->getLinkModel(
+      grasp_candidate->grasp_data_->ee_jmg_->getEndEffectorParentGroup().second);
+  if (!link)
+    return;
+  const Eigen::Affine3d target = ik_thread_struct->link_transform_.inverse() * ik_pose;
+  const CartesianInterpolator interpolator;
+
+  robot_state.setJointGroupPositions(arm_jmg, ik_seed);
+  for (std::size_t step = 0; step < RESIDUAL_STEPS; ++step)
+  {
+    if (interpolator.computeJacobianStep(robot_state, arm_jmg, link, target))
+      break;
+    robot_state.enforceBounds(arm_jmg);
+  }
+  robot_state.update();
+  const Eigen::Affine3d& link_pose = robot_state.getGlobalLinkTransform(link);
+  failure.position_residual_ = (target.translation() - link_pose.translation()).norm();
+  failure.rotation_residual_ =
+      std::abs(Eigen::AngleAxisd(target.rotation() * link_pose.rotation().transpose()).angle());
+}
+
+void GraspFilter::collectFailureDiagnostics(const std::vector<IkThreadStructPtr>& ik_thread_structs)
+{
+  for (std::size_t i = 0; i < ik_thread_structs.size(); ++i)
+  {
+    std::vector<GraspFailureDiagnostics>& thread_failures = ik_thread_structs[i]->failure_diagnostics_;
+    failure_diagnostics_.insert(failure_diagnostics_.end(), thread_failures.begin(), thread_failures.end());
+    thread_failures.clear();
+  }
+}
+
+bool GraspFilter::visualizeFailureDiagnostics(std::size_t max_failures)
+{
+  if (failure_diagnostics_.empty())
+  {
+    ROS_WARN_STREAM_NAMED("grasp_filter", "No failures recorded, is record_failure_diagnostics enabled?");
+    return false;
+  }
+
+  // Best scored grasps first
+  std::vector<std::size_t> order(failure_diagnostics_.size());
+  for (std::size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [this](std::size_t a, std::size_t b) {
+    return failure_diagnostics_[a].grasp_candidate_->grasp_.grasp_quality >
+           failure_diagnostics_[b].grasp_candidate_->grasp_.grasp_quality;
+  });
+  order.resize(std::min(max_failures, order.size()));
+
+  static const char* STAGE_NAMES[] = { "grasp", "grasp with closed fingers", "pre-grasp" };
+  for (std::size_t i = 0; i < order.size(); ++i)
+  {
+    const GraspFailureDiagnostics& failure = failure_diagnostics_[order[i]];
+    const CollisionDiagnostics& collision = failure.collision_;
+    ROS_INFO_STREAM_NAMED("grasp_filter", "Failure of the " << STAGE_NAMES[failure.stage_] << " IK with quality "
+                                                            << failure.grasp_candidate_->grasp_.grasp_quality
+                                                            << ", error code " << failure.error_code_.val << ", "
+                                                            << collision.num_rejected_states_
+                                                            << " states rejected by collision");
+    for (std::size_t j = 0; j < collision.contact_pairs_.size(); ++j)
+      ROS_INFO_STREAM_NAMED("grasp_filter", "  Contact between " << collision.contact_pairs_[j].first << " and "
+                                                                  << collision.contact_pairs_[j].second);
+    if (failure.position_residual_ >= 0)
+      ROS_INFO_STREAM_NAMED("grasp_filter", "  Residual " << failure.position_residual_ << " m, "
+                                                          << failure.rotation_residual_ << " rad");
+
+    if (!collision.rejected_positions_.empty())
+    {
+      const robot_model::JointModelGroup* group =
+          failure.stage_ == GRASP_CLOSED_IK_FAILURE ? failure.grasp_candidate_->grasp_data_->ee_jmg_ :
+                                                      failure.grasp_candidate_->grasp_data_->arm_jmg_;
+      robot_state_->setJointGroupPositions(group, collision.rejected_positions_);
+      visual_tools_->publishRobotState(robot_state_, rviz_visual_tools::RED);
+      for (std::size_t j = 0; j < collision.contact_points_.size(); ++j)
+        visual_tools_->publishSphere(collision.contact_points_[j], rviz_visual_tools::YELLOW,
+                                     rviz_visual_tools::MEDIUM);
+    }
+    visual_tools_->trigger();
+    ros::Duration(collision_verbose_speed_).sleep();
+  }
+
+  return true;
+}
+
 void GraspFilter::addCuttingPlane(Eigen::Affine3d pose, grasp_parallel_plane plane, int direction)
 {
-  cutting_planes_.push_back(CuttingPlanePtr(new CuttingPlane(pose, plane, direction)));
+  grasp_predicates_->addCuttingPlane(pose, plane, direction);
+  filter_cache_.clear();
 }
 
 void GraspFilter::addDesiredGraspOrientation(Eigen::Affine3d pose, double max_angle_offset)
 {
-  desired_grasp_orientations_.push_back(
-      DesiredGraspOrientationPtr(new DesiredGraspOrientation(pose, max_angle_offset)));
+  grasp_predicates_->addDesiredGraspOrientation(pose, max_angle_offset);
+  filter_cache_.clear();
+}
+
+void GraspFilter::setMotionStartState(const moveit::core::RobotStatePtr& motion_start_state)
+{
+  motion_start_state_ = motion_start_state;
+}
+
+void GraspFilter::setGraspPredicates(const GraspPredicatesPtr& grasp_predicates)
+{
+  grasp_predicates_ = grasp_predicates;
+  filter_cache_.clear();
 }
 
 bool GraspFilter::removeInvalidAndFilter(std::vector<GraspCandidatePtr>& grasp_candidates)
@@ -625,8 +2235,18 @@ bool GraspFilter::removeInvalidAndFilter(std::vector<GraspCandidatePtr>& grasp_c
     return false;
   }
 
-  // Order remaining valid grasps by best score
-  std::sort(grasp_candidates.begin(), grasp_candidates.end(), compareGraspScores);
+  // Order remaining valid grasps by best score, optionally penalizing the motion to them
+  if (joint_distance_weight_ > 0)
+  {
+    const double weight = joint_distance_weight_;
+    std::sort(grasp_candidates.begin(), grasp_candidates.end(),
+              [weight](const GraspCandidatePtr& grasp_a, const GraspCandidatePtr& grasp_b) {
+                return grasp_a->grasp_.grasp_quality - weight * grasp_a->joint_distance_ >
+                       grasp_b->grasp_.grasp_quality - weight * grasp_b->joint_distance_;
+              });
+  }
+  else
+    std::sort(grasp_candidates.begin(), grasp_candidates.end(), compareGraspScores);
 
   ROS_INFO_STREAM_NAMED("grasp_filter", "Sorted valid grasps, highest quality is "
                                             << grasp_candidates.front()->grasp_.grasp_quality
@@ -656,7 +2276,7 @@ bool GraspFilter::visualizeGrasps(const std::vector<GraspCandidatePtr>& grasp_ca
   {
     double size = 0.1;  // 0.01 * grasp_candidates[i]->grasp_.grasp_quality;
 
-    if (grasp_candidates[i]->grasp_filtered_by_ik_)
+    if (grasp_candidates[i]->grasp_filtered_by_ik_ || grasp_candidates[i]->grasp_skipped_by_predictor_)
     {
       visual_tools_->publishZArrow(grasp_candidates[i]->grasp_.grasp_pose.pose, rviz_visual_tools::RED,
                                    rviz_visual_tools::MEDIUM, size);
@@ -743,18 +2363,19 @@ bool GraspFilter::visualizeCuttingPlanes()
 {
   if (show_cutting_planes_)
   {
-    for (std::size_t i = 0; i < cutting_planes_.size(); i++)
+    const std::vector<CuttingPlanePtr>& cutting_planes = grasp_predicates_->getCuttingPlanes();
+    for (std::size_t i = 0; i < cutting_planes.size(); i++)
     {
-      switch (cutting_planes_[i]->plane_)
+      switch (cutting_planes[i]->plane_)
       {
         case XY:
-          visual_tools_->publishXYPlane(cutting_planes_[i]->pose_);
+          visual_tools_->publishXYPlane(cutting_planes[i]->pose_);
           break;
         case XZ:
-          visual_tools_->publishXZPlane(cutting_planes_[i]->pose_);
+          visual_tools_->publishXZPlane(cutting_planes[i]->pose_);
           break;
         case YZ:
-          visual_tools_->publishYZPlane(cutting_planes_[i]->pose_);
+          visual_tools_->publishYZPlane(cutting_planes[i]->pose_);
           break;
         default:
           ROS_ERROR_STREAM_NAMED("grasp_filter", "Unknown cutting plane type");
@@ -766,12 +2387,14 @@ bool GraspFilter::visualizeCuttingPlanes()
 
 void GraspFilter::clearCuttingPlanes()
 {
-  cutting_planes_.clear();
+  grasp_predicates_->clearCuttingPlanes();
+  filter_cache_.clear();
 }
 
 void GraspFilter::clearDesiredGraspOrientations()
 {
-  desired_grasp_orientations_.clear();
+  grasp_predicates_->clearDesiredGraspOrientations();
+  filter_cache_.clear();
 }
 
 bool GraspFilter::addCuttingPlanesForBin(const Eigen::Affine3d& world_to_bin, const Eigen::Affine3d& bin_to_product,
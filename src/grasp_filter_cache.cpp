@@ -0,0 +1,438 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Remembers the arm volumes of filtered grasps so that only grasps near a planning scene change are re-checked
+*/
+
+// moveit_grasps
+#include <moveit_grasps/grasp_filter_cache.h>
+
+// geometric_shapes
+#include <geometric_shapes/shape_operations.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// Number of bits used for each axis of a cell key
+const int CELL_KEY_BITS = 21;
+const std::int64_t CELL_KEY_OFFSET = std::int64_t(1) << (CELL_KEY_BITS - 1);
+const std::int64_t CELL_KEY_MASK = (std::int64_t(1) << CELL_KEY_BITS) - 1;
+
+bool sameObject(const std::vector<shapes::ShapeConstPtr>& shapes_a, const EigenSTL::vector_Affine3d& poses_a,
+                const std::vector<shapes::ShapeConstPtr>& shapes_b, const EigenSTL::vector_Affine3d& poses_b)
+{
+  if (shapes_a.size() != shapes_b.size() || poses_a.size() != poses_b.size())
+    return false;
+  for (std::size_t i = 0; i < shapes_a.size(); ++i)
+    if (shapes_a[i] != shapes_b[i])
+      return false;
+  for (std::size_t i = 0; i < poses_a.size(); ++i)
+    if (!(poses_a[i].matrix() == poses_b[i].matrix()))
+      return false;
+  return true;
+}
+
+bool hasOctomap(const std::vector<shapes::ShapeConstPtr>& shapes)
+{
+  for (std::size_t i = 0; i < shapes.size(); ++i)
+    if (shapes[i]->type == shapes::OCTREE)
+      return true;
+  return false;
+}
+
+// Joint position changes below this, e.g. sensor noise, do not invalidate the results
+const double POSITION_TOLERANCE = 1e-4;
+
+bool samePositions(const std::vector<double>& positions_a, const double* positions_b, const std::vector<int>& skip)
+{
+  for (std::size_t i = 0; i < positions_a.size(); ++i)
+    if (std::abs(positions_a[i] - positions_b[i]) > POSITION_TOLERANCE &&
+        std::find(skip.begin(), skip.end(), static_cast<int>(i)) == skip.end())
+      return false;
+  return true;
+}
+
+bool sameAllowedCollisionMatrix(const collision_detection::AllowedCollisionMatrix& acm_a,
+                                const collision_detection::AllowedCollisionMatrix& acm_b)
+{
+  std::vector<std::string> names;
+  std::vector<std::string> names_b;
+  acm_a.getAllEntryNames(names);
+  acm_b.getAllEntryNames(names_b);
+  std::sort(names.begin(), names.end());
+  std::sort(names_b.begin(), names_b.end());
+  if (names != names_b)
+    return false;
+
+  collision_detection::AllowedCollision::Type type_a;
+  collision_detection::AllowedCollision::Type type_b;
+  for (std::size_t i = 0; i < names.size(); ++i)
+  {
+    const bool found_a = acm_a.getDefaultEntry(names[i], type_a);
+    if (found_a != acm_b.getDefaultEntry(names[i], type_b) || (found_a && type_a != type_b))
+      return false;
+    for (std::size_t j = i; j < names.size(); ++j)
+    {
+      const bool found_a = acm_a.getEntry(names[i], names[j], type_a);
+      if (found_a != acm_b.getEntry(names[i], names[j], type_b) || (found_a && type_a != type_b))
+        return false;
+    }
+  }
+  return true;
+}
+}
+
+namespace moveit_grasps
+{
+GraspFilterCache::GraspFilterCache(double cell_size)
+  : arm_jmg_(NULL), filter_pregrasp_(false), cell_size_(cell_size)
+{
+}
+
+void GraspFilterCache::clear()
+{
+  grasp_candidates_.clear();
+  arm_jmg_ = NULL;
+  grasp_volumes_.clear();
+  unbounded_grasps_.clear();
+  cells_.clear();
+  objects_.clear();
+  attached_bodies_.clear();
+  allowed_collision_matrix_ = collision_detection::AllowedCollisionMatrix();
+  current_positions_.clear();
+  seed_positions_.clear();
+}
+
+void GraspFilterCache::setFilterRequest(const std::vector<GraspCandidatePtr>& grasp_candidates,
+                                        const robot_model::JointModelGroup* arm_jmg, bool filter_pregrasp)
+{
+  clear();
+  grasp_candidates_ = grasp_candidates;
+  arm_jmg_ = arm_jmg;
+  filter_pregrasp_ = filter_pregrasp;
+  grasp_volumes_.resize(grasp_candidates.size());
+}
+
+bool GraspFilterCache::matchesFilterRequest(const std::vector<GraspCandidatePtr>& grasp_candidates,
+                                            const robot_model::JointModelGroup* arm_jmg, bool filter_pregrasp) const
+{
+  if (grasp_candidates_.empty() || arm_jmg != arm_jmg_ || filter_pregrasp != filter_pregrasp_)
+    return false;
+  return grasp_candidates == grasp_candidates_;
+}
+
+void GraspFilterCache::setGraspVolumes(std::size_t grasp_id, const AlignedBoxes& volumes)
+{
+  if (grasp_id >= grasp_volumes_.size())
+  {
+    ROS_ERROR_STREAM_NAMED("grasp_filter_cache", "Grasp id " << grasp_id << " out of range");
+    return;
+  }
+
+  indexGrasp(grasp_id, false);
+  grasp_volumes_[grasp_id] = volumes;
+  indexGrasp(grasp_id, true);
+  unbounded_grasps_.erase(std::remove(unbounded_grasps_.begin(), unbounded_grasps_.end(), grasp_id),
+                          unbounded_grasps_.end());
+}
+
+void GraspFilterCache::setGraspUnbounded(std::size_t grasp_id)
+{
+  setGraspVolumes(grasp_id, AlignedBoxes());
+  if (grasp_id < grasp_volumes_.size())
+    unbounded_grasps_.push_back(grasp_id);
+}
+
+void GraspFilterCache::findOverlappingGrasps(const Eigen::AlignedBox3d& region, std::set<std::size_t>& grasp_ids) const
+{
+  if (region.isEmpty())
+    return;
+  grasp_ids.insert(unbounded_grasps_.begin(), unbounded_grasps_.end());
+
+  Eigen::Vector3i min_cell;
+  Eigen::Vector3i max_cell;
+  getCellRange(region, min_cell, max_cell);
+
+  // Large regions, e.g. a table, are faster to test against every volume than to walk the grid
+  const Eigen::Vector3i num_cells = max_cell - min_cell + Eigen::Vector3i::Ones();
+  const double region_cells = double(num_cells.x()) * num_cells.y() * num_cells.z();
+  std::vector<std::size_t> candidates;
+  if (region_cells > cells_.size())
+  {
+    for (std::size_t grasp_id = 0; grasp_id < grasp_volumes_.size(); ++grasp_id)
+      candidates.push_back(grasp_id);
+  }
+  else
+  {
+    for (int x = min_cell.x(); x <= max_cell.x(); ++x)
+      for (int y = min_cell.y(); y <= max_cell.y(); ++y)
+        for (int z = min_cell.z(); z <= max_cell.z(); ++z)
+        {
+          std::unordered_map<std::int64_t, std::vector<std::size_t> >::const_iterator cell_it =
+              cells_.find(getCellKey(x, y, z));
+          if (cell_it != cells_.end())
+            candidates.insert(candidates.end(), cell_it->second.begin(), cell_it->second.end());
+        }
+  }
+
+  // Exact test of the volumes of every grasp sharing a cell with the region
+  for (std::size_t i = 0; i < candidates.size(); ++i)
+  {
+    const std::size_t grasp_id = candidates[i];
+    if (grasp_ids.count(grasp_id))
+      continue;
+    const AlignedBoxes& volumes = grasp_volumes_[grasp_id];
+    for (std::size_t j = 0; j < volumes.size(); ++j)
+    {
+      if (volumes[j].intersects(region))
+      {
+        grasp_ids.insert(grasp_id);
+        break;
+      }
+    }
+  }
+}
+
+void GraspFilterCache::setWorld(const planning_scene::PlanningScene& planning_scene,
+                                const moveit::core::RobotState& seed_state)
+{
+  const collision_detection::World& world = *planning_scene.getWorld();
+  objects_.clear();
+  for (collision_detection::World::const_iterator it = world.begin(); it != world.end(); ++it)
+  {
+    ObjectSnapshot& snapshot = objects_[it->first];
+    snapshot.shapes_ = it->second->shapes_;
+    snapshot.shape_poses_ = it->second->shape_poses_;
+    snapshot.bounded_ = getObjectVolume(*it->second, snapshot.volume_);
+  }
+
+  const moveit::core::RobotState& current_state = planning_scene.getCurrentState();
+  std::vector<const moveit::core::AttachedBody*> attached_bodies;
+  current_state.getAttachedBodies(attached_bodies);
+  attached_bodies_.clear();
+  for (std::size_t i = 0; i < attached_bodies.size(); ++i)
+  {
+    AttachedBodySnapshot& snapshot = attached_bodies_[attached_bodies[i]->getName()];
+    snapshot.link_name_ = attached_bodies[i]->getAttachedLinkName();
+    snapshot.shapes_ = attached_bodies[i]->getShapes();
+    snapshot.fixed_transforms_ = attached_bodies[i]->getFixedTransforms();
+    snapshot.touch_links_ = attached_bodies[i]->getTouchLinks();
+  }
+
+  allowed_collision_matrix_ = planning_scene.getAllowedCollisionMatrix();
+  current_positions_.assign(current_state.getVariablePositions(),
+                            current_state.getVariablePositions() + current_state.getVariableCount());
+  seed_positions_.assign(seed_state.getVariablePositions(),
+                         seed_state.getVariablePositions() + seed_state.getVariableCount());
+}
+
+bool GraspFilterCache::matchesRobot(const planning_scene::PlanningScene& planning_scene,
+                                    const moveit::core::RobotState& seed_state) const
+{
+  const moveit::core::RobotState& current_state = planning_scene.getCurrentState();
+  if (current_state.getVariableCount() != current_positions_.size() ||
+      seed_state.getVariableCount() != seed_positions_.size())
+    return false;
+
+  // The arm joints of the current state are replaced by the IK solutions
+  const std::vector<int> no_variables;
+  const std::vector<int>& arm_variables = arm_jmg_ ? arm_jmg_->getVariableIndexList() : no_variables;
+  if (!samePositions(current_positions_, current_state.getVariablePositions(), arm_variables) ||
+      !samePositions(seed_positions_, seed_state.getVariablePositions(), no_variables))
+    return false;
+
+  return matchesCollisionSettings(planning_scene);
+}
+
+bool GraspFilterCache::matchesCollisionSettings(const planning_scene::PlanningScene& planning_scene) const
+{
+  const moveit::core::RobotState& current_state = planning_scene.getCurrentState();
+  std::vector<const moveit::core::AttachedBody*> attached_bodies;
+  current_state.getAttachedBodies(attached_bodies);
+  if (attached_bodies.size() != attached_bodies_.size())
+    return false;
+  for (std::size_t i = 0; i < attached_bodies.size(); ++i)
+  {
+    std::map<std::string, AttachedBodySnapshot>::const_iterator snapshot_it =
+        attached_bodies_.find(attached_bodies[i]->getName());
+    if (snapshot_it == attached_bodies_.end())
+      return false;
+    const AttachedBodySnapshot& snapshot = snapshot_it->second;
+    if (snapshot.link_name_ != attached_bodies[i]->getAttachedLinkName() ||
+        snapshot.touch_links_ != attached_bodies[i]->getTouchLinks() ||
+        !sameObject(snapshot.shapes_, snapshot.fixed_transforms_, attached_bodies[i]->getShapes(),
+                    attached_bodies[i]->getFixedTransforms()))
+      return false;
+  }
+
+  return sameAllowedCollisionMatrix(allowed_collision_matrix_, planning_scene.getAllowedCollisionMatrix());
+}
+
+bool GraspFilterCache::getChangedRegions(const collision_detection::World& world, AlignedBoxes& changed_regions,
+                                         bool ignore_octomaps) const
+{
+  std::set<std::string> seen_objects;
+  for (collision_detection::World::const_iterator it = world.begin(); it != world.end(); ++it)
+  {
+    const collision_detection::World::Object& object = *it->second;
+    seen_objects.insert(it->first);
+    if (ignore_octomaps && hasOctomap(object.shapes_))
+      continue;
+
+    std::map<std::string, ObjectSnapshot>::const_iterator snapshot_it = objects_.find(it->first);
+    if (snapshot_it != objects_.end())
+    {
+      const ObjectSnapshot& snapshot = snapshot_it->second;
+      if (sameObject(snapshot.shapes_, snapshot.shape_poses_, object.shapes_, object.shape_poses_))
+        continue;
+
+      // Object moved or changed shape, the grasps near its old location may have become valid
+      if (!snapshot.bounded_)
+        return false;
+      changed_regions.push_back(snapshot.volume_);
+    }
+
+    // Object was added, moved or changed shape
+    Eigen::AlignedBox3d volume;
+    if (!getObjectVolume(object, volume))
+      return false;
+    changed_regions.push_back(volume);
+  }
+
+  // Removed objects
+  for (std::map<std::string, ObjectSnapshot>::const_iterator it = objects_.begin(); it != objects_.end(); ++it)
+  {
+    if (seen_objects.count(it->first) || (ignore_octomaps && hasOctomap(it->second.shapes_)))
+      continue;
+    if (!it->second.bounded_)
+      return false;
+    changed_regions.push_back(it->second.volume_);
+  }
+
+  return true;
+}
+
+void GraspFilterCache::getLinkVolumes(const moveit::core::RobotState& robot_state,
+                                      const std::vector<const robot_model::LinkModel*>& links, AlignedBoxes& volumes)
+{
+  for (std::size_t i = 0; i < links.size(); ++i)
+  {
+    const robot_model::LinkModel* link = links[i];
+    if (link->getShapes().empty())
+      continue;
+
+    // Rotate the link's centered bounding box into the planning frame and bound it again
+    const Eigen::Affine3d& link_pose = robot_state.getGlobalLinkTransform(link);
+    const Eigen::Vector3d center = link_pose * link->getCenteredBoundingBoxOffset();
+    const Eigen::Vector3d half_extents =
+        link_pose.linear().cwiseAbs() * (link->getShapeExtentsAtOrigin() / 2.0);
+    volumes.push_back(Eigen::AlignedBox3d(center - half_extents, center + half_extents));
+  }
+}
+
+bool GraspFilterCache::getObjectVolume(const collision_detection::World::Object& object, Eigen::AlignedBox3d& volume)
+{
+  volume.setEmpty();
+  for (std::size_t i = 0; i < object.shapes_.size(); ++i)
+  {
+    // Octomaps and planes have no useful bounds
+    if (object.shapes_[i]->type == shapes::OCTREE || object.shapes_[i]->type == shapes::PLANE)
+      return false;
+
+    Eigen::Vector3d center;
+    double radius;
+    shapes::computeShapeBoundingSphere(object.shapes_[i].get(), center, radius);
+    center = object.shape_poses_[i] * center;
+    volume.extend(center - Eigen::Vector3d::Constant(radius));
+    volume.extend(center + Eigen::Vector3d::Constant(radius));
+  }
+  return true;
+}
+
+std::int64_t GraspFilterCache::getCellKey(int x, int y, int z) const
+{
+  return (((x + CELL_KEY_OFFSET) & CELL_KEY_MASK) << (2 * CELL_KEY_BITS)) |
+         (((y + CELL_KEY_OFFSET) & CELL_KEY_MASK) << CELL_KEY_BITS) | ((z + CELL_KEY_OFFSET) & CELL_KEY_MASK);
+}
+
+void GraspFilterCache::getCellRange(const Eigen::AlignedBox3d& box, Eigen::Vector3i& min_cell,
+                                    Eigen::Vector3i& max_cell) const
+{
+  for (std::size_t i = 0; i < 3; ++i)
+  {
+    min_cell[i] = static_cast<int>(std::floor(box.min()[i] / cell_size_));
+    max_cell[i] = static_cast<int>(std::floor(box.max()[i] / cell_size_));
+  }
+}
+
+void GraspFilterCache::indexGrasp(std::size_t grasp_id, bool insert)
+{
+  const AlignedBoxes& volumes = grasp_volumes_[grasp_id];
+  for (std::size_t i = 0; i < volumes.size(); ++i)
+  {
+    Eigen::Vector3i min_cell;
+    Eigen::Vector3i max_cell;
+    getCellRange(volumes[i], min_cell, max_cell);
+
+    for (int x = min_cell.x(); x <= max_cell.x(); ++x)
+      for (int y = min_cell.y(); y <= max_cell.y(); ++y)
+        for (int z = min_cell.z(); z <= max_cell.z(); ++z)
+        {
+          const std::int64_t key = getCellKey(x, y, z);
+          if (insert)
+          {
+            // Volumes of one grasp are inserted together, so a duplicate can only be at the back
+            std::vector<std::size_t>& cell = cells_[key];
+            if (cell.empty() || cell.back() != grasp_id)
+              cell.push_back(grasp_id);
+          }
+          else
+          {
+            std::unordered_map<std::int64_t, std::vector<std::size_t> >::iterator cell_it = cells_.find(key);
+            if (cell_it == cells_.end())
+              continue;
+            std::vector<std::size_t>& cell = cell_it->second;
+            cell.erase(std::remove(cell.begin(), cell.end(), grasp_id), cell.end());
+            if (cell.empty())
+              cells_.erase(cell_it);
+          }
+        }
+  }
+}
+
+}  // namespace
@@ -0,0 +1,148 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Filters the grasps of a shared grasp queue, as one of several worker processes
+*/
+
+#include <moveit_grasps/grasp_filter_worker.h>
+
+// C++
+#include <cstring>
+#include <omp.h>
+
+namespace moveit_grasps
+{
+namespace
+{
+// Time to wait for the scene version of a batch, before asking the coordinator for the complete scene
+const double SCENE_TIMEOUT = 0.1;
+}
+
+GraspFilterWorker::GraspFilterWorker(const GraspFilterPtr& grasp_filter, const GraspDataPtr& grasp_data,
+                                     const std::string& queue_name, std::size_t chunk_size, std::size_t num_threads)
+  : grasp_filter_(grasp_filter)
+  , grasp_data_(grasp_data)
+  , queue_name_(queue_name)
+  , chunk_size_(std::max<std::size_t>(chunk_size, 1))
+  , num_threads_(std::max<std::size_t>(num_threads, 1))
+  , skipped_batch_id_(0)
+{
+  planning_scene_.reset(new planning_scene::PlanningScene(grasp_data_->robot_model_));
+}
+
+bool GraspFilterWorker::connect()
+{
+  if (!queue_.open(queue_name_))
+    return false;
+
+  scene_subscriber_.reset(new WorkerSceneSubscriber(nh_, queue_name_, planning_scene_));
+  ROS_INFO_STREAM_NAMED("grasp_filter_worker", "Connected to queue " << queue_name_ << " with "
+                                                                      << queue_.getNumWorkers() << " workers");
+  return true;
+}
+
+bool GraspFilterWorker::processBatch(double timeout)
+{
+  SharedGraspBatch batch;
+  if (!queue_.waitForTasks(batch, timeout))
+    return false;
+
+  const robot_model::JointModelGroup* arm_jmg = grasp_data_->arm_jmg_;
+  const std::string arm_name(batch.arm_name_, strnlen(batch.arm_name_, SHARED_MAX_NAME_LENGTH));
+  if (arm_name != arm_jmg->getName())
+  {
+    if (batch.batch_id_ != skipped_batch_id_)
+      ROS_WARN_STREAM_NAMED("grasp_filter_worker", "Leaving grasps for arm " << arm_name << " to other workers");
+    skipped_batch_id_ = batch.batch_id_;
+    ros::Duration(std::min(timeout, SCENE_TIMEOUT)).sleep();
+    return false;
+  }
+
+  planning_scene::PlanningScenePtr cloned_scene;
+  if (!scene_subscriber_->getScene(batch.scene_version_, SCENE_TIMEOUT, cloned_scene))
+  {
+    ROS_DEBUG_STREAM_NAMED("grasp_filter_worker", "No scene of version " << batch.scene_version_
+                                                                         << ", requesting the complete scene");
+    queue_.requestScene();
+    return false;
+  }
+
+  moveit::core::RobotStatePtr seed_state(new moveit::core::RobotState(cloned_scene->getCurrentState()));
+  seed_state->setJointGroupPositions(
+      arm_jmg, std::vector<double>(batch.seed_state_, batch.seed_state_ + batch.num_seed_joints_));
+  grasp_filter_->setSolverTimeout(batch.ik_timeout_);
+
+  // The filter uses as many threads as OpenMP allows
+  omp_set_num_threads(num_threads_);
+
+  std::size_t num_grasps = 0;
+  std::size_t begin;
+  std::vector<SharedGraspTask> tasks;
+  while (queue_.claimTasks(batch.batch_id_, chunk_size_, begin, tasks))
+  {
+    std::vector<GraspCandidatePtr> grasp_candidates(tasks.size());
+    for (std::size_t i = 0; i < tasks.size(); ++i)
+      grasp_candidates[i] = readGraspTask(tasks[i], grasp_data_);
+
+    grasp_filter_->filterGraspsHelper(grasp_candidates, cloned_scene, arm_jmg, seed_state, batch.filter_pregrasp_,
+                                      false);
+
+    for (std::size_t i = 0; i < tasks.size(); ++i)
+      writeGraspTaskResult(grasp_candidates[i], tasks[i]);
+    queue_.finishTasks(batch.batch_id_, begin, tasks);
+    num_grasps += tasks.size();
+  }
+
+  ROS_DEBUG_STREAM_NAMED("grasp_filter_worker", "Filtered " << num_grasps << " grasps of batch " << batch.batch_id_);
+  return true;
+}
+
+void GraspFilterWorker::run()
+{
+  while (ros::ok())
+  {
+    if (processBatch(0.1) || queue_.isCurrent())
+      continue;
+
+    // The queue of a stopped coordinator never gets another batch, an expired lease no tasks
+    ROS_WARN_STREAM_NAMED("grasp_filter_worker", "Queue " << queue_name_ << " was replaced or the lease expired, "
+                                                                            "reconnecting");
+    queue_.close();
+    while (ros::ok() && !connect())
+      ros::Duration(1.0).sleep();
+  }
+}
+
+}  // namespace
@@ -0,0 +1,106 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Worker process that filters grasps for the GraspFilter of another process
+*/
+
+// ROS
+#include <ros/ros.h>
+
+// MoveIt
+#include <moveit/planning_scene_monitor/planning_scene_monitor.h>
+
+// Grasp
+#include <moveit_grasps/grasp_data.h>
+#include <moveit_grasps/grasp_filter.h>
+#include <moveit_grasps/grasp_filter_worker.h>
+#include <moveit_visual_tools/moveit_visual_tools.h>
+
+// Parameter loading
+#include <rosparam_shortcuts/rosparam_shortcuts.h>
+
+int main(int argc, char* argv[])
+{
+  ros::init(argc, argv, "grasp_filter_worker");
+
+  // Scene diffs are received while filtering
+  ros::AsyncSpinner spinner(2);
+  spinner.start();
+
+  ros::NodeHandle nh("~");
+  const std::string parent_name = "grasp_filter_worker";  // for namespacing logging messages
+  std::string ee_group_name;
+  std::size_t error = 0;
+  error += !rosparam_shortcuts::get(parent_name, nh, "ee_group_name", ee_group_name);
+  rosparam_shortcuts::shutdownIfError(parent_name, error);
+
+  // Same queue settings as the GraspFilter of the coordinator
+  ros::NodeHandle filter_nh("~/moveit_grasps/filter");
+  std::string queue_name;
+  int chunk_size;
+  int num_threads;
+  filter_nh.param("worker_queue_name", queue_name, std::string("moveit_grasps_filter"));
+  filter_nh.param("worker_chunk_size", chunk_size, 32);
+  filter_nh.param("worker_num_threads", num_threads, 1);
+
+  // Load the robot, without monitoring the scene of the robot
+  planning_scene_monitor::PlanningSceneMonitorPtr planning_scene_monitor(
+      new planning_scene_monitor::PlanningSceneMonitor("robot_description"));
+  const robot_model::RobotModelConstPtr robot_model = planning_scene_monitor->getRobotModel();
+  if (!robot_model)
+  {
+    ROS_ERROR_STREAM_NAMED(parent_name, "Unable to load robot model");
+    return 1;
+  }
+
+  moveit_visual_tools::MoveItVisualToolsPtr visual_tools(
+      new moveit_visual_tools::MoveItVisualTools(robot_model->getModelFrame(), "/rviz_visual_tools",
+                                                 planning_scene_monitor));
+  visual_tools->loadSharedRobotState();
+
+  moveit_grasps::GraspDataPtr grasp_data(new moveit_grasps::GraspData(nh, ee_group_name, robot_model));
+  moveit_grasps::GraspFilterPtr grasp_filter(
+      new moveit_grasps::GraspFilter(visual_tools->getSharedRobotState(), visual_tools));
+
+  moveit_grasps::GraspFilterWorker worker(grasp_filter, grasp_data, queue_name, std::max(chunk_size, 1),
+                                          std::max(num_threads, 1));
+
+  // The coordinator creates the queue on its first filter call
+  while (ros::ok() && !worker.connect())
+    ros::Duration(1.0).sleep();
+
+  worker.run();
+  return 0;
+}
@@ -40,6 +40,10 @@
 
 #include <rosparam_shortcuts/rosparam_shortcuts.h>
 
+// C++
+#include <algorithm>
+#include <map>
+
 namespace
 {
 void debugFailedOpenGripper(double percent_open, double min_finger_open_on_approach, double object_width,
@@ -77,6 +81,23 @@ GraspGenerator::GraspGenerator(moveit_visual_tools::MoveItVisualToolsPtr visual_
 
   // Load scoring weights
   rosparam_shortcuts::shutdownIfError(parent_name, error);
+
+  // Optional settings
+  nh_.param("single_precision_grasp_poses", single_precision_grasp_poses_, false);
+  nh_.param("tracking_max_translation", tracking_max_translation_, 0.05);
+  nh_.param("tracking_max_rotation", tracking_max_rotation_, 0.3);
+  nh_.param("tracking_max_size_change", tracking_max_size_change_, 0.01);
+
+  std::string approach_atlas_file;
+  nh_.param("approach_atlas_file", approach_atlas_file, std::string());
+  if (!approach_atlas_file.empty())
+  {
+    ApproachAtlasPtr approach_atlas(new ApproachAtlas());
+    if (approach_atlas->load(approach_atlas_file))
+      approach_atlas_ = approach_atlas;
+    else
+      ROS_WARN_STREAM_NAMED("grasp_generator", "Generating grasps without the approach atlas");
+  }
 }
 
 void GraspGenerator::setIdealGraspPoseRPY(const std::vector<double>& ideal_grasp_orientation_rpy)
@@ -100,6 +121,24 @@ bool GraspGenerator::generateCuboidAxisGrasps(const Eigen::Affine3d& cuboid_pose
                                               const moveit_grasps::GraspDataPtr grasp_data,
                                               const GraspCandidateConfig& grasp_candidate_config,
                                               std::vector<GraspCandidatePtr>& grasp_candidates)
+{
+  if (single_precision_grasp_poses_)
+  {
+    GraspPoseBatchf grasp_poses;
+    return generateCuboidAxisGrasps(cuboid_pose, depth, width, height, axis, grasp_data, grasp_candidate_config,
+                                    grasp_candidates, grasp_poses);
+  }
+  std::vector<Eigen::Affine3d> grasp_poses;
+  return generateCuboidAxisGrasps(cuboid_pose, depth, width, height, axis, grasp_data, grasp_candidate_config,
+                                  grasp_candidates, grasp_poses);
+}
+
+template <typename PoseBatch>
+bool GraspGenerator::generateCuboidAxisGrasps(const Eigen::Affine3d& cuboid_pose, double depth, double width,
+                                              double height, grasp_axis_t axis, const GraspDataPtr grasp_data,
+                                              const GraspCandidateConfig& grasp_candidate_config,
+                                              std::vector<GraspCandidatePtr>& grasp_candidates,
+                                              PoseBatch& grasp_poses)
 {
   double finger_depth = grasp_data->grasp_max_depth_ - grasp_data->grasp_min_depth_;
   double length_along_a, length_along_b, length_along_c;
@@ -108,7 +147,6 @@ bool GraspGenerator::generateCuboidAxisGrasps(const Eigen::Affine3d& cuboid_pose
   Eigen::Vector3d object_size(depth, width, height);
 
   double object_width;
-  std::vector<Eigen::Affine3d> grasp_poses;
 
   Eigen::Affine3d grasp_pose = cuboid_pose;
   Eigen::Vector3d a_dir, b_dir, c_dir;
@@ -162,6 +200,28 @@ bool GraspGenerator::generateCuboidAxisGrasps(const Eigen::Affine3d& cuboid_pose
   b_dir = b_dir.normalized();
   c_dir = c_dir.normalized();
 
+  // The fingers close along c_dir, so corner, face and variable angle grasps approach normal to it and edge grasps
+  // at 45 degrees. Skip the families a desired orientation excludes entirely
+  GraspCandidateConfig axis_config = grasp_candidate_config;
+  if (grasp_predicates_)
+  {
+    if (grasp_predicates_->excludesApproachCone(c_dir, 0.0))
+    {
+      axis_config.enable_corner_grasps_ = false;
+      axis_config.enable_face_grasps_ = false;
+      axis_config.enable_variable_angle_grasps_ = false;
+    }
+    if (grasp_predicates_->excludesApproachCone(c_dir, M_SQRT1_2) &&
+        grasp_predicates_->excludesApproachCone(c_dir, -M_SQRT1_2))
+      axis_config.enable_edge_grasps_ = false;
+
+    if (!axis_config.enable_corner_grasps_ && !axis_config.enable_face_grasps_ && !axis_config.enable_edge_grasps_)
+    {
+      ROS_DEBUG_STREAM_NAMED("cuboid_axis_grasps", "all approach directions of axis " << axis << " are excluded");
+      return true;
+    }
+  }
+
   // Add grasps at corners, grasps are centroid aligned
   double offset = 0.001;  // back the palm off of the object slightly
   Eigen::Vector3d corner_translation_a;
@@ -170,7 +230,7 @@ bool GraspGenerator::generateCuboidAxisGrasps(const Eigen::Affine3d& cuboid_pose
   std::size_t num_radial_grasps = ceil((M_PI / 2.0) / angle_res);
   Eigen::Vector3d translation;
 
-  if (grasp_candidate_config.enable_corner_grasps_)
+  if (axis_config.enable_corner_grasps_)
   {
     ROS_DEBUG_STREAM_NAMED("cuboid_axis_grasps", "adding corner grasps...");
     corner_translation_a = 0.5 * (length_along_a + offset) * a_dir;
@@ -240,7 +300,7 @@ bool GraspGenerator::generateCuboidAxisGrasps(const Eigen::Affine3d& cuboid_pose
   // TODO(mlautman): There is a bug with face grasps allowing the grasp generator to generate grasps where the gripper
   // fingers
   //                 are in collision with the object being grasped
-  if (grasp_candidate_config.enable_face_grasps_)
+  if (axis_config.enable_face_grasps_)
   {
     ROS_DEBUG_STREAM_NAMED("cuboid_axis_grasps", "adding face grasps...");
 
@@ -274,7 +334,7 @@ bool GraspGenerator::generateCuboidAxisGrasps(const Eigen::Affine3d& cuboid_pose
   ROS_DEBUG_STREAM_NAMED("cuboid_axis_grasps", "adding variable angle grasps...");
   Eigen::Affine3d base_pose;
   std::size_t num_grasps = grasp_poses.size();
-  if (grasp_candidate_config.enable_variable_angle_grasps_)
+  if (axis_config.enable_variable_angle_grasps_)
   {
     for (std::size_t i = num_corner_grasps; i < num_grasps;
          i++)  // corner grasps at zero depth don't need variable angles
@@ -316,7 +376,7 @@ bool GraspGenerator::generateCuboidAxisGrasps(const Eigen::Affine3d& cuboid_pose
     }
   }
 
-  if (grasp_candidate_config.enable_edge_grasps_)
+  if (axis_config.enable_edge_grasps_)
   {
     // Add grasps along edges
     // move grasp pose to edge of cuboid
@@ -412,10 +472,12 @@ bool GraspGenerator::generateCuboidAxisGrasps(const Eigen::Affine3d& cuboid_pose
                                       std::numeric_limits<double>::min());
   double grasp_distance;
 
+  Eigen::Vector3d grasp_translation;
+
   for (std::size_t i = 0; i < num_grasps; i++)
   {
-    grasp_pose = grasp_poses[i];
-    grasp_distance = (grasp_pose.translation() - cuboid_pose.translation()).norm();
+    grasp_translation = getTranslation(grasp_poses, i);
+    grasp_distance = (grasp_translation - cuboid_pose.translation()).norm();
     if (grasp_distance > max_grasp_distance_)
       max_grasp_distance_ = grasp_distance;
 
@@ -424,11 +486,11 @@ bool GraspGenerator::generateCuboidAxisGrasps(const Eigen::Affine3d& cuboid_pose
 
     for (std::size_t j = 0; j < 3; j++)
     {
-      if (grasp_pose.translation()[j] < min_translations_[j])
-        min_translations_[j] = grasp_pose.translation()[j];
+      if (grasp_translation[j] < min_translations_[j])
+        min_translations_[j] = grasp_translation[j];
 
-      if (grasp_pose.translation()[j] > max_translations_[j])
-        max_translations_[j] = grasp_pose.translation()[j];
+      if (grasp_translation[j] > max_translations_[j])
+        max_translations_[j] = grasp_translation[j];
     }
   }
 
@@ -437,25 +499,34 @@ bool GraspGenerator::generateCuboidAxisGrasps(const Eigen::Affine3d& cuboid_pose
 
   // add all poses as possible grasps
   std::size_t num_grasps_added = 0;
+  std::size_t num_grasps_excluded = 0;
 
   for (std::size_t i = 0; i < grasp_poses.size(); i++)
   {
-    if (!addGrasp(grasp_poses[i], grasp_data, grasp_candidates, cuboid_pose, object_size, object_width))
+    const Eigen::Affine3d candidate_pose = grasp_poses[i];
+    if (isGraspPoseExcluded(candidate_pose, grasp_data))
+    {
+      num_grasps_excluded++;
+      continue;
+    }
+    if (!addGrasp(candidate_pose, grasp_data, grasp_candidates, cuboid_pose, object_size, object_width))
     {
       ROS_DEBUG_STREAM_NAMED("grasp_generator.add", "Unable to add grasp - function returned false");
     }
     else
       num_grasps_added++;
   }
+  ROS_DEBUG_STREAM_NAMED("grasp_generator.add", num_grasps_excluded << " grasp poses excluded before adding them");
   ROS_INFO_STREAM_NAMED("grasp_generator.add", "\033[1;36madded " << num_grasps_added << " of " << grasp_poses.size()
                                                                   << " grasp poses created\033[0m");
   return true;
 }
 
+template <typename PoseBatch>
 std::size_t GraspGenerator::addFaceGraspsHelper(Eigen::Affine3d pose, double rotation_angles[3],
                                                 Eigen::Vector3d translation, Eigen::Vector3d delta,
                                                 double alignment_rotation, std::size_t num_grasps,
-                                                std::vector<Eigen::Affine3d>& grasp_poses)
+                                                PoseBatch& grasp_poses)
 {
   std::size_t num_grasps_added = 0;
   ROS_DEBUG_STREAM_NAMED("cuboid_axis_grasps.helper", "delta = \n" << delta);
@@ -479,10 +550,11 @@ std::size_t GraspGenerator::addFaceGraspsHelper(Eigen::Affine3d pose, double rot
   return true;
 }
 
+template <typename PoseBatch>
 std::size_t GraspGenerator::addEdgeGraspsHelper(Eigen::Affine3d pose, double rotation_angles[3],
                                                 Eigen::Vector3d translation, Eigen::Vector3d delta,
                                                 double alignment_rotation, std::size_t num_grasps,
-                                                std::vector<Eigen::Affine3d>& grasp_poses, double corner_rotation)
+                                                PoseBatch& grasp_poses, double corner_rotation)
 {
   std::size_t num_grasps_added = 0;
   ROS_DEBUG_STREAM_NAMED("cuboid_axis_grasps.helper", "delta = \n" << delta);
@@ -509,10 +581,10 @@ std::size_t GraspGenerator::addEdgeGraspsHelper(Eigen::Affine3d pose, double rot
   return true;
 }
 
+template <typename PoseBatch>
 std::size_t GraspGenerator::addCornerGraspsHelper(Eigen::Affine3d pose, double rotation_angles[3],
                                                   Eigen::Vector3d translation, double corner_rotation,
-                                                  std::size_t num_radial_grasps,
-                                                  std::vector<Eigen::Affine3d>& grasp_poses)
+                                                  std::size_t num_radial_grasps, PoseBatch& grasp_poses)
 {
   std::size_t num_grasps_added = 0;
   double delta_angle = (M_PI / 2.0) / static_cast<double>(num_radial_grasps + 1);
@@ -540,6 +612,20 @@ std::size_t GraspGenerator::addCornerGraspsHelper(Eigen::Affine3d pose, double r
   return num_grasps_added;
 }
 
+// Instantiate the helpers for the grasp pose containers used by the generator
+template std::size_t GraspGenerator::addFaceGraspsHelper(Eigen::Affine3d, double[3], Eigen::Vector3d, Eigen::Vector3d,
+                                                         double, std::size_t, std::vector<Eigen::Affine3d>&);
+template std::size_t GraspGenerator::addFaceGraspsHelper(Eigen::Affine3d, double[3], Eigen::Vector3d, Eigen::Vector3d,
+                                                         double, std::size_t, GraspPoseBatchf&);
+template std::size_t GraspGenerator::addEdgeGraspsHelper(Eigen::Affine3d, double[3], Eigen::Vector3d, Eigen::Vector3d,
+                                                         double, std::size_t, std::vector<Eigen::Affine3d>&, double);
+template std::size_t GraspGenerator::addEdgeGraspsHelper(Eigen::Affine3d, double[3], Eigen::Vector3d, Eigen::Vector3d,
+                                                         double, std::size_t, GraspPoseBatchf&, double);
+template std::size_t GraspGenerator::addCornerGraspsHelper(Eigen::Affine3d, double[3], Eigen::Vector3d, double,
+                                                           std::size_t, std::vector<Eigen::Affine3d>&);
+template std::size_t GraspGenerator::addCornerGraspsHelper(Eigen::Affine3d, double[3], Eigen::Vector3d, double,
+                                                           std::size_t, GraspPoseBatchf&);
+
 bool GraspGenerator::graspIntersectionHelper(Eigen::Affine3d cuboid_pose, double depth, double width, double height,
                                              Eigen::Affine3d grasp_pose, const GraspDataPtr grasp_data)
 {
@@ -726,6 +812,7 @@ bool GraspGenerator::addGrasp(const Eigen::Affine3d& grasp_pose, const GraspData
 
   // set grasp postures e.g. hand closed
   new_grasp.grasp_posture = grasp_data->grasp_posture_;
+  GraspFeatureVector features;
 
   if (grasp_data->end_effector_type_ == FINGER)
   {
@@ -742,11 +829,11 @@ bool GraspGenerator::addGrasp(const Eigen::Affine3d& grasp_pose, const GraspData
       return false;
     }
 
-    new_grasp.grasp_quality = scoreFingerGrasp(grasp_pose, grasp_data, object_pose, percent_open);
+    new_grasp.grasp_quality = scoreFingerGrasp(grasp_pose, grasp_data, object_pose, percent_open, &features);
 
     // Show visualization for widest grasp
 
-    grasp_candidates.push_back(GraspCandidatePtr(new GraspCandidate(new_grasp, grasp_data, object_pose)));
+    grasp_candidates.push_back(createGraspCandidate(new_grasp, grasp_data, object_pose, features));
 
     // Create grasp with middle width fingers -------------------------------------------------
     percent_open = 0.5;
@@ -756,8 +843,8 @@ bool GraspGenerator::addGrasp(const Eigen::Affine3d& grasp_pose, const GraspData
                              grasp_data->grasp_padding_on_approach_);
       return false;
     }
-    new_grasp.grasp_quality = scoreFingerGrasp(grasp_pose, grasp_data, object_pose, percent_open);
-    grasp_candidates.push_back(GraspCandidatePtr(new GraspCandidate(new_grasp, grasp_data, object_pose)));
+    new_grasp.grasp_quality = scoreFingerGrasp(grasp_pose, grasp_data, object_pose, percent_open, &features);
+    grasp_candidates.push_back(createGraspCandidate(new_grasp, grasp_data, object_pose, features));
 
     // Create grasp with fingers at minimum width ---------------------------------------------
     percent_open = 0.0;
@@ -767,24 +854,39 @@ bool GraspGenerator::addGrasp(const Eigen::Affine3d& grasp_pose, const GraspData
                              grasp_data->grasp_padding_on_approach_);
       return false;
     }
-    new_grasp.grasp_quality = scoreFingerGrasp(grasp_pose, grasp_data, object_pose, percent_open);
-    grasp_candidates.push_back(GraspCandidatePtr(new GraspCandidate(new_grasp, grasp_data, object_pose)));
+    new_grasp.grasp_quality = scoreFingerGrasp(grasp_pose, grasp_data, object_pose, percent_open, &features);
+    grasp_candidates.push_back(createGraspCandidate(new_grasp, grasp_data, object_pose, features));
 
     return true;
   }
 
   if (grasp_data->end_effector_type_ == SUCTION)
   {
-    new_grasp.grasp_quality = scoreSuctionGrasp(grasp_pose, grasp_data, object_pose, object_size);
-    grasp_candidates.push_back(GraspCandidatePtr(new GraspCandidate(new_grasp, grasp_data, object_pose)));
+    new_grasp.grasp_quality = scoreSuctionGrasp(grasp_pose, grasp_data, object_pose, object_size, &features);
+    grasp_candidates.push_back(createGraspCandidate(new_grasp, grasp_data, object_pose, features));
     return true;
   }
 
   return false;
 }
 
+GraspCandidatePtr GraspGenerator::createGraspCandidate(const moveit_msgs::Grasp& grasp, const GraspDataPtr& grasp_data,
+                                                       const Eigen::Affine3d& object_pose,
+                                                       const GraspFeatureVector& features) const
+{
+  GraspCandidatePtr grasp_candidate(new GraspCandidate(grasp, grasp_data, object_pose));
+
+  if (feature_matrix_)
+  {
+    grasp_candidate->feature_matrix_ = feature_matrix_;
+    grasp_candidate->feature_row_ = feature_matrix_->addGrasp(features);
+  }
+  return grasp_candidate;
+}
+
 double GraspGenerator::scoreSuctionGrasp(const Eigen::Affine3d& grasp_pose, const GraspDataPtr& grasp_data,
-                                         const Eigen::Affine3d& cuboid_pose, const Eigen::Vector3d& object_size)
+                                         const Eigen::Affine3d& cuboid_pose, const Eigen::Vector3d& object_size,
+                                         GraspFeatureVector* features)
 {
   ROS_DEBUG_STREAM_NAMED("grasp_generator.scoreGrasp",
                          "Scoring grasp at: \n\tpose:  ("
@@ -835,6 +937,14 @@ double GraspGenerator::scoreSuctionGrasp(const Eigen::Affine3d& grasp_pose, cons
   }
   total_score /= weight_total;
 
+  if (features)
+  {
+    features->setZero();
+    features->head<3>() = orientation_scores;
+    features->segment<3>(TRANSLATION_X_FEATURE) = translation_scores;
+    (*features)[OVERHANG_FEATURE] = overhang_score[0] + overhang_score[1];
+  }
+
   ROS_DEBUG_STREAM_NAMED("grasp_generator.scoreGrasp",
                          "Grasp score: \n "
                              << "\torientation_score.x = " << orientation_scores[0] << "\n"
@@ -853,7 +963,8 @@ double GraspGenerator::scoreSuctionGrasp(const Eigen::Affine3d& grasp_pose, cons
 }
 
 double GraspGenerator::scoreFingerGrasp(const Eigen::Affine3d& grasp_pose, const GraspDataPtr& grasp_data,
-                                        const Eigen::Affine3d& object_pose, double percent_open)
+                                        const Eigen::Affine3d& object_pose, double percent_open,
+                                        GraspFeatureVector* features)
 {
   ROS_DEBUG_STREAM_NAMED("grasp_generator.scoreGrasp", "starting to score grasp...");
 
@@ -911,6 +1022,15 @@ double GraspGenerator::scoreFingerGrasp(const Eigen::Affine3d& grasp_pose, const
   }
   total_score /= high_score;
 
+  if (features)
+  {
+    features->setZero();
+    features->head<3>() = orientation_scores;
+    features->segment<3>(TRANSLATION_X_FEATURE) = translation_scores;
+    (*features)[DEPTH_FEATURE] = distance_score;
+    (*features)[WIDTH_FEATURE] = width_score;
+  }
+
   if (verbose_)
   {
     ROS_DEBUG_STREAM_NAMED("grasp_generator.scoreGrasp",
@@ -948,19 +1068,152 @@ double GraspGenerator::scoreFingerGrasp(const Eigen::Affine3d& grasp_pose, const
   return total_score;
 }
 
+bool GraspGenerator::generateGrasps(const shape_msgs::Mesh& mesh_msg, const Eigen::Affine3d& object_pose,
+                                    const moveit_grasps::GraspDataPtr grasp_data,
+                                    std::vector<GraspCandidatePtr>& grasp_candidates,
+                                    const GraspCandidateConfig grasp_candidate_config)
+{
+  ros::WallTime start_time = ros::WallTime::now();
+  Eigen::Affine3d box_pose;
+  Eigen::Vector3d box_size;
+  if (!mesh_bounding_box_.fit(mesh_msg, box_pose, box_size))
+  {
+    ROS_ERROR_STREAM_NAMED("grasp_generator", "Unable to fit a bounding box to the mesh");
+    return false;
+  }
+  const double fit_time = (ros::WallTime::now() - start_time).toSec();
+  ROS_DEBUG_STREAM_NAMED("grasp_generator.mesh", "Fit bounding box of size " << box_size.transpose() << " to "
+                                                                             << mesh_msg.vertices.size()
+                                                                             << " vertices in " << fit_time << " s");
+
+  Eigen::Affine3d cuboid_pose = object_pose * box_pose;
+  if (grasp_data->end_effector_type_ == SUCTION)
+  {
+    // Suction grasps are generated around the top of the cuboid, so use the face pointing up the most
+    std::size_t up_axis;
+    cuboid_pose.linear().row(2).cwiseAbs().maxCoeff(&up_axis);
+    const std::size_t x_axis = (up_axis + 1) % 3;
+    const std::size_t y_axis = (up_axis + 2) % 3;
+    const double sign = cuboid_pose.linear()(2, up_axis) < 0 ? -1.0 : 1.0;
+
+    Eigen::Affine3d cuboid_top_pose = cuboid_pose;
+    cuboid_top_pose.linear().col(0) = cuboid_pose.linear().col(x_axis);
+    cuboid_top_pose.linear().col(1) = sign * cuboid_pose.linear().col(y_axis);
+    cuboid_top_pose.linear().col(2) = sign * cuboid_pose.linear().col(up_axis);
+    cuboid_top_pose.translation() += cuboid_top_pose.linear().col(2) * box_size[up_axis] / 2.0;
+    return generateGrasps(cuboid_top_pose, box_size[x_axis], box_size[y_axis], box_size[up_axis], grasp_data,
+                          grasp_candidates, grasp_candidate_config);
+  }
+
+  return generateGrasps(cuboid_pose, box_size.x(), box_size.y(), box_size.z(), grasp_data, grasp_candidates,
+                        grasp_candidate_config);
+}
+
 bool GraspGenerator::generateGrasps(const Eigen::Affine3d& cuboid_pose, double depth, double width, double height,
                                     const moveit_grasps::GraspDataPtr grasp_data,
                                     std::vector<GraspCandidatePtr>& grasp_candidates,
                                     const GraspCandidateConfig grasp_candidate_config)
 {
+  // Each feature holds one score of a finger grasp, the overhang feature the two overhang scores of a suction grasp
+  GraspFeatureVector feature_counts = GraspFeatureVector::Ones();
   if (grasp_data->end_effector_type_ == FINGER)
-    return generateFingerGrasps(cuboid_pose, depth, width, height, grasp_data, grasp_candidates,
-                                grasp_candidate_config);
-  if (grasp_data->end_effector_type_ == SUCTION)
-    return generateSuctionGrasps(cuboid_pose, depth, width, height, grasp_data, grasp_candidates,
-                                 grasp_candidate_config);
+    feature_counts[OVERHANG_FEATURE] = 0.0;
   else
+    feature_counts << 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 0.0, 0.0, 2.0;
+  feature_matrix_.reset(new GraspFeatureMatrix(feature_counts));
+
+  bool success = false;
+  if (grasp_data->end_effector_type_ == FINGER)
+    success = generateFingerGrasps(cuboid_pose, depth, width, height, grasp_data, grasp_candidates,
+                                   grasp_candidate_config);
+  else if (grasp_data->end_effector_type_ == SUCTION)
+    success = generateSuctionGrasps(cuboid_pose, depth, width, height, grasp_data, grasp_candidates,
+                                    grasp_candidate_config);
+
+  feature_matrix_.reset();
+  return success;
+}
+
+bool GraspGenerator::rescoreGrasps(std::vector<GraspCandidatePtr>& grasp_candidates,
+                                   const GraspScoreWeights& grasp_score_weights)
+{
+  const GraspFeatureVector weights = grasp_score_weights.getFeatureWeights();
+
+  // One product per feature matrix, the grasps usually come from one or a few generateGrasps() calls. All of them
+  // are computed before any grasp is changed
+  std::map<const GraspFeatureMatrix*, Eigen::VectorXd> matrix_qualities;
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+  {
+    const GraspFeatureMatrixConstPtr& feature_matrix = grasp_candidates[i]->feature_matrix_;
+    if (!feature_matrix || matrix_qualities.count(feature_matrix.get()))
+      continue;
+    if (!feature_matrix->computeQualities(weights, matrix_qualities[feature_matrix.get()]))
+    {
+      ROS_ERROR_STREAM_NAMED("grasp_generator", "The weights of the scored features do not sum to a positive value, "
+                                                "the grasps keep their qualities");
+      return false;
+    }
+  }
+
+  std::size_t missing_features = 0;
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+  {
+    const GraspFeatureMatrixConstPtr& feature_matrix = grasp_candidates[i]->feature_matrix_;
+    if (!feature_matrix)
+    {
+      missing_features++;
+      continue;
+    }
+    const Eigen::VectorXd& qualities = matrix_qualities[feature_matrix.get()];
+    grasp_candidates[i]->grasp_.grasp_quality = qualities[grasp_candidates[i]->feature_row_];
+  }
+
+  std::stable_sort(grasp_candidates.begin(), grasp_candidates.end(),
+                   [](const GraspCandidatePtr& a, const GraspCandidatePtr& b) {
+                     return a->grasp_.grasp_quality > b->grasp_.grasp_quality;
+                   });
+
+  if (missing_features)
+  {
+    ROS_WARN_STREAM_NAMED("grasp_generator", missing_features << " of " << grasp_candidates.size()
+                                                              << " grasps have no features and keep their quality");
+    return false;
+  }
+  return true;
+}
+
+bool GraspGenerator::trackGrasps(const TrackedGrasps& tracked_grasps, const Eigen::Affine3d& cuboid_pose, double depth,
+                                 double width, double height, std::vector<GraspCandidatePtr>& grasp_candidates)
+{
+  const double size_change =
+      (Eigen::Vector3d(depth, width, height) - tracked_grasps.cuboid_size_).cwiseAbs().maxCoeff();
+  const double translation = (cuboid_pose.translation() - tracked_grasps.cuboid_pose_.translation()).norm();
+  const double rotation =
+      Eigen::AngleAxisd(tracked_grasps.cuboid_pose_.rotation().transpose() * cuboid_pose.rotation()).angle();
+  if (size_change > tracking_max_size_change_ || translation > tracking_max_translation_ ||
+      rotation > tracking_max_rotation_)
+  {
+    ROS_INFO_STREAM_NAMED("grasp_generator.tracking", "Cuboid moved " << translation << " m and " << rotation
+                                                                      << " rad and changed size by " << size_change
+                                                                      << " m, not tracking its grasps");
     return false;
+  }
+
+  // Move the grasps in the world frame, from the previous to the current cuboid pose
+  const Eigen::Affine3d transform = cuboid_pose * tracked_grasps.cuboid_pose_.inverse();
+  grasp_candidates.clear();
+  for (std::size_t i = 0; i < tracked_grasps.grasp_candidates_.size(); ++i)
+    if (tracked_grasps.grasp_candidates_[i]->isValid())
+      grasp_candidates.push_back(tracked_grasps.grasp_candidates_[i]->cloneWithTransform(transform));
+
+  if (grasp_candidates.empty())
+  {
+    ROS_INFO_STREAM_NAMED("grasp_generator.tracking", "No valid grasps to track");
+    return false;
+  }
+
+  ROS_INFO_STREAM_NAMED("grasp_generator.tracking", "Tracked " << grasp_candidates.size() << " grasps");
+  return true;
 }
 
 bool GraspGenerator::generateSuctionGrasps(const Eigen::Affine3d& cuboid_top_pose, double depth, double width,
@@ -969,7 +1222,6 @@ bool GraspGenerator::generateSuctionGrasps(const Eigen::Affine3d& cuboid_top_pos
                                            const GraspCandidateConfig grasp_candidate_config)
 {
   grasp_candidates.clear();
-  std::vector<Eigen::Affine3d> grasp_poses;
   ////////////////
   // Re-orient the cuboid center top grasp so to be as close as possible to the ideal grasp
   ////////////////
@@ -1028,8 +1280,53 @@ bool GraspGenerator::generateSuctionGrasps(const Eigen::Affine3d& cuboid_top_pos
     visual_tools_->publishAxis(center_grasp_pose, rviz_visual_tools::SMALL, "center_grasp_pose");
     visual_tools_->trigger();
   }
-  grasp_poses.push_back(center_grasp_pose);
 
+  // All suction grasps are rotated about and translated normal to the approach direction of the center grasp
+  if (grasp_predicates_ && grasp_predicates_->isOutsideOrientations(center_grasp_pose.rotation().col(2)))
+  {
+    ROS_INFO_STREAM_NAMED("grasp_generator", "The approach direction of the suction grasps is excluded");
+  }
+  else if (single_precision_grasp_poses_)
+  {
+    GraspPoseBatchf grasp_poses;
+    grasp_poses.push_back(center_grasp_pose);
+    addSuctionGrasps(cuboid_top_pose, depth, width, object_size, grasp_data, grasp_candidates, grasp_poses);
+  }
+  else
+  {
+    std::vector<Eigen::Affine3d> grasp_poses;
+    grasp_poses.push_back(center_grasp_pose);
+    addSuctionGrasps(cuboid_top_pose, depth, width, object_size, grasp_data, grasp_candidates, grasp_poses);
+  }
+
+  if (debug_top_grasps_)
+  {
+    Eigen::Affine3d ideal_copy = ideal_grasp_pose_;
+    ideal_copy.translation() += Eigen::Vector3d(0.0, 0.0, 1.0);
+    visual_tools_->publishAxisLabeled(ideal_copy, "ideal grasp orientation", rviz_visual_tools::MEDIUM);
+    visual_tools_->trigger();
+  }
+
+  if (!grasp_candidates.size())
+    ROS_WARN_STREAM_NAMED("grasp_generator", "Generated 0 grasps");
+  else
+    ROS_INFO_STREAM_NAMED("grasp_generator", "Generated " << grasp_candidates.size() << " grasps");
+
+  // Visualize animated grasps that have been generated
+  if (show_prefiltered_grasps_)
+  {
+    ROS_DEBUG_STREAM_NAMED("grasp_generator", "Animating all generated (candidate) grasps before filtering");
+    visualizeAnimatedGrasps(grasp_candidates, grasp_data->ee_jmg_, show_prefiltered_grasps_speed_);
+  }
+
+  return true;
+}
+
+template <typename PoseBatch>
+void GraspGenerator::addSuctionGrasps(const Eigen::Affine3d& cuboid_top_pose, double depth, double width,
+                                      const Eigen::Vector3d& object_size, const GraspDataPtr grasp_data,
+                                      std::vector<GraspCandidatePtr>& grasp_candidates, PoseBatch& grasp_poses)
+{
   // We define min, max and inc for each for loop here for readability
 
   // if X range is less than y range then we use x range for the xy range
@@ -1114,33 +1411,24 @@ bool GraspGenerator::generateSuctionGrasps(const Eigen::Affine3d& cuboid_top_pos
 
   for (std::size_t i = 0; i < num_grasps; ++i)
   {
-    addGrasp(grasp_poses[i], grasp_data, grasp_candidates, cuboid_top_pose, object_size, 0);
+    const Eigen::Affine3d candidate_pose = grasp_poses[i];
+    if (isGraspPoseExcluded(candidate_pose, grasp_data))
+      continue;
+    addGrasp(candidate_pose, grasp_data, grasp_candidates, cuboid_top_pose, object_size, 0);
     if (debug_top_grasps_)
     {
-      visual_tools_->publishAxis(grasp_poses[i], rviz_visual_tools::MEDIUM, "pose");
+      visual_tools_->publishAxis(candidate_pose, rviz_visual_tools::MEDIUM, "pose");
     }
   }
-  if (debug_top_grasps_)
-  {
-    Eigen::Affine3d ideal_copy = ideal_grasp_pose_;
-    ideal_copy.translation() += Eigen::Vector3d(0.0, 0.0, 1.0);
-    visual_tools_->publishAxisLabeled(ideal_copy, "ideal grasp orientation", rviz_visual_tools::MEDIUM);
-    visual_tools_->trigger();
-  }
-
-  if (!grasp_candidates.size())
-    ROS_WARN_STREAM_NAMED("grasp_generator", "Generated 0 grasps");
-  else
-    ROS_INFO_STREAM_NAMED("grasp_generator", "Generated " << grasp_candidates.size() << " grasps");
+}
 
-  // Visualize animated grasps that have been generated
-  if (show_prefiltered_grasps_)
-  {
-    ROS_DEBUG_STREAM_NAMED("grasp_generator", "Animating all generated (candidate) grasps before filtering");
-    visualizeAnimatedGrasps(grasp_candidates, grasp_data->ee_jmg_, show_prefiltered_grasps_speed_);
-  }
+bool GraspGenerator::isGraspPoseExcluded(const Eigen::Affine3d& grasp_pose, const GraspDataPtr& grasp_data) const
+{
+  // Skip approach directions that never reach this part of the shelf
+  if (approach_atlas_ && !approach_atlas_->isFeasible(grasp_pose))
+    return true;
 
-  return true;
+  return grasp_predicates_ && grasp_predicates_->excludes(grasp_pose, grasp_data->grasp_pose_to_eef_pose_);
 }
 
 bool GraspGenerator::generateFingerGrasps(const Eigen::Affine3d& cuboid_pose, double depth, double width, double height,
@@ -253,9 +253,32 @@ bool GraspPlanner::computeCartesianWaypointPath(GraspCandidatePtr& grasp_candida
   // End effector parent link (arm tip for ik solving)
   const moveit::core::LinkModel* ik_tip_link = grasp_candidate->grasp_data_->parent_link_;
 
+  // Continuous collision checking validates the motion between the points, which can then be further apart
+  // Optional settings, they are missing from older configs
+  bool continuous_collision_checking;
+  nh_.param("moveit_grasps/planner/continuous_collision_checking", continuous_collision_checking, false);
+  if (continuous_collision_checking && !continuous_collision_checker_)
+  {
+    double continuous_min_clearance;
+    nh_.param("moveit_grasps/planner/continuous_min_clearance", continuous_min_clearance, 0.0);
+    continuous_collision_checker_.reset(
+        new ContinuousCollisionChecker(planning_scene->getRobotModel(), continuous_min_clearance));
+  }
+
   // Resolution of trajectory
   // The maximum distance in Cartesian space between consecutive points on the resulting path
-  const double max_step = 0.01;
+  const double max_step = continuous_collision_checking ? 0.05 : 0.01;
+
+  // Grow the steps far from obstacles and singularities, and solve them with the Jacobian instead of IK
+  bool adaptive_cartesian_step;
+  nh_.param("moveit_grasps/planner/adaptive_cartesian_step", adaptive_cartesian_step, false);
+  bool jacobian_cartesian_steps;
+  nh_.param("moveit_grasps/planner/jacobian_cartesian_steps", jacobian_cartesian_steps, false);
+  boost::scoped_ptr<CartesianInterpolator> cartesian_interpolator;
+  if (adaptive_cartesian_step)
+    cartesian_interpolator.reset(new CartesianInterpolator(0.005, 0.05, 0.1, 0.5, jacobian_cartesian_steps));
+  else if (jacobian_cartesian_steps)
+    cartesian_interpolator.reset(new CartesianInterpolator(max_step, max_step, 0.1, 0.5, true));
 
   // Jump threshold for preventing consequtive joint values from 'jumping' by a large amount in joint space
   const double jump_threshold = 4;  // config_->jump_threshold_; // aka jump factor
@@ -264,8 +287,27 @@ bool GraspPlanner::computeCartesianWaypointPath(GraspCandidatePtr& grasp_candida
   const bool collision_checking_verbose = isEnabled("collision_checking_verbose");
   const bool only_check_self_collision = false;
 
-  // Reference frame setting
-  const bool global_reference_frame = true;
+
+  // Static objects are looked up in the distance field, everything else is checked exactly. Continuous checks need
+  // the distance to all objects
+  planning_scene::PlanningSceneConstPtr check_scene = planning_scene;
+  if (static_distance_field_ && !continuous_collision_checking)
+  {
+    static_distance_field_->update(*planning_scene);
+    check_scene = static_distance_field_->getDynamicScene(planning_scene);
+  }
+
+  // Objects out of reach of the arm along the waypoints cannot collide
+  if (scene_region_cropper_)
+  {
+    EigenSTL::vector_Vector3d targets;
+    for (std::size_t i = 0; i < waypoints.size(); ++i)
+      targets.push_back(waypoints[i].translation());
+    start_state->update();
+    check_scene = scene_region_cropper_->cropScene(
+        check_scene,
+        scene_region_cropper_->computeReachRegion(*start_state, grasp_candidate->grasp_data_->arm_jmg_, targets));
+  }
 
   // Check for kinematic solver
   if (!grasp_candidate->grasp_data_->arm_jmg_->canSetStateFromIK(ik_tip_link->getName()))
@@ -286,10 +328,12 @@ bool GraspPlanner::computeCartesianWaypointPath(GraspCandidatePtr& grasp_candida
     }
     attempts++;
 
-    // Collision check
-    moveit::core::GroupStateValidityCallbackFn constraint_fn =
-        boost::bind(&isGraspStateValid, planning_scene.get(), collision_checking_verbose, only_check_self_collision,
-                    visual_tools_, _1, _2, _3);
+    // Collision check, of the waypoints or afterwards of the motions between them
+    moveit::core::GroupStateValidityCallbackFn constraint_fn;
+    if (!continuous_collision_checking)
+      constraint_fn = boost::bind(&isGraspStateValid, check_scene.get(), static_cast<CoarseCollisionChecker*>(NULL),
+                                  static_distance_field_.get(), collision_checking_verbose, only_check_self_collision,
+                                  visual_tools_, _1, _2, _3);
 
     moveit::core::RobotStatePtr start_state_copy(new moveit::core::RobotState(*start_state));
     if (!grasp_candidate->getPreGraspState(start_state_copy))
@@ -301,10 +345,14 @@ bool GraspPlanner::computeCartesianWaypointPath(GraspCandidatePtr& grasp_candida
     // Compute Cartesian Path
     grasp_candidate->segmented_cartesian_traj_.clear();
     grasp_candidate->segmented_cartesian_traj_.resize(3);
-    double valid_approach_percentage = start_state_copy->computeCartesianPath(
-        grasp_candidate->grasp_data_->arm_jmg_, grasp_candidate->segmented_cartesian_traj_[APPROACH], ik_tip_link,
-        waypoints[APPROACH], global_reference_frame, max_step, jump_threshold, constraint_fn,
-        kinematics::KinematicsQueryOptions());
+    double valid_approach_percentage = computeCartesianSegment(
+        start_state_copy, grasp_candidate->grasp_data_->arm_jmg_,
+        grasp_candidate->segmented_cartesian_traj_[APPROACH], ik_tip_link, waypoints[APPROACH], max_step,
+        jump_threshold, constraint_fn, check_scene, cartesian_interpolator.get());
+    if (continuous_collision_checking)
+      valid_approach_percentage =
+          checkContinuousCollision(check_scene, grasp_candidate->segmented_cartesian_traj_[APPROACH],
+                                   grasp_candidate->grasp_data_->arm_jmg_, valid_approach_percentage);
 
     if (!grasp_candidate->getGraspStateClosedEEOnly(start_state_copy))
     {
@@ -312,15 +360,24 @@ bool GraspPlanner::computeCartesianWaypointPath(GraspCandidatePtr& grasp_candida
       return false;
     }
 
-    double valid_lift_retreat_percentage = start_state_copy->computeCartesianPath(
-        grasp_candidate->grasp_data_->arm_jmg_, grasp_candidate->segmented_cartesian_traj_[LIFT], ik_tip_link,
-        waypoints[LIFT], global_reference_frame, max_step, jump_threshold, constraint_fn,
-        kinematics::KinematicsQueryOptions());
-
-    valid_lift_retreat_percentage *= start_state_copy->computeCartesianPath(
-        grasp_candidate->grasp_data_->arm_jmg_, grasp_candidate->segmented_cartesian_traj_[RETREAT], ik_tip_link,
-        waypoints[RETREAT], global_reference_frame, max_step, jump_threshold, constraint_fn,
-        kinematics::KinematicsQueryOptions());
+    double valid_lift_retreat_percentage = computeCartesianSegment(
+        start_state_copy, grasp_candidate->grasp_data_->arm_jmg_, grasp_candidate->segmented_cartesian_traj_[LIFT],
+        ik_tip_link, waypoints[LIFT], max_step, jump_threshold, constraint_fn, check_scene,
+        cartesian_interpolator.get());
+    if (continuous_collision_checking)
+      valid_lift_retreat_percentage =
+          checkContinuousCollision(check_scene, grasp_candidate->segmented_cartesian_traj_[LIFT],
+                                   grasp_candidate->grasp_data_->arm_jmg_, valid_lift_retreat_percentage);
+
+    double valid_retreat_percentage = computeCartesianSegment(
+        start_state_copy, grasp_candidate->grasp_data_->arm_jmg_, grasp_candidate->segmented_cartesian_traj_[RETREAT],
+        ik_tip_link, waypoints[RETREAT], max_step, jump_threshold, constraint_fn, check_scene,
+        cartesian_interpolator.get());
+    if (continuous_collision_checking)
+      valid_retreat_percentage =
+          checkContinuousCollision(check_scene, grasp_candidate->segmented_cartesian_traj_[RETREAT],
+                                   grasp_candidate->grasp_data_->arm_jmg_, valid_retreat_percentage);
+    valid_lift_retreat_percentage *= valid_retreat_percentage;
 
     ROS_DEBUG_STREAM_NAMED("grasp_planner.waypoints", "valid_approach_percentage: " << valid_approach_percentage
                                                                                     << " \tvalid_lift_retreat_"
@@ -347,6 +404,55 @@ bool GraspPlanner::computeCartesianWaypointPath(GraspCandidatePtr& grasp_candida
   return true;
 }
 
+double GraspPlanner::computeCartesianSegment(moveit::core::RobotStatePtr& robot_state,
+                                             const robot_model::JointModelGroup* arm_jmg,
+                                             std::vector<moveit::core::RobotStatePtr>& trajectory,
+                                             const moveit::core::LinkModel* ik_tip_link, const Eigen::Affine3d& target,
+                                             double max_step, double jump_threshold,
+                                             const moveit::core::GroupStateValidityCallbackFn& constraint_fn,
+                                             const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                             const CartesianInterpolator* cartesian_interpolator)
+{
+  if (cartesian_interpolator)
+    return cartesian_interpolator->computeCartesianPath(robot_state.get(), arm_jmg, trajectory, ik_tip_link, target,
+                                                        jump_threshold, constraint_fn, planning_scene.get());
+
+  // Waypoints are in the planning frame
+  const bool global_reference_frame = true;
+  return robot_state->computeCartesianPath(arm_jmg, trajectory, ik_tip_link, target, global_reference_frame, max_step,
+                                           jump_threshold, constraint_fn, kinematics::KinematicsQueryOptions());
+}
+
+double GraspPlanner::checkContinuousCollision(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                              std::vector<moveit::core::RobotStatePtr>& trajectory,
+                                              const robot_model::JointModelGroup* arm_jmg, double valid_percentage)
+{
+  if (trajectory.size() < 2)
+    return valid_percentage;
+
+  const std::size_t valid_states =
+      continuous_collision_checker_->checkTrajectory(*planning_scene, trajectory, arm_jmg);
+  if (valid_states == trajectory.size())
+    return valid_percentage;
+
+  ROS_DEBUG_STREAM_NAMED("grasp_planner.waypoints", "Motion to waypoint " << valid_states << " of "
+                                                                          << trajectory.size() - 1
+                                                                          << " is in collision");
+  const double valid_fraction = static_cast<double>(valid_states - 1) / (trajectory.size() - 1);
+  trajectory.resize(valid_states);
+  return valid_percentage * valid_fraction;
+}
+
+void GraspPlanner::setStaticDistanceField(const StaticDistanceFieldPtr& static_distance_field)
+{
+  static_distance_field_ = static_distance_field;
+}
+
+void GraspPlanner::setSceneRegionCropper(const SceneRegionCropperPtr& scene_region_cropper)
+{
+  scene_region_cropper_ = scene_region_cropper;
+}
+
 void GraspPlanner::waitForNextStep(const std::string& message)
 {
   if (wait_for_next_step_callback_)
@@ -0,0 +1,174 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Cutting planes, approach orientation cones and pose checks shared by the grasp generator and filter
+*/
+
+#include <moveit_grasps/grasp_predicates.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+
+namespace moveit_grasps
+{
+GraspPredicates::GraspPredicates() : version_(0)
+{
+}
+
+void GraspPredicates::addCuttingPlane(const Eigen::Affine3d& pose, grasp_parallel_plane plane, int direction)
+{
+  cutting_planes_.push_back(CuttingPlanePtr(new CuttingPlane(pose, plane, direction)));
+  ++version_;
+}
+
+void GraspPredicates::addDesiredGraspOrientation(const Eigen::Affine3d& pose, double max_angle_offset)
+{
+  desired_grasp_orientations_.push_back(
+      DesiredGraspOrientationPtr(new DesiredGraspOrientation(pose, max_angle_offset)));
+  ++version_;
+}
+
+void GraspPredicates::addGraspPoseCheck(const GraspPoseCheckFn& grasp_pose_check)
+{
+  grasp_pose_checks_.push_back(grasp_pose_check);
+  ++version_;
+}
+
+void GraspPredicates::clearCuttingPlanes()
+{
+  cutting_planes_.clear();
+  ++version_;
+}
+
+void GraspPredicates::clearDesiredGraspOrientations()
+{
+  desired_grasp_orientations_.clear();
+  ++version_;
+}
+
+void GraspPredicates::clearGraspPoseChecks()
+{
+  grasp_pose_checks_.clear();
+  ++version_;
+}
+
+bool GraspPredicates::isCutByPlane(const CuttingPlane& cutting_plane, const Eigen::Vector3d& eef_position)
+{
+  // get grasp translation in filter pose CS
+  const Eigen::Vector3d grasp_position = cutting_plane.pose_.inverse() * eef_position;
+
+  // filter grasps by cutting plane
+  double epsilon = 0.00000001;
+  std::size_t normal_axis;
+  switch (cutting_plane.plane_)
+  {
+    case XY:
+      normal_axis = 2;
+      break;
+    case XZ:
+      normal_axis = 1;
+      break;
+    case YZ:
+      normal_axis = 0;
+      break;
+    default:
+      ROS_WARN_STREAM_NAMED("filter_by_plane", "plane not specified correctly");
+      return false;
+  }
+
+  return (cutting_plane.direction_ == -1 && grasp_position(normal_axis) < 0 + epsilon) ||
+         (cutting_plane.direction_ == 1 && grasp_position(normal_axis) > 0 - epsilon);
+}
+
+bool GraspPredicates::isOutsideOrientation(const DesiredGraspOrientation& desired_orientation,
+                                           const Eigen::Vector3d& approach_direction)
+{
+  // compute the angle between the z-axes of the desired and grasp poses
+  const Eigen::Vector3d desired_z_axis = desired_orientation.pose_.rotation() * Eigen::Vector3d::UnitZ();
+  const double angle = acos(approach_direction.normalized().dot(desired_z_axis.normalized()));
+  return angle > desired_orientation.max_angle_offset_;
+}
+
+bool GraspPredicates::isCut(const Eigen::Vector3d& eef_position) const
+{
+  for (std::size_t i = 0; i < cutting_planes_.size(); ++i)
+    if (isCutByPlane(*cutting_planes_[i], eef_position))
+      return true;
+  return false;
+}
+
+bool GraspPredicates::isOutsideOrientations(const Eigen::Vector3d& approach_direction) const
+{
+  for (std::size_t i = 0; i < desired_grasp_orientations_.size(); ++i)
+    if (isOutsideOrientation(*desired_grasp_orientations_[i], approach_direction))
+      return true;
+  return false;
+}
+
+bool GraspPredicates::excludes(const Eigen::Affine3d& grasp_pose, const Eigen::Affine3d& grasp_pose_to_eef_pose) const
+{
+  // Cutting planes apply to the end effector like in the filter, orientations to the approach direction
+  if (!cutting_planes_.empty() && isCut(grasp_pose * grasp_pose_to_eef_pose.translation()))
+    return true;
+  if (isOutsideOrientations(grasp_pose.rotation().col(2)))
+    return true;
+  for (std::size_t i = 0; i < grasp_pose_checks_.size(); ++i)
+    if (!grasp_pose_checks_[i](grasp_pose))
+      return true;
+  return false;
+}
+
+bool GraspPredicates::excludesApproachCone(const Eigen::Vector3d& axis, double offset) const
+{
+  // Directions on the cone are offset * axis plus a unit vector normal to the axis scaled to the rest, the one
+  // closest to a desired direction has its normal part along the normal part of the desired direction
+  const double normal_length = std::sqrt(std::max(1.0 - offset * offset, 0.0));
+  for (std::size_t i = 0; i < desired_grasp_orientations_.size(); ++i)
+  {
+    const Eigen::Vector3d desired_z_axis =
+        (desired_grasp_orientations_[i]->pose_.rotation() * Eigen::Vector3d::UnitZ()).normalized();
+    const double axis_alignment = std::max(std::min(axis.dot(desired_z_axis), 1.0), -1.0);
+    const double max_alignment =
+        offset * axis_alignment + normal_length * std::sqrt(1.0 - axis_alignment * axis_alignment);
+
+    // Leave a margin so rounding never excludes a direction the per grasp check would allow
+    if (std::acos(std::min(max_alignment, 1.0)) > desired_grasp_orientations_[i]->max_angle_offset_ + 1e-6)
+      return true;
+  }
+  return false;
+}
+
+}  // end namespace
@@ -0,0 +1,212 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Online nearest neighbor model predicting whether a grasp pose will have an IK solution
+*/
+
+// moveit_grasps
+#include <moveit_grasps/grasp_success_predictor.h>
+
+// C++
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+// Samples compared one by one at the bottom of the kd-tree
+const std::size_t LEAF_SIZE = 16;
+}
+
+namespace moveit_grasps
+{
+GraspSuccessPredictor::GraspSuccessPredictor(std::size_t k, std::size_t max_samples, double orientation_weight)
+  : k_(std::max<std::size_t>(k, 1))
+  , max_samples_(max_samples)
+  , orientation_weight_(orientation_weight)
+  , next_sample_(0)
+  , index_valid_(false)
+{
+  samples_.reserve(max_samples_);
+  outcomes_.reserve(max_samples_);
+}
+
+void GraspSuccessPredictor::addSample(const Eigen::Affine3d& ik_pose, bool success)
+{
+  if (max_samples_ == 0)
+    return;
+  index_valid_ = false;
+
+  if (samples_.size() < max_samples_)
+  {
+    samples_.push_back(getFeature(ik_pose));
+    outcomes_.push_back(success);
+    return;
+  }
+
+  // Full, overwrite the oldest sample
+  samples_[next_sample_] = getFeature(ik_pose);
+  outcomes_[next_sample_] = success;
+  next_sample_ = (next_sample_ + 1) % max_samples_;
+}
+
+double GraspSuccessPredictor::predictSuccess(const Eigen::Affine3d& ik_pose) const
+{
+  if (samples_.empty())
+    return 0.5;
+
+  const Feature feature = getFeature(ik_pose);
+
+  // Keep only the k nearest samples
+  const std::size_t k = std::min(k_, samples_.size());
+  Neighbors neighbors;
+  neighbors.reserve(k + 1);
+  if (index_valid_)
+    searchNode(0, feature, k, neighbors);
+  else
+    for (std::size_t i = 0; i < samples_.size(); ++i)
+      addNeighbor(feature, i, k, neighbors);
+
+  std::size_t successes = 0;
+  for (std::size_t i = 0; i < neighbors.size(); ++i)
+    if (outcomes_[neighbors[i].second])
+      successes++;
+
+  // Laplace smoothing so that a handful of neighbors never gives certainty
+  return (successes + 1.0) / (k + 2.0);
+}
+
+void GraspSuccessPredictor::updateIndex()
+{
+  if (index_valid_ || samples_.empty())
+    return;
+
+  nodes_.clear();
+  index_.resize(samples_.size());
+  for (std::size_t i = 0; i < index_.size(); ++i)
+    index_[i] = i;
+  buildNode(0, index_.size());
+  index_valid_ = true;
+}
+
+void GraspSuccessPredictor::clear()
+{
+  samples_.clear();
+  outcomes_.clear();
+  next_sample_ = 0;
+  nodes_.clear();
+  index_.clear();
+  index_valid_ = false;
+}
+
+void GraspSuccessPredictor::addNeighbor(const Feature& feature, std::size_t sample_id, std::size_t k,
+                                        Neighbors& neighbors) const
+{
+  const double distance = (samples_[sample_id] - feature).squaredNorm();
+  if (neighbors.size() == k && distance >= neighbors.front().first)
+    return;
+  neighbors.push_back(std::make_pair(distance, sample_id));
+  std::push_heap(neighbors.begin(), neighbors.end());
+  if (neighbors.size() > k)
+  {
+    std::pop_heap(neighbors.begin(), neighbors.end());
+    neighbors.pop_back();
+  }
+}
+
+int GraspSuccessPredictor::buildNode(std::size_t begin, std::size_t end)
+{
+  const int node_id = nodes_.size();
+  nodes_.push_back(Node());
+  Node node;
+  node.axis_ = -1;
+  node.split_ = 0.0;
+  node.left_ = -1;
+  node.right_ = -1;
+  node.begin_ = begin;
+  node.end_ = end;
+
+  if (end - begin > LEAF_SIZE)
+  {
+    // Split at the median of the axis with the largest spread
+    Feature min = samples_[index_[begin]];
+    Feature max = min;
+    for (std::size_t i = begin + 1; i < end; ++i)
+    {
+      min = min.cwiseMin(samples_[index_[i]]);
+      max = max.cwiseMax(samples_[index_[i]]);
+    }
+    int axis;
+    (max - min).maxCoeff(&axis);
+
+    const std::size_t middle = begin + (end - begin) / 2;
+    std::nth_element(index_.begin() + begin, index_.begin() + middle, index_.begin() + end,
+                     [this, axis](std::size_t a, std::size_t b) { return samples_[a][axis] < samples_[b][axis]; });
+    node.axis_ = axis;
+    node.split_ = samples_[index_[middle]][axis];
+    node.left_ = buildNode(begin, middle);
+    node.right_ = buildNode(middle, end);
+  }
+
+  nodes_[node_id] = node;
+  return node_id;
+}
+
+void GraspSuccessPredictor::searchNode(int node_id, const Feature& feature, std::size_t k, Neighbors& neighbors) const
+{
+  const Node& node = nodes_[node_id];
+  if (node.axis_ < 0)
+  {
+    for (std::size_t i = node.begin_; i < node.end_; ++i)
+      addNeighbor(feature, index_[i], k, neighbors);
+    return;
+  }
+
+  // Descend into the side of the query first, the other side only if it can hold a closer sample
+  const double offset = feature[node.axis_] - node.split_;
+  searchNode(offset < 0.0 ? node.left_ : node.right_, feature, k, neighbors);
+  if (neighbors.size() < k || offset * offset < neighbors.front().first)
+    searchNode(offset < 0.0 ? node.right_ : node.left_, feature, k, neighbors);
+}
+
+GraspSuccessPredictor::Feature GraspSuccessPredictor::getFeature(const Eigen::Affine3d& ik_pose) const
+{
+  Feature feature;
+  feature.segment<3>(0) = ik_pose.translation();
+  feature.segment<3>(3) = orientation_weight_ * ik_pose.linear().col(0);
+  feature.segment<3>(6) = orientation_weight_ * ik_pose.linear().col(2);
+  return feature;
+}
+
+}  // namespace
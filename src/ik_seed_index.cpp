@@ -0,0 +1,134 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   IK solutions of solved grasp poses, looked up by nearby poses to seed their IK
+*/
+
+#include <moveit_grasps/ik_seed_index.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// Number of bits used for each axis of a cell key
+const int CELL_KEY_BITS = 21;
+const std::int64_t CELL_KEY_OFFSET = std::int64_t(1) << (CELL_KEY_BITS - 1);
+const std::int64_t CELL_KEY_MASK = (std::int64_t(1) << CELL_KEY_BITS) - 1;
+
+// Rotation angle between two rotation matrices, without the cost of a full angle axis conversion
+double rotationAngle(const Eigen::Matrix3d& rotation_a, const Eigen::Matrix3d& rotation_b)
+{
+  const double cos_angle = ((rotation_a.transpose() * rotation_b).trace() - 1.0) / 2.0;
+  return std::acos(std::max(-1.0, std::min(1.0, cos_angle)));
+}
+}  // namespace
+
+namespace moveit_grasps
+{
+IKSeedIndex::IKSeedIndex(double cell_size, double max_rotation, std::size_t max_seeds_per_cell)
+  : cell_size_(cell_size), max_rotation_(max_rotation), max_seeds_per_cell_(max_seeds_per_cell), num_solutions_(0)
+{
+}
+
+void IKSeedIndex::addSolution(const Eigen::Affine3d& ik_pose, const std::vector<double>& solution)
+{
+  const std::int64_t key = getCellKey(ik_pose.translation());
+  boost::mutex::scoped_lock lock(cells_mutex_);
+  std::vector<Seed>& cell = cells_[key];
+  if (cell.size() >= max_seeds_per_cell_)
+    return;
+
+  // A seed for nearly the same rotation is already known
+  for (std::size_t i = 0; i < cell.size(); ++i)
+    if (rotationAngle(cell[i].rotation_, ik_pose.rotation()) < max_rotation_ / 4.0)
+      return;
+
+  cell.push_back(Seed());
+  cell.back().rotation_ = ik_pose.rotation();
+  cell.back().solution_ = solution;
+  num_solutions_++;
+}
+
+bool IKSeedIndex::findSeed(const Eigen::Affine3d& ik_pose, std::vector<double>& seed) const
+{
+  const std::int64_t key = getCellKey(ik_pose.translation());
+  boost::mutex::scoped_lock lock(cells_mutex_);
+  std::unordered_map<std::int64_t, std::vector<Seed> >::const_iterator cell_it = cells_.find(key);
+  if (cell_it == cells_.end())
+    return false;
+
+  const Seed* closest = NULL;
+  double closest_rotation = max_rotation_;
+  for (std::size_t i = 0; i < cell_it->second.size(); ++i)
+  {
+    const double rotation = rotationAngle(cell_it->second[i].rotation_, ik_pose.rotation());
+    if (rotation <= closest_rotation)
+    {
+      closest = &cell_it->second[i];
+      closest_rotation = rotation;
+    }
+  }
+  if (!closest)
+    return false;
+
+  seed = closest->solution_;
+  return true;
+}
+
+std::size_t IKSeedIndex::getNumSolutions() const
+{
+  boost::mutex::scoped_lock lock(cells_mutex_);
+  return num_solutions_;
+}
+
+void IKSeedIndex::clear()
+{
+  boost::mutex::scoped_lock lock(cells_mutex_);
+  cells_.clear();
+  num_solutions_ = 0;
+}
+
+std::int64_t IKSeedIndex::getCellKey(const Eigen::Vector3d& position) const
+{
+  const std::int64_t x = static_cast<std::int64_t>(std::floor(position.x() / cell_size_));
+  const std::int64_t y = static_cast<std::int64_t>(std::floor(position.y() / cell_size_));
+  const std::int64_t z = static_cast<std::int64_t>(std::floor(position.z() / cell_size_));
+  return (((x + CELL_KEY_OFFSET) & CELL_KEY_MASK) << (2 * CELL_KEY_BITS)) |
+         (((y + CELL_KEY_OFFSET) & CELL_KEY_MASK) << CELL_KEY_BITS) | ((z + CELL_KEY_OFFSET) & CELL_KEY_MASK);
+}
+
+}  // namespace
@@ -0,0 +1,405 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Fit an oriented bounding box to a mesh, so meshes from perception can be grasped like cuboids
+*/
+
+#include <moveit_grasps/mesh_bounding_box.h>
+
+// Eigen
+#include <Eigen/Eigenvalues>
+
+// C++
+#include <algorithm>
+#include <limits>
+
+namespace moveit_grasps
+{
+namespace
+{
+// Cross product of (b - a) and (c - a), positive if c is left of the line from a to b
+double cross(const Eigen::Vector2d& a, const Eigen::Vector2d& b, const Eigen::Vector2d& c)
+{
+  return (b.x() - a.x()) * (c.y() - a.y()) - (b.y() - a.y()) * (c.x() - a.x());
+}
+
+bool lessXY(const Eigen::Vector2d& a, const Eigen::Vector2d& b)
+{
+  return a.x() < b.x() || (a.x() == b.x() && a.y() < b.y());
+}
+
+double surfaceArea(const Eigen::Vector3d& size)
+{
+  return size.x() * size.y() + size.y() * size.z() + size.z() * size.x();
+}
+}  // namespace
+
+MeshBoundingBox::MeshBoundingBox()
+{
+}
+
+bool MeshBoundingBox::fit(const shape_msgs::Mesh& mesh_msg, Eigen::Affine3d& box_pose, Eigen::Vector3d& box_size)
+{
+  const std::size_t num_vertices = mesh_msg.vertices.size();
+  if (num_vertices == 0)
+  {
+    ROS_ERROR_STREAM_NAMED("mesh_bounding_box", "Unable to fit a bounding box to a mesh without vertices");
+    return false;
+  }
+
+  // Accumulate the covariance while copying the vertices, relative to the first one to avoid cancellation
+  const Eigen::Vector3d origin(mesh_msg.vertices[0].x, mesh_msg.vertices[0].y, mesh_msg.vertices[0].z);
+  double sx = 0, sy = 0, sz = 0, sxx = 0, sxy = 0, sxz = 0, syy = 0, syz = 0, szz = 0;
+  vertices_.resize(3, num_vertices);
+  for (std::size_t i = 0; i < num_vertices; ++i)
+  {
+    const double x = mesh_msg.vertices[i].x - origin.x();
+    const double y = mesh_msg.vertices[i].y - origin.y();
+    const double z = mesh_msg.vertices[i].z - origin.z();
+    vertices_.col(i) << x, y, z;
+    sx += x;
+    sy += y;
+    sz += z;
+    sxx += x * x;
+    sxy += x * y;
+    sxz += x * z;
+    syy += y * y;
+    syz += y * z;
+    szz += z * z;
+  }
+  const double inverse_num = 1.0 / static_cast<double>(num_vertices);
+  const Eigen::Vector3d mean = Eigen::Vector3d(sx, sy, sz) * inverse_num;
+  Eigen::Matrix3d covariance;
+  covariance << sxx, sxy, sxz, sxy, syy, syz, sxz, syz, szz;
+  covariance = covariance * inverse_num - mean * mean.transpose();
+
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+  solver.computeDirect(covariance);
+  Eigen::Matrix3d axes = solver.eigenvectors();
+  if (axes.determinant() < 0)
+    axes.col(0) = -axes.col(0);
+
+  // Box along the principal axes, with the vertices still relative to the first one
+  projected_vertices_.noalias() = axes.transpose() * vertices_;
+  const Eigen::Vector3d min_corner = projected_vertices_.rowwise().minCoeff();
+  const Eigen::Vector3d max_corner = projected_vertices_.rowwise().maxCoeff();
+  const Eigen::Vector3d pca_size = max_corner - min_corner;
+  const Eigen::Vector3d pca_center = (min_corner + max_corner) / 2.0;
+
+  Eigen::Matrix3d best_rotation = axes;
+  Eigen::Vector3d best_center = pca_center;
+  Eigen::Vector3d best_size = pca_size;
+
+  // Refine the rotation around each principal axis
+  Eigen::Vector2d direction, center, size;
+  for (std::size_t k = 0; k < 3; ++k)
+  {
+    const std::size_t u = (k + 1) % 3;
+    const std::size_t v = (k + 2) % 3;
+    const double extent = Eigen::Vector2d(pca_size[u], pca_size[v]).norm();
+    selectHullCandidates(u, v, extent);
+    if (fitMinAreaRectangle(extent, direction, center, size) < 0)
+      continue;
+
+    Eigen::Vector3d refined_size;
+    refined_size[u] = size.x();
+    refined_size[v] = size.y();
+    refined_size[k] = pca_size[k];
+    if (surfaceArea(refined_size) >= surfaceArea(best_size))
+      continue;
+
+    // Rotate the u and v axes to the sides of the rectangle, which keeps the frame right handed
+    best_rotation = axes;
+    best_rotation.col(u) = axes.col(u) * direction.x() + axes.col(v) * direction.y();
+    best_rotation.col(v) = -axes.col(u) * direction.y() + axes.col(v) * direction.x();
+    best_center[u] = center.x();
+    best_center[v] = center.y();
+    best_center[k] = pca_center[k];
+    best_size = refined_size;
+  }
+
+  box_pose = Eigen::Affine3d::Identity();
+  box_pose.linear() = best_rotation;
+  box_pose.translation() = origin + axes * best_center;
+  box_size = best_size;
+  return true;
+}
+
+double MeshBoundingBox::fitMinAreaRectangle(double extent, Eigen::Vector2d& direction, Eigen::Vector2d& center,
+                                            Eigen::Vector2d& size)
+{
+  computeConvexHull(extent);
+  const std::size_t num_hull = hull_.size();
+  if (num_hull < 3)
+    return -1.0;
+
+  double best_area = std::numeric_limits<double>::max();
+
+  // Indices of the hull points with the largest and smallest projection on an edge, and the largest distance to it.
+  // They only move forward while the edges turn counter clockwise
+  std::size_t right = 0;
+  std::size_t top = 0;
+  std::size_t left = 0;
+  for (std::size_t i = 0; i < num_hull; ++i)
+  {
+    const Eigen::Vector2d& start = hull_[i];
+    const Eigen::Vector2d edge = (hull_[(i + 1) % num_hull] - start).normalized();
+    const Eigen::Vector2d normal(-edge.y(), edge.x());
+
+    if (i == 0)
+    {
+      for (std::size_t j = 1; j < num_hull; ++j)
+      {
+        if (hull_[j].dot(edge) > hull_[right].dot(edge))
+          right = j;
+        if (hull_[j].dot(normal) > hull_[top].dot(normal))
+          top = j;
+        if (hull_[j].dot(edge) < hull_[left].dot(edge))
+          left = j;
+      }
+    }
+    else
+    {
+      for (std::size_t steps = 0; steps < num_hull && hull_[(right + 1) % num_hull].dot(edge) >= hull_[right].dot(edge);
+           ++steps)
+        right = (right + 1) % num_hull;
+      for (std::size_t steps = 0;
+           steps < num_hull && hull_[(top + 1) % num_hull].dot(normal) >= hull_[top].dot(normal); ++steps)
+        top = (top + 1) % num_hull;
+      for (std::size_t steps = 0; steps < num_hull && hull_[(left + 1) % num_hull].dot(edge) <= hull_[left].dot(edge);
+           ++steps)
+        left = (left + 1) % num_hull;
+    }
+
+    const double min_edge = hull_[left].dot(edge);
+    const double max_edge = hull_[right].dot(edge);
+    const double min_normal = start.dot(normal);
+    const double max_normal = hull_[top].dot(normal);
+    const double area = (max_edge - min_edge) * (max_normal - min_normal);
+    if (area < best_area)
+    {
+      best_area = area;
+      direction = edge;
+      center = edge * (min_edge + max_edge) / 2.0 + normal * (min_normal + max_normal) / 2.0;
+      size = Eigen::Vector2d(max_edge - min_edge, max_normal - min_normal);
+    }
+  }
+  return best_area;
+}
+
+void MeshBoundingBox::selectHullCandidates(std::size_t u, std::size_t v, double extent)
+{
+  // Extreme points along x, y and the diagonals, in counter clockwise order of their directions
+  const std::size_t num_vertices = projected_vertices_.cols();
+  std::size_t extremes[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  double max_x = projected_vertices_(u, 0), min_x = max_x;
+  double max_y = projected_vertices_(v, 0), min_y = max_y;
+  double max_sum = max_x + max_y, min_sum = max_sum;
+  double max_difference = max_x - max_y, min_difference = max_difference;
+  for (std::size_t i = 1; i < num_vertices; ++i)
+  {
+    const double x = projected_vertices_(u, i);
+    const double y = projected_vertices_(v, i);
+    // clang-format off
+    if (x > max_x) { max_x = x; extremes[0] = i; }
+    if (x + y > max_sum) { max_sum = x + y; extremes[1] = i; }
+    if (y > max_y) { max_y = y; extremes[2] = i; }
+    if (x - y < min_difference) { min_difference = x - y; extremes[3] = i; }
+    if (x < min_x) { min_x = x; extremes[4] = i; }
+    if (x + y < min_sum) { min_sum = x + y; extremes[5] = i; }
+    if (y < min_y) { min_y = y; extremes[6] = i; }
+    if (x - y > max_difference) { max_difference = x - y; extremes[7] = i; }
+    // clang-format on
+  }
+
+  Eigen::Vector2d corners[8];
+  polygon_.clear();
+  for (std::size_t d = 0; d < 8; ++d)
+  {
+    corners[d] = Eigen::Vector2d(projected_vertices_(u, extremes[d]), projected_vertices_(v, extremes[d]));
+    polygon_.push_back(corners[d]);
+  }
+
+  hull_candidates_.clear();
+  if (!setPolygonEdges(extent))
+  {
+    for (std::size_t i = 0; i < num_vertices; ++i)
+      hull_candidates_.push_back(Eigen::Vector2d(projected_vertices_(u, i), projected_vertices_(v, i)));
+    return;
+  }
+
+  // Most interior points are inside an axis aligned rectangle between the extreme points, which is quicker to test
+  double inner_min_x = std::max(corners[3].x(), std::max(corners[4].x(), corners[5].x()));
+  double inner_max_x = std::min(corners[7].x(), std::min(corners[0].x(), corners[1].x()));
+  double inner_min_y = std::max(corners[5].y(), std::max(corners[6].y(), corners[7].y()));
+  double inner_max_y = std::min(corners[1].y(), std::min(corners[2].y(), corners[3].y()));
+  if (!isInsidePolygon(Eigen::Vector2d(inner_min_x, inner_min_y)) ||
+      !isInsidePolygon(Eigen::Vector2d(inner_max_x, inner_min_y)) ||
+      !isInsidePolygon(Eigen::Vector2d(inner_max_x, inner_max_y)) ||
+      !isInsidePolygon(Eigen::Vector2d(inner_min_x, inner_max_y)))
+  {
+    inner_min_x = inner_min_y = std::numeric_limits<double>::max();
+    inner_max_x = inner_max_y = -std::numeric_limits<double>::max();
+  }
+
+  for (std::size_t i = 0; i < num_vertices; ++i)
+  {
+    const Eigen::Vector2d point(projected_vertices_(u, i), projected_vertices_(v, i));
+    if (point.x() > inner_min_x && point.x() < inner_max_x && point.y() > inner_min_y && point.y() < inner_max_y)
+      continue;
+    if (!isInsidePolygon(point))
+      hull_candidates_.push_back(point);
+  }
+
+  // The polygon itself is part of the hull
+  hull_candidates_.insert(hull_candidates_.end(), polygon_.begin(), polygon_.end());
+}
+
+void MeshBoundingBox::discardInteriorPoints(std::size_t num_directions, double extent)
+{
+  if (hull_candidates_.size() < 3 * num_directions)
+    return;
+
+  // Extreme points, in counter clockwise order of their directions, found in one pass over the points
+  const std::size_t MAX_DIRECTIONS = 32;
+  num_directions = std::min(num_directions, MAX_DIRECTIONS);
+  Eigen::Vector2d directions[MAX_DIRECTIONS];
+  double max_projections[MAX_DIRECTIONS];
+  std::size_t extremes[MAX_DIRECTIONS];
+  for (std::size_t d = 0; d < num_directions; ++d)
+  {
+    const double angle = 2.0 * M_PI * static_cast<double>(d) / static_cast<double>(num_directions);
+    directions[d] = Eigen::Vector2d(cos(angle), sin(angle));
+    max_projections[d] = -std::numeric_limits<double>::max();
+    extremes[d] = 0;
+  }
+  for (std::size_t i = 0; i < hull_candidates_.size(); ++i)
+  {
+    for (std::size_t d = 0; d < num_directions; ++d)
+    {
+      const double projection = hull_candidates_[i].dot(directions[d]);
+      if (projection > max_projections[d])
+      {
+        max_projections[d] = projection;
+        extremes[d] = i;
+      }
+    }
+  }
+
+  polygon_.clear();
+  for (std::size_t d = 0; d < num_directions; ++d)
+    polygon_.push_back(hull_candidates_[extremes[d]]);
+  if (!setPolygonEdges(extent))
+    return;
+
+  std::size_t num_kept = 0;
+  for (std::size_t i = 0; i < hull_candidates_.size(); ++i)
+  {
+    const Eigen::Vector2d point = hull_candidates_[i];
+    if (!isInsidePolygon(point))
+      hull_candidates_[num_kept++] = point;
+  }
+  hull_candidates_.resize(num_kept);
+  hull_candidates_.insert(hull_candidates_.end(), polygon_.begin(), polygon_.end());
+}
+
+bool MeshBoundingBox::setPolygonEdges(double extent)
+{
+  // Remove repeated extreme points
+  std::size_t num_edges = 0;
+  for (std::size_t j = 0; j < polygon_.size(); ++j)
+    if (num_edges == 0 || (polygon_[j] - polygon_[num_edges - 1]).squaredNorm() > 0)
+      polygon_[num_edges++] = polygon_[j];
+  while (num_edges > 1 && (polygon_[0] - polygon_[num_edges - 1]).squaredNorm() == 0)
+    --num_edges;
+  polygon_.resize(num_edges);
+  if (num_edges < 3)
+    return false;
+
+  // Edges as inward normals and offsets. Points on an edge are not hull vertices either, but they are only treated
+  // as inside up to a tolerance, so rounding errors can not drop a real one by more than that
+  const double tolerance = 1e-9 * extent * extent;
+  edge_normals_.resize(num_edges);
+  edge_offsets_.resize(num_edges);
+  for (std::size_t j = 0; j < num_edges; ++j)
+  {
+    const Eigen::Vector2d edge = polygon_[(j + 1) % num_edges] - polygon_[j];
+    edge_normals_[j] = Eigen::Vector2d(-edge.y(), edge.x());
+    edge_offsets_[j] = edge_normals_[j].dot(polygon_[j]) - tolerance;
+  }
+  return true;
+}
+
+bool MeshBoundingBox::isInsidePolygon(const Eigen::Vector2d& point) const
+{
+  for (std::size_t j = 0; j < edge_normals_.size(); ++j)
+    if (edge_normals_[j].dot(point) < edge_offsets_[j])
+      return false;
+  return true;
+}
+
+void MeshBoundingBox::computeConvexHull(double extent)
+{
+  // Most points outside the first polygon are near curved outlines, and inside a finer polygon
+  discardInteriorPoints(32, extent);
+
+  // Andrew's monotone chain, which also drops collinear and duplicate points
+  std::sort(hull_candidates_.begin(), hull_candidates_.end(), lessXY);
+  const std::size_t num_candidates = hull_candidates_.size();
+  if (num_candidates == 0)
+  {
+    hull_.clear();
+    return;
+  }
+  hull_.resize(2 * num_candidates);
+  std::size_t num_hull = 0;
+  for (std::size_t i = 0; i < num_candidates; ++i)
+  {
+    while (num_hull >= 2 && cross(hull_[num_hull - 2], hull_[num_hull - 1], hull_candidates_[i]) <= 0)
+      --num_hull;
+    hull_[num_hull++] = hull_candidates_[i];
+  }
+  const std::size_t lower_size = num_hull + 1;
+  for (std::size_t i = num_candidates - 1; i-- > 0;)
+  {
+    while (num_hull >= lower_size && cross(hull_[num_hull - 2], hull_[num_hull - 1], hull_candidates_[i]) <= 0)
+      --num_hull;
+    hull_[num_hull++] = hull_candidates_[i];
+  }
+  // The last point is the first one again
+  hull_.resize(num_hull > 1 ? num_hull - 1 : num_hull);
+}
+
+}  // namespace
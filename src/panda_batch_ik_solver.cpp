@@ -0,0 +1,376 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Closed form inverse kinematics of the Franka Emika Panda arm for batches of poses
+*/
+
+// moveit_grasps
+#include <moveit_grasps/panda_batch_ik_solver.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+
+namespace moveit_grasps
+{
+namespace
+{
+// Modified Denavit-Hartenberg parameters of the Panda, each link is Rx(alpha) Tx(a) Rz(q) Tz(d)
+const double D1 = 0.333;
+const double D3 = 0.316;
+const double A4 = 0.0825;
+const double D5 = 0.384;
+const double A7 = 0.088;
+const double D_FLANGE = 0.107;
+const double DH_A[PandaBatchIKSolver::NUM_JOINTS] = { 0.0, 0.0, 0.0, A4, -A4, 0.0, A7 };
+const double DH_D[PandaBatchIKSolver::NUM_JOINTS] = { D1, 0.0, D3, 0.0, D5, 0.0, 0.0 };
+const double DH_ALPHA[PandaBatchIKSolver::NUM_JOINTS] = { 0.0, -M_PI_2, M_PI_2, M_PI_2, -M_PI_2, M_PI_2, M_PI_2 };
+
+// Limits from the Panda datasheet, replaced by the robot model's in initialize()
+const double LOWER_LIMITS[PandaBatchIKSolver::NUM_JOINTS] = { -2.8973, -1.7628, -2.8973, -3.0718,
+                                                              -2.8973, -0.0175, -2.8973 };
+const double UPPER_LIMITS[PandaBatchIKSolver::NUM_JOINTS] = { 2.8973, 1.7628, 2.8973, -0.0698, 2.8973, 3.7525, 2.8973 };
+
+// Random configurations compared with the robot model in initialize()
+const std::size_t NUM_VALIDATION_SAMPLES = 10;
+const double VALIDATION_POSITION_TOLERANCE = 1e-4;
+const double VALIDATION_ANGLE_TOLERANCE = 1e-3;
+
+// Below this the shoulder or the swivel is singular
+const double SINGULAR_EPSILON = 1e-9;
+}
+
+PandaBatchIKSolver::PandaBatchIKSolver(double redundancy_step)
+  : redundancy_step_(redundancy_step), tip_to_flange_(Eigen::Affine3d::Identity())
+{
+  std::copy(LOWER_LIMITS, LOWER_LIMITS + NUM_JOINTS, lower_);
+  std::copy(UPPER_LIMITS, UPPER_LIMITS + NUM_JOINTS, upper_);
+  solutions_.resize(MAX_SOLUTIONS * NUM_JOINTS);
+  solution_order_.resize(MAX_SOLUTIONS);
+  solution_distances_.resize(MAX_SOLUTIONS);
+  solution_.resize(NUM_JOINTS);
+}
+
+bool PandaBatchIKSolver::initialize(const moveit::core::RobotState& robot_state,
+                                    const robot_model::JointModelGroup* arm_jmg, const std::string& base_frame,
+                                    const std::string& tip_frame)
+{
+  const std::vector<const robot_model::JointModel*>& joints = arm_jmg->getActiveJointModels();
+  if (arm_jmg->getVariableCount() != NUM_JOINTS || joints.size() != NUM_JOINTS)
+  {
+    ROS_WARN_STREAM_NAMED("batch_ik_solver", "Arm " << arm_jmg->getName() << " does not have the seven joints of a "
+                                                                           "Panda");
+    return false;
+  }
+  for (std::size_t i = 0; i < NUM_JOINTS; ++i)
+  {
+    const robot_model::VariableBounds& bounds = joints[i]->getVariableBounds()[0];
+    lower_[i] = bounds.min_position_;
+    upper_[i] = bounds.max_position_;
+  }
+
+  const std::string base_link = (!base_frame.empty() && base_frame[0] == '/') ? base_frame.substr(1) : base_frame;
+  const std::string tip_link = (!tip_frame.empty() && tip_frame[0] == '/') ? tip_frame.substr(1) : tip_frame;
+  if (!robot_state.getRobotModel()->getLinkModel(base_link) || !robot_state.getRobotModel()->getLinkModel(tip_link))
+  {
+    ROS_WARN_STREAM_NAMED("batch_ik_solver", "Unknown base frame " << base_frame << " or tip frame " << tip_frame);
+    return false;
+  }
+
+  // Compare the analytic flange pose with the tip pose of the model, the first sample defines the tip offset
+  moveit::core::RobotState state(robot_state);
+  double joint_values[NUM_JOINTS];
+  for (std::size_t sample = 0; sample < NUM_VALIDATION_SAMPLES; ++sample)
+  {
+    for (std::size_t i = 0; i < NUM_JOINTS; ++i)
+    {
+      const double fraction = std::fmod(0.5 + 0.618034 * (sample * NUM_JOINTS + i), 1.0);
+      joint_values[i] = lower_[i] + fraction * (upper_[i] - lower_[i]);
+    }
+    state.setJointGroupPositions(arm_jmg, joint_values);
+    state.update();
+    const Eigen::Affine3d base_to_tip =
+        state.getGlobalLinkTransform(base_link).inverse() * state.getGlobalLinkTransform(tip_link);
+    const Eigen::Affine3d base_to_flange = computeFlangePose(joint_values);
+
+    if (sample == 0)
+    {
+      tip_to_flange_ = base_to_tip.inverse() * base_to_flange;
+      continue;
+    }
+
+    const Eigen::Affine3d error = base_to_flange.inverse() * base_to_tip * tip_to_flange_;
+    if (error.translation().norm() > VALIDATION_POSITION_TOLERANCE ||
+        Eigen::AngleAxisd(error.rotation()).angle() > VALIDATION_ANGLE_TOLERANCE)
+    {
+      ROS_WARN_STREAM_NAMED("batch_ik_solver", "Arm " << arm_jmg->getName() << " does not match the kinematics of a "
+                                                                             "Panda");
+      return false;
+    }
+  }
+  return true;
+}
+
+std::size_t PandaBatchIKSolver::solve(const EigenSTL::vector_Affine3d& ik_poses,
+                                      const std::vector<std::vector<double> >& ik_seeds, double timeout,
+                                      const BatchIKCallbackFn& solution_callback,
+                                      std::vector<std::vector<double> >& ik_solutions,
+                                      std::vector<moveit_msgs::MoveItErrorCodes>& error_codes)
+{
+  const ros::WallTime start_time = ros::WallTime::now();
+  const double batch_timeout = timeout * ik_poses.size();
+
+  ik_solutions.resize(ik_poses.size());
+  error_codes.resize(ik_poses.size());
+  flange_poses_.resize(ik_poses.size());
+  pending_.clear();
+  for (std::size_t pose_id = 0; pose_id < ik_poses.size(); ++pose_id)
+  {
+    ik_solutions[pose_id].clear();
+    error_codes[pose_id].val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+    if (ik_seeds[pose_id].size() != NUM_JOINTS)
+    {
+      ROS_ERROR_STREAM_NAMED("batch_ik_solver", "Seed of pose " << pose_id << " has " << ik_seeds[pose_id].size()
+                                                                << " values, expected " << NUM_JOINTS);
+      continue;
+    }
+    flange_poses_[pose_id] = ik_poses[pose_id] * tip_to_flange_;
+    pending_.push_back(pose_id);
+  }
+
+  // Step the last joint outwards from the seed, alternating sides, until it has left its range on both sides
+  const std::size_t max_steps = std::ceil((upper_[NUM_JOINTS - 1] - lower_[NUM_JOINTS - 1]) / redundancy_step_);
+  std::size_t num_solved = 0;
+  for (std::size_t step = 0; step <= 2 * max_steps && !pending_.empty(); ++step)
+  {
+    const double offset = ((step + 1) / 2) * redundancy_step_ * (step % 2 ? 1.0 : -1.0);
+
+    std::size_t num_pending = 0;
+    for (std::size_t i = 0; i < pending_.size(); ++i)
+    {
+      const std::size_t pose_id = pending_[i];
+      const double* seed = &ik_seeds[pose_id][0];
+      const double q7 = std::min(std::max(seed[NUM_JOINTS - 1], lower_[NUM_JOINTS - 1]), upper_[NUM_JOINTS - 1]) +
+                        offset;
+      std::size_t num_solutions = 0;
+      if (q7 >= lower_[NUM_JOINTS - 1] && q7 <= upper_[NUM_JOINTS - 1])
+        num_solutions = solveFixedRedundancy(flange_poses_[pose_id], q7, seed, &solutions_[0]);
+
+      // Try the solutions closest to the seed first
+      for (std::size_t j = 0; j < num_solutions; ++j)
+      {
+        solution_order_[j] = j;
+        solution_distances_[j] = 0.0;
+        for (std::size_t k = 0; k < NUM_JOINTS; ++k)
+        {
+          const double diff = solutions_[j * NUM_JOINTS + k] - seed[k];
+          solution_distances_[j] += diff * diff;
+        }
+      }
+      for (std::size_t j = 1; j < num_solutions; ++j)
+        for (std::size_t k = j; k > 0 && solution_distances_[solution_order_[k]] <
+                                             solution_distances_[solution_order_[k - 1]];
+             --k)
+          std::swap(solution_order_[k], solution_order_[k - 1]);
+
+      bool solved = false;
+      for (std::size_t j = 0; j < num_solutions && !solved; ++j)
+      {
+        const double* solution = &solutions_[solution_order_[j] * NUM_JOINTS];
+        solution_.assign(solution, solution + NUM_JOINTS);
+        solved = !solution_callback || solution_callback(pose_id, solution_);
+      }
+
+      if (solved)
+      {
+        ik_solutions[pose_id] = solution_;
+        error_codes[pose_id].val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+        num_solved++;
+      }
+      else
+        pending_[num_pending++] = pose_id;
+    }
+    pending_.resize(num_pending);
+
+    if (!pending_.empty() && (ros::WallTime::now() - start_time).toSec() > batch_timeout)
+    {
+      for (std::size_t i = 0; i < pending_.size(); ++i)
+        error_codes[pending_[i]].val = moveit_msgs::MoveItErrorCodes::TIMED_OUT;
+      break;
+    }
+  }
+  return num_solved;
+}
+
+std::string PandaBatchIKSolver::getName() const
+{
+  return "panda_analytic";
+}
+
+Eigen::Affine3d PandaBatchIKSolver::computeFlangePose(const double* joints)
+{
+  Eigen::Affine3d pose = Eigen::Affine3d::Identity();
+  for (std::size_t i = 0; i < NUM_JOINTS; ++i)
+  {
+    pose = pose * Eigen::AngleAxisd(DH_ALPHA[i], Eigen::Vector3d::UnitX()) * Eigen::Translation3d(DH_A[i], 0, 0) *
+           Eigen::AngleAxisd(joints[i], Eigen::Vector3d::UnitZ()) * Eigen::Translation3d(0, 0, DH_D[i]);
+  }
+  return pose * Eigen::Translation3d(0, 0, D_FLANGE);
+}
+
+std::size_t PandaBatchIKSolver::solveFixedRedundancy(const Eigen::Affine3d& flange_pose, double q7, const double* seed,
+                                                     double* solutions) const
+{
+  // Frame 6 from the flange and the last joint
+  const Eigen::Matrix3d r07 = flange_pose.rotation();
+  const Eigen::Vector3d o7 = flange_pose.translation() - D_FLANGE * r07.col(2);
+  const double c7 = std::cos(q7);
+  const double s7 = std::sin(q7);
+  const Eigen::Matrix3d r06 = r07 * (Eigen::AngleAxisd(-q7, Eigen::Vector3d::UnitZ()) *
+                                     Eigen::AngleAxisd(-M_PI_2, Eigen::Vector3d::UnitX())).toRotationMatrix();
+  const Eigen::Vector3d z6 = r06.col(2);
+
+  // The wrist center is the origin of frames 5 and 6, its distance from the shoulder only depends on the elbow
+  const Eigen::Vector3d wrist = o7 - A7 * (c7 * r07.col(0) - s7 * r07.col(1)) - Eigen::Vector3d(0, 0, D1);
+  const double wrist_squared = wrist.squaredNorm();
+  if (wrist_squared < SINGULAR_EPSILON)
+    return 0;
+  const Eigen::Vector3d wrist_dir = wrist / std::sqrt(wrist_squared);
+
+  // wrist_squared = K + P cos(q4) - Q sin(q4)
+  const double k = 2.0 * A4 * A4 + D5 * D5 + D3 * D3;
+  const double p = 2.0 * (D3 * D5 - A4 * A4);
+  const double q = 2.0 * A4 * (D5 + D3);
+  const double elbow_ratio = (wrist_squared - k) / std::sqrt(p * p + q * q);
+  if (std::abs(elbow_ratio) > 1.0)
+    return 0;
+  const double elbow_phase = std::atan2(q, p);
+  const double elbow_offset = std::acos(elbow_ratio);
+
+  std::size_t num_solutions = 0;
+  double joints[NUM_JOINTS];
+  joints[6] = q7;
+  for (int elbow_sign = -1; elbow_sign <= 1; elbow_sign += 2)
+  {
+    double q4 = elbow_sign * elbow_offset - elbow_phase;
+    q4 = std::atan2(std::sin(q4), std::cos(q4));
+    if (q4 < lower_[3] || q4 > upper_[3])
+      continue;
+    const double c4 = std::cos(q4);
+    const double s4 = std::sin(q4);
+
+    // Wrist center and axis of joint 5 in frame 3
+    const Eigen::Vector3d wrist_3(A4 * (1.0 - c4) - D5 * s4, 0.0, D3 - A4 * s4 + D5 * c4);
+    const Eigen::Vector3d z5_3(-s4, 0.0, c4);
+
+    // Any rotation of frame 3 that reaches the wrist center is this one turned about the wrist direction. The turn
+    // angle psi has to make the axis of joint 5 perpendicular to the axis of joint 6:
+    // a cos(psi) + b sin(psi) + c = 0
+    const Eigen::Matrix3d r_align = Eigen::Quaterniond::FromTwoVectors(wrist_3, wrist).toRotationMatrix();
+    const Eigen::Vector3d z5 = r_align * z5_3;
+    const double z5_along = z5.dot(wrist_dir);
+    const Eigen::Vector3d z5_perp = z5 - z5_along * wrist_dir;
+    const double a = z5_perp.dot(z6);
+    const double b = wrist_dir.cross(z5_perp).dot(z6);
+    const double c = z5_along * wrist_dir.dot(z6);
+    const double swivel_norm = std::sqrt(a * a + b * b);
+    if (swivel_norm < SINGULAR_EPSILON)
+      continue;
+    const double swivel_ratio = -c / swivel_norm;
+    if (std::abs(swivel_ratio) > 1.0 + SINGULAR_EPSILON)
+      continue;
+    const double swivel_phase = std::atan2(b, a);
+    const double swivel_offset = std::acos(std::min(1.0, std::max(-1.0, swivel_ratio)));
+
+    const Eigen::Matrix3d r34 = (Eigen::AngleAxisd(M_PI_2, Eigen::Vector3d::UnitX()) *
+                                 Eigen::AngleAxisd(q4, Eigen::Vector3d::UnitZ())).toRotationMatrix();
+    for (int swivel_sign = -1; swivel_sign <= 1; swivel_sign += 2)
+    {
+      const double psi = swivel_phase + swivel_sign * swivel_offset;
+      const Eigen::Matrix3d r03 = Eigen::AngleAxisd(psi, wrist_dir).toRotationMatrix() * r_align;
+
+      // Wrist: R_46 = Ry(q5) Rz(q6)
+      const Eigen::Matrix3d r46 = (r03 * r34).transpose() * r06;
+      joints[3] = q4;
+      joints[4] = std::atan2(r46(0, 2), r46(2, 2));
+      joints[5] = std::atan2(r46(1, 0), r46(1, 1));
+
+      // Shoulder: R_03 = Rz(q1) Ry(q2) Rz(q3), with two branches unless q2 is zero
+      const double s2 = std::sqrt(r03(0, 2) * r03(0, 2) + r03(1, 2) * r03(1, 2));
+      if (s2 < SINGULAR_EPSILON)
+      {
+        joints[0] = std::min(std::max(seed[0], lower_[0]), upper_[0]);
+        joints[1] = 0.0;
+        joints[2] = std::atan2(r03(1, 0), r03(0, 0)) - joints[0];
+        num_solutions = addSolution(joints, solutions, num_solutions);
+        continue;
+      }
+      const double q1 = std::atan2(r03(1, 2), r03(0, 2));
+      const double q2 = std::atan2(s2, r03(2, 2));
+      const double q3 = std::atan2(r03(2, 1), -r03(2, 0));
+
+      joints[0] = q1;
+      joints[1] = q2;
+      joints[2] = q3;
+      num_solutions = addSolution(joints, solutions, num_solutions);
+
+      joints[0] = q1 + M_PI;
+      joints[1] = -q2;
+      joints[2] = q3 + M_PI;
+      num_solutions = addSolution(joints, solutions, num_solutions);
+    }
+  }
+  return num_solutions;
+}
+
+std::size_t PandaBatchIKSolver::addSolution(double* joints, double* solutions, std::size_t num_solutions) const
+{
+  // Angles are only known up to full turns, the first turn within the limits is used
+  for (std::size_t i = 0; i < NUM_JOINTS; ++i)
+  {
+    double value = std::atan2(std::sin(joints[i]), std::cos(joints[i]));
+    if (value < lower_[i])
+      value += 2.0 * M_PI;
+    else if (value > upper_[i])
+      value -= 2.0 * M_PI;
+    if (value < lower_[i] || value > upper_[i])
+      return num_solutions;
+    joints[i] = value;
+  }
+  std::copy(joints, joints + NUM_JOINTS, solutions + num_solutions * NUM_JOINTS);
+  return num_solutions + 1;
+}
+
+}  // end namespace
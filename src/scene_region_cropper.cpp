@@ -0,0 +1,176 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Crop a planning scene to the region an arm can sweep through while reaching its grasps
+*/
+
+// moveit_grasps
+#include <moveit_grasps/scene_region_cropper.h>
+
+// geometric_shapes
+#include <geometric_shapes/shape_operations.h>
+
+// octomap
+#include <octomap/octomap.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+
+namespace moveit_grasps
+{
+SceneRegionCropper::SceneRegionCropper(double margin) : margin_(margin)
+{
+}
+
+Eigen::AlignedBox3d SceneRegionCropper::computeReachRegion(const robot_state::RobotState& robot_state,
+                                                           const robot_model::JointModelGroup* arm_jmg,
+                                                           const EigenSTL::vector_Vector3d& targets) const
+{
+  Eigen::AlignedBox3d region;
+
+  const robot_model::LinkModel* base_link = arm_jmg->getJointModels().front()->getParentLinkModel();
+  if (base_link)
+    region.extend(robot_state.getGlobalLinkTransform(base_link).translation());
+  for (std::size_t i = 0; i < targets.size(); ++i)
+    region.extend(targets[i]);
+
+  if (region.isEmpty())
+    return region;
+  region.min() -= Eigen::Vector3d::Constant(margin_);
+  region.max() += Eigen::Vector3d::Constant(margin_);
+  return region;
+}
+
+planning_scene::PlanningScenePtr
+SceneRegionCropper::cropScene(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                              const Eigen::AlignedBox3d& region) const
+{
+  planning_scene::PlanningScenePtr cropped_scene = planning_scene->diff();
+  const collision_detection::WorldPtr& world = cropped_scene->getWorldNonConst();
+
+  std::size_t removed_objects = 0;
+  const std::vector<std::string> object_ids = world->getObjectIds();
+  for (std::size_t i = 0; i < object_ids.size(); ++i)
+  {
+    const std::string& object_id = object_ids[i];
+
+    // Copy the shapes since the object is modified while they are removed
+    collision_detection::World::ObjectConstPtr object = world->getObject(object_id);
+    const std::vector<shapes::ShapeConstPtr> object_shapes = object->shapes_;
+    const EigenSTL::vector_Affine3d shape_poses = object->shape_poses_;
+
+    for (std::size_t j = 0; j < object_shapes.size(); ++j)
+    {
+      const shapes::ShapeType type = object_shapes[j]->type;
+      if (type == shapes::PLANE)
+        continue;
+
+      if (type == shapes::OCTREE)
+      {
+        // Add the cropped octomap first, otherwise removing the last shape would remove the object
+        shapes::ShapeConstPtr cropped_octree =
+            cropOcTree(static_cast<const shapes::OcTree&>(*object_shapes[j]), shape_poses[j], region);
+        if (cropped_octree)
+          world->addToObject(object_id, cropped_octree, shape_poses[j]);
+        world->removeShapeFromObject(object_id, object_shapes[j]);
+        continue;
+      }
+
+      Eigen::Vector3d center;
+      double radius;
+      shapes::computeShapeBoundingSphere(object_shapes[j].get(), center, radius);
+      if (region.exteriorDistance(shape_poses[j] * center) > radius)
+        world->removeShapeFromObject(object_id, object_shapes[j]);
+    }
+
+    if (!world->hasObject(object_id))
+      removed_objects++;
+  }
+
+  ROS_DEBUG_STREAM_NAMED("scene_region_cropper", "Removed " << removed_objects << " of " << object_ids.size()
+                                                            << " collision objects outside of the region");
+  return cropped_scene;
+}
+
+shapes::ShapeConstPtr SceneRegionCropper::cropOcTree(const shapes::OcTree& octree_shape, const Eigen::Affine3d& pose,
+                                                     const Eigen::AlignedBox3d& region)
+{
+  const octomap::OcTree& octree = *octree_shape.octree;
+  const double resolution = octree.getResolution();
+
+  // Bound the region in the frame of the octomap
+  const Eigen::Affine3d pose_inverse = pose.inverse();
+  Eigen::AlignedBox3d octree_region;
+  for (int i = 0; i < 8; ++i)
+    octree_region.extend(pose_inverse * region.corner(static_cast<Eigen::AlignedBox3d::CornerType>(i)));
+
+  boost::shared_ptr<octomap::OcTree> cropped_octree(new octomap::OcTree(resolution));
+  cropped_octree->setOccupancyThres(octree.getOccupancyThres());
+  cropped_octree->setClampingThresMin(octree.getClampingThresMin());
+  cropped_octree->setClampingThresMax(octree.getClampingThresMax());
+
+  std::size_t num_leafs = 0;
+  const octomap::point3d min(octree_region.min().x(), octree_region.min().y(), octree_region.min().z());
+  const octomap::point3d max(octree_region.max().x(), octree_region.max().y(), octree_region.max().z());
+  for (octomap::OcTree::leaf_bbx_iterator it = octree.begin_leafs_bbx(min, max), end = octree.end_leafs_bbx();
+       it != end; ++it)
+  {
+    if (!octree.isNodeOccupied(*it))
+      continue;
+    num_leafs++;
+
+    // Pruned leafs cover several voxels
+    const double size = it.getSize();
+    const int num_voxels = std::max(1, static_cast<int>(std::floor(size / resolution + 0.5)));
+    const double offset = (size - resolution) / 2.0;
+    const octomap::point3d center = it.getCoordinate();
+    for (int x = 0; x < num_voxels; ++x)
+      for (int y = 0; y < num_voxels; ++y)
+        for (int z = 0; z < num_voxels; ++z)
+          cropped_octree->setNodeValue(octomap::point3d(center.x() - offset + x * resolution,
+                                                        center.y() - offset + y * resolution,
+                                                        center.z() - offset + z * resolution),
+                                       it->getLogOdds(), true);
+  }
+
+  if (!num_leafs)
+    return shapes::ShapeConstPtr();
+
+  cropped_octree->updateInnerOccupancy();
+  return shapes::ShapeConstPtr(new shapes::OcTree(cropped_octree));
+}
+
+}  // namespace
@@ -0,0 +1,672 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Queue of grasps in shared memory, for filtering grasps in worker processes
+*/
+
+#include <moveit_grasps/shared_grasp_queue.h>
+#include <moveit_grasps/grasp_generator.h>
+
+// Boost
+#include <boost/interprocess/shared_memory_object.hpp>
+
+// C++
+#include <algorithm>
+#include <cerrno>
+#include <new>
+#include <pthread.h>
+#include <time.h>
+
+namespace moveit_grasps
+{
+namespace bip = boost::interprocess;
+
+namespace
+{
+// Task slots start at a cache line boundary
+const std::size_t TASKS_ALIGNMENT = 64;
+
+// Leases are renewed several times per timeout, so a busy process is not dropped
+const uint64_t LEASE_RENEWALS_PER_TIMEOUT = 4;
+
+// The monotonic clock is shared by all processes of the machine
+uint64_t getMonotonicTime()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+timespec toTimespec(uint64_t time)
+{
+  timespec result;
+  result.tv_sec = time / 1000000000;
+  result.tv_nsec = time % 1000000000;
+  return result;
+}
+
+timespec getDeadline(double timeout)
+{
+  return toTimespec(getMonotonicTime() + static_cast<uint64_t>(std::max(timeout, 0.0) * 1e9));
+}
+
+// A process that dies while holding the mutex leaves it to the next one, the counters it protects are only
+// incremented and reset, so the queue stays usable
+void recoverMutex(pthread_mutex_t& mutex, int result)
+{
+  if (result != EOWNERDEAD)
+    return;
+  ROS_WARN_STREAM_NAMED("shared_grasp_queue", "A process died while holding the grasp queue lock");
+  pthread_mutex_consistent(&mutex);
+}
+
+/**
+ * \brief Scoped lock of a robust, process shared mutex
+ */
+class SharedLock
+{
+public:
+  explicit SharedLock(pthread_mutex_t& mutex) : mutex_(mutex)
+  {
+    recoverMutex(mutex_, pthread_mutex_lock(&mutex_));
+  }
+
+  ~SharedLock()
+  {
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  /**
+   * \brief Wait for a condition, with the lock held again afterwards
+   * \param deadline - on the monotonic clock
+   * \return false on timeout
+   */
+  bool timedWait(pthread_cond_t& condition, const timespec& deadline)
+  {
+    const int result = pthread_cond_timedwait(&condition, &mutex_, &deadline);
+    recoverMutex(mutex_, result);
+    return result != ETIMEDOUT;
+  }
+
+private:
+  pthread_mutex_t& mutex_;
+};
+}
+
+bool writeGraspTask(const GraspCandidatePtr& grasp_candidate, SharedGraspTask& task)
+{
+  const moveit_msgs::Grasp& grasp = grasp_candidate->grasp_;
+  const geometry_msgs::Pose& pose = grasp.grasp_pose.pose;
+  task.grasp_pose_[0] = pose.position.x;
+  task.grasp_pose_[1] = pose.position.y;
+  task.grasp_pose_[2] = pose.position.z;
+  task.grasp_pose_[3] = pose.orientation.x;
+  task.grasp_pose_[4] = pose.orientation.y;
+  task.grasp_pose_[5] = pose.orientation.z;
+  task.grasp_pose_[6] = pose.orientation.w;
+
+  // The worker can not tell the frame of the approach direction, send it in the frame of the grasp pose
+  Eigen::Vector3d approach_direction =
+      GraspGenerator::getPreGraspDirection(grasp, grasp_candidate->grasp_data_->parent_link_->getName());
+  for (std::size_t i = 0; i < 3; ++i)
+    task.approach_direction_[i] = approach_direction[i];
+  task.approach_distance_ = grasp.pre_grasp_approach.desired_distance;
+
+  task.num_posture_joints_ = 0;
+  if (grasp.pre_grasp_posture.points.empty() || grasp.grasp_posture.points.empty())
+    return true;
+  const std::vector<double>& open_positions = grasp.pre_grasp_posture.points.front().positions;
+  const std::vector<double>& closed_positions = grasp.grasp_posture.points.front().positions;
+  if (open_positions.size() != closed_positions.size() || open_positions.size() > SHARED_MAX_JOINTS)
+    return false;
+  std::copy(open_positions.begin(), open_positions.end(), task.pre_grasp_posture_);
+  std::copy(closed_positions.begin(), closed_positions.end(), task.grasp_posture_);
+  task.num_posture_joints_ = open_positions.size();
+  return true;
+}
+
+GraspCandidatePtr readGraspTask(const SharedGraspTask& task, const GraspDataPtr& grasp_data)
+{
+  moveit_msgs::Grasp grasp;
+  grasp.grasp_pose.header.frame_id = grasp_data->base_link_;
+  geometry_msgs::Pose& pose = grasp.grasp_pose.pose;
+  pose.position.x = task.grasp_pose_[0];
+  pose.position.y = task.grasp_pose_[1];
+  pose.position.z = task.grasp_pose_[2];
+  pose.orientation.x = task.grasp_pose_[3];
+  pose.orientation.y = task.grasp_pose_[4];
+  pose.orientation.z = task.grasp_pose_[5];
+  pose.orientation.w = task.grasp_pose_[6];
+
+  grasp.pre_grasp_approach.direction.header.frame_id = grasp_data->base_link_;
+  grasp.pre_grasp_approach.direction.vector.x = task.approach_direction_[0];
+  grasp.pre_grasp_approach.direction.vector.y = task.approach_direction_[1];
+  grasp.pre_grasp_approach.direction.vector.z = task.approach_direction_[2];
+  grasp.pre_grasp_approach.desired_distance = task.approach_distance_;
+
+  grasp.pre_grasp_posture = grasp_data->pre_grasp_posture_;
+  grasp.grasp_posture = grasp_data->grasp_posture_;
+  if (task.num_posture_joints_ > 0 && !grasp.pre_grasp_posture.points.empty() && !grasp.grasp_posture.points.empty())
+  {
+    grasp.pre_grasp_posture.points.resize(1);
+    grasp.pre_grasp_posture.points.front().positions.assign(task.pre_grasp_posture_,
+                                                            task.pre_grasp_posture_ + task.num_posture_joints_);
+    grasp.grasp_posture.points.resize(1);
+    grasp.grasp_posture.points.front().positions.assign(task.grasp_posture_,
+                                                        task.grasp_posture_ + task.num_posture_joints_);
+  }
+
+  return GraspCandidatePtr(new GraspCandidate(grasp, grasp_data, Eigen::Affine3d::Identity()));
+}
+
+void writeGraspTaskResult(const GraspCandidatePtr& grasp_candidate, SharedGraspTask& task)
+{
+  task.grasp_filtered_by_ik_ = grasp_candidate->grasp_filtered_by_ik_;
+  task.grasp_filtered_by_ik_closed_ = grasp_candidate->grasp_filtered_by_ik_closed_;
+  task.pregrasp_filtered_by_ik_ = grasp_candidate->pregrasp_filtered_by_ik_;
+  task.grasp_skipped_by_predictor_ = grasp_candidate->grasp_skipped_by_predictor_;
+  task.ik_timed_out_ = grasp_candidate->ik_timed_out_;
+
+  const std::vector<double>& grasp_ik_solution = grasp_candidate->grasp_ik_solution_;
+  task.num_grasp_ik_joints_ = std::min(grasp_ik_solution.size(), SHARED_MAX_JOINTS);
+  std::copy(grasp_ik_solution.begin(), grasp_ik_solution.begin() + task.num_grasp_ik_joints_,
+            task.grasp_ik_solution_);
+  const std::vector<double>& pregrasp_ik_solution = grasp_candidate->pregrasp_ik_solution_;
+  task.num_pregrasp_ik_joints_ = std::min(pregrasp_ik_solution.size(), SHARED_MAX_JOINTS);
+  std::copy(pregrasp_ik_solution.begin(), pregrasp_ik_solution.begin() + task.num_pregrasp_ik_joints_,
+            task.pregrasp_ik_solution_);
+}
+
+void readGraspTaskResult(const SharedGraspTask& task, GraspCandidatePtr& grasp_candidate)
+{
+  grasp_candidate->grasp_filtered_by_ik_ = task.grasp_filtered_by_ik_;
+  grasp_candidate->grasp_filtered_by_ik_closed_ = task.grasp_filtered_by_ik_closed_;
+  grasp_candidate->pregrasp_filtered_by_ik_ = task.pregrasp_filtered_by_ik_;
+  grasp_candidate->grasp_skipped_by_predictor_ = task.grasp_skipped_by_predictor_;
+  grasp_candidate->ik_timed_out_ = task.ik_timed_out_;
+  grasp_candidate->grasp_ik_solution_.assign(task.grasp_ik_solution_,
+                                             task.grasp_ik_solution_ + task.num_grasp_ik_joints_);
+  grasp_candidate->pregrasp_ik_solution_.assign(task.pregrasp_ik_solution_,
+                                                task.pregrasp_ik_solution_ + task.num_pregrasp_ik_joints_);
+}
+
+struct SharedGraspQueue::Header
+{
+  // Identifies the shared memory object, a coordinator that restarts replaces it by one of another generation. Set
+  // last, zero while the coordinator initializes the queue
+  volatile uint64_t generation_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t tasks_available_;
+  pthread_cond_t tasks_done_;
+  SharedGraspBatch batch_;
+  uint32_t capacity_;
+  uint32_t next_task_;
+  uint32_t num_done_;
+  uint8_t batch_open_;
+  uint8_t scene_requested_;
+
+  // Tasks below next_task_ that were handed back by expired workers
+  uint32_t num_reclaimed_;
+
+  // Leases of the workers, a worker id of 0 marks a free slot. Times are on the monotonic clock in nanoseconds
+  struct WorkerSlot
+  {
+    uint64_t worker_id_;
+    uint64_t renewed_;
+  };
+  WorkerSlot workers_[SHARED_MAX_WORKERS];
+  uint32_t num_workers_;
+  uint64_t next_worker_id_;
+  uint64_t lease_timeout_;
+};
+
+std::size_t SharedGraspQueue::getTasksOffset()
+{
+  return (sizeof(Header) + TASKS_ALIGNMENT - 1) / TASKS_ALIGNMENT * TASKS_ALIGNMENT;
+}
+
+SharedGraspQueue::SharedGraspQueue()
+  : header_(NULL), tasks_(NULL), generation_(0), slot_(0), worker_id_(0), owner_(false)
+{
+}
+
+SharedGraspQueue::~SharedGraspQueue()
+{
+  close();
+}
+
+void SharedGraspQueue::close()
+{
+  if (!header_)
+    return;
+
+  if (owner_)
+  {
+    region_.reset();
+    bip::shared_memory_object::remove(name_.c_str());
+  }
+  else
+  {
+    if (lease_thread_)
+    {
+      lease_thread_->interrupt();
+      lease_thread_->join();
+      lease_thread_.reset();
+    }
+    {
+      SharedLock lock(header_->mutex_);
+      if (header_->workers_[slot_].worker_id_ == worker_id_)
+        releaseWorker(slot_);
+    }
+    region_.reset();
+  }
+  header_ = NULL;
+  tasks_ = NULL;
+  generation_ = 0;
+  worker_id_ = 0;
+}
+
+bool SharedGraspQueue::create(const std::string& name, std::size_t capacity, double lease_timeout)
+{
+  if (header_)
+  {
+    ROS_ERROR_STREAM_NAMED("shared_grasp_queue", "Queue is already open");
+    return false;
+  }
+
+  try
+  {
+    bip::shared_memory_object::remove(name.c_str());
+    bip::shared_memory_object shm(bip::create_only, name.c_str(), bip::read_write);
+    shm.truncate(getTasksOffset() + capacity * sizeof(SharedGraspTask));
+    region_.reset(new bip::mapped_region(shm, bip::read_write));
+  }
+  catch (const bip::interprocess_exception& e)
+  {
+    ROS_ERROR_STREAM_NAMED("shared_grasp_queue", "Unable to create shared memory '" << name << "': " << e.what());
+    region_.reset();
+    return false;
+  }
+
+  name_ = name;
+  owner_ = true;
+  header_ = new (region_->get_address()) Header();
+  header_->generation_ = 0;
+
+  // Workers that crash while holding the mutex must not block the coordinator
+  pthread_mutexattr_t mutex_attr;
+  pthread_mutexattr_init(&mutex_attr);
+  pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&mutex_attr, PTHREAD_MUTEX_ROBUST);
+  pthread_mutex_init(&header_->mutex_, &mutex_attr);
+  pthread_mutexattr_destroy(&mutex_attr);
+
+  pthread_condattr_t condition_attr;
+  pthread_condattr_init(&condition_attr);
+  pthread_condattr_setpshared(&condition_attr, PTHREAD_PROCESS_SHARED);
+  pthread_condattr_setclock(&condition_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&header_->tasks_available_, &condition_attr);
+  pthread_cond_init(&header_->tasks_done_, &condition_attr);
+  pthread_condattr_destroy(&condition_attr);
+
+  header_->batch_ = SharedGraspBatch();
+  header_->capacity_ = capacity;
+  header_->next_task_ = 0;
+  header_->num_done_ = 0;
+  header_->batch_open_ = false;
+  header_->scene_requested_ = false;
+  header_->num_reclaimed_ = 0;
+  for (std::size_t i = 0; i < SHARED_MAX_WORKERS; ++i)
+    header_->workers_[i].worker_id_ = 0;
+  header_->num_workers_ = 0;
+  header_->next_worker_id_ = 1;
+  header_->lease_timeout_ = static_cast<uint64_t>(std::max(lease_timeout, 0.01) * 1e9);
+  tasks_ = reinterpret_cast<SharedGraspTask*>(static_cast<char*>(region_->get_address()) + getTasksOffset());
+
+  // The creation time tells this queue apart from the one of a previous coordinator
+  timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  generation_ = static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+  __sync_synchronize();
+  header_->generation_ = generation_;
+  return true;
+}
+
+bool SharedGraspQueue::open(const std::string& name)
+{
+  if (header_)
+  {
+    ROS_ERROR_STREAM_NAMED("shared_grasp_queue", "Queue is already open");
+    return false;
+  }
+
+  try
+  {
+    bip::shared_memory_object shm(bip::open_only, name.c_str(), bip::read_write);
+    region_.reset(new bip::mapped_region(shm, bip::read_write));
+  }
+  catch (const bip::interprocess_exception& e)
+  {
+    if (e.get_error_code() == bip::not_found_error)
+      ROS_DEBUG_STREAM_NAMED("shared_grasp_queue", "Shared memory '" << name << "' does not exist yet");
+    else
+      ROS_ERROR_STREAM_NAMED("shared_grasp_queue", "Unable to open shared memory '" << name << "': " << e.what());
+    region_.reset();
+    return false;
+  }
+
+  if (region_->get_size() < getTasksOffset())
+  {
+    ROS_ERROR_STREAM_NAMED("shared_grasp_queue", "Shared memory '" << name << "' is not a grasp queue");
+    region_.reset();
+    return false;
+  }
+
+  Header* header = static_cast<Header*>(region_->get_address());
+  if (header->generation_ == 0)
+  {
+    ROS_DEBUG_STREAM_NAMED("shared_grasp_queue", "Shared memory '" << name << "' is not initialized yet");
+    region_.reset();
+    return false;
+  }
+  __sync_synchronize();
+
+  header_ = header;
+  tasks_ = reinterpret_cast<SharedGraspTask*>(static_cast<char*>(region_->get_address()) + getTasksOffset());
+  {
+    SharedLock lock(header_->mutex_);
+    expireWorkers();
+    slot_ = 0;
+    while (slot_ < SHARED_MAX_WORKERS && header_->workers_[slot_].worker_id_ != 0)
+      slot_++;
+    if (slot_ < SHARED_MAX_WORKERS)
+    {
+      worker_id_ = header_->next_worker_id_++;
+      header_->workers_[slot_].worker_id_ = worker_id_;
+      header_->workers_[slot_].renewed_ = getMonotonicTime();
+      header_->num_workers_++;
+    }
+  }
+  if (slot_ == SHARED_MAX_WORKERS)
+  {
+    ROS_ERROR_STREAM_NAMED("shared_grasp_queue", "Queue '" << name << "' has no slot for another worker");
+    header_ = NULL;
+    tasks_ = NULL;
+    region_.reset();
+    return false;
+  }
+
+  name_ = name;
+  owner_ = false;
+  generation_ = header_->generation_;
+  lease_thread_.reset(new boost::thread(boost::bind(&SharedGraspQueue::renewLease, this)));
+  return true;
+}
+
+void SharedGraspQueue::renewLease()
+{
+  const boost::posix_time::microseconds period(header_->lease_timeout_ / LEASE_RENEWALS_PER_TIMEOUT / 1000);
+  try
+  {
+    while (true)
+    {
+      boost::this_thread::sleep(period);
+      SharedLock lock(header_->mutex_);
+      // An expired lease is not renewed, the worker reconnects when isCurrent() fails
+      if (header_->workers_[slot_].worker_id_ != worker_id_)
+        return;
+      header_->workers_[slot_].renewed_ = getMonotonicTime();
+    }
+  }
+  catch (const boost::thread_interrupted&)
+  {
+  }
+}
+
+void SharedGraspQueue::expireWorkers()
+{
+  const uint64_t now = getMonotonicTime();
+  for (std::size_t i = 0; i < SHARED_MAX_WORKERS; ++i)
+  {
+    const Header::WorkerSlot& worker = header_->workers_[i];
+    if (worker.worker_id_ == 0 || now < worker.renewed_ + header_->lease_timeout_)
+      continue;
+    ROS_WARN_STREAM_NAMED("shared_grasp_queue", "Lease of worker " << worker.worker_id_
+                                                                   << " expired, it probably crashed");
+    releaseWorker(i);
+  }
+}
+
+void SharedGraspQueue::releaseWorker(std::size_t slot)
+{
+  const uint64_t worker_id = header_->workers_[slot].worker_id_;
+  std::size_t num_reclaimed = 0;
+  if (header_->batch_open_)
+  {
+    for (std::size_t i = 0; i < header_->next_task_; ++i)
+    {
+      if (!tasks_[i].done_ && tasks_[i].claim_worker_ == worker_id)
+      {
+        tasks_[i].claim_worker_ = 0;
+        num_reclaimed++;
+      }
+    }
+  }
+  header_->workers_[slot].worker_id_ = 0;
+  if (header_->num_workers_ > 0)
+    header_->num_workers_--;
+
+  if (num_reclaimed > 0)
+  {
+    header_->num_reclaimed_ += num_reclaimed;
+    pthread_cond_broadcast(&header_->tasks_available_);
+  }
+}
+
+bool SharedGraspQueue::isCurrent() const
+{
+  if (!header_)
+    return false;
+  if (owner_)
+    return true;
+
+  {
+    SharedLock lock(header_->mutex_);
+    if (header_->workers_[slot_].worker_id_ != worker_id_)
+      return false;
+  }
+
+  // The name refers to the queue of the current coordinator, the mapping of a replaced queue remains valid
+  try
+  {
+    bip::shared_memory_object shm(bip::open_only, name_.c_str(), bip::read_only);
+    bip::offset_t size;
+    if (!shm.get_size(size) || static_cast<std::size_t>(size) < sizeof(Header))
+      return false;
+    bip::mapped_region region(shm, bip::read_only, 0, sizeof(Header));
+    return static_cast<const Header*>(region.get_address())->generation_ == generation_;
+  }
+  catch (const bip::interprocess_exception&)
+  {
+    return false;
+  }
+}
+
+std::size_t SharedGraspQueue::getCapacity() const
+{
+  return header_ ? header_->capacity_ : 0;
+}
+
+std::size_t SharedGraspQueue::getNumWorkers()
+{
+  if (!header_)
+    return 0;
+  SharedLock lock(header_->mutex_);
+  expireWorkers();
+  return header_->num_workers_;
+}
+
+void SharedGraspQueue::submitBatch(SharedGraspBatch& batch)
+{
+  SharedLock lock(header_->mutex_);
+  batch.batch_id_ = header_->batch_.batch_id_ + 1;
+  batch.num_tasks_ = std::min<uint32_t>(batch.num_tasks_, header_->capacity_);
+  for (std::size_t i = 0; i < batch.num_tasks_; ++i)
+  {
+    tasks_[i].done_ = false;
+    tasks_[i].claim_worker_ = 0;
+  }
+
+  header_->batch_ = batch;
+  header_->next_task_ = 0;
+  header_->num_done_ = 0;
+  header_->num_reclaimed_ = 0;
+  header_->batch_open_ = true;
+  pthread_cond_broadcast(&header_->tasks_available_);
+}
+
+bool SharedGraspQueue::waitForBatch(double timeout)
+{
+  const uint64_t deadline = getMonotonicTime() + static_cast<uint64_t>(std::max(timeout, 0.0) * 1e9);
+  SharedLock lock(header_->mutex_);
+  while (true)
+  {
+    expireWorkers();
+    if (header_->num_done_ >= header_->batch_.num_tasks_)
+      return true;
+
+    // Wake up in time to notice expired leases
+    const uint64_t now = getMonotonicTime();
+    if (now >= deadline)
+      return false;
+    lock.timedWait(header_->tasks_done_, toTimespec(std::min(deadline, now + header_->lease_timeout_ / 2)));
+  }
+}
+
+void SharedGraspQueue::closeBatch()
+{
+  SharedLock lock(header_->mutex_);
+  header_->next_task_ = header_->batch_.num_tasks_;
+  header_->num_reclaimed_ = 0;
+  header_->batch_open_ = false;
+}
+
+bool SharedGraspQueue::takeSceneRequest()
+{
+  SharedLock lock(header_->mutex_);
+  bool requested = header_->scene_requested_;
+  header_->scene_requested_ = false;
+  return requested;
+}
+
+bool SharedGraspQueue::waitForTasks(SharedGraspBatch& batch, double timeout)
+{
+  const timespec deadline = getDeadline(timeout);
+  SharedLock lock(header_->mutex_);
+  while (!header_->batch_open_ ||
+         (header_->next_task_ >= header_->batch_.num_tasks_ && header_->num_reclaimed_ == 0))
+  {
+    if (!lock.timedWait(header_->tasks_available_, deadline))
+      return false;
+  }
+  batch = header_->batch_;
+  return true;
+}
+
+bool SharedGraspQueue::claimTasks(uint64_t batch_id, std::size_t max_tasks, std::size_t& begin,
+                                  std::vector<SharedGraspTask>& tasks)
+{
+  SharedLock lock(header_->mutex_);
+  if (!header_->batch_open_ || header_->batch_.batch_id_ != batch_id ||
+      header_->workers_[slot_].worker_id_ != worker_id_)
+    return false;
+
+  std::size_t end;
+  if (header_->next_task_ < header_->batch_.num_tasks_)
+  {
+    begin = header_->next_task_;
+    end = std::min<std::size_t>(begin + max_tasks, header_->batch_.num_tasks_);
+    header_->next_task_ = end;
+  }
+  else if (header_->num_reclaimed_ > 0)
+  {
+    // The first run of tasks handed back by expired workers
+    begin = 0;
+    while (begin < header_->next_task_ && (tasks_[begin].done_ || tasks_[begin].claim_worker_ != 0))
+      begin++;
+    end = begin;
+    while (end < header_->next_task_ && end - begin < max_tasks && !tasks_[end].done_ &&
+           tasks_[end].claim_worker_ == 0)
+      end++;
+    header_->num_reclaimed_ = end > begin ? header_->num_reclaimed_ - (end - begin) : 0;
+  }
+  else
+    return false;
+
+  for (std::size_t i = begin; i < end; ++i)
+    tasks_[i].claim_worker_ = worker_id_;
+  tasks.assign(tasks_ + begin, tasks_ + end);
+  return end > begin;
+}
+
+void SharedGraspQueue::finishTasks(uint64_t batch_id, std::size_t begin, const std::vector<SharedGraspTask>& tasks)
+{
+  SharedLock lock(header_->mutex_);
+  // The coordinator reads the slots of a closed batch, or already reuses them
+  if (!header_->batch_open_ || header_->batch_.batch_id_ != batch_id)
+    return;
+
+  for (std::size_t i = 0; i < tasks.size(); ++i)
+  {
+    // Tasks of an expired lease may have been handed to another worker
+    SharedGraspTask& task = tasks_[begin + i];
+    if (task.done_ || task.claim_worker_ != worker_id_)
+      continue;
+    task = tasks[i];
+    task.claim_worker_ = worker_id_;
+    task.done_ = true;
+    header_->num_done_++;
+  }
+  if (header_->num_done_ >= header_->batch_.num_tasks_)
+    pthread_cond_broadcast(&header_->tasks_done_);
+}
+
+void SharedGraspQueue::requestScene()
+{
+  SharedLock lock(header_->mutex_);
+  header_->scene_requested_ = true;
+}
+
+}  // namespace
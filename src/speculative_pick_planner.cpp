@@ -0,0 +1,305 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Plan the free space motion to several of the best grasps at once and keep the first or best pick plan
+*/
+
+// moveit_grasps
+#include <moveit_grasps/speculative_pick_planner.h>
+
+// MoveIt
+#include <moveit/kinematic_constraints/utils.h>
+#include <moveit/robot_state/conversions.h>
+
+// C++
+#include <algorithm>
+
+namespace moveit_grasps
+{
+namespace
+{
+// Longest wait for a speculation before checking the deadline and ros::ok() again
+const double MAX_WAIT_SECONDS = 0.1;
+}
+
+SpeculativePickPlanner::SpeculativePickPlanner(const GraspPlannerPtr& grasp_planner,
+                                               const planning_pipeline::PlanningPipelinePtr& planning_pipeline)
+  : nh_("~/moveit_grasps/pick_planner"), grasp_planner_(grasp_planner), planning_pipeline_(planning_pipeline)
+{
+  nh_.param("max_speculative_plans", max_speculative_plans_, 4);
+  nh_.param("wait_for_better_ranked", wait_for_better_ranked_, true);
+  nh_.param("deadline", deadline_, 5.0);
+  nh_.param("planning_time", planning_time_, 1.5);
+  nh_.param("planning_attempts", planning_attempts_, 1);
+  nh_.param("planner_id", planner_id_, std::string(""));
+  nh_.param("goal_tolerance", goal_tolerance_, 0.01);
+  if (!worker_thread_config_.load(nh_))
+    ROS_WARN_STREAM_NAMED("speculative_pick_planner", "Invalid thread settings, the planner threads keep the CPU "
+                                                      "affinity and scheduling of the process");
+
+  // Load the same request adapters as the pipeline
+  if (!planning_pipeline_ || planning_pipeline_->getAdapterPluginNames().empty())
+    return;
+  try
+  {
+    adapter_plugin_loader_.reset(new pluginlib::ClassLoader<planning_request_adapter::PlanningRequestAdapter>(
+        "moveit_core", "planning_request_adapter::PlanningRequestAdapter"));
+  }
+  catch (pluginlib::PluginlibException& ex)
+  {
+    ROS_ERROR_STREAM_NAMED("speculative_pick_planner", "Exception while creating the planning request adapter "
+                                                       "plugin loader: "
+                                                           << ex.what());
+    return;
+  }
+  const std::vector<std::string>& adapter_names = planning_pipeline_->getAdapterPluginNames();
+  for (std::size_t i = 0; i < adapter_names.size(); ++i)
+  {
+    planning_request_adapter::PlanningRequestAdapterConstPtr adapter;
+    try
+    {
+      adapter.reset(adapter_plugin_loader_->createUnmanagedInstance(adapter_names[i]));
+    }
+    catch (pluginlib::PluginlibException& ex)
+    {
+      ROS_ERROR_STREAM_NAMED("speculative_pick_planner", "Exception while loading planning request adapter "
+                                                             << adapter_names[i] << ": " << ex.what());
+    }
+    if (adapter)
+      planning_adapters_.push_back(adapter);
+  }
+}
+
+bool SpeculativePickPlanner::planPick(const std::vector<GraspCandidatePtr>& grasp_candidates,
+                                      const moveit::core::RobotState& start_state,
+                                      const planning_scene::PlanningSceneConstPtr& planning_scene, PickPlan& pick_plan)
+{
+  const ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(deadline_);
+  const std::size_t max_speculative_plans =
+      worker_thread_config_.limitNumWorkers(std::max(max_speculative_plans_, 1));
+
+  std::vector<SpeculationPtr> speculations;
+  SpeculationPtr chosen;
+  std::size_t next_rank = 0;
+  {
+    boost::unique_lock<boost::mutex> lock(speculation_mutex_);
+    while (ros::ok())
+    {
+      const bool deadline_passed = ros::WallTime::now() > deadline;
+      chosen = chooseSpeculation(speculations, deadline_passed);
+      if (chosen || deadline_passed)
+        break;
+
+      // Running planners keep their worker, so pinned planners never share a CPU
+      std::size_t num_running = 0;
+      std::vector<bool> busy_workers(max_speculative_plans, false);
+      for (std::size_t i = 0; i < speculations.size(); ++i)
+      {
+        if (!speculations[i]->done_)
+        {
+          num_running++;
+          busy_workers[speculations[i]->worker_id_] = true;
+        }
+      }
+
+      // Plan the cartesian path of the next grasp while the free space planners of the others run
+      if (num_running < max_speculative_plans && next_rank < grasp_candidates.size())
+      {
+        lock.unlock();
+        SpeculationPtr speculation =
+            createSpeculation(grasp_candidates[next_rank], next_rank, start_state, planning_scene);
+        lock.lock();
+        next_rank++;
+        if (speculation)
+        {
+          speculation->worker_id_ = std::find(busy_workers.begin(), busy_workers.end(), false) - busy_workers.begin();
+          speculation->thread_.reset(
+              new boost::thread(boost::bind(&SpeculativePickPlanner::solveSpeculation, this, speculation)));
+          speculations.push_back(speculation);
+        }
+        continue;
+      }
+
+      // Every grasp was tried
+      if (num_running == 0)
+        break;
+
+      const double wait_time = std::min(MAX_WAIT_SECONDS, (deadline - ros::WallTime::now()).toSec());
+      const long wait_microseconds = static_cast<long>(std::max(wait_time, 0.0) * 1e6);
+      speculation_done_.timed_wait(lock, boost::posix_time::microseconds(wait_microseconds));
+    }
+  }
+
+  // Stop the planners that are no longer needed, the threads that have no context yet do not create one
+  std::vector<planning_interface::PlanningContextPtr> planning_contexts;
+  {
+    boost::lock_guard<boost::mutex> lock(speculation_mutex_);
+    for (std::size_t i = 0; i < speculations.size(); ++i)
+    {
+      speculations[i]->terminated_ = true;
+      if (speculations[i]->planning_context_)
+        planning_contexts.push_back(speculations[i]->planning_context_);
+    }
+  }
+  for (std::size_t i = 0; i < planning_contexts.size(); ++i)
+    planning_contexts[i]->terminate();
+  for (std::size_t i = 0; i < speculations.size(); ++i)
+    speculations[i]->thread_->join();
+
+  ROS_INFO_STREAM_NAMED("pick_planner", "Started free space plans for " << speculations.size() << " of "
+                                                                          << next_rank << " tried grasps");
+  if (!chosen)
+  {
+    ROS_WARN_STREAM_NAMED("pick_planner", "No pick plan found for " << grasp_candidates.size() << " grasps");
+    return false;
+  }
+
+  pick_plan.grasp_candidate_ = chosen->grasp_candidate_;
+  pick_plan.pre_approach_plan_ = chosen->response_;
+  pick_plan.rank_ = chosen->rank_;
+  ROS_INFO_STREAM_NAMED("pick_planner", "Chose the pick plan of grasp " << chosen->rank_);
+  return true;
+}
+
+SpeculativePickPlanner::SpeculationPtr
+SpeculativePickPlanner::createSpeculation(const GraspCandidatePtr& grasp_candidate, std::size_t rank,
+                                          const moveit::core::RobotState& start_state,
+                                          const planning_scene::PlanningSceneConstPtr& planning_scene)
+{
+  SpeculationPtr speculation(new Speculation());
+  speculation->grasp_candidate_ = grasp_candidate;
+  speculation->rank_ = rank;
+  speculation->worker_id_ = 0;
+  speculation->done_ = false;
+  speculation->success_ = false;
+  speculation->terminated_ = false;
+
+  // Cartesian approach, lift and retreat
+  moveit::core::RobotStatePtr robot_state(new moveit::core::RobotState(start_state));
+  speculation->grasp_candidate_->getPreGraspState(robot_state);
+  if (!grasp_planner_->planApproachLiftRetreat(speculation->grasp_candidate_, robot_state, planning_scene, false))
+  {
+    ROS_DEBUG_STREAM_NAMED("pick_planner", "No approach lift retreat path for grasp " << rank);
+    return SpeculationPtr();
+  }
+
+  // Free space motion to the start of the approach
+  const robot_model::JointModelGroup* arm_jmg = grasp_candidate->grasp_data_->arm_jmg_;
+  const moveit::core::RobotStatePtr& pre_grasp_state = grasp_candidate->segmented_cartesian_traj_[APPROACH].front();
+  planning_interface::MotionPlanRequest& req = speculation->request_;
+  req.group_name = arm_jmg->getName();
+  req.planner_id = planner_id_;
+  req.num_planning_attempts = planning_attempts_;
+  req.allowed_planning_time = planning_time_;
+  req.goal_constraints.push_back(
+      kinematic_constraints::constructGoalConstraints(*pre_grasp_state, arm_jmg, goal_tolerance_, goal_tolerance_));
+  moveit::core::robotStateToRobotStateMsg(start_state, req.start_state);
+  speculation->planning_scene_ = planning_scene;
+  return speculation;
+}
+
+void SpeculativePickPlanner::solveSpeculation(const SpeculationPtr& speculation)
+{
+  if (worker_thread_config_.isEnabled())
+    worker_thread_config_.applyToCurrentThread(speculation->worker_id_);
+
+  planning_interface::MotionPlanResponse response;
+  const bool success = adaptAndSolve(speculation, 0, speculation->planning_scene_, speculation->request_, response) &&
+                       response.error_code_.val == moveit_msgs::MoveItErrorCodes::SUCCESS;
+
+  boost::lock_guard<boost::mutex> lock(speculation_mutex_);
+  speculation->response_ = response;
+  speculation->success_ = success && response.trajectory_;
+  speculation->done_ = true;
+  speculation_done_.notify_all();
+}
+
+bool SpeculativePickPlanner::adaptAndSolve(const SpeculationPtr& speculation, std::size_t adapter_id,
+                                           const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                           const planning_interface::MotionPlanRequest& req,
+                                           planning_interface::MotionPlanResponse& res)
+{
+  // Each adapter calls the next one with its adapted request, like the adapter chain of the pipeline
+  if (adapter_id < planning_adapters_.size())
+    return planning_adapters_[adapter_id]->adaptAndPlan(
+        boost::bind(&SpeculativePickPlanner::adaptAndSolve, this, speculation, adapter_id + 1, _1, _2, _3),
+        planning_scene, req, res);
+
+  planning_interface::PlanningContextPtr planning_context;
+  {
+    boost::lock_guard<boost::mutex> lock(speculation_mutex_);
+    planning_context = speculation->planning_context_;
+  }
+  if (!planning_context)
+  {
+    moveit_msgs::MoveItErrorCodes error_code;
+    planning_context = planning_pipeline_->getPlannerManager()->getPlanningContext(planning_scene, req, error_code);
+    if (!planning_context)
+    {
+      ROS_WARN_STREAM_NAMED("pick_planner", "Unable to create a planning context for grasp "
+                                                << speculation->rank_ << ", error " << error_code.val);
+      res.error_code_ = error_code;
+      return false;
+    }
+
+    // Do not start planning once the pick plan was chosen
+    boost::lock_guard<boost::mutex> lock(speculation_mutex_);
+    if (speculation->terminated_)
+    {
+      res.error_code_.val = moveit_msgs::MoveItErrorCodes::PREEMPTED;
+      return false;
+    }
+    speculation->planning_context_ = planning_context;
+  }
+  return planning_context->solve(res);
+}
+
+SpeculativePickPlanner::SpeculationPtr
+SpeculativePickPlanner::chooseSpeculation(const std::vector<SpeculationPtr>& speculations, bool deadline_passed) const
+{
+  // Speculations are started in rank order
+  for (std::size_t i = 0; i < speculations.size(); ++i)
+  {
+    if (speculations[i]->done_ && speculations[i]->success_)
+      return speculations[i];
+
+    // A better ranked plan may still succeed
+    if (!speculations[i]->done_ && wait_for_better_ranked_ && !deadline_passed)
+      return SpeculationPtr();
+  }
+  return SpeculationPtr();
+}
+
+}  // end namespace
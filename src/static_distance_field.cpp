@@ -0,0 +1,260 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Precomputed distance field of static collision objects, checked against sphere sets of the arm links
+*/
+
+// moveit_grasps
+#include <moveit_grasps/static_distance_field.h>
+
+// geometric_shapes
+#include <geometric_shapes/shapes.h>
+#include <geometric_shapes/shape_operations.h>
+
+// Conversions
+#include <eigen_conversions/eigen_msg.h>
+
+// octomap
+#include <octomap/octomap.h>
+
+// C++
+#include <algorithm>
+#include <cmath>
+
+namespace moveit_grasps
+{
+StaticDistanceField::StaticDistanceField(const robot_model::RobotModelConstPtr& robot_model,
+                                         const std::vector<std::string>& static_object_ids, double resolution,
+                                         double padding)
+  : max_sphere_radius_(0), static_object_ids_(static_object_ids), resolution_(resolution), padding_(padding)
+{
+  computeLinkSpheres(robot_model);
+}
+
+bool StaticDistanceField::update(const planning_scene::PlanningScene& planning_scene)
+{
+  const collision_detection::World& world = *planning_scene.getWorld();
+  const collision_detection::AllowedCollisionMatrix& acm = planning_scene.getAllowedCollisionMatrix();
+  const std::vector<std::string>& link_names =
+      planning_scene.getRobotModel()->getLinkModelNamesWithCollisionGeometry();
+
+  // Choose the static objects the field can represent
+  std::map<std::string, collision_detection::World::ObjectConstPtr> field_objects;
+  for (std::size_t i = 0; i < static_object_ids_.size(); ++i)
+  {
+    const std::string& object_id = static_object_ids_[i];
+    collision_detection::World::ObjectConstPtr object = world.getObject(object_id);
+    if (!object)
+      continue;
+
+    // Objects the robot is allowed to touch need the exact checks
+    bool allowed = false;
+    for (std::size_t j = 0; j < link_names.size() && !allowed; ++j)
+    {
+      collision_detection::AllowedCollision::Type type;
+      allowed = acm.getAllowedCollision(link_names[j], object_id, type) &&
+                type != collision_detection::AllowedCollision::NEVER;
+    }
+
+    // Octomaps are added in their own frame
+    bool supported = true;
+    for (std::size_t j = 0; j < object->shapes_.size(); ++j)
+    {
+      const shapes::ShapeType type = object->shapes_[j]->type;
+      if (type == shapes::PLANE ||
+          (type == shapes::OCTREE && !object->shape_poses_[j].isApprox(Eigen::Affine3d::Identity())))
+        supported = false;
+    }
+    if (!supported)
+      ROS_WARN_STREAM_NAMED("static_distance_field", "Unable to add object " << object_id << " to the distance field");
+
+    if (!allowed && supported)
+      field_objects[object_id] = object;
+  }
+
+  // World objects are copied on write, so an unchanged pointer means an unchanged object
+  if (distance_field_ && field_objects == field_objects_)
+    return false;
+
+  field_objects_ = field_objects;
+  field_object_ids_.clear();
+  distance_field_.reset();
+  static_scene_.reset(new planning_scene::PlanningScene(planning_scene.getRobotModel()));
+
+  // Bound the static objects
+  Eigen::AlignedBox3d bounds;
+  for (std::map<std::string, collision_detection::World::ObjectConstPtr>::const_iterator it = field_objects_.begin();
+       it != field_objects_.end(); ++it)
+  {
+    field_object_ids_.push_back(it->first);
+    const collision_detection::World::Object& object = *it->second;
+    static_scene_->getWorldNonConst()->addToObject(it->first, object.shapes_, object.shape_poses_);
+    for (std::size_t i = 0; i < object.shapes_.size(); ++i)
+    {
+      if (object.shapes_[i]->type == shapes::OCTREE)
+      {
+        const shapes::OcTree* octree_shape = static_cast<const shapes::OcTree*>(object.shapes_[i].get());
+        Eigen::Vector3d min, max;
+        octree_shape->octree->getMetricMin(min.x(), min.y(), min.z());
+        octree_shape->octree->getMetricMax(max.x(), max.y(), max.z());
+        bounds.extend(min);
+        bounds.extend(max);
+        continue;
+      }
+      Eigen::Vector3d center;
+      double radius;
+      shapes::computeShapeBoundingSphere(object.shapes_[i].get(), center, radius);
+      center = object.shape_poses_[i] * center;
+      bounds.extend(center - Eigen::Vector3d::Constant(radius));
+      bounds.extend(center + Eigen::Vector3d::Constant(radius));
+    }
+  }
+  if (bounds.isEmpty())
+    return true;
+
+  // Distances are only needed up to the largest sphere
+  const double max_distance = max_sphere_radius_ + padding_ + 2 * resolution_;
+  bounds.min() -= Eigen::Vector3d::Constant(max_distance);
+  bounds.max() += Eigen::Vector3d::Constant(max_distance);
+  const Eigen::Vector3d size = bounds.sizes();
+
+  ros::Time start_time = ros::Time::now();
+  distance_field_.reset(new distance_field::PropagationDistanceField(size.x(), size.y(), size.z(), resolution_,
+                                                                     bounds.min().x(), bounds.min().y(),
+                                                                     bounds.min().z(), max_distance));
+  for (std::map<std::string, collision_detection::World::ObjectConstPtr>::const_iterator it = field_objects_.begin();
+       it != field_objects_.end(); ++it)
+  {
+    const collision_detection::World::Object& object = *it->second;
+    for (std::size_t i = 0; i < object.shapes_.size(); ++i)
+    {
+      if (object.shapes_[i]->type == shapes::OCTREE)
+      {
+        distance_field_->addOcTreeToField(static_cast<const shapes::OcTree*>(object.shapes_[i].get())->octree.get());
+        continue;
+      }
+      geometry_msgs::Pose pose;
+      tf::poseEigenToMsg(object.shape_poses_[i], pose);
+      distance_field_->addShapeToField(object.shapes_[i].get(), pose);
+    }
+  }
+
+  ROS_INFO_STREAM_NAMED("static_distance_field", "Built distance field of " << field_object_ids_.size()
+                                                                            << " static objects in "
+                                                                            << (ros::Time::now() - start_time).toSec()
+                                                                            << " seconds");
+  return true;
+}
+
+planning_scene::PlanningScenePtr
+StaticDistanceField::getDynamicScene(const planning_scene::PlanningSceneConstPtr& planning_scene) const
+{
+  planning_scene::PlanningScenePtr dynamic_scene = planning_scene->diff();
+  for (std::size_t i = 0; i < field_object_ids_.size(); ++i)
+    dynamic_scene->getWorldNonConst()->removeObject(field_object_ids_[i]);
+  return dynamic_scene;
+}
+
+bool StaticDistanceField::isStateColliding(const robot_state::RobotState& robot_state,
+                                           const robot_model::JointModelGroup* group) const
+{
+  if (!distance_field_)
+    return false;
+
+  // Distances are measured to voxel centers
+  const double margin = padding_ + resolution_;
+
+  const std::vector<const robot_model::LinkModel*>& links = group->getUpdatedLinkModelsWithGeometry();
+  for (std::size_t i = 0; i < links.size(); ++i)
+  {
+    const LinkSpheres& spheres = link_spheres_[links[i]->getLinkIndex()];
+    if (spheres.centers_.empty())
+      continue;
+
+    const Eigen::Affine3d& link_pose = robot_state.getGlobalLinkTransform(links[i]);
+    for (std::size_t j = 0; j < spheres.centers_.size(); ++j)
+    {
+      const Eigen::Vector3d center = link_pose * spheres.centers_[j];
+      if (distance_field_->getDistance(center.x(), center.y(), center.z()) < spheres.radii_[j] + margin)
+        return isStateCollidingExact(robot_state, group);
+    }
+  }
+  return false;
+}
+
+bool StaticDistanceField::isStateCollidingExact(const robot_state::RobotState& robot_state,
+                                                const robot_model::JointModelGroup* group) const
+{
+  // The spheres over-approximate the links, only the meshes tell whether the state really collides
+  collision_detection::CollisionRequest request;
+  collision_detection::CollisionResult result;
+  request.group_name = group->getName();
+  static_scene_->getCollisionWorld()->checkRobotCollision(request, result, *static_scene_->getCollisionRobot(),
+                                                          robot_state, static_scene_->getAllowedCollisionMatrix());
+  return result.collision;
+}
+
+void StaticDistanceField::computeLinkSpheres(const robot_model::RobotModelConstPtr& robot_model)
+{
+  const std::vector<const robot_model::LinkModel*>& links = robot_model->getLinkModels();
+  link_spheres_.resize(links.size());
+  for (std::size_t i = 0; i < links.size(); ++i)
+  {
+    if (links[i]->getShapes().empty())
+      continue;
+
+    // Cover the link's bounding box with spheres along its longest axis
+    const Eigen::Vector3d& extents = links[i]->getShapeExtentsAtOrigin();
+    std::size_t long_axis;
+    const double length = extents.maxCoeff(&long_axis);
+    const double cross_section_radius = std::sqrt(extents.squaredNorm() - length * length) / 2.0;
+    const std::size_t num_spheres =
+        std::max<std::size_t>(1, std::ceil(length / std::max(2.0 * cross_section_radius, resolution_)));
+    const double spacing = length / num_spheres;
+    const double radius = std::sqrt(cross_section_radius * cross_section_radius + spacing * spacing / 4.0);
+
+    LinkSpheres& spheres = link_spheres_[links[i]->getLinkIndex()];
+    for (std::size_t j = 0; j < num_spheres; ++j)
+    {
+      Eigen::Vector3d center = links[i]->getCenteredBoundingBoxOffset();
+      center[long_axis] += -length / 2.0 + spacing * (j + 0.5);
+      spheres.centers_.push_back(center);
+      spheres.radii_.push_back(radius);
+    }
+    max_sphere_radius_ = std::max(max_sphere_radius_, radius);
+  }
+}
+
+}  // namespace
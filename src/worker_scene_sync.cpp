@@ -0,0 +1,247 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   Keep copies of a planning scene in worker processes in sync through versioned scene diffs
+*/
+
+#include <moveit_grasps/worker_scene_sync.h>
+
+// MoveIt
+#include <moveit/robot_state/conversions.h>
+
+// C++
+#include <cstdlib>
+#include <sstream>
+
+namespace moveit_grasps
+{
+namespace
+{
+std::string getVersionName(uint64_t version)
+{
+  std::ostringstream name;
+  name << version;
+  return name.str();
+}
+
+bool getVersion(const moveit_msgs::PlanningScene& msg, uint64_t& version)
+{
+  char* end;
+  version = std::strtoull(msg.name.c_str(), &end, 10);
+  return !msg.name.empty() && *end == '\0';
+}
+}
+
+WorkerScenePublisher::WorkerScenePublisher(ros::NodeHandle& nh, const std::string& queue_name) : version_(0)
+{
+  diff_pub_ = nh.advertise<moveit_msgs::PlanningScene>(queue_name + "/scene_diff", 10);
+  // Latched, so that workers started later get a scene to apply the diffs to
+  full_pub_ = nh.advertise<moveit_msgs::PlanningScene>(queue_name + "/scene", 1, true);
+}
+
+uint64_t WorkerScenePublisher::publishScene(const planning_scene::PlanningSceneConstPtr& planning_scene)
+{
+  if (version_ == 0)
+  {
+    version_++;
+    publishFullScene(planning_scene);
+    return version_;
+  }
+
+  moveit_msgs::PlanningScene msg;
+  msg.is_diff = true;
+  bool world_changed = false;
+
+  const collision_detection::World& world = *planning_scene->getWorld();
+  for (collision_detection::World::const_iterator it = world.begin(); it != world.end(); ++it)
+  {
+    std::map<std::string, collision_detection::World::ObjectConstPtr>::const_iterator sent_it =
+        objects_.find(it->first);
+    if (sent_it != objects_.end() && sent_it->second == it->second)
+      continue;
+
+    world_changed = true;
+    if (it->first == planning_scene::PlanningScene::OCTOMAP_NS)
+    {
+      planning_scene->getOctomapMsg(msg.world.octomap);
+      continue;
+    }
+
+    moveit_msgs::CollisionObject collision_object;
+    if (planning_scene->getCollisionObjectMsg(collision_object, it->first))
+    {
+      // Adding an existing object replaces it
+      collision_object.operation = moveit_msgs::CollisionObject::ADD;
+      msg.world.collision_objects.push_back(collision_object);
+    }
+  }
+
+  for (std::map<std::string, collision_detection::World::ObjectConstPtr>::const_iterator it = objects_.begin();
+       it != objects_.end(); ++it)
+  {
+    if (world.hasObject(it->first))
+      continue;
+
+    // A removed octomap can not be expressed as a diff
+    if (it->first == planning_scene::PlanningScene::OCTOMAP_NS)
+    {
+      version_++;
+      publishFullScene(planning_scene);
+      return version_;
+    }
+
+    world_changed = true;
+    moveit_msgs::CollisionObject collision_object;
+    collision_object.id = it->first;
+    collision_object.operation = moveit_msgs::CollisionObject::REMOVE;
+    msg.world.collision_objects.push_back(collision_object);
+  }
+
+  // The robot state and allowed collisions are small, they are always sent
+  moveit::core::robotStateToRobotStateMsg(planning_scene->getCurrentState(), msg.robot_state);
+  planning_scene->getAllowedCollisionMatrix().getMessage(msg.allowed_collision_matrix);
+
+  version_++;
+  msg.name = getVersionName(version_);
+  diff_pub_.publish(msg);
+
+  if (world_changed)
+  {
+    objects_.clear();
+    for (collision_detection::World::const_iterator it = world.begin(); it != world.end(); ++it)
+      objects_[it->first] = it->second;
+  }
+
+  return version_;
+}
+
+void WorkerScenePublisher::publishFullScene(const planning_scene::PlanningSceneConstPtr& planning_scene)
+{
+  moveit_msgs::PlanningScene msg;
+  planning_scene->getPlanningSceneMsg(msg);
+  msg.is_diff = false;
+  msg.name = getVersionName(version_);
+  full_pub_.publish(msg);
+
+  objects_.clear();
+  const collision_detection::World& world = *planning_scene->getWorld();
+  for (collision_detection::World::const_iterator it = world.begin(); it != world.end(); ++it)
+    objects_[it->first] = it->second;
+}
+
+WorkerSceneSubscriber::WorkerSceneSubscriber(ros::NodeHandle& nh, const std::string& queue_name,
+                                             const planning_scene::PlanningScenePtr& planning_scene)
+  : planning_scene_(planning_scene), version_(0), out_of_sync_(false)
+{
+  diff_sub_ = nh.subscribe(queue_name + "/scene_diff", 10, &WorkerSceneSubscriber::sceneDiffCallback, this);
+  full_sub_ = nh.subscribe(queue_name + "/scene", 1, &WorkerSceneSubscriber::sceneCallback, this);
+}
+
+bool WorkerSceneSubscriber::getScene(uint64_t version, double timeout,
+                                     planning_scene::PlanningScenePtr& planning_scene)
+{
+  boost::system_time deadline =
+      boost::get_system_time() + boost::posix_time::microseconds(static_cast<int64_t>(timeout * 1e6));
+  boost::mutex::scoped_lock lock(mutex_);
+  while (version_ < version)
+  {
+    if (out_of_sync_ || !scene_updated_.timed_wait(lock, deadline))
+      return false;
+  }
+
+  // The coordinator moved on to a newer scene
+  if (version_ > version)
+    return false;
+
+  planning_scene = planning_scene::PlanningScene::clone(planning_scene_);
+  return true;
+}
+
+void WorkerSceneSubscriber::sceneDiffCallback(const moveit_msgs::PlanningScene::ConstPtr& msg)
+{
+  uint64_t version;
+  if (!getVersion(*msg, version))
+  {
+    ROS_ERROR_STREAM_NAMED("worker_scene_sync", "Scene diff without a version");
+    return;
+  }
+
+  boost::mutex::scoped_lock lock(mutex_);
+  if (version <= version_)
+    return;
+  if (version != version_ + 1 || version_ == 0)
+  {
+    ROS_DEBUG_STREAM_NAMED("worker_scene_sync", "Missed scene diffs, have version " << version_ << " but got "
+                                                                                    << version);
+    out_of_sync_ = true;
+    scene_updated_.notify_all();
+    return;
+  }
+
+  if (!planning_scene_->setPlanningSceneDiffMsg(*msg))
+  {
+    ROS_ERROR_STREAM_NAMED("worker_scene_sync", "Unable to apply scene diff of version " << version);
+    out_of_sync_ = true;
+  }
+  else
+    version_ = version;
+  scene_updated_.notify_all();
+}
+
+void WorkerSceneSubscriber::sceneCallback(const moveit_msgs::PlanningScene::ConstPtr& msg)
+{
+  uint64_t version;
+  if (!getVersion(*msg, version))
+  {
+    ROS_ERROR_STREAM_NAMED("worker_scene_sync", "Scene without a version");
+    return;
+  }
+
+  // Always applied, since versions restart with the coordinator
+  boost::mutex::scoped_lock lock(mutex_);
+  if (!planning_scene_->setPlanningSceneMsg(*msg))
+  {
+    ROS_ERROR_STREAM_NAMED("worker_scene_sync", "Unable to apply scene of version " << version);
+    out_of_sync_ = true;
+  }
+  else
+  {
+    version_ = version;
+    out_of_sync_ = false;
+  }
+  scene_updated_.notify_all();
+}
+
+}  // namespace
@@ -0,0 +1,168 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2015, University of Colorado, Boulder
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Univ of CO, Boulder nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Desc:   CPU affinity and scheduling of the filter and planner worker threads
+*/
+
+#include <moveit_grasps/worker_thread_config.h>
+
+// C++
+#include <algorithm>
+#include <cstring>
+
+namespace moveit_grasps
+{
+WorkerThreadConfig::WorkerThreadConfig() : pin_workers_(false), scheduler_policy_(NO_POLICY), priority_(0)
+{
+}
+
+bool WorkerThreadConfig::load(const ros::NodeHandle& nh)
+{
+  std::vector<int> allowed_cpus;
+  bool pin_workers;
+  std::string scheduler;
+  int priority;
+  nh.param("thread_cpus", allowed_cpus, std::vector<int>());
+  nh.param("pin_threads", pin_workers, false);
+  nh.param("thread_scheduler", scheduler, std::string(""));
+  nh.param("thread_priority", priority, 0);
+
+  int scheduler_policy = NO_POLICY;
+  if (scheduler == "fifo")
+    scheduler_policy = SCHED_FIFO;
+  else if (scheduler == "other")
+    scheduler_policy = SCHED_OTHER;
+  else if (!scheduler.empty())
+  {
+    ROS_ERROR_STREAM_NAMED("worker_thread_config", "Unknown thread_scheduler '" << scheduler
+                                                                                << "', expected 'fifo' or 'other'");
+    return false;
+  }
+
+  // SCHED_OTHER only takes priority 0, its niceness is not a priority
+  if (scheduler_policy != NO_POLICY && (priority < sched_get_priority_min(scheduler_policy) ||
+                                        priority > sched_get_priority_max(scheduler_policy)))
+  {
+    ROS_ERROR_STREAM_NAMED("worker_thread_config",
+                           "thread_priority " << priority << " is out of the range "
+                                              << sched_get_priority_min(scheduler_policy) << " to "
+                                              << sched_get_priority_max(scheduler_policy) << " of thread_scheduler '"
+                                              << scheduler << "'");
+    return false;
+  }
+
+  for (std::size_t i = 0; i < allowed_cpus.size(); ++i)
+  {
+    if (allowed_cpus[i] < 0 || allowed_cpus[i] >= CPU_SETSIZE)
+    {
+      ROS_ERROR_STREAM_NAMED("worker_thread_config", "Invalid CPU " << allowed_cpus[i] << " in thread_cpus");
+      return false;
+    }
+  }
+  if (pin_workers && allowed_cpus.empty())
+    ROS_WARN_STREAM_NAMED("worker_thread_config", "pin_threads needs thread_cpus, the threads are not pinned");
+
+  allowed_cpus_ = allowed_cpus;
+  pin_workers_ = pin_workers && !allowed_cpus.empty();
+  scheduler_policy_ = scheduler_policy;
+  priority_ = priority;
+  return true;
+}
+
+std::size_t WorkerThreadConfig::limitNumWorkers(std::size_t num_threads) const
+{
+  // More threads than CPUs would only take turns on them
+  if (!allowed_cpus_.empty())
+    return std::min(num_threads, allowed_cpus_.size());
+  return num_threads;
+}
+
+bool WorkerThreadConfig::applyToCurrentThread(std::size_t worker_id) const
+{
+  bool success = true;
+  const pthread_t thread = pthread_self();
+
+  if (!allowed_cpus_.empty())
+  {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (pin_workers_)
+      CPU_SET(allowed_cpus_[worker_id % allowed_cpus_.size()], &cpu_set);
+    else
+      for (std::size_t i = 0; i < allowed_cpus_.size(); ++i)
+        CPU_SET(allowed_cpus_[i], &cpu_set);
+
+    const int error = pthread_setaffinity_np(thread, sizeof(cpu_set), &cpu_set);
+    if (error)
+    {
+      ROS_WARN_STREAM_NAMED("worker_thread_config", "Unable to set the CPU affinity of worker "
+                                                        << worker_id << ": " << std::strerror(error));
+      success = false;
+    }
+  }
+
+  if (scheduler_policy_ != NO_POLICY)
+  {
+    sched_param param;
+    param.sched_priority = priority_;
+    const int error = pthread_setschedparam(thread, scheduler_policy_, &param);
+    if (error)
+    {
+      ROS_WARN_STREAM_NAMED("worker_thread_config", "Unable to set the scheduling of worker "
+                                                        << worker_id << ": " << std::strerror(error));
+      success = false;
+    }
+  }
+
+  return success;
+}
+
+ScopedThreadSettings::ScopedThreadSettings() : thread_(pthread_self()), policy_(SCHED_OTHER), saved_(false)
+{
+  CPU_ZERO(&cpu_set_);
+  std::memset(&param_, 0, sizeof(param_));
+  saved_ = !pthread_getaffinity_np(thread_, sizeof(cpu_set_), &cpu_set_) &&
+           !pthread_getschedparam(thread_, &policy_, &param_);
+}
+
+ScopedThreadSettings::~ScopedThreadSettings()
+{
+  if (!saved_)
+    return;
+  pthread_setschedparam(thread_, policy_, &param_);
+  pthread_setaffinity_np(thread_, sizeof(cpu_set_), &cpu_set_);
+}
+
+}  // namespace
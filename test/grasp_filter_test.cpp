@@ -37,7 +37,11 @@
  */
 
 // C++
+#include <cmath>
 #include <string>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 // ROS
 #include <ros/ros.h>
@@ -48,6 +52,13 @@
 // Grasp
 #include <moveit_grasps/grasp_generator.h>
 #include <moveit_grasps/grasp_filter.h>
+#include <moveit_grasps/continuous_collision_checker.h>
+#include <moveit_grasps/cartesian_interpolator.h>
+#include <moveit_grasps/shared_grasp_queue.h>
+#include <moveit_grasps/panda_batch_ik_solver.h>
+#include <moveit_grasps/ik_seed_index.h>
+#include <moveit_grasps/worker_thread_config.h>
+#include <moveit_grasps/speculative_pick_planner.h>
 #include <moveit_visual_tools/moveit_visual_tools.h>
 #include <moveit_grasps/grasp_data.h>
 
@@ -75,6 +86,18 @@ public:
   }
 
 protected:
+  // Generate the face grasps along the z axis of a cube
+  void generateTestGrasps(const Eigen::Affine3d& cuboid_pose, double size,
+                          std::vector<moveit_grasps::GraspCandidatePtr>& grasp_candidates)
+  {
+    moveit_grasps::GraspCandidateConfig grasp_generator_config = moveit_grasps::GraspCandidateConfig();
+    grasp_generator_config.disableAll();
+    grasp_generator_config.enable_face_grasps_ = true;
+    grasp_generator_config.generate_z_axis_grasps_ = true;
+    grasp_generator_->generateGrasps(cuboid_pose, size, size, size, grasp_data_, grasp_candidates,
+                                     grasp_generator_config);
+  }
+
   ros::NodeHandle nh_;
   bool verbose_;
   std::string ee_group_name_;
@@ -134,6 +157,1217 @@ TEST_F(GraspFilterTest, TestGraspFilter)
     EXPECT_FALSE(valid_grasps == 0) << "No valid grasps found after IK filtering";
   }
 }
+
+TEST_F(GraspFilterTest, TestMultiArmGraspFilter)
+{
+  // Generate grasps for a cuboid in front of the robot
+  std::vector<moveit_grasps::GraspCandidatePtr> grasp_candidates;
+  generateTestGrasps(Eigen::Affine3d(Eigen::Translation3d(0.6, 0.0, 0.4)), 0.01, grasp_candidates);
+  ASSERT_FALSE(grasp_candidates.empty());
+
+  // The panda only has one arm, so every tag must point at it and match the per arm results
+  moveit_grasps::GraspDatas grasp_datas;
+  grasp_datas[arm_jmg_] = grasp_data_;
+  moveit_grasps::ArmGraspCandidates arm_grasp_candidates;
+  bool filter_pregrasps = true;
+  grasp_filter_->filterGrasps(grasp_candidates, planning_scene_monitor_, grasp_datas,
+                              visual_tools_->getSharedRobotState(), arm_grasp_candidates, filter_pregrasps);
+
+  ASSERT_EQ(arm_grasp_candidates[arm_jmg_].size(), grasp_candidates.size());
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+  {
+    const bool valid = arm_grasp_candidates[arm_jmg_][i]->isValid() &&
+                       !arm_grasp_candidates[arm_jmg_][i]->grasp_filtered_by_ik_closed_;
+    EXPECT_EQ(grasp_candidates[i]->reachable_arms_.size(), valid ? 1u : 0u);
+    if (valid)
+    {
+      EXPECT_EQ(grasp_candidates[i]->reachable_arms_.front(), arm_jmg_);
+    }
+  }
+}
+
+TEST_F(GraspFilterTest, TestFilterGraspsForObjects)
+{
+  // The same cuboid seen twice and a second one next to it
+  const Eigen::Vector3d positions[3] = { Eigen::Vector3d(0.6, 0.0, 0.4), Eigen::Vector3d(0.6, 0.0, 0.4),
+                                         Eigen::Vector3d(0.6, 0.1, 0.4) };
+  std::vector<std::vector<GraspCandidatePtr> > object_grasp_candidates(3);
+  for (std::size_t object_id = 0; object_id < 3; ++object_id)
+  {
+    Eigen::Affine3d object_pose = Eigen::Affine3d::Identity();
+    object_pose.translation() = positions[object_id];
+    generateTestGrasps(object_pose, 0.01, object_grasp_candidates[object_id]);
+    ASSERT_FALSE(object_grasp_candidates[object_id].empty());
+  }
+
+  std::vector<ObjectFilterResult> object_results;
+  bool filter_pregrasps = true;
+  EXPECT_TRUE(grasp_filter_->filterGraspsForObjects(object_grasp_candidates, planning_scene_monitor_, arm_jmg_,
+                                                    visual_tools_->getSharedRobotState(), object_results,
+                                                    filter_pregrasps));
+
+  ASSERT_EQ(object_results.size(), 3u);
+  std::size_t seeded_grasps = 0;
+  for (std::size_t object_id = 0; object_id < 3; ++object_id)
+  {
+    std::size_t valid_grasps = 0;
+    for (std::size_t i = 0; i < object_grasp_candidates[object_id].size(); ++i)
+      valid_grasps += object_grasp_candidates[object_id][i]->isValid();
+    EXPECT_EQ(object_results[object_id].remaining_grasps_, valid_grasps);
+    EXPECT_GT(object_results[object_id].remaining_grasps_, 0u);
+    EXPECT_GT(object_results[object_id].filter_time_, 0.0);
+    seeded_grasps += object_results[object_id].seeded_grasps_;
+  }
+
+  // The duplicate shares every IK pose with the first object, so some of its grasps start from their solutions
+  EXPECT_GT(seeded_grasps, 0u);
+}
+
+TEST_F(GraspFilterTest, TestFailureDiagnostics)
+{
+  // Generate grasps for a cuboid out of reach
+  std::vector<moveit_grasps::GraspCandidatePtr> grasp_candidates;
+  generateTestGrasps(Eigen::Affine3d(Eigen::Translation3d(1.5, 0.0, 0.4)), 0.01, grasp_candidates);
+  ASSERT_FALSE(grasp_candidates.empty());
+
+  // Every grasp fails in the parallel pass and keeps its diagnostics
+  bool filter_pregrasps = true;
+  nh_.setParam("moveit_grasps/filter/record_failure_diagnostics", true);
+  grasp_filter_.reset(new moveit_grasps::GraspFilter(visual_tools_->getSharedRobotState(), visual_tools_));
+  nh_.setParam("moveit_grasps/filter/record_failure_diagnostics", false);
+  EXPECT_FALSE(grasp_filter_->filterGrasps(grasp_candidates, planning_scene_monitor_, arm_jmg_,
+                                           visual_tools_->getSharedRobotState(), filter_pregrasps));
+
+  const std::vector<GraspFailureDiagnostics>& failures = grasp_filter_->getFailureDiagnostics();
+  ASSERT_EQ(failures.size(), grasp_candidates.size());
+  for (std::size_t i = 0; i < failures.size(); ++i)
+  {
+    EXPECT_EQ(failures[i].stage_, GRASP_IK_FAILURE);
+    EXPECT_NE(failures[i].error_code_.val, moveit_msgs::MoveItErrorCodes::SUCCESS);
+
+    // Nothing is in the way, the arm is just too short
+    EXPECT_EQ(failures[i].collision_.num_rejected_states_, 0u);
+    EXPECT_GT(failures[i].position_residual_, 0.1);
+  }
+  EXPECT_TRUE(grasp_filter_->visualizeFailureDiagnostics(1));
+
+  // Showing failures records them too
+  nh_.setParam("moveit_grasps/filter/show_grasp_filter_collision_if_failed", true);
+  grasp_filter_.reset(new moveit_grasps::GraspFilter(visual_tools_->getSharedRobotState(), visual_tools_));
+  nh_.setParam("moveit_grasps/filter/show_grasp_filter_collision_if_failed", false);
+  EXPECT_FALSE(grasp_filter_->filterGrasps(grasp_candidates, planning_scene_monitor_, arm_jmg_,
+                                           visual_tools_->getSharedRobotState(), filter_pregrasps));
+  EXPECT_EQ(grasp_filter_->getFailureDiagnostics().size(), grasp_candidates.size());
+}
+
+TEST_F(GraspFilterTest, TestTwoPhaseIKTimeout)
+{
+  // Generate grasps for a cuboid in front of the robot
+  std::vector<moveit_grasps::GraspCandidatePtr> grasp_candidates;
+  generateTestGrasps(Eigen::Affine3d(Eigen::Translation3d(0.6, 0.0, 0.4)), 0.01, grasp_candidates);
+  ASSERT_FALSE(grasp_candidates.empty());
+
+  // A filter with a first pass timeout too short for most grasps, retrying only some of them
+  const int second_pass_max_grasps = 5;
+  nh_.setParam("moveit_grasps/filter/two_phase_ik", true);
+  nh_.setParam("moveit_grasps/filter/first_pass_ik_timeout", 0.0001);
+  nh_.setParam("moveit_grasps/filter/second_pass_max_grasps", second_pass_max_grasps);
+  grasp_filter_.reset(new moveit_grasps::GraspFilter(visual_tools_->getSharedRobotState(), visual_tools_));
+  nh_.setParam("moveit_grasps/filter/two_phase_ik", false);
+  nh_.setParam("moveit_grasps/filter/second_pass_max_grasps", 50);
+
+  bool filter_pregrasps = true;
+  EXPECT_TRUE(grasp_filter_->filterGrasps(grasp_candidates, planning_scene_monitor_, arm_jmg_,
+                                          visual_tools_->getSharedRobotState(), filter_pregrasps));
+
+  // Valid grasps were either solved quickly or retried with the full timeout
+  std::size_t num_retried = 0;
+  std::size_t num_recovered = 0;
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+  {
+    if (grasp_candidates[i]->isValid())
+    {
+      EXPECT_FALSE(grasp_candidates[i]->ik_timed_out_);
+    }
+    num_retried += grasp_candidates[i]->ik_retried_;
+    num_recovered += grasp_candidates[i]->ik_retried_ && grasp_candidates[i]->isValid();
+  }
+  EXPECT_GT(num_recovered, 0u) << "No grasp timed out in the first pass and was solved by the retry";
+  EXPECT_LE(num_retried, static_cast<std::size_t>(second_pass_max_grasps));
+}
+
+TEST_F(GraspFilterTest, TestTrackedGrasps)
+{
+  // Generate and filter grasps for a cuboid in front of the robot
+  Eigen::Affine3d cuboid_pose = Eigen::Affine3d::Identity();
+  cuboid_pose.translation() = Eigen::Vector3d(0.6, 0.0, 0.4);
+  const double depth = 0.01, width = 0.01, height = 0.01;
+
+  std::vector<moveit_grasps::GraspCandidatePtr> grasp_candidates;
+  generateTestGrasps(cuboid_pose, depth, grasp_candidates);
+  bool filter_pregrasps = true;
+  ASSERT_TRUE(grasp_filter_->filterGrasps(grasp_candidates, planning_scene_monitor_, arm_jmg_,
+                                          visual_tools_->getSharedRobotState(), filter_pregrasps));
+  moveit_grasps::TrackedGrasps tracked_grasps(cuboid_pose, depth, width, height, grasp_candidates);
+
+  // A small motion moves the valid grasps, seeded with their previous solutions
+  Eigen::Affine3d moved_pose = Eigen::Translation3d(0.01, 0.005, 0.0) * cuboid_pose;
+  std::vector<moveit_grasps::GraspCandidatePtr> tracked_candidates;
+  ASSERT_TRUE(grasp_generator_->trackGrasps(tracked_grasps, moved_pose, depth, width, height, tracked_candidates));
+  for (std::size_t i = 0; i < tracked_candidates.size(); ++i)
+  {
+    EXPECT_FALSE(tracked_candidates[i]->grasp_ik_seed_.empty());
+    EXPECT_TRUE(tracked_candidates[i]->grasp_ik_solution_.empty());
+    EXPECT_NEAR(0.0, (tracked_candidates[i]->cuboid_pose_.translation() - moved_pose.translation()).norm(), 1e-9);
+  }
+  EXPECT_TRUE(grasp_filter_->revalidateGrasps(tracked_candidates, planning_scene_monitor_, arm_jmg_,
+                                              visual_tools_->getSharedRobotState(), filter_pregrasps));
+
+  // A large motion needs all grasps to be generated again
+  Eigen::Affine3d far_pose = Eigen::Translation3d(0.0, 0.3, 0.0) * cuboid_pose;
+  EXPECT_FALSE(grasp_generator_->trackGrasps(tracked_grasps, far_pose, depth, width, height, tracked_candidates));
+}
+
+TEST_F(GraspFilterTest, TestRefilterGrasps)
+{
+  std::vector<moveit_grasps::GraspCandidatePtr> grasp_candidates;
+  generateTestGrasps(Eigen::Affine3d(Eigen::Translation3d(0.6, 0.0, 0.4)), 0.01, grasp_candidates);
+
+  nh_.setParam("moveit_grasps/filter/incremental_refilter", true);
+  grasp_filter_.reset(new moveit_grasps::GraspFilter(visual_tools_->getSharedRobotState(), visual_tools_));
+  nh_.setParam("moveit_grasps/filter/incremental_refilter", false);
+  bool filter_pregrasps = true;
+  ASSERT_TRUE(grasp_filter_->filterGrasps(grasp_candidates, planning_scene_monitor_, arm_jmg_,
+                                          visual_tools_->getSharedRobotState(), filter_pregrasps));
+
+  // Place a box on the elbow of the first valid grasp
+  std::size_t blocked_grasp = grasp_candidates.size();
+  for (std::size_t i = 0; i < grasp_candidates.size() && blocked_grasp == grasp_candidates.size(); ++i)
+    if (grasp_candidates[i]->isValid())
+      blocked_grasp = i;
+  ASSERT_LT(blocked_grasp, grasp_candidates.size());
+  moveit::core::RobotStatePtr robot_state(new moveit::core::RobotState(*visual_tools_->getSharedRobotState()));
+  grasp_candidates[blocked_grasp]->getGraspStateOpen(robot_state);
+  robot_state->update();
+  const Eigen::Vector3d elbow = robot_state->getGlobalLinkTransform("panda_link4").translation();
+  const Eigen::Affine3d box_pose = Eigen::Affine3d(Eigen::Translation3d(elbow));
+  const Eigen::AlignedBox3d box_volume(box_pose.translation() - Eigen::Vector3d::Constant(0.02),
+                                       box_pose.translation() + Eigen::Vector3d::Constant(0.02));
+
+  // Grasps whose arm and gripper volumes stay clear of the box must keep their results
+  std::vector<const robot_model::LinkModel*> links = arm_jmg_->getLinkModels();
+  const std::vector<const robot_model::LinkModel*>& ee_links = grasp_data_->ee_jmg_->getLinkModels();
+  links.insert(links.end(), ee_links.begin(), ee_links.end());
+  std::vector<bool> overlapping(grasp_candidates.size(), true);
+  std::vector<bool> valid(grasp_candidates.size());
+  std::vector<std::vector<double> > ik_solutions(grasp_candidates.size());
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+  {
+    valid[i] = grasp_candidates[i]->isValid();
+    ik_solutions[i] = grasp_candidates[i]->grasp_ik_solution_;
+    if (grasp_candidates[i]->grasp_ik_solution_.empty() || grasp_candidates[i]->pregrasp_ik_solution_.empty())
+      continue;
+
+    AlignedBoxes volumes;
+    grasp_candidates[i]->getGraspStateOpen(robot_state);
+    robot_state->update();
+    GraspFilterCache::getLinkVolumes(*robot_state, links, volumes);
+    grasp_candidates[i]->getPreGraspState(robot_state);
+    robot_state->update();
+    GraspFilterCache::getLinkVolumes(*robot_state, links, volumes);
+    overlapping[i] = false;
+    for (std::size_t j = 0; j < volumes.size(); ++j)
+      overlapping[i] = overlapping[i] || volumes[j].intersects(box_volume);
+  }
+  ASSERT_TRUE(overlapping[blocked_grasp]);
+
+  {
+    planning_scene_monitor::LockedPlanningSceneRW scene(planning_scene_monitor_);
+    scene->getWorldNonConst()->addToObject("refilter_box", shapes::ShapeConstPtr(new shapes::Box(0.04, 0.04, 0.04)),
+                                           box_pose);
+  }
+  grasp_filter_->refilterGrasps(grasp_candidates, planning_scene_monitor_, arm_jmg_,
+                                visual_tools_->getSharedRobotState(), filter_pregrasps);
+
+  std::size_t num_unchanged = 0;
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+  {
+    if (overlapping[i])
+      continue;
+    EXPECT_EQ(grasp_candidates[i]->isValid(), valid[i]) << "grasp " << i;
+    EXPECT_EQ(grasp_candidates[i]->grasp_ik_solution_, ik_solutions[i]) << "grasp " << i;
+    ++num_unchanged;
+  }
+  EXPECT_GT(num_unchanged, 0u);
+
+  // The blocked arm configuration is rejected, the grasp is invalid or reached in another way
+  EXPECT_TRUE(!grasp_candidates[blocked_grasp]->isValid() ||
+              grasp_candidates[blocked_grasp]->grasp_ik_solution_ != ik_solutions[blocked_grasp]);
+
+  // Allowing the collision does not move any object, but must still re-check all grasps
+  {
+    planning_scene_monitor::LockedPlanningSceneRW scene(planning_scene_monitor_);
+    scene->getAllowedCollisionMatrixNonConst().setEntry("refilter_box", true);
+  }
+  grasp_filter_->refilterGrasps(grasp_candidates, planning_scene_monitor_, arm_jmg_,
+                                visual_tools_->getSharedRobotState(), filter_pregrasps);
+  EXPECT_TRUE(grasp_candidates[blocked_grasp]->isValid());
+}
+
+TEST_F(GraspFilterTest, TestGraspFilterCacheMatchesRobot)
+{
+  planning_scene::PlanningScenePtr planning_scene =
+      planning_scene::PlanningScene::clone(planning_scene_monitor_->getPlanningScene());
+  moveit::core::RobotState seed_state(*visual_tools_->getSharedRobotState());
+
+  GraspFilterCache filter_cache(0.1);
+  filter_cache.setFilterRequest(std::vector<GraspCandidatePtr>(1), arm_jmg_, true);
+  filter_cache.setWorld(*planning_scene, seed_state);
+  EXPECT_TRUE(filter_cache.matchesRobot(*planning_scene, seed_state));
+
+  // The arm joints of the current state are replaced by the IK solutions
+  std::vector<double> arm_positions;
+  planning_scene->getCurrentState().copyJointGroupPositions(arm_jmg_, arm_positions);
+  arm_positions.front() += 0.5;
+  planning_scene->getCurrentStateNonConst().setJointGroupPositions(arm_jmg_, arm_positions);
+  EXPECT_TRUE(filter_cache.matchesRobot(*planning_scene, seed_state));
+
+  // but the seed state changes the IK solutions
+  moveit::core::RobotState moved_seed_state(seed_state);
+  moved_seed_state.setJointGroupPositions(arm_jmg_, arm_positions);
+  EXPECT_FALSE(filter_cache.matchesRobot(*planning_scene, moved_seed_state));
+
+  // and the allowed collision matrix changes the collision checks
+  planning_scene->getAllowedCollisionMatrixNonConst().setEntry("some_object", true);
+  EXPECT_FALSE(filter_cache.matchesRobot(*planning_scene, seed_state));
+  filter_cache.setWorld(*planning_scene, seed_state);
+  EXPECT_TRUE(filter_cache.matchesRobot(*planning_scene, seed_state));
+
+  // as do attached bodies
+  planning_scene->getCurrentStateNonConst().attachBody(
+      "attached_box", std::vector<shapes::ShapeConstPtr>(1, shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1))),
+      EigenSTL::vector_Affine3d(1, Eigen::Affine3d::Identity()), std::set<std::string>(), "panda_link8");
+  EXPECT_FALSE(filter_cache.matchesRobot(*planning_scene, seed_state));
+}
+
+TEST_F(GraspFilterTest, TestSuccessPredictorForgetsChangedScene)
+{
+  std::vector<moveit_grasps::GraspCandidatePtr> grasp_candidates;
+  generateTestGrasps(Eigen::Affine3d(Eigen::Translation3d(0.6, 0.0, 0.4)), 0.01, grasp_candidates);
+
+  // Skip every grasp as soon as there is a single sample
+  nh_.setParam("moveit_grasps/filter/use_success_predictor", true);
+  nh_.setParam("moveit_grasps/filter/success_predictor_min_samples", 1);
+  nh_.setParam("moveit_grasps/filter/success_predictor_threshold", 1.1);
+  nh_.setParam("moveit_grasps/filter/success_predictor_verify_fraction", 0.0);
+  grasp_filter_.reset(new moveit_grasps::GraspFilter(visual_tools_->getSharedRobotState(), visual_tools_));
+  nh_.setParam("moveit_grasps/filter/use_success_predictor", false);
+  nh_.setParam("moveit_grasps/filter/success_predictor_min_samples", 200);
+  nh_.setParam("moveit_grasps/filter/success_predictor_threshold", 0.1);
+  nh_.setParam("moveit_grasps/filter/success_predictor_verify_fraction", 0.1);
+
+  const auto num_skipped = [&grasp_candidates]() {
+    std::size_t skipped = 0;
+    for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+      if (grasp_candidates[i]->grasp_skipped_by_predictor_)
+        ++skipped;
+    return skipped;
+  };
+  const auto filter = [&]() {
+    for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+      grasp_candidates[i]->resetFilterResults();
+    grasp_filter_->filterGrasps(grasp_candidates, planning_scene_monitor_, arm_jmg_,
+                                visual_tools_->getSharedRobotState(), true);
+  };
+
+  // The first pass has no samples, the second one uses them
+  filter();
+  EXPECT_EQ(num_skipped(), 0u);
+  filter();
+  EXPECT_GT(num_skipped(), 0u);
+
+  // Outcomes learned in another scene are not used
+  {
+    planning_scene_monitor::LockedPlanningSceneRW scene(planning_scene_monitor_);
+    scene->getWorldNonConst()->addToObject("far_box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)),
+                                           Eigen::Affine3d(Eigen::Translation3d(-2.0, 0.0, 0.0)));
+  }
+  filter();
+  EXPECT_EQ(num_skipped(), 0u);
+
+  // Neither are those learned with other allowed collisions
+  filter();
+  EXPECT_GT(num_skipped(), 0u);
+  {
+    planning_scene_monitor::LockedPlanningSceneRW scene(planning_scene_monitor_);
+    scene->getAllowedCollisionMatrixNonConst().setEntry("far_box", true);
+  }
+  filter();
+  EXPECT_EQ(num_skipped(), 0u);
+}
+
+TEST_F(GraspFilterTest, TestClosestIKSolutions)
+{
+  // Generate grasps for a cuboid in front of the robot
+  std::vector<moveit_grasps::GraspCandidatePtr> grasp_candidates;
+  generateTestGrasps(Eigen::Affine3d(Eigen::Translation3d(0.6, 0.0, 0.4)), 0.01, grasp_candidates);
+  ASSERT_FALSE(grasp_candidates.empty());
+
+  // Keep the closest of several solutions and rank by it
+  bool filter_pregrasps = true;
+  nh_.setParam("moveit_grasps/filter/batch_ik_solver", "panda_analytic");
+  nh_.setParam("moveit_grasps/filter/ik_solutions_per_grasp", 4);
+  nh_.setParam("moveit_grasps/filter/joint_distance_weight", 100.0);
+  grasp_filter_.reset(new moveit_grasps::GraspFilter(visual_tools_->getSharedRobotState(), visual_tools_));
+  nh_.setParam("moveit_grasps/filter/batch_ik_solver", "");
+  nh_.setParam("moveit_grasps/filter/ik_solutions_per_grasp", 1);
+  nh_.setParam("moveit_grasps/filter/joint_distance_weight", 0.0);
+  ASSERT_TRUE(grasp_filter_->filterGrasps(grasp_candidates, planning_scene_monitor_, arm_jmg_,
+                                          visual_tools_->getSharedRobotState(), filter_pregrasps));
+
+  // The distance is measured from the seed state to the pregrasp, the start of the motion
+  std::vector<double> start_joints;
+  visual_tools_->getSharedRobotState()->copyJointGroupPositions(arm_jmg_, start_joints);
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+  {
+    if (!grasp_candidates[i]->isValid())
+      continue;
+    double distance = 0.0;
+    for (std::size_t j = 0; j < start_joints.size(); ++j)
+      distance += std::pow(grasp_candidates[i]->pregrasp_ik_solution_[j] - start_joints[j], 2);
+    EXPECT_NEAR(grasp_candidates[i]->joint_distance_, std::sqrt(distance), 1e-9);
+  }
+
+  // A large weight ranks the grasps by their joint distance
+  ASSERT_TRUE(grasp_filter_->removeInvalidAndFilter(grasp_candidates));
+  for (std::size_t i = 1; i < grasp_candidates.size(); ++i)
+    EXPECT_LE(grasp_candidates[i - 1]->joint_distance_, grasp_candidates[i]->joint_distance_ + 0.01);
+}
+
+TEST_F(GraspFilterTest, TestFingersClosedChecksOnlyEndEffector)
+{
+  planning_scene::PlanningScenePtr planning_scene =
+      planning_scene::PlanningScene::clone(planning_scene_monitor_->getPlanningScene());
+  planning_scene->getWorldNonConst()->clearObjects();
+  robot_state::RobotStatePtr robot_state(new robot_state::RobotState(planning_scene->getCurrentState()));
+  robot_state->setToDefaultValues();
+  robot_state->update();
+  std::vector<double> ik_solution;
+  robot_state->copyJointGroupPositions(arm_jmg_, ik_solution);
+
+  std::vector<GraspCandidatePtr> grasp_candidates;
+  Eigen::Affine3d link_transform = Eigen::Affine3d::Identity();
+  IkThreadStructPtr ik_thread_struct(new IkThreadStruct(grasp_candidates, planning_scene, link_transform, 0,
+                                                        kinematics::KinematicsBaseConstPtr(), robot_state, 0.1, false,
+                                                        false, 0));
+  moveit_msgs::Grasp grasp;
+  grasp.grasp_posture = grasp_data_->grasp_posture_;
+  GraspCandidatePtr grasp_candidate(new GraspCandidate(grasp, grasp_data_, Eigen::Affine3d::Identity()));
+
+  // The arm was validated with open fingers, so the full state validity callback is not run again
+  std::size_t num_full_checks = 0;
+  const moveit::core::GroupStateValidityCallbackFn constraint_fn =
+      [&num_full_checks](robot_state::RobotState*, const robot_model::JointModelGroup*, const double*) {
+        num_full_checks++;
+        return true;
+      };
+  EXPECT_TRUE(grasp_filter_->checkFingersClosedIK(ik_solution, ik_thread_struct, grasp_candidate, constraint_fn));
+  EXPECT_TRUE(grasp_filter_->isEndEffectorStateValid(ik_thread_struct, grasp_data_->ee_jmg_));
+
+  // An obstacle at the elbow is not checked again
+  const shapes::ShapeConstPtr box(new shapes::Box(0.05, 0.05, 0.05));
+  planning_scene->getWorldNonConst()->addToObject(
+      "elbow_box", box, robot_state->getGlobalLinkTransform("panda_link4"));
+  EXPECT_TRUE(planning_scene->isStateColliding(*robot_state, arm_jmg_->getName()));
+  EXPECT_TRUE(grasp_filter_->checkFingersClosedIK(ik_solution, ik_thread_struct, grasp_candidate, constraint_fn));
+  EXPECT_TRUE(grasp_filter_->isEndEffectorStateValid(ik_thread_struct, grasp_data_->ee_jmg_));
+
+  // An obstacle between the fingers is
+  planning_scene->getWorldNonConst()->clearObjects();
+  planning_scene->getWorldNonConst()->addToObject(
+      "finger_box", box, robot_state->getGlobalLinkTransform("panda_leftfinger"));
+  EXPECT_FALSE(grasp_filter_->checkFingersClosedIK(ik_solution, ik_thread_struct, grasp_candidate, constraint_fn));
+  EXPECT_FALSE(grasp_filter_->isEndEffectorStateValid(ik_thread_struct, grasp_data_->ee_jmg_));
+  EXPECT_EQ(num_full_checks, 0u);
+}
+
+TEST_F(GraspFilterTest, TestCoarseCollisionChecker)
+{
+  planning_scene::PlanningScenePtr planning_scene =
+      planning_scene::PlanningScene::clone(planning_scene_monitor_->getPlanningScene());
+  robot_state::RobotState& robot_state = planning_scene->getCurrentStateNonConst();
+  robot_state.setToDefaultValues();
+  robot_state.update();
+
+  CoarseCollisionChecker coarse_collision_checker(planning_scene->getRobotModel());
+
+  // An object far away from the arm is resolved without an exact check
+  planning_scene->getWorldNonConst()->addToObject("far_box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)),
+                                                  Eigen::Affine3d(Eigen::Translation3d(5.0, 5.0, 5.0)));
+  coarse_collision_checker.setPlanningScene(*planning_scene);
+  EXPECT_EQ(coarse_collision_checker.checkWorldCollision(robot_state, arm_jmg_), COARSE_CLEAR);
+
+  // So is an arm buried in a solid object
+  planning_scene->getWorldNonConst()->addToObject("big_box", shapes::ShapeConstPtr(new shapes::Box(5.0, 5.0, 5.0)),
+                                                  Eigen::Affine3d::Identity());
+  coarse_collision_checker.setPlanningScene(*planning_scene);
+  EXPECT_EQ(coarse_collision_checker.checkWorldCollision(robot_state, arm_jmg_), COARSE_COLLIDING);
+  EXPECT_TRUE(planning_scene->isStateColliding(robot_state, arm_jmg_->getName()));
+}
+
+TEST_F(GraspFilterTest, TestStaticDistanceField)
+{
+  planning_scene::PlanningScenePtr planning_scene =
+      planning_scene::PlanningScene::clone(planning_scene_monitor_->getPlanningScene());
+  robot_state::RobotState& robot_state = planning_scene->getCurrentStateNonConst();
+  robot_state.setToDefaultValues();
+  robot_state.update();
+
+  StaticDistanceField static_distance_field(planning_scene->getRobotModel(), std::vector<std::string>(1, "shelf"));
+
+  // A shelf behind the robot
+  planning_scene->getWorldNonConst()->addToObject("shelf", shapes::ShapeConstPtr(new shapes::Box(0.2, 1.0, 1.0)),
+                                                  Eigen::Affine3d(Eigen::Translation3d(-1.0, 0.0, 0.5)));
+  EXPECT_TRUE(static_distance_field.update(*planning_scene));
+  EXPECT_FALSE(static_distance_field.update(*planning_scene));
+  EXPECT_FALSE(static_distance_field.isStateColliding(robot_state, arm_jmg_));
+
+  // The shelf is only in the distance field
+  planning_scene::PlanningScenePtr dynamic_scene = static_distance_field.getDynamicScene(planning_scene);
+  EXPECT_FALSE(dynamic_scene->getWorld()->hasObject("shelf"));
+  EXPECT_TRUE(planning_scene->getWorld()->hasObject("shelf"));
+
+  // Moving the shelf onto the arm rebuilds the field
+  planning_scene->getWorldNonConst()->moveShapeInObject(
+      "shelf", planning_scene->getWorld()->getObject("shelf")->shapes_[0],
+      Eigen::Affine3d(Eigen::Translation3d(0.0, 0.0, 0.5)));
+  EXPECT_TRUE(static_distance_field.update(*planning_scene));
+  EXPECT_TRUE(static_distance_field.isStateColliding(robot_state, arm_jmg_));
+}
+
+TEST_F(GraspFilterTest, TestSceneRegionCropper)
+{
+  planning_scene::PlanningScenePtr planning_scene =
+      planning_scene::PlanningScene::clone(planning_scene_monitor_->getPlanningScene());
+  robot_state::RobotState& robot_state = planning_scene->getCurrentStateNonConst();
+  robot_state.setToDefaultValues();
+  robot_state.update();
+
+  // One box next to the robot, one far away and one object with a shape at each place
+  const shapes::ShapeConstPtr box(new shapes::Box(0.1, 0.1, 0.1));
+  const Eigen::Affine3d near_pose(Eigen::Translation3d(0.5, 0.0, 0.5));
+  const Eigen::Affine3d far_pose(Eigen::Translation3d(10.0, 0.0, 0.5));
+  const collision_detection::WorldPtr& world = planning_scene->getWorldNonConst();
+  world->addToObject("near", box, near_pose);
+  world->addToObject("far", box, far_pose);
+  world->addToObject("split", box, near_pose);
+  world->addToObject("split", shapes::ShapeConstPtr(new shapes::Sphere(0.1)), far_pose);
+
+  SceneRegionCropper scene_region_cropper(0.3);
+  const Eigen::AlignedBox3d region = scene_region_cropper.computeReachRegion(
+      robot_state, arm_jmg_, EigenSTL::vector_Vector3d(1, near_pose.translation()));
+  EXPECT_TRUE(region.contains(near_pose.translation()));
+  EXPECT_FALSE(region.contains(far_pose.translation()));
+
+  planning_scene::PlanningScenePtr cropped_scene = scene_region_cropper.cropScene(planning_scene, region);
+  EXPECT_TRUE(cropped_scene->getWorld()->hasObject("near"));
+  EXPECT_FALSE(cropped_scene->getWorld()->hasObject("far"));
+  ASSERT_TRUE(cropped_scene->getWorld()->hasObject("split"));
+  EXPECT_EQ(cropped_scene->getWorld()->getObject("split")->shapes_.size(), 1u);
+
+  // The original scene is unchanged
+  EXPECT_TRUE(planning_scene->getWorld()->hasObject("far"));
+  EXPECT_EQ(planning_scene->getWorld()->getObject("split")->shapes_.size(), 2u);
+}
+
+TEST_F(GraspFilterTest, TestContinuousCollisionChecker)
+{
+  planning_scene::PlanningScenePtr planning_scene =
+      planning_scene::PlanningScene::clone(planning_scene_monitor_->getPlanningScene());
+  planning_scene->getWorldNonConst()->clearObjects();
+  robot_state::RobotState from(planning_scene->getCurrentState());
+  from.setToDefaultValues();
+  from.update();
+  robot_state::RobotState to(from);
+  to.setVariablePosition("panda_joint1", 1.0);
+  to.update();
+
+  ContinuousCollisionChecker continuous_collision_checker(planning_scene->getRobotModel());
+
+  // The bound covers the motion of the hand
+  const robot_model::LinkModel* hand_link = planning_scene->getRobotModel()->getLinkModel("panda_link8");
+  const double hand_motion =
+      (to.getGlobalLinkTransform(hand_link).translation() - from.getGlobalLinkTransform(hand_link).translation())
+          .norm();
+  EXPECT_GE(continuous_collision_checker.getMotionBound(from, to, arm_jmg_), hand_motion);
+  EXPECT_EQ(continuous_collision_checker.getMotionBound(from, from, arm_jmg_), 0.0);
+  EXPECT_TRUE(continuous_collision_checker.isMotionValid(*planning_scene, from, to, arm_jmg_));
+
+  // An obstacle at the end of the motion
+  planning_scene->getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)),
+                                                  to.getGlobalLinkTransform(hand_link));
+  EXPECT_FALSE(continuous_collision_checker.isMotionValid(*planning_scene, from, to, arm_jmg_));
+  EXPECT_FALSE(continuous_collision_checker.isMotionValid(*planning_scene, to, from, arm_jmg_));
+}
+
+TEST_F(GraspFilterTest, TestCartesianInterpolator)
+{
+  planning_scene::PlanningScenePtr planning_scene =
+      planning_scene::PlanningScene::clone(planning_scene_monitor_->getPlanningScene());
+  planning_scene->getWorldNonConst()->clearObjects();
+  robot_state::RobotState robot_state(planning_scene->getCurrentState());
+  robot_state.setToDefaultValues();
+  robot_state.update();
+
+  // Move the hand 10 cm down
+  const robot_model::LinkModel* tip_link = planning_scene->getRobotModel()->getLinkModel("panda_link8");
+  Eigen::Affine3d target = robot_state.getGlobalLinkTransform(tip_link);
+  target.translation().z() -= 0.1;
+
+  CartesianInterpolator cartesian_interpolator(0.005, 0.05);
+  std::vector<robot_state::RobotStatePtr> trajectory;
+  const double fraction = cartesian_interpolator.computeCartesianPath(
+      &robot_state, arm_jmg_, trajectory, tip_link, target, 4.0, moveit::core::GroupStateValidityCallbackFn(),
+      planning_scene.get());
+  EXPECT_DOUBLE_EQ(fraction, 1.0);
+
+  // Far fewer states than with fixed 1 cm steps
+  EXPECT_LT(trajectory.size(), 11u);
+  robot_state.update();
+  EXPECT_TRUE(robot_state.getGlobalLinkTransform(tip_link).isApprox(target, 1e-3));
+
+  // Back up with Jacobian steps
+  CartesianInterpolator jacobian_interpolator(0.01, 0.01, 0.1, 0.5, true);
+  target.translation().z() += 0.1;
+  EXPECT_DOUBLE_EQ(jacobian_interpolator.computeCartesianPath(&robot_state, arm_jmg_, trajectory, tip_link, target, 4.0,
+                                                              moveit::core::GroupStateValidityCallbackFn(), NULL),
+                   1.0);
+  EXPECT_EQ(trajectory.size(), 11u);
+  robot_state.update();
+  EXPECT_TRUE(robot_state.getGlobalLinkTransform(tip_link).isApprox(target, 1e-3));
+}
+
+TEST_F(GraspFilterTest, TestPandaBatchIKSolver)
+{
+  robot_state::RobotState robot_state(planning_scene_monitor_->getPlanningScene()->getCurrentState());
+  robot_state.setToDefaultValues();
+  robot_state.update();
+
+  PandaBatchIKSolver panda_solver;
+  ASSERT_TRUE(panda_solver.initialize(robot_state, arm_jmg_, "panda_link0", "panda_link8"));
+
+  // Tip poses of random configurations, all seeded from the default configuration
+  std::vector<double> default_joints;
+  robot_state.copyJointGroupPositions(arm_jmg_, default_joints);
+  const std::size_t num_poses = 50;
+  EigenSTL::vector_Affine3d ik_poses;
+  for (std::size_t i = 0; i < num_poses; ++i)
+  {
+    robot_state.setToRandomPositions(arm_jmg_);
+    robot_state.update();
+    ik_poses.push_back(robot_state.getGlobalLinkTransform("panda_link0").inverse() *
+                       robot_state.getGlobalLinkTransform("panda_link8"));
+  }
+  std::vector<std::vector<double> > ik_seeds(num_poses, default_joints);
+
+  std::vector<std::vector<double> > ik_solutions;
+  std::vector<moveit_msgs::MoveItErrorCodes> error_codes;
+  const std::size_t num_solved =
+      panda_solver.solve(ik_poses, ik_seeds, 0.1, BatchIKCallbackFn(), ik_solutions, error_codes);
+
+  // Sampling the last joint can miss poses right at the joint limits
+  EXPECT_GE(num_solved, num_poses * 9 / 10);
+  for (std::size_t i = 0; i < num_poses; ++i)
+  {
+    if (error_codes[i].val != moveit_msgs::MoveItErrorCodes::SUCCESS)
+      continue;
+    robot_state.setJointGroupPositions(arm_jmg_, ik_solutions[i]);
+    robot_state.update();
+    EXPECT_TRUE(robot_state.satisfiesBounds(arm_jmg_));
+    EXPECT_TRUE((robot_state.getGlobalLinkTransform("panda_link0").inverse() *
+                 robot_state.getGlobalLinkTransform("panda_link8")).isApprox(ik_poses[i], 1e-6));
+  }
+
+  // Rejected solutions are not returned
+  BatchIKCallbackFn reject_all = [](std::size_t, const std::vector<double>&) { return false; };
+  EXPECT_EQ(panda_solver.solve(ik_poses, ik_seeds, 0.1, reject_all, ik_solutions, error_codes), 0u);
+  EXPECT_TRUE(ik_solutions.front().empty());
+}
+
+TEST(GraspFilterCacheTest, FindOverlappingGrasps)
+{
+  GraspFilterCache filter_cache(0.1);
+  filter_cache.setFilterRequest(std::vector<GraspCandidatePtr>(3), NULL, true);
+
+  // Grasp 0 near the origin, grasp 1 spanning several cells, grasp 2 without volumes
+  filter_cache.setGraspVolumes(0, AlignedBoxes(1, Eigen::AlignedBox3d(Eigen::Vector3d(-0.05, -0.05, -0.05),
+                                                                      Eigen::Vector3d(0.05, 0.05, 0.05))));
+  filter_cache.setGraspVolumes(1, AlignedBoxes(1, Eigen::AlignedBox3d(Eigen::Vector3d(0.3, 0.0, 0.0),
+                                                                      Eigen::Vector3d(0.6, 0.1, 0.1))));
+
+  std::set<std::size_t> grasp_ids;
+  filter_cache.findOverlappingGrasps(
+      Eigen::AlignedBox3d(Eigen::Vector3d(0.0, 0.0, 0.0), Eigen::Vector3d(0.01, 0.01, 0.01)), grasp_ids);
+  EXPECT_EQ(grasp_ids, std::set<std::size_t>({ 0 }));
+
+  // Same cell as grasp 0 but not touching its volume
+  grasp_ids.clear();
+  filter_cache.findOverlappingGrasps(
+      Eigen::AlignedBox3d(Eigen::Vector3d(0.07, 0.07, 0.07), Eigen::Vector3d(0.09, 0.09, 0.09)), grasp_ids);
+  EXPECT_TRUE(grasp_ids.empty());
+
+  grasp_ids.clear();
+  filter_cache.findOverlappingGrasps(
+      Eigen::AlignedBox3d(Eigen::Vector3d(0.5, 0.05, 0.05), Eigen::Vector3d(0.55, 0.06, 0.06)), grasp_ids);
+  EXPECT_EQ(grasp_ids, std::set<std::size_t>({ 1 }));
+
+  // Moving a grasp removes it from its old cells
+  filter_cache.setGraspVolumes(1, AlignedBoxes(1, Eigen::AlignedBox3d(Eigen::Vector3d(-1.0, -1.0, -1.0),
+                                                                      Eigen::Vector3d(-0.9, -0.9, -0.9))));
+  grasp_ids.clear();
+  filter_cache.findOverlappingGrasps(
+      Eigen::AlignedBox3d(Eigen::Vector3d(0.5, 0.05, 0.05), Eigen::Vector3d(0.55, 0.06, 0.06)), grasp_ids);
+  EXPECT_TRUE(grasp_ids.empty());
+
+  // A large region is tested against every volume
+  grasp_ids.clear();
+  filter_cache.findOverlappingGrasps(
+      Eigen::AlignedBox3d(Eigen::Vector3d(-2.0, -2.0, -2.0), Eigen::Vector3d(2.0, 2.0, 2.0)), grasp_ids);
+  EXPECT_EQ(grasp_ids, std::set<std::size_t>({ 0, 1 }));
+
+  // An unbounded grasp, e.g. an IK failure, touches every region until it gets volumes again
+  filter_cache.setGraspUnbounded(2);
+  grasp_ids.clear();
+  filter_cache.findOverlappingGrasps(
+      Eigen::AlignedBox3d(Eigen::Vector3d(0.07, 0.07, 0.07), Eigen::Vector3d(0.09, 0.09, 0.09)), grasp_ids);
+  EXPECT_EQ(grasp_ids, std::set<std::size_t>({ 2 }));
+  filter_cache.setGraspVolumes(2, AlignedBoxes());
+  grasp_ids.clear();
+  filter_cache.findOverlappingGrasps(
+      Eigen::AlignedBox3d(Eigen::Vector3d(0.07, 0.07, 0.07), Eigen::Vector3d(0.09, 0.09, 0.09)), grasp_ids);
+  EXPECT_TRUE(grasp_ids.empty());
+}
+
+TEST(GraspSuccessPredictorTest, PredictFromNeighbors)
+{
+  GraspSuccessPredictor predictor(5, 100);
+  EXPECT_DOUBLE_EQ(predictor.predictSuccess(Eigen::Affine3d::Identity()), 0.5);
+
+  // Reachable close to the arm base, unreachable far away
+  for (std::size_t i = 0; i < 10; ++i)
+  {
+    predictor.addSample(Eigen::Affine3d(Eigen::Translation3d(0.3 + 0.01 * i, 0, 0.5)), true);
+    predictor.addSample(Eigen::Affine3d(Eigen::Translation3d(2.0 + 0.01 * i, 0, 0.5)), false);
+  }
+  EXPECT_EQ(predictor.getNumSamples(), 20u);
+  EXPECT_GT(predictor.predictSuccess(Eigen::Affine3d(Eigen::Translation3d(0.35, 0, 0.5))), 0.8);
+  EXPECT_LT(predictor.predictSuccess(Eigen::Affine3d(Eigen::Translation3d(2.05, 0, 0.5))), 0.2);
+
+  // Old samples are forgotten once full
+  for (std::size_t i = 0; i < 100; ++i)
+    predictor.addSample(Eigen::Affine3d(Eigen::Translation3d(0.3 + 0.001 * i, 0, 0.5)), false);
+  EXPECT_EQ(predictor.getNumSamples(), 100u);
+  EXPECT_LT(predictor.predictSuccess(Eigen::Affine3d(Eigen::Translation3d(0.35, 0, 0.5))), 0.2);
+}
+
+TEST(GraspSuccessPredictorTest, IndexMatchesLinearScan)
+{
+  GraspSuccessPredictor predictor(10, 2000);
+  for (std::size_t i = 0; i < 3000; ++i)
+  {
+    const Eigen::Affine3d ik_pose =
+        Eigen::Translation3d(Eigen::Vector3d::Random()) * Eigen::Quaterniond(Eigen::Vector4d::Random()).normalized();
+    predictor.addSample(ik_pose, ik_pose.translation().norm() < 1.0);
+  }
+
+  EigenSTL::vector_Affine3d ik_poses;
+  std::vector<double> predictions;
+  for (std::size_t i = 0; i < 200; ++i)
+  {
+    ik_poses.push_back(Eigen::Translation3d(Eigen::Vector3d::Random()) *
+                       Eigen::Quaterniond(Eigen::Vector4d::Random()).normalized());
+    predictions.push_back(predictor.predictSuccess(ik_poses.back()));
+  }
+
+  predictor.updateIndex();
+  for (std::size_t i = 0; i < ik_poses.size(); ++i)
+    EXPECT_EQ(predictions[i], predictor.predictSuccess(ik_poses[i]));
+}
+
+TEST(IKSeedIndexTest, FindNearbySeeds)
+{
+  IKSeedIndex ik_seed_index(0.02, 0.3);
+  const Eigen::Affine3d pose(Eigen::Translation3d(0.505, 0.105, 0.305));
+  std::vector<double> seed;
+  EXPECT_FALSE(ik_seed_index.findSeed(pose, seed));
+
+  ik_seed_index.addSolution(pose, std::vector<double>(7, 1.0));
+  ik_seed_index.addSolution(pose * Eigen::AngleAxisd(M_PI / 2.0, Eigen::Vector3d::UnitZ()),
+                            std::vector<double>(7, 2.0));
+  EXPECT_EQ(ik_seed_index.getNumSolutions(), 2u);
+
+  // The closest rotation in the same cell
+  ASSERT_TRUE(ik_seed_index.findSeed(pose * Eigen::Translation3d(0.004, 0, 0) *
+                                         Eigen::AngleAxisd(1.4, Eigen::Vector3d::UnitZ()),
+                                     seed));
+  EXPECT_EQ(seed, std::vector<double>(7, 2.0));
+  ASSERT_TRUE(ik_seed_index.findSeed(pose * Eigen::AngleAxisd(0.1, Eigen::Vector3d::UnitX()), seed));
+  EXPECT_EQ(seed, std::vector<double>(7, 1.0));
+
+  // Too far rotated or in another cell
+  EXPECT_FALSE(ik_seed_index.findSeed(pose * Eigen::AngleAxisd(M_PI, Eigen::Vector3d::UnitZ()), seed));
+  EXPECT_FALSE(ik_seed_index.findSeed(pose * Eigen::Translation3d(0.03, 0, 0), seed));
+
+  ik_seed_index.clear();
+  EXPECT_EQ(ik_seed_index.getNumSolutions(), 0u);
+  EXPECT_FALSE(ik_seed_index.findSeed(pose, seed));
+}
+
+TEST(WorkerThreadConfigTest, PinToAllowedCPU)
+{
+  ros::NodeHandle nh("~/worker_thread_config_test");
+  WorkerThreadConfig worker_thread_config;
+  EXPECT_FALSE(worker_thread_config.isEnabled());
+
+  // An unknown scheduler leaves the threads as they are
+  nh.setParam("thread_scheduler", "round_robin");
+  EXPECT_FALSE(worker_thread_config.load(nh));
+  EXPECT_FALSE(worker_thread_config.isEnabled());
+
+  // Pin to a CPU the test may run on, e.g. in a container restricted to some CPUs
+  cpu_set_t original_cpus;
+  ASSERT_EQ(pthread_getaffinity_np(pthread_self(), sizeof(original_cpus), &original_cpus), 0);
+  int allowed_cpu = 0;
+  while (allowed_cpu < CPU_SETSIZE && !CPU_ISSET(allowed_cpu, &original_cpus))
+    allowed_cpu++;
+  ASSERT_LT(allowed_cpu, CPU_SETSIZE);
+
+  nh.setParam("thread_scheduler", "");
+  nh.setParam("thread_cpus", std::vector<int>(1, allowed_cpu));
+  ASSERT_TRUE(worker_thread_config.load(nh));
+  EXPECT_TRUE(worker_thread_config.isEnabled());
+  EXPECT_EQ(worker_thread_config.limitNumWorkers(8), 1u);
+
+  nh.setParam("pin_threads", true);
+  ASSERT_TRUE(worker_thread_config.load(nh));
+  EXPECT_EQ(worker_thread_config.limitNumWorkers(8), 1u);
+  {
+    ScopedThreadSettings thread_settings;
+    EXPECT_TRUE(worker_thread_config.applyToCurrentThread(3));
+    EXPECT_EQ(sched_getcpu(), allowed_cpu);
+  }
+
+  // The settings of the thread are restored
+  cpu_set_t restored_cpus;
+  ASSERT_EQ(pthread_getaffinity_np(pthread_self(), sizeof(restored_cpus), &restored_cpus), 0);
+  EXPECT_TRUE(CPU_EQUAL(&original_cpus, &restored_cpus));
+}
+
+TEST(SharedGraspQueueTest, ClaimAndFinishTasks)
+{
+  SharedGraspQueue coordinator;
+  ASSERT_TRUE(coordinator.create("moveit_grasps_test_queue", 10));
+  SharedGraspQueue worker;
+  ASSERT_TRUE(worker.open("moveit_grasps_test_queue"));
+  EXPECT_EQ(coordinator.getNumWorkers(), 1u);
+  EXPECT_EQ(worker.getCapacity(), 10u);
+
+  SharedGraspBatch batch = SharedGraspBatch();
+  batch.num_tasks_ = 5;
+  for (std::size_t i = 0; i < batch.num_tasks_; ++i)
+    coordinator.getTask(i).approach_distance_ = i;
+  coordinator.submitBatch(batch);
+
+  SharedGraspBatch worker_batch;
+  ASSERT_TRUE(worker.waitForTasks(worker_batch, 1.0));
+  EXPECT_EQ(worker_batch.batch_id_, batch.batch_id_);
+
+  // Claim in chunks of three
+  std::size_t begin;
+  std::vector<SharedGraspTask> tasks;
+  ASSERT_TRUE(worker.claimTasks(batch.batch_id_, 3, begin, tasks));
+  EXPECT_EQ(begin, 0u);
+  ASSERT_EQ(tasks.size(), 3u);
+  EXPECT_DOUBLE_EQ(tasks[2].approach_distance_, 2.0);
+  tasks[2].grasp_filtered_by_ik_ = true;
+  worker.finishTasks(batch.batch_id_, begin, tasks);
+  EXPECT_FALSE(coordinator.waitForBatch(0.01));
+
+  ASSERT_TRUE(worker.claimTasks(batch.batch_id_, 3, begin, tasks));
+  EXPECT_EQ(begin, 3u);
+  EXPECT_EQ(tasks.size(), 2u);
+  worker.finishTasks(batch.batch_id_, begin, tasks);
+  EXPECT_FALSE(worker.claimTasks(batch.batch_id_, 3, begin, tasks));
+  EXPECT_TRUE(coordinator.waitForBatch(0.01));
+
+  coordinator.closeBatch();
+  EXPECT_TRUE(coordinator.getTask(4).done_);
+  EXPECT_TRUE(coordinator.getTask(2).grasp_filtered_by_ik_);
+
+  // Results of a closed batch are dropped
+  batch.num_tasks_ = 2;
+  coordinator.submitBatch(batch);
+  ASSERT_TRUE(worker.claimTasks(batch.batch_id_, 3, begin, tasks));
+  coordinator.closeBatch();
+  worker.finishTasks(batch.batch_id_, begin, tasks);
+  EXPECT_FALSE(coordinator.getTask(0).done_);
+}
+
+TEST(SharedGraspQueueTest, ReattachToNewGeneration)
+{
+  SharedGraspQueue worker;
+  {
+    SharedGraspQueue coordinator;
+    ASSERT_TRUE(coordinator.create("moveit_grasps_test_queue", 10));
+    ASSERT_TRUE(worker.open("moveit_grasps_test_queue"));
+    EXPECT_TRUE(worker.isCurrent());
+  }
+
+  // The coordinator restarts and replaces the queue, the worker keeps the old mapping until it reopens
+  EXPECT_FALSE(worker.isCurrent());
+  SharedGraspQueue coordinator;
+  ASSERT_TRUE(coordinator.create("moveit_grasps_test_queue", 10));
+  EXPECT_FALSE(worker.isCurrent());
+  EXPECT_EQ(coordinator.getNumWorkers(), 0u);
+
+  worker.close();
+  ASSERT_TRUE(worker.open("moveit_grasps_test_queue"));
+  EXPECT_TRUE(worker.isCurrent());
+  EXPECT_EQ(coordinator.getNumWorkers(), 1u);
+
+  SharedGraspBatch batch = SharedGraspBatch();
+  batch.num_tasks_ = 1;
+  coordinator.submitBatch(batch);
+  SharedGraspBatch worker_batch;
+  EXPECT_TRUE(worker.waitForTasks(worker_batch, 1.0));
+}
+
+TEST(SharedGraspQueueTest, KillWorkerMidBatch)
+{
+  SharedGraspQueue coordinator;
+  ASSERT_TRUE(coordinator.create("moveit_grasps_test_queue", 10, 0.2));
+  SharedGraspBatch batch = SharedGraspBatch();
+  batch.num_tasks_ = 6;
+  coordinator.submitBatch(batch);
+
+  // A worker process claims a chunk and reports back before it is killed
+  int claimed_pipe[2];
+  ASSERT_EQ(pipe(claimed_pipe), 0);
+  const pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0)
+  {
+    SharedGraspQueue worker;
+    SharedGraspBatch worker_batch;
+    std::size_t begin;
+    std::vector<SharedGraspTask> tasks;
+    const char claimed = worker.open("moveit_grasps_test_queue") && worker.waitForTasks(worker_batch, 1.0) &&
+                         worker.claimTasks(worker_batch.batch_id_, 4, begin, tasks);
+    if (write(claimed_pipe[1], &claimed, 1) != 1)
+      _exit(1);
+    while (true)
+      pause();
+  }
+  char claimed = 0;
+  ASSERT_EQ(read(claimed_pipe[0], &claimed, 1), 1);
+  ASSERT_TRUE(claimed);
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+  close(claimed_pipe[0]);
+  close(claimed_pipe[1]);
+
+  // A live worker first gets the tasks nobody claimed
+  SharedGraspQueue worker;
+  ASSERT_TRUE(worker.open("moveit_grasps_test_queue"));
+  std::size_t begin;
+  std::vector<SharedGraspTask> tasks;
+  ASSERT_TRUE(worker.claimTasks(batch.batch_id_, 4, begin, tasks));
+  EXPECT_EQ(begin, 4u);
+  EXPECT_EQ(tasks.size(), 2u);
+  worker.finishTasks(batch.batch_id_, begin, tasks);
+  EXPECT_FALSE(worker.claimTasks(batch.batch_id_, 4, begin, tasks));
+
+  // Once the lease of the killed worker expires its chunk is handed out again, the live worker keeps renewing
+  EXPECT_FALSE(coordinator.waitForBatch(0.5));
+  EXPECT_EQ(coordinator.getNumWorkers(), 1u);
+  EXPECT_TRUE(worker.isCurrent());
+  ASSERT_TRUE(worker.claimTasks(batch.batch_id_, 4, begin, tasks));
+  EXPECT_EQ(begin, 0u);
+  EXPECT_EQ(tasks.size(), 4u);
+  worker.finishTasks(batch.batch_id_, begin, tasks);
+  EXPECT_TRUE(coordinator.waitForBatch(0.01));
+
+  // A worker that closes hands its claimed tasks back right away
+  coordinator.submitBatch(batch);
+  ASSERT_TRUE(worker.claimTasks(batch.batch_id_, 6, begin, tasks));
+  worker.close();
+  EXPECT_EQ(coordinator.getNumWorkers(), 0u);
+  ASSERT_TRUE(worker.open("moveit_grasps_test_queue"));
+  ASSERT_TRUE(worker.claimTasks(batch.batch_id_, 6, begin, tasks));
+  EXPECT_EQ(tasks.size(), 6u);
+}
+
+// Free space planner that finishes after a fixed time, or as soon as it is terminated
+class StubPlanningContext : public planning_interface::PlanningContext
+{
+public:
+  StubPlanningContext(const robot_model::RobotModelConstPtr& robot_model, double duration, bool success)
+    : planning_interface::PlanningContext("stub_planning_context", "panda_arm")
+    , robot_model_(robot_model)
+    , duration_(duration)
+    , success_(success)
+    , terminated_(false)
+  {
+  }
+
+  bool solve(planning_interface::MotionPlanResponse& res)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    const boost::system_time end_time =
+        boost::get_system_time() + boost::posix_time::microseconds(static_cast<long>(duration_ * 1e6));
+    while (!terminated_ && terminate_condition_.timed_wait(lock, end_time))
+    {
+    }
+    if (terminated_ || !success_)
+    {
+      res.error_code_.val = moveit_msgs::MoveItErrorCodes::PLANNING_FAILED;
+      return false;
+    }
+
+    moveit::core::RobotState robot_state(robot_model_);
+    robot_state.setToDefaultValues();
+    res.trajectory_.reset(new robot_trajectory::RobotTrajectory(robot_model_, "panda_arm"));
+    res.trajectory_->addSuffixWayPoint(robot_state, 0.0);
+    res.error_code_.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+    return true;
+  }
+
+  bool solve(planning_interface::MotionPlanDetailedResponse& res)
+  {
+    return false;
+  }
+
+  bool terminate()
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    terminated_ = true;
+    terminate_condition_.notify_all();
+    return true;
+  }
+
+  void clear()
+  {
+  }
+
+private:
+  robot_model::RobotModelConstPtr robot_model_;
+  double duration_;
+  bool success_;
+  bool terminated_;
+  boost::mutex mutex_;
+  boost::condition_variable terminate_condition_;
+};
+
+// Pick planner running a stub free space planner for every grasp, without cartesian planning
+class StubPickPlanner : public SpeculativePickPlanner
+{
+public:
+  // Planning time and result of the free space plan of one grasp
+  struct StubPlan
+  {
+    double duration_;
+    bool success_;
+  };
+
+  StubPickPlanner(const robot_model::RobotModelConstPtr& robot_model, const std::vector<StubPlan>& stub_plans)
+    : SpeculativePickPlanner(GraspPlannerPtr(), planning_pipeline::PlanningPipelinePtr())
+    , robot_model_(robot_model)
+    , stub_plans_(stub_plans)
+    , num_created_(0)
+  {
+  }
+
+  /**
+   * \brief Choose between speculations in the given states, ordered by rank
+   * \param states - done and success of each speculation
+   * \return rank of the chosen speculation, or -1 to keep waiting
+   */
+  int chooseRank(const std::vector<std::pair<bool, bool> >& states, bool deadline_passed) const
+  {
+    std::vector<SpeculationPtr> speculations;
+    for (std::size_t i = 0; i < states.size(); ++i)
+    {
+      SpeculationPtr speculation(new Speculation());
+      speculation->rank_ = i;
+      speculation->worker_id_ = 0;
+      speculation->done_ = states[i].first;
+      speculation->success_ = states[i].second;
+      speculations.push_back(speculation);
+    }
+    SpeculationPtr chosen = chooseSpeculation(speculations, deadline_passed);
+    return chosen ? static_cast<int>(chosen->rank_) : -1;
+  }
+
+  std::size_t getNumCreated() const
+  {
+    return num_created_;
+  }
+
+protected:
+  SpeculationPtr createSpeculation(const GraspCandidatePtr& grasp_candidate, std::size_t rank,
+                                   const moveit::core::RobotState& start_state,
+                                   const planning_scene::PlanningSceneConstPtr& planning_scene)
+  {
+    num_created_++;
+    SpeculationPtr speculation(new Speculation());
+    speculation->grasp_candidate_ = grasp_candidate;
+    speculation->rank_ = rank;
+    speculation->worker_id_ = 0;
+    speculation->done_ = false;
+    speculation->success_ = false;
+    speculation->terminated_ = false;
+    speculation->planning_context_.reset(
+        new StubPlanningContext(robot_model_, stub_plans_[rank].duration_, stub_plans_[rank].success_));
+    return speculation;
+  }
+
+private:
+  robot_model::RobotModelConstPtr robot_model_;
+  std::vector<StubPlan> stub_plans_;
+  std::size_t num_created_;
+};
+
+void setPickPlannerParams(bool wait_for_better_ranked, double deadline)
+{
+  ros::NodeHandle nh("~/moveit_grasps/pick_planner");
+  nh.setParam("max_speculative_plans", 4);
+  nh.setParam("wait_for_better_ranked", wait_for_better_ranked);
+  nh.setParam("deadline", deadline);
+}
+
+TEST(SpeculativePickPlannerTest, ChooseSpeculation)
+{
+  typedef std::pair<bool, bool> State;
+  const State running(false, false);
+  const State failed(true, false);
+  const State succeeded(true, true);
+
+  std::vector<State> states;
+  states.push_back(running);
+  states.push_back(succeeded);
+  states.push_back(succeeded);
+
+  // Only settle for a lower ranked plan once the better ranked ones are done or the deadline passed
+  const std::vector<StubPickPlanner::StubPlan> no_stub_plans;
+  setPickPlannerParams(true, 5.0);
+  StubPickPlanner waiting_planner(robot_model::RobotModelConstPtr(), no_stub_plans);
+  EXPECT_EQ(waiting_planner.chooseRank(states, false), -1);
+  EXPECT_EQ(waiting_planner.chooseRank(states, true), 1);
+  states[0] = failed;
+  EXPECT_EQ(waiting_planner.chooseRank(states, false), 1);
+  states[0] = succeeded;
+  EXPECT_EQ(waiting_planner.chooseRank(states, false), 0);
+
+  // Failed plans are never chosen
+  states.assign(3, failed);
+  EXPECT_EQ(waiting_planner.chooseRank(states, true), -1);
+  EXPECT_EQ(waiting_planner.chooseRank(std::vector<State>(), true), -1);
+
+  // Take the first finished plan
+  setPickPlannerParams(false, 5.0);
+  StubPickPlanner greedy_planner(robot_model::RobotModelConstPtr(), no_stub_plans);
+  states[0] = running;
+  states[1] = running;
+  states[2] = succeeded;
+  EXPECT_EQ(greedy_planner.chooseRank(states, false), 2);
+  states[2] = running;
+  EXPECT_EQ(greedy_planner.chooseRank(states, true), -1);
+}
+
+TEST_F(GraspFilterTest, TestPickPlannerLowerRankedFinishesFirst)
+{
+  std::vector<StubPickPlanner::StubPlan> stub_plans(2);
+  stub_plans[0].duration_ = 1.0;
+  stub_plans[0].success_ = true;
+  stub_plans[1].duration_ = 0.01;
+  stub_plans[1].success_ = true;
+  const std::vector<GraspCandidatePtr> grasp_candidates(stub_plans.size());
+
+  // Wait for the better ranked plan
+  setPickPlannerParams(true, 10.0);
+  StubPickPlanner waiting_planner(visual_tools_->getRobotModel(), stub_plans);
+  PickPlan pick_plan;
+  ros::WallTime start_time = ros::WallTime::now();
+  ASSERT_TRUE(waiting_planner.planPick(grasp_candidates, *visual_tools_->getSharedRobotState(),
+                                       planning_scene::PlanningSceneConstPtr(), pick_plan));
+  EXPECT_EQ(pick_plan.rank_, 0u);
+  EXPECT_GE((ros::WallTime::now() - start_time).toSec(), 0.9);
+  EXPECT_TRUE(pick_plan.pre_approach_plan_.trajectory_);
+
+  // Take the lower ranked plan and terminate the other
+  setPickPlannerParams(false, 10.0);
+  StubPickPlanner greedy_planner(visual_tools_->getRobotModel(), stub_plans);
+  start_time = ros::WallTime::now();
+  ASSERT_TRUE(greedy_planner.planPick(grasp_candidates, *visual_tools_->getSharedRobotState(),
+                                      planning_scene::PlanningSceneConstPtr(), pick_plan));
+  EXPECT_EQ(pick_plan.rank_, 1u);
+  EXPECT_LT((ros::WallTime::now() - start_time).toSec(), 0.9);
+  EXPECT_EQ(greedy_planner.getNumCreated(), 2u);
+}
+
+TEST_F(GraspFilterTest, TestPickPlannerDeadline)
+{
+  std::vector<StubPickPlanner::StubPlan> stub_plans(2);
+  stub_plans[0].duration_ = 30.0;
+  stub_plans[0].success_ = true;
+  stub_plans[1].duration_ = 0.01;
+  stub_plans[1].success_ = true;
+  const std::vector<GraspCandidatePtr> grasp_candidates(stub_plans.size());
+
+  // Settle for the finished lower ranked plan at the deadline
+  setPickPlannerParams(true, 0.5);
+  StubPickPlanner planner(visual_tools_->getRobotModel(), stub_plans);
+  PickPlan pick_plan;
+  ros::WallTime start_time = ros::WallTime::now();
+  ASSERT_TRUE(planner.planPick(grasp_candidates, *visual_tools_->getSharedRobotState(),
+                               planning_scene::PlanningSceneConstPtr(), pick_plan));
+  EXPECT_EQ(pick_plan.rank_, 1u);
+  double planning_time = (ros::WallTime::now() - start_time).toSec();
+  EXPECT_GE(planning_time, 0.4);
+  EXPECT_LT(planning_time, 5.0);
+
+  // Give up at the deadline if no plan finished
+  stub_plans.resize(1);
+  StubPickPlanner slow_planner(visual_tools_->getRobotModel(), stub_plans);
+  start_time = ros::WallTime::now();
+  EXPECT_FALSE(slow_planner.planPick(std::vector<GraspCandidatePtr>(stub_plans.size()),
+                                     *visual_tools_->getSharedRobotState(), planning_scene::PlanningSceneConstPtr(),
+                                     pick_plan));
+  planning_time = (ros::WallTime::now() - start_time).toSec();
+  EXPECT_GE(planning_time, 0.4);
+  EXPECT_LT(planning_time, 5.0);
+}
+
+TEST_F(GraspFilterTest, TestPickPlannerAllPlansFail)
+{
+  std::vector<StubPickPlanner::StubPlan> stub_plans(6);
+  for (std::size_t i = 0; i < stub_plans.size(); ++i)
+  {
+    stub_plans[i].duration_ = 0.01 * (stub_plans.size() - i);
+    stub_plans[i].success_ = false;
+  }
+  const std::vector<GraspCandidatePtr> grasp_candidates(stub_plans.size());
+
+  // Every grasp is tried and the planner returns without waiting for the deadline
+  setPickPlannerParams(true, 30.0);
+  StubPickPlanner planner(visual_tools_->getRobotModel(), stub_plans);
+  PickPlan pick_plan;
+  const ros::WallTime start_time = ros::WallTime::now();
+  EXPECT_FALSE(planner.planPick(grasp_candidates, *visual_tools_->getSharedRobotState(),
+                                planning_scene::PlanningSceneConstPtr(), pick_plan));
+  EXPECT_LT((ros::WallTime::now() - start_time).toSec(), 5.0);
+  EXPECT_EQ(planner.getNumCreated(), stub_plans.size());
+}
 }  // namespace moveit_grasps
 
 int main(int argc, char** argv)
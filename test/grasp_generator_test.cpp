@@ -267,6 +267,257 @@ TEST_F(GraspGeneratorTest, GenerateCornerGrasps)
   EXPECT_EQ(NUM_EXPECTED_GRASPS, grasp_candidates.size());
 }
 
+TEST(GraspPoseBatchTest, SinglePrecisionRoundTrip)
+{
+  Eigen::Affine3d pose = Eigen::Translation3d(0.4, -0.2, 0.9) * Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitX()) *
+                         Eigen::AngleAxisd(-1.2, Eigen::Vector3d::UnitZ());
+
+  GraspPoseBatchf grasp_poses;
+  grasp_poses.push_back(pose);
+  grasp_poses.push_back(pose * Eigen::AngleAxisd(M_PI, Eigen::Vector3d::UnitZ()));
+  EXPECT_EQ(2u, grasp_poses.size());
+
+  // Sub-micrometer and sub-microradian error is far below the grasp resolution
+  EXPECT_TRUE(grasp_poses[0].isApprox(pose, 1e-6));
+  EXPECT_NEAR(0.0, (grasp_poses.getTranslation(1) - pose.translation()).norm(), 1e-6);
+  Eigen::Matrix3d rotation = grasp_poses[1].rotation();
+  EXPECT_NEAR(0.0, (rotation.transpose() * rotation - Eigen::Matrix3d::Identity()).norm(), 1e-6);
+}
+
+TEST(MeshBoundingBoxTest, FitRotatedBox)
+{
+  // Corners and face centers of a rotated box
+  const Eigen::Vector3d half_size(0.1, 0.025, 0.05);
+  const Eigen::Affine3d box_pose = Eigen::Translation3d(0.5, -0.3, 0.2) *
+                                   Eigen::AngleAxisd(0.4, Eigen::Vector3d::UnitZ()) *
+                                   Eigen::AngleAxisd(-0.2, Eigen::Vector3d::UnitX());
+  shape_msgs::Mesh mesh_msg;
+  for (int x = -1; x <= 1; ++x)
+    for (int y = -1; y <= 1; ++y)
+      for (int z = -1; z <= 1; ++z)
+      {
+        if (abs(x) + abs(y) + abs(z) < 2)
+          continue;
+        Eigen::Vector3d vertex = box_pose * Eigen::Vector3d(x, y, z).cwiseProduct(half_size);
+        geometry_msgs::Point point;
+        tf::pointEigenToMsg(vertex, point);
+        mesh_msg.vertices.push_back(point);
+      }
+
+  MeshBoundingBox mesh_bounding_box;
+  Eigen::Affine3d fit_pose;
+  Eigen::Vector3d fit_size;
+  ASSERT_TRUE(mesh_bounding_box.fit(mesh_msg, fit_pose, fit_size));
+
+  // The axes may be permuted, but the box must be the same
+  EXPECT_NEAR(0.0, (fit_pose.translation() - box_pose.translation()).norm(), 1e-6);
+  EXPECT_NEAR((2.0 * half_size).prod(), fit_size.prod(), 1e-8);
+  for (std::size_t i = 0; i < mesh_msg.vertices.size(); ++i)
+  {
+    Eigen::Vector3d vertex;
+    tf::pointMsgToEigen(mesh_msg.vertices[i], vertex);
+    Eigen::Vector3d local_vertex = fit_pose.inverse() * vertex;
+    EXPECT_TRUE((local_vertex.cwiseAbs() - fit_size / 2.0).maxCoeff() < 1e-6);
+  }
+
+  // A single vertex has a box without size, no vertices have none
+  mesh_msg.vertices.resize(1);
+  ASSERT_TRUE(mesh_bounding_box.fit(mesh_msg, fit_pose, fit_size));
+  EXPECT_NEAR(0.0, fit_size.norm(), 1e-12);
+  mesh_msg.vertices.clear();
+  EXPECT_FALSE(mesh_bounding_box.fit(mesh_msg, fit_pose, fit_size));
+}
+
+TEST(ApproachAtlasTest, FeasibleDirections)
+{
+  ApproachAtlas atlas(8);
+  const Eigen::Affine3d world_to_bin =
+      Eigen::Translation3d(0.5, -0.1, 0.3) * Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitZ());
+  const std::size_t bin_id = atlas.addBin(world_to_bin, Eigen::Vector3d(0.2, 0.2, 0.25), 0.1);
+  ASSERT_EQ(12, atlas.getNumCells(bin_id));
+
+  // Approach along one of the directions at the center of the first cell
+  Eigen::Affine3d grasp_pose = Eigen::Translation3d(atlas.getCellCenter(bin_id, 0)) *
+                               Eigen::Quaterniond::FromTwoVectors(Eigen::Vector3d::UnitZ(), atlas.getDirections()[3]);
+  const Eigen::Affine3d flipped_pose = grasp_pose * Eigen::AngleAxisd(M_PI, Eigen::Vector3d::UnitX());
+  EXPECT_EQ(3, atlas.getDirectionId(grasp_pose.rotation().col(2)));
+  EXPECT_FALSE(atlas.isFeasible(grasp_pose));
+
+  atlas.setFeasible(bin_id, 0, 3);
+  EXPECT_TRUE(atlas.isFeasible(grasp_pose));
+  EXPECT_FALSE(atlas.isFeasible(flipped_pose));
+
+  // Outside of the bins every grasp is feasible
+  Eigen::Affine3d outside_pose = grasp_pose;
+  outside_pose.translation().x() += 1.0;
+  EXPECT_TRUE(atlas.isFeasible(outside_pose));
+
+  // Dilation reaches the neighbor cells only
+  Eigen::Affine3d neighbor_pose = grasp_pose;
+  neighbor_pose.translation() = atlas.getCellCenter(bin_id, 1);
+  Eigen::Affine3d far_pose = grasp_pose;
+  far_pose.translation() = atlas.getCellCenter(bin_id, 11);
+  EXPECT_FALSE(atlas.isFeasible(neighbor_pose));
+  atlas.dilate();
+  EXPECT_TRUE(atlas.isFeasible(neighbor_pose));
+  EXPECT_FALSE(atlas.isFeasible(far_pose));
+
+  // Round trip through a file
+  const std::string file_name = "/tmp/moveit_grasps_approach_atlas_test.bin";
+  ASSERT_TRUE(atlas.save(file_name));
+  ApproachAtlas loaded_atlas;
+  ASSERT_TRUE(loaded_atlas.load(file_name));
+  EXPECT_EQ(8, loaded_atlas.getDirections().size());
+  EXPECT_TRUE(loaded_atlas.isFeasible(neighbor_pose));
+  EXPECT_FALSE(loaded_atlas.isFeasible(far_pose));
+  EXPECT_FALSE(loaded_atlas.isFeasible(flipped_pose));
+  EXPECT_FALSE(loaded_atlas.load("/tmp/moveit_grasps_no_such_atlas.bin"));
+}
+
+TEST(GraspPredicatesTest, ExcludesApproachCone)
+{
+  GraspPredicates grasp_predicates;
+  const Eigen::Vector3d axis = Eigen::Vector3d(0.3, -0.5, 0.8).normalized();
+  const Eigen::Vector3d normal = axis.unitOrthogonal();
+  const Eigen::Vector3d binormal = axis.cross(normal);
+  const double offsets[3] = { 0.0, M_SQRT1_2, -M_SQRT1_2 };
+
+  // Compare with sampling the cone for desired orientations around random directions
+  std::srand(42);
+  for (std::size_t i = 0; i < 50; ++i)
+  {
+    const Eigen::Vector3d desired_z_axis = Eigen::Vector3d::Random().normalized();
+    const Eigen::Affine3d desired_pose(
+        Eigen::Quaterniond::FromTwoVectors(Eigen::Vector3d::UnitZ(), desired_z_axis));
+    const double max_angle_offset = 0.2 + 0.02 * i;
+    grasp_predicates.clearDesiredGraspOrientations();
+    grasp_predicates.addDesiredGraspOrientation(desired_pose, max_angle_offset);
+
+    for (std::size_t j = 0; j < 3; ++j)
+    {
+      bool any_allowed = false;
+      for (std::size_t k = 0; k < 3600 && !any_allowed; ++k)
+      {
+        const double angle = 2.0 * M_PI * k / 3600.0;
+        const Eigen::Vector3d approach_direction =
+            offsets[j] * axis + std::sqrt(1.0 - offsets[j] * offsets[j]) *
+                                    (std::cos(angle) * normal + std::sin(angle) * binormal);
+        any_allowed = !grasp_predicates.isOutsideOrientations(approach_direction);
+      }
+      // Sampling misses directions right at the border of the desired orientation
+      if (any_allowed)
+      {
+        EXPECT_FALSE(grasp_predicates.excludesApproachCone(axis, offsets[j]));
+      }
+    }
+  }
+
+  // A cone around the axis itself excludes the directions normal to it
+  grasp_predicates.clearDesiredGraspOrientations();
+  grasp_predicates.addDesiredGraspOrientation(
+      Eigen::Affine3d(Eigen::Quaterniond::FromTwoVectors(Eigen::Vector3d::UnitZ(), axis)), M_PI / 8.0);
+  EXPECT_TRUE(grasp_predicates.excludesApproachCone(axis, 0.0));
+  EXPECT_TRUE(grasp_predicates.excludesApproachCone(axis, M_SQRT1_2));
+  EXPECT_FALSE(grasp_predicates.excludesApproachCone(axis, std::cos(M_PI / 10.0)));
+}
+
+TEST_F(GraspGeneratorTest, SkipExcludedGrasps)
+{
+  GraspGenerator grasp_generator(visual_tools_, verbose_);
+  Eigen::Affine3d cuboid_pose = Eigen::Affine3d::Identity();
+  cuboid_pose.translation() = Eigen::Vector3d(0.5, 0.0, 0.3);
+  const double size = 0.04;
+
+  // Approach from the front through a bin opening, with the end effector above its floor
+  GraspPredicatesPtr grasp_predicates(new GraspPredicates());
+  grasp_predicates->addDesiredGraspOrientation(
+      Eigen::Affine3d(Eigen::AngleAxisd(M_PI / 2.0, Eigen::Vector3d::UnitY())), 0.6);
+  grasp_predicates->addCuttingPlane(Eigen::Affine3d(Eigen::Translation3d(0.0, 0.0, 0.29)), XY, -1);
+
+  std::vector<GraspCandidatePtr> all_grasp_candidates;
+  ASSERT_TRUE(
+      grasp_generator.generateGrasps(cuboid_pose, size, size, size, grasp_data_, all_grasp_candidates));
+  std::size_t num_allowed = 0;
+  for (std::size_t i = 0; i < all_grasp_candidates.size(); ++i)
+  {
+    const Eigen::Affine3d eef_pose = visual_tools_->convertPose(all_grasp_candidates[i]->grasp_.grasp_pose.pose);
+    const Eigen::Affine3d grasp_pose = eef_pose * grasp_data_->grasp_pose_to_eef_pose_.inverse();
+    num_allowed += !grasp_predicates->excludes(grasp_pose, grasp_data_->grasp_pose_to_eef_pose_);
+  }
+  EXPECT_GT(num_allowed, 0);
+  EXPECT_LT(num_allowed, all_grasp_candidates.size());
+
+  // The generator only creates the allowed grasps
+  std::vector<GraspCandidatePtr> grasp_candidates;
+  grasp_generator.setGraspPredicates(grasp_predicates);
+  ASSERT_TRUE(grasp_generator.generateGrasps(cuboid_pose, size, size, size, grasp_data_, grasp_candidates));
+  EXPECT_EQ(num_allowed, grasp_candidates.size());
+}
+
+TEST_F(GraspGeneratorTest, RescoreGrasps)
+{
+  Eigen::Affine3d cuboid_pose = Eigen::Affine3d::Identity();
+  cuboid_pose.translation() = Eigen::Vector3d(0.5, 0.0, 0.3);
+  const double size = 0.04;
+
+  GraspGenerator grasp_generator(visual_tools_, verbose_);
+  std::vector<GraspCandidatePtr> grasp_candidates;
+  ASSERT_TRUE(grasp_generator.generateGrasps(cuboid_pose, size, size, size, grasp_data_, grasp_candidates));
+
+  // The weights of the generator give back the generated qualities
+  std::vector<double> generated_qualities;
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+  {
+    ASSERT_TRUE(grasp_candidates[i]->feature_matrix_);
+    generated_qualities.push_back(grasp_candidates[i]->grasp_.grasp_quality);
+  }
+  std::vector<GraspCandidatePtr> rescored_candidates = grasp_candidates;
+  ASSERT_TRUE(GraspGenerator::rescoreGrasps(rescored_candidates, grasp_generator.getGraspScoreWeights()));
+  for (std::size_t i = 0; i < grasp_candidates.size(); ++i)
+    EXPECT_NEAR(generated_qualities[i], grasp_candidates[i]->grasp_.grasp_quality, 1e-9);
+
+  // Only the width counts, so the widest open grasps come first
+  GraspScoreWeights width_weights;
+  width_weights.orientation_x_score_weight_ = 0.0;
+  width_weights.orientation_y_score_weight_ = 0.0;
+  width_weights.orientation_z_score_weight_ = 0.0;
+  width_weights.translation_x_score_weight_ = 0.0;
+  width_weights.translation_y_score_weight_ = 0.0;
+  width_weights.translation_z_score_weight_ = 0.0;
+  width_weights.depth_score_weight_ = 0.0;
+  ASSERT_TRUE(GraspGenerator::rescoreGrasps(rescored_candidates, width_weights));
+  for (std::size_t i = 0; i < rescored_candidates.size(); ++i)
+  {
+    const GraspCandidatePtr& grasp_candidate = rescored_candidates[i];
+    EXPECT_NEAR(grasp_candidate->grasp_.grasp_quality,
+                grasp_candidate->feature_matrix_->getFeatures(grasp_candidate->feature_row_)[WIDTH_FEATURE], 1e-9);
+    if (i > 0)
+    {
+      EXPECT_GE(rescored_candidates[i - 1]->grasp_.grasp_quality, grasp_candidate->grasp_.grasp_quality);
+    }
+  }
+
+  // Without positive weights there is nothing to normalize by, the grasps keep their qualities and order
+  const std::vector<GraspCandidatePtr> width_ranked_candidates = rescored_candidates;
+  std::vector<double> width_qualities;
+  for (std::size_t i = 0; i < rescored_candidates.size(); ++i)
+    width_qualities.push_back(rescored_candidates[i]->grasp_.grasp_quality);
+  width_weights.width_score_weight_ = 0.0;
+  width_weights.overhang_score_weight_ = 0.0;
+  EXPECT_FALSE(GraspGenerator::rescoreGrasps(rescored_candidates, width_weights));
+  width_weights.width_score_weight_ = -1.0;
+  EXPECT_FALSE(GraspGenerator::rescoreGrasps(rescored_candidates, width_weights));
+  for (std::size_t i = 0; i < rescored_candidates.size(); ++i)
+  {
+    EXPECT_EQ(rescored_candidates[i], width_ranked_candidates[i]);
+    EXPECT_EQ(rescored_candidates[i]->grasp_.grasp_quality, width_qualities[i]);
+  }
+
+  Eigen::VectorXd qualities = Eigen::VectorXd::Constant(3, 5.0);
+  EXPECT_FALSE(rescored_candidates[0]->feature_matrix_->computeQualities(GraspFeatureVector::Zero(), qualities));
+  EXPECT_EQ(qualities, Eigen::VectorXd::Constant(3, 5.0));
+}
+
 // TODO(davetcoleman): Test all helper functions
 // TODO(davetcoleman): Test addGrasp
 // TODO(davetcoleman): Test scoreGrasp